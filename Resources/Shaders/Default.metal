@@ -60,9 +60,11 @@ fragment float4 fragmentShader(
     constant FragmentUniforms& uniforms [[buffer(VertexInputIndex_FragmentUniforms)]]
     )
 {
-    constexpr sampler textureSampler(mag_filter::linear, min_filter::linear);
+    constexpr sampler textureSampler(mag_filter::linear, min_filter::linear, mip_filter::linear);
     float4 color = texture.sample(textureSampler, in.texCoord);
-    float3 normal = normalize(normalMap.sample(textureSampler, in.texCoord).rgb * 2.0 - 1.0);
+    // BC5 normal maps store x and y only
+    float2 normalXY = normalMap.sample(textureSampler, in.texCoord).rg * 2.0 - 1.0;
+    float3 normal = float3(normalXY, sqrt(saturate(1.0 - dot(normalXY, normalXY))));
 
     float intensity = saturate(dot(normal, normalize(in.lightDirection)));
     float attenuation = 0.5 * in.lightDistance;
@@ -42,7 +42,7 @@ fragment float4 fragmentShader(
     constant FragmentUniforms& uniforms [[buffer(VertexInputIndex_FragmentUniforms)]]
     )
 {
-    constexpr sampler textureSampler(mag_filter::linear, min_filter::linear);
+    constexpr sampler textureSampler(mag_filter::linear, min_filter::linear, mip_filter::linear);
     float4 color = texture.sample(textureSampler, in.texCoord) * float4(1.0, 1.0, 0.7, 1.0);
 
     float3 lightDirection = in.lightDirection;
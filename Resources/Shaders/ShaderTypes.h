@@ -8,6 +8,8 @@ enum VertexInputIndex
     VertexInputIndex_SkinningMatrices,
     VertexInputIndex_VertexUniforms,
     VertexInputIndex_FragmentUniforms,
+    VertexInputIndex_SkinningPalettes,
+    VertexInputIndex_InstanceUniforms,
 };
 
 struct VertexUniforms
@@ -23,3 +25,20 @@ struct FragmentUniforms
 {
     simd::float4 ambientColor;
 };
+
+struct InstanceUniforms
+{
+    unsigned int paletteSize;
+};
+
+struct StaticInstance
+{
+    simd::float3x4 modelMatrix;
+    simd::float3x4 normalMatrix;
+};
+
+struct BakedInstance
+{
+    simd::float3x4 modelMatrix;
+    simd::float4 frames;
+};
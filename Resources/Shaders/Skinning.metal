@@ -47,6 +47,6 @@ fragment float4 fragmentShader(
     texture2d<float> texture [[texture(0)]]
     )
 {
-    constexpr sampler textureSampler(mag_filter::linear, min_filter::linear);
+    constexpr sampler textureSampler(mag_filter::linear, min_filter::linear, mip_filter::linear);
     return texture.sample(textureSampler, in.texCoord);
 }
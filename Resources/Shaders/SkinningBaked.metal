@@ -0,0 +1,74 @@
+#include <metal_stdlib>
+#include <simd/simd.h>
+
+using namespace metal;
+
+#import "ShaderTypes.h"
+
+struct VertexInput
+{
+    float3 position [[attribute(0)]];
+    float3 normal [[attribute(1)]];
+    float3 tangent [[attribute(2)]];
+    float3 bitangent [[attribute(3)]];
+    float2 texCoord [[attribute(4)]];
+    float4 boneWeights [[attribute(5)]];
+    uchar4 boneIndices [[attribute(6)]];
+};
+
+struct FragmentInput
+{
+    float4 position [[position]];
+    float2 texCoord;
+};
+
+// Rows of 3x4 bone matrices, one row per frame, three texels per bone
+static float3x4 bakedBoneMatrix(texture2d<float> bakedPoses, uint bone, uint frame)
+{
+    uint x = bone * 3;
+    return float3x4(
+        bakedPoses.read(uint2(x + 0, frame)),
+        bakedPoses.read(uint2(x + 1, frame)),
+        bakedPoses.read(uint2(x + 2, frame)));
+}
+
+static float3x4 blendedBoneMatrix(texture2d<float> bakedPoses, uint bone, float4 frames)
+{
+    float3x4 a = bakedBoneMatrix(bakedPoses, bone, uint(frames.x));
+    float3x4 b = bakedBoneMatrix(bakedPoses, bone, uint(frames.y));
+    return a * (1.0 - frames.z) + b * frames.z;
+}
+
+vertex FragmentInput vertexShader(
+    VertexInput in [[stage_in]],
+    uint instanceId [[instance_id]],
+    texture2d<float> bakedPoses [[texture(1)]],
+    const device BakedInstance* instances [[buffer(VertexInputIndex_SkinningPalettes)]],
+    constant VertexUniforms& uniforms [[buffer(VertexInputIndex_VertexUniforms)]]
+    )
+{
+    BakedInstance instance = instances[instanceId];
+
+    float3x4 boneTransform = blendedBoneMatrix(bakedPoses, in.boneIndices.x, instance.frames) * in.boneWeights.x;
+    boneTransform += blendedBoneMatrix(bakedPoses, in.boneIndices.y, instance.frames) * in.boneWeights.y;
+    boneTransform += blendedBoneMatrix(bakedPoses, in.boneIndices.z, instance.frames) * in.boneWeights.z;
+    boneTransform += blendedBoneMatrix(bakedPoses, in.boneIndices.w, instance.frames) * in.boneWeights.w;
+
+    float3 position = float4(in.position, 1.0) * boneTransform;
+    float3 worldPosition = float4(position, 1.0) * instance.modelMatrix;
+
+    FragmentInput out;
+    out.position = uniforms.projectionMatrix * uniforms.viewMatrix * float4(worldPosition, 1.0);
+    out.texCoord = in.texCoord;
+
+    return out;
+}
+
+fragment float4 fragmentShader(
+    FragmentInput in [[stage_in]],
+    texture2d<float> texture [[texture(0)]]
+    )
+{
+    constexpr sampler textureSampler(mag_filter::linear, min_filter::linear, mip_filter::linear);
+    return texture.sample(textureSampler, in.texCoord);
+}
@@ -0,0 +1,59 @@
+#include <metal_stdlib>
+#include <simd/simd.h>
+
+using namespace metal;
+
+#import "ShaderTypes.h"
+
+struct VertexInput
+{
+    float3 position [[attribute(0)]];
+    float3 normal [[attribute(1)]];
+    float3 tangent [[attribute(2)]];
+    float3 bitangent [[attribute(3)]];
+    float2 texCoord [[attribute(4)]];
+    float4 boneWeights [[attribute(5)]];
+    uchar4 boneIndices [[attribute(6)]];
+};
+
+struct FragmentInput
+{
+    float4 position [[position]];
+    float2 texCoord;
+};
+
+vertex FragmentInput vertexShader(
+    VertexInput in [[stage_in]],
+    uint instanceId [[instance_id]],
+    const device float3x4* palettes [[buffer(VertexInputIndex_SkinningPalettes)]],
+    constant VertexUniforms& uniforms [[buffer(VertexInputIndex_VertexUniforms)]],
+    constant InstanceUniforms& instanceUniforms [[buffer(VertexInputIndex_InstanceUniforms)]]
+    )
+{
+    // Per instance: model matrix followed by the bone palette, all stored as transposed 3x4 matrices
+    const device float3x4* palette = palettes + instanceId * instanceUniforms.paletteSize;
+    const device float3x4* matrices = palette + 1;
+
+    float3x4 boneTransform = matrices[in.boneIndices.x] * in.boneWeights.x;
+    boneTransform += matrices[in.boneIndices.y] * in.boneWeights.y;
+    boneTransform += matrices[in.boneIndices.z] * in.boneWeights.z;
+    boneTransform += matrices[in.boneIndices.w] * in.boneWeights.w;
+
+    float3 position = float4(in.position, 1.0) * boneTransform;
+    float3 worldPosition = float4(position, 1.0) * palette[0];
+
+    FragmentInput out;
+    out.position = uniforms.projectionMatrix * uniforms.viewMatrix * float4(worldPosition, 1.0);
+    out.texCoord = in.texCoord;
+
+    return out;
+}
+
+fragment float4 fragmentShader(
+    FragmentInput in [[stage_in]],
+    texture2d<float> texture [[texture(0)]]
+    )
+{
+    constexpr sampler textureSampler(mag_filter::linear, min_filter::linear, mip_filter::linear);
+    return texture.sample(textureSampler, in.texCoord);
+}
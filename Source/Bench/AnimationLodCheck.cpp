@@ -0,0 +1,110 @@
+#include "Checks.h"
+#include "Engine/Core/Engine.h"
+#include "Engine/Input/InputManager.h"
+#include "Engine/Mesh/MeshData.h"
+#include "Engine/Mesh/PoseEvaluator.h"
+#include "Engine/Renderer/Null/NullRenderDevice.h"
+#include "Game/Game.h"
+#include "Resources/Compiled/Animations.h"
+#include "Resources/Compiled/Meshes.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdio.h>
+
+namespace
+{
+    struct Clip
+    {
+        const char* name;
+        const MeshData* mesh;
+        const MeshAnimation* animation;
+    };
+
+    const Clip Clips[] = {
+        { "characterIdle", &Meshes::character, &Animations::characterIdle },
+        { "characterRun", &Meshes::character, &Animations::characterRun },
+    };
+
+    // Poses are sampled more finely than the importer does, to catch vertices between its samples
+    const float SampleTime = 1.0f / 240.0f;
+
+    // Of the radius
+    const float MaxOutside = 1e-3f;
+
+    const int GameFrames = 600;
+    const int FramesPerKey = 45;
+    const float FrameTime = 1.0f / 60.0f;
+
+    // Distance of the farthest skinned vertex from the mesh's bounding sphere, relative to its radius
+    float outsideOfBounds(const MeshData& mesh, const glm::mat4* matrices)
+    {
+        float outside = 0.0f;
+        for (size_t i = 0; i < mesh.vertexCount; i++) {
+            const MeshSkinningVertex& v = mesh.skinningVertices[i];
+            glm::mat4 m = matrices[v.boneIndices[0]] * v.boneWeights[0];
+            for (int j = 1; j < 4; j++)
+                m += matrices[v.boneIndices[j]] * v.boneWeights[j];
+            glm::vec3 position = glm::vec3(m * glm::vec4(mesh.vertices[i].position, 1.0f));
+            float distance = glm::length(position - mesh.boundingSphereCenter) - mesh.boundingSphereRadius;
+            outside = std::max(outside, distance / mesh.boundingSphereRadius);
+        }
+        return outside;
+    }
+
+    bool checkBounds(const Clip& clip)
+    {
+        const MeshData& mesh = *clip.mesh;
+        const MeshAnimation* animation = clip.animation;
+        std::unique_ptr<glm::mat4[]> matrices(new glm::mat4[mesh.boneCount]);
+        PoseSkeleton skeleton(mesh.bones, mesh.boneCount, *mesh.globalInverseTransform);
+        PoseEvaluator evaluator(skeleton);
+
+        float ticksPerSecond = (animation->ticksPerSecond > 0.0f ? animation->ticksPerSecond : 25.0f);
+        int steps = int(ceilf(animation->durationInTicks / ticksPerSecond / SampleTime));
+        float outside = 0.0f;
+        for (int i = 0; i < steps; i++) {
+            float timeInTicks = fmodf(float(i) * SampleTime * ticksPerSecond, animation->durationInTicks);
+            evaluator.evaluate(animation, timeInTicks, matrices.get());
+            outside = std::max(outside, outsideOfBounds(mesh, matrices.get()));
+        }
+
+        printf("animation lod, %s: bounding sphere radius %.1f, farthest vertex %.2e of it outside\n",
+            clip.name, mesh.boundingSphereRadius, outside);
+        return outside <= MaxOutside;
+    }
+
+    // The player stays close to the game's camera, which follows it; its pose must never be reused
+    bool checkPlayer()
+    {
+        NullRenderDevice device;
+        Engine engine(&device, [](Engine* engine) { return new Game(engine); });
+
+        const Key keys[] = { KeyLeft, KeyUp, KeyRight, KeyDown };
+        int framesSkipped = 0;
+        for (int i = 0; i < GameFrames; i++) {
+            // Standing still for a while, then walking around
+            for (Key key : keys)
+                engine.inputManager()->injectKeyRelease(key);
+            if (i >= GameFrames / 2)
+                engine.inputManager()->injectKeyPress(keys[(i / FramesPerKey) % 4]);
+
+            engine.doOneFrame(FrameTime);
+            if (engine.frameStats().posesEvaluated != 1)
+                ++framesSkipped;
+        }
+
+        printf("animation lod, player close to the camera: pose not evaluated in %d of %d frames\n",
+            framesSkipped, GameFrames);
+        return framesSkipped == 0;
+    }
+}
+
+bool checkAnimationLod()
+{
+    bool ok = true;
+    for (const auto& clip : Clips)
+        ok = checkBounds(clip) && ok;
+    ok = checkPlayer() && ok;
+    return ok;
+}
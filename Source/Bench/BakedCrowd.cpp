@@ -0,0 +1,56 @@
+#include "BakedCrowd.h"
+#include "Resources/Compiled/Animations.h"
+#include "Resources/Compiled/Meshes.h"
+#include "Engine/Core/Engine.h"
+#include "Engine/Mesh/AnimatedMesh.h"
+#include "Engine/Mesh/AnimatedMeshInstance.h"
+#include "Engine/ResMgr/ResourceManager.h"
+#include "Game/Level.h"
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace
+{
+    // Every this many walkable tiles gets a character, 41 of them in level1
+    const int CrowdSpacing = 7;
+}
+
+BakedCrowd::BakedCrowd(Engine* engine, const LevelData* level)
+{
+    auto mesh = engine->resourceManager()->cachedAnimatedMesh(&Meshes::character);
+    int tile = 0;
+    for (int y = 0; y < LevelHeight; y++) {
+        for (int x = 0; x < LevelWidth; x++) {
+            if (!level->walkable[y * LevelWidth + x] || ++tile % CrowdSpacing != 0)
+                continue;
+
+            // Rows of walkable[] run from the top of the level, world y from the bottom
+            glm::vec3 pos(float(x), float(LevelHeight - 1 - y), 0.0f);
+            if (pos == glm::vec3(level->playerX, level->playerY, 0.0f))
+                continue;
+
+            // Placed like Game places the player
+            glm::mat4 m = glm::mat4(1.0f);
+            m = glm::translate(m, pos);
+            m = glm::rotate(m, 3.1415f * 0.5f, glm::vec3(1.0f, 0.0f, 0.0f));
+            m = glm::rotate(m, float(tile % 4) * 3.1415f * 0.5f, glm::vec3(0.0f, 1.0f, 0.0f));
+            m = glm::scale(m, glm::vec3(0.005f, 0.0025f, 0.005f));
+
+            auto instance = std::make_unique<AnimatedMeshInstance>(engine, mesh);
+            instance->setAnimation(tile % 3 == 0 ? &Animations::characterRun : &Animations::characterIdle);
+            instance->setUseBakedPose(true);
+            instance->setModelMatrix(m);
+            instance->addTime(float(tile) * 0.37f);
+            mInstances.emplace_back(std::move(instance));
+        }
+    }
+}
+
+BakedCrowd::~BakedCrowd()
+{
+}
+
+void BakedCrowd::addTime(float time)
+{
+    for (const auto& instance : mInstances)
+        instance->addTime(time);
+}
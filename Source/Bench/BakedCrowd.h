@@ -0,0 +1,24 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+class Engine;
+class AnimatedMeshInstance;
+struct LevelData;
+
+// Characters standing around on the level for frame_bench -b, each looping an animation posed
+// from the character's baked pose texture. The game draws them along with the player, since they
+// are instances of the same mesh.
+class BakedCrowd
+{
+public:
+    BakedCrowd(Engine* engine, const LevelData* level);
+    ~BakedCrowd();
+
+    size_t size() const { return mInstances.size(); }
+
+    void addTime(float time);
+
+private:
+    std::vector<std::unique_ptr<AnimatedMeshInstance>> mInstances;
+};
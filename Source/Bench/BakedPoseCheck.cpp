@@ -0,0 +1,178 @@
+#include "Checks.h"
+#include "Engine/Mesh/MeshData.h"
+#include "Engine/Mesh/PoseEvaluator.h"
+#include "Engine/Renderer/TextureData.h"
+#include "Resources/Compiled/Meshes.h"
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <stdio.h>
+
+namespace
+{
+    struct BakedMesh
+    {
+        const char* name;
+        const MeshData* mesh;
+    };
+
+    const BakedMesh BakedMeshes[] = {
+        { "character", &Meshes::character },
+    };
+
+    // Vertex displacement relative to the size of the model; about half a pixel for a character
+    // close to the game's camera
+    const float MaxError = 1e-3f;
+
+    // Played back at times between the rows as well as on them
+    const int StepsPerBakedFrame = 4;
+
+    const char* formatName(TextureFormat format)
+    {
+        return (format == TextureFormat::RGBA16F ? "RGBA16F" : "RGBA32F");
+    }
+
+    float texel(const TextureData& texture, size_t index)
+    {
+        if (texture.format == TextureFormat::RGBA16F)
+            return glm::unpackHalf1x16(static_cast<const uint16_t*>(texture.pixels)[index]);
+        return static_cast<const float*>(texture.pixels)[index];
+    }
+
+    // Bone matrices of a row of the texture, as the SkinningBaked shader reads them
+    void bakedMatrices(const TextureData& texture, unsigned frame, size_t boneCount, glm::mat4* matrices)
+    {
+        for (size_t bone = 0; bone < boneCount; bone++) {
+            size_t base = (size_t(frame) * texture.width + bone * 3) * 4;
+            glm::mat4& m = matrices[bone];
+            m = glm::mat4(1.0f);
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 4; c++)
+                    m[c][r] = texel(texture, base + size_t(r) * 4 + size_t(c));
+            }
+        }
+    }
+
+    void roundToHalf(glm::mat4* matrices, size_t boneCount)
+    {
+        for (size_t bone = 0; bone < boneCount; bone++) {
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 4; c++)
+                    matrices[bone][c][r] = glm::unpackHalf1x16(glm::packHalf1x16(matrices[bone][c][r]));
+            }
+        }
+    }
+
+    void skin(const MeshData& mesh, const glm::mat4* matrices, std::vector<glm::vec3>& positions)
+    {
+        positions.resize(mesh.vertexCount);
+        for (size_t i = 0; i < mesh.vertexCount; i++) {
+            const MeshSkinningVertex& v = mesh.skinningVertices[i];
+            glm::mat4 m = matrices[v.boneIndices[0]] * v.boneWeights[0];
+            for (int j = 1; j < 4; j++)
+                m += matrices[v.boneIndices[j]] * v.boneWeights[j];
+            positions[i] = glm::vec3(m * glm::vec4(mesh.vertices[i].position, 1.0f));
+        }
+    }
+
+    float maxDistance(const std::vector<glm::vec3>& a, const std::vector<glm::vec3>& b)
+    {
+        float distance = 0.0f;
+        for (size_t i = 0; i < a.size(); i++)
+            distance = std::max(distance, glm::length(a[i] - b[i]));
+        return distance;
+    }
+
+    float modelSize(const std::vector<glm::vec3>& positions)
+    {
+        glm::vec3 min = positions[0];
+        glm::vec3 max = positions[0];
+        for (const auto& p : positions) {
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+        return glm::length(max - min);
+    }
+
+    bool check(const BakedMesh& baked)
+    {
+        const MeshData& mesh = *baked.mesh;
+        const TextureData& texture = *mesh.bakedPoses;
+        size_t boneCount = mesh.boneCount;
+
+        std::unique_ptr<glm::mat4[]> evaluated(new glm::mat4[boneCount]);
+        std::unique_ptr<glm::mat4[]> frame1(new glm::mat4[boneCount]);
+        std::unique_ptr<glm::mat4[]> frame2(new glm::mat4[boneCount]);
+        std::unique_ptr<glm::mat4[]> blended(new glm::mat4[boneCount]);
+        std::vector<glm::vec3> reference;
+        std::vector<glm::vec3> positions;
+        PoseSkeleton skeleton(mesh.bones, boneCount, *mesh.globalInverseTransform);
+        PoseEvaluator evaluator(skeleton);
+
+        bool ok = true;
+        for (size_t a = 0; a < mesh.bakedAnimationCount; a++) {
+            const MeshBakedAnimation& clip = mesh.bakedAnimations[a];
+            const MeshAnimation* animation = clip.animation;
+            float ticksPerSecond = (animation->ticksPerSecond > 0.0f ? animation->ticksPerSecond : 25.0f);
+
+            // The rows themselves, against the poses they were baked from and against those poses
+            // stored as RGBA16F, whatever the texture uses
+            float size = 0.0f;
+            float storedError = 0.0f;
+            float halfError = 0.0f;
+            for (unsigned frame = 0; frame < clip.frameCount; frame++) {
+                float timeInTicks = fmodf(float(frame) / mesh.bakedFrameRate * ticksPerSecond, animation->durationInTicks);
+                evaluator.evaluate(animation, timeInTicks, evaluated.get());
+                skin(mesh, evaluated.get(), reference);
+                size = std::max(size, modelSize(reference));
+
+                bakedMatrices(texture, clip.firstFrame + frame, boneCount, frame1.get());
+                skin(mesh, frame1.get(), positions);
+                storedError = std::max(storedError, maxDistance(positions, reference));
+
+                roundToHalf(evaluated.get(), boneCount);
+                skin(mesh, evaluated.get(), positions);
+                halfError = std::max(halfError, maxDistance(positions, reference));
+            }
+
+            // Blending two rows like AnimatedMeshInstance::bakedFrames() and the SkinningBaked shader
+            float playbackError = 0.0f;
+            float stepTime = 1.0f / (mesh.bakedFrameRate * StepsPerBakedFrame);
+            int steps = int(ceilf(animation->durationInTicks / ticksPerSecond / stepTime));
+            for (int i = 0; i < steps; i++) {
+                float timeInTicks = fmodf(float(i) * stepTime * ticksPerSecond, animation->durationInTicks);
+                float frame = timeInTicks / ticksPerSecond * mesh.bakedFrameRate;
+                unsigned f1 = std::min(unsigned(frame), clip.frameCount - 1);
+                unsigned f2 = (f1 + 1) % clip.frameCount;
+                float factor = std::min(frame - float(f1), 1.0f);
+
+                bakedMatrices(texture, clip.firstFrame + f1, boneCount, frame1.get());
+                bakedMatrices(texture, clip.firstFrame + f2, boneCount, frame2.get());
+                for (size_t bone = 0; bone < boneCount; bone++)
+                    blended[bone] = frame1[bone] * (1.0f - factor) + frame2[bone] * factor;
+                skin(mesh, blended.get(), positions);
+
+                evaluator.evaluate(animation, timeInTicks, evaluated.get());
+                skin(mesh, evaluated.get(), reference);
+                playbackError = std::max(playbackError, maxDistance(positions, reference));
+            }
+
+            printf("baked poses, %s clip %zu (%u frames at %.0f fps, %s, model size %.1f): max vertex error "
+                "%.2e of size in the stored rows (%.2e as RGBA16F), %.2e played back\n", baked.name, a,
+                clip.frameCount, mesh.bakedFrameRate, formatName(texture.format), size, storedError / size,
+                halfError / size, playbackError / size);
+            ok = ok && storedError / size <= MaxError && playbackError / size <= MaxError;
+        }
+        return ok;
+    }
+}
+
+bool checkBakedPoses()
+{
+    bool ok = true;
+    for (const auto& baked : BakedMeshes)
+        ok = check(baked) && ok;
+    return ok;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// Checks run by frame_bench -c <name> instead of the benchmark. Each prints what it measured and
+// returns false if something did not hold.
+
+// Checks that the bounds of skinned meshes hold every vertex in every pose of their animations,
+// and that the player of the game, close to the camera, has its pose evaluated every frame.
+bool checkAnimationLod();
+
+// Compares the shipped baked pose textures with the poses they were baked from, both the rows
+// themselves and as played back by blending two rows, by the vertices they skin.
+bool checkBakedPoses();
+
+// Frees, compacts and redraws GeometryArena allocations over a number of frames, checking that
+// every draw reads the data of its allocation and that nothing frames in flight still read from
+// is overwritten or released.
+bool checkGeometryArena();
+
+// Compares the poses of PoseEvaluator with those of AnimatedMesh::calculatePose(), the evaluator it
+// replaced, over the shipped animations, and times both.
+bool checkPoseEvaluator();
+
+// Draws copies of a static mesh both merged into a static batch and instanced, for a number of
+// copies, printing what each path costs. Then checks that the static objects of the shipped level
+// take fewer draws than they would one by one.
+bool checkStaticInstancing();
@@ -0,0 +1,183 @@
+#include "Checks.h"
+#include "Engine/Renderer/GeometryArena.h"
+#include "Engine/Renderer/Null/NullRenderBuffer.h"
+#include "Engine/Renderer/Null/NullRenderDevice.h"
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+    // Enough vertices for three pages, most of which get freed so that compact() empties two
+    const int GeometryCount = 48;
+    const size_t VerticesPerGeometry = 6000;
+    const unsigned Strides[GeometryArena::MaxStreams] = { 12, 8 };
+    const int FrameCount = 24;
+
+    struct SourceGeometry
+    {
+        std::vector<uint8_t> streams[GeometryArena::MaxStreams];
+        std::vector<uint16_t> indices;
+        GeometryArena::Id id;
+        unsigned baseVertex;
+        unsigned firstIndex;
+    };
+
+    // Bytes a draw reads from one buffer, and what they have to be. The source is kept alive for as
+    // long as the frame is in flight, even if the geometry was freed meanwhile.
+    struct Read
+    {
+        std::shared_ptr<const NullRenderBuffer::Contents> contents;
+        size_t offset;
+        size_t size;
+        std::shared_ptr<const SourceGeometry> source;
+        const void* expected;
+    };
+
+    std::shared_ptr<SourceGeometry> allocate(GeometryArena& arena, int seed)
+    {
+        auto source = std::make_shared<SourceGeometry>();
+
+        GeometryArena::Geometry geometry;
+        for (int i = 0; i < GeometryArena::MaxStreams; i++) {
+            source->streams[i].resize(VerticesPerGeometry * Strides[i]);
+            for (size_t j = 0; j < source->streams[i].size(); j++)
+                source->streams[i][j] = uint8_t(j * (seed + 1) + i);
+            geometry.streams[i] = source->streams[i].data();
+            geometry.strides[i] = Strides[i];
+        }
+        geometry.vertexCount = VerticesPerGeometry;
+
+        source->indices.resize(VerticesPerGeometry * 3);
+        for (size_t i = 0; i < source->indices.size(); i++)
+            source->indices[i] = uint16_t((i * 7 + size_t(seed)) % VerticesPerGeometry);
+        geometry.indices = source->indices.data();
+        geometry.indexCount = source->indices.size();
+
+        source->id = arena.allocate(geometry);
+        source->baseVertex = arena.range(source->id).baseVertex;
+        source->firstIndex = arena.range(source->id).firstIndex;
+        return source;
+    }
+
+    void addRead(std::vector<Read>& reads, const std::unique_ptr<IRenderBuffer>& buffer, size_t offset,
+        size_t size, const std::shared_ptr<SourceGeometry>& source, const void* expected)
+    {
+        const auto* nullBuffer = static_cast<const NullRenderBuffer*>(buffer.get());
+        reads.push_back({ nullBuffer->contents(), offset, size, source, expected });
+    }
+
+    bool verify(const Read& read)
+    {
+        return read.contents && !read.contents->released && read.offset + read.size <= read.contents->bytes.size()
+            && memcmp(read.contents->bytes.data() + read.offset, read.expected, read.size) == 0;
+    }
+
+    bool check(uint32_t framesInFlight)
+    {
+        NullRenderDevice device(glm::vec2(1024.0f, 768.0f), framesInFlight);
+        GeometryArena arena(&device);
+
+        std::vector<std::shared_ptr<SourceGeometry>> geometries;
+        for (int i = 0; i < GeometryCount; i++)
+            geometries.emplace_back(allocate(arena, i));
+
+        size_t initialPages = arena.pageCount();
+        size_t minPages = initialPages;
+        unsigned draws = 0;
+        unsigned moves = 0;
+        unsigned badDraws = 0;
+        unsigned badReadsInFlight = 0;
+        std::deque<std::vector<Read>> frames; // the last framesInFlight frames, oldest first
+
+        auto freeWhere = [&](auto predicate) {
+            size_t index = 0;
+            auto end = std::remove_if(geometries.begin(), geometries.end(), [&](const std::shared_ptr<SourceGeometry>& g) {
+                    if (!predicate(index++))
+                        return false;
+                    arena.free(g->id);
+                    return true;
+                });
+            geometries.erase(end, geometries.end());
+        };
+
+        for (int frame = 0; frame < FrameCount + int(framesInFlight) + 1; frame++) {
+            if (frame == 2)
+                freeWhere([](size_t i) { return i % 8 != 0; });
+            else if (frame == 8) {
+                for (int i = 0; i < 8; i++)
+                    geometries.emplace_back(allocate(arena, 100 + i));
+            } else if (frame == 12)
+                freeWhere([](size_t i) { return i % 3 == 1; });
+            else if (frame == FrameCount)
+                freeWhere([](size_t) { return true; });
+
+            arena.compact();
+            if (!geometries.empty())
+                minPages = std::min(minPages, arena.pageCount());
+
+            // Nothing that frames still in flight read may have been overwritten or released
+            for (const auto& reads : frames) {
+                for (const auto& read : reads) {
+                    if (!verify(read))
+                        ++badReadsInFlight;
+                }
+            }
+
+            device.beginFrame();
+            std::vector<Read> reads;
+            for (const auto& g : geometries) {
+                const auto& range = arena.range(g->id);
+                if (range.baseVertex != g->baseVertex || range.firstIndex != g->firstIndex) {
+                    ++moves;
+                    g->baseVertex = range.baseVertex;
+                    g->firstIndex = range.firstIndex;
+                }
+
+                device.setVertexBuffer(0, *range.vertexBuffers[0], 0);
+                device.setVertexBuffer(1, *range.vertexBuffers[1], 0);
+                device.drawIndexedPrimitive(*range.indexBuffer, range.firstIndex, unsigned(g->indices.size()), range.baseVertex);
+                ++draws;
+
+                for (int i = 0; i < GeometryArena::MaxStreams; i++) {
+                    addRead(reads, *range.vertexBuffers[i], size_t(range.baseVertex) * Strides[i],
+                        g->streams[i].size(), g, g->streams[i].data());
+                }
+                addRead(reads, *range.indexBuffer, size_t(range.firstIndex) * sizeof(uint16_t),
+                    g->indices.size() * sizeof(uint16_t), g, g->indices.data());
+            }
+            device.endFrame();
+
+            for (const auto& read : reads) {
+                if (!verify(read))
+                    ++badDraws;
+            }
+            frames.emplace_back(std::move(reads));
+            if (frames.size() > framesInFlight)
+                frames.pop_front();
+        }
+
+        size_t finalPages = arena.pageCount();
+        printf("geometry arena, %u frames in flight: %u draws, %u moved, pages %zu -> %zu -> %zu, "
+            "%u bad draws, %u bad reads in flight\n", framesInFlight, draws, moves, initialPages, minPages,
+            finalPages, badDraws, badReadsInFlight);
+
+        bool ok = (badDraws == 0 && badReadsInFlight == 0 && finalPages == 0);
+        if (moves == 0 || minPages >= initialPages) {
+            printf("  compaction did not move anything or release a page\n");
+            ok = false;
+        }
+        return ok;
+    }
+}
+
+bool checkGeometryArena()
+{
+    bool ok = true;
+    for (uint32_t framesInFlight = 1; framesInFlight <= 3; framesInFlight++)
+        ok = check(framesInFlight) && ok;
+    return ok;
+}
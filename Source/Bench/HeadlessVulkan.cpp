@@ -0,0 +1,107 @@
+#include "HeadlessVulkan.h"
+#include <stdio.h>
+
+#ifdef __APPLE__
+
+std::unique_ptr<IRenderDevice> createHeadlessVulkanDevice(int, int)
+{
+    fprintf(stderr, "Vulkan is not available on this platform.\n");
+    return nullptr;
+}
+
+void destroyHeadlessVulkan()
+{
+}
+
+#else
+
+#include "Engine/Renderer/Vulkan/VulkanCommon.h"
+#include "Engine/Renderer/Vulkan/VulkanRenderDevice.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace
+{
+    void* vulkanLibrary;
+    int offscreenWidth;
+    int offscreenHeight;
+
+    PFN_vkVoidFunction getVulkanLibraryExport(const char* name)
+    {
+      #ifdef _WIN32
+        return (PFN_vkVoidFunction)GetProcAddress(HMODULE(vulkanLibrary), name);
+      #else
+        return (PFN_vkVoidFunction)dlsym(vulkanLibrary, name);
+      #endif
+    }
+}
+
+// The platform functions of VulkanCommon.h. Without surface extensions vulkanSurface stays null,
+// which makes VulkanRenderDevice render offscreen.
+
+bool initVulkan()
+{
+  #ifdef _WIN32
+    vulkanLibrary = LoadLibraryA("vulkan-1.dll");
+  #else
+    vulkanLibrary = dlopen("libvulkan.so.1", RTLD_NOW | RTLD_LOCAL);
+  #endif
+    if (!vulkanLibrary) {
+        vulkanError("Unable to load the Vulkan library.");
+        return false;
+    }
+
+    if (!vulkanLoadExports(getVulkanLibraryExport))
+        return false;
+
+    vulkanEnumerateAvailableLayers();
+    vulkanEnumerateAvailableExtensions();
+
+    vulkanSurface = VK_NULL_HANDLE;
+    return vulkanCreateInstance({});
+}
+
+void destroyVulkan()
+{
+    PFN_vkDestroyInstance vkDestroyInstance;
+    if (vulkanInstance && getVulkanProc("vkDestroyInstance", vkDestroyInstance))
+        vkDestroyInstance(vulkanInstance, nullptr);
+    vulkanInstance = VK_NULL_HANDLE;
+}
+
+void getVulkanWindowSize(int* width, int* height)
+{
+    *width = offscreenWidth;
+    *height = offscreenHeight;
+}
+
+void vulkanError(const char* text)
+{
+    fprintf(stderr, "%s\n", text);
+}
+
+std::unique_ptr<IRenderDevice> createHeadlessVulkanDevice(int width, int height)
+{
+    offscreenWidth = width;
+    offscreenHeight = height;
+    if (!initVulkan())
+        return nullptr;
+
+    std::unique_ptr<VulkanRenderDevice> renderDevice{new VulkanRenderDevice};
+    if (!renderDevice->initialized()) {
+        renderDevice.reset();
+        destroyVulkan();
+        return nullptr;
+    }
+    return std::move(renderDevice);
+}
+
+void destroyHeadlessVulkan()
+{
+    destroyVulkan();
+}
+
+#endif
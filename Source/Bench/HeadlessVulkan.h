@@ -0,0 +1,11 @@
+#pragma once
+#include "Engine/Renderer/IRenderDevice.h"
+#include <memory>
+
+// A Vulkan device without a window for frame_bench -g, rendering into an offscreen image of the
+// given size, so that GPU timings can be taken on machines without a display, with a software
+// implementation such as lavapipe. Returns null, after printing why, if there is no Vulkan.
+std::unique_ptr<IRenderDevice> createHeadlessVulkanDevice(int width, int height);
+
+// After the device is gone
+void destroyHeadlessVulkan();
@@ -0,0 +1,288 @@
+#include "Checks.h"
+#include "Engine/Mesh/MeshData.h"
+#include "Engine/Mesh/PoseEvaluator.h"
+#include "Resources/Compiled/Animations.h"
+#include "Resources/Compiled/Meshes.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+namespace
+{
+    struct Clip
+    {
+        const char* name;
+        const MeshData* mesh;
+        const MeshAnimation* animation;
+    };
+
+    const Clip Clips[] = {
+        { "characterIdle", &Meshes::character, &Animations::characterIdle },
+        { "characterRun", &Meshes::character, &Animations::characterRun },
+    };
+
+    // Difference to the reference relative to the largest element of its matrix, so that
+    // translations in scene units do not hide errors in the rotation part
+    const float MaxError = 1e-3f;
+
+    // Over the reference below, as asked of the evaluator, on the widest path the CPU has
+    const double TargetSpeedup = 4.0;
+
+    const float FrameTime = 1.0f / 60.0f;
+    const int SteppedPoses = 2000;
+    const int SeekPoses = 2000;
+    const int TimedPoses = 2000;
+    const int TimedRuns = 40;
+
+    typedef std::chrono::high_resolution_clock Clock;
+
+    // The evaluator as it was before PoseEvaluator, AnimatedMesh::calculatePose(), on keys in the
+    // form it read them: times in ticks and full quaternions. A binary search per key track,
+    // blends through std::function, slerp for every rotation and glm matrices composed bone by bone.
+    struct ReferencePositionKey
+    {
+        float time;
+        glm::vec3 position;
+    };
+
+    struct ReferenceRotationKey
+    {
+        float time;
+        glm::quat rotation;
+    };
+
+    struct ReferenceScaleKey
+    {
+        float time;
+        glm::vec3 scale;
+    };
+
+    struct ReferenceBoneAnimation
+    {
+        std::vector<ReferencePositionKey> positionKeys;
+        std::vector<ReferenceRotationKey> rotationKeys;
+        std::vector<ReferenceScaleKey> scaleKeys;
+    };
+
+    std::vector<ReferenceBoneAnimation> referenceAnimation(const MeshData& mesh, const MeshAnimation* animation)
+    {
+        std::vector<ReferenceBoneAnimation> result(mesh.boneCount);
+        for (size_t i = 0; i < mesh.boneCount; i++) {
+            const MeshBoneAnimation& anim = animation->boneAnimations[i];
+            for (size_t j = 0; anim.positionKeys && j < anim.positionKeyCount; j++) {
+                const auto& key = anim.positionKeys[j];
+                result[i].positionKeys.push_back({ float(key.frame) * animation->ticksPerFrame, key.position });
+            }
+            for (size_t j = 0; anim.rotationKeys && j < anim.rotationKeyCount; j++) {
+                const auto& key = anim.rotationKeys[j];
+                result[i].rotationKeys.push_back({ float(key.frame) * animation->ticksPerFrame, key.decodeRotation() });
+            }
+            for (size_t j = 0; anim.scaleKeys && j < anim.scaleKeyCount; j++) {
+                const auto& key = anim.scaleKeys[j];
+                result[i].scaleKeys.push_back({ float(key.frame) * animation->ticksPerFrame, key.scale });
+            }
+        }
+        return result;
+    }
+
+    template <class T> T interpolatedValue(float time, float duration, const T* keys, size_t keyCount,
+        const T& defaultValue, const std::function<T(const T&, const T&, float)>& interpolate)
+    {
+        if (keyCount < 2) {
+            if (keyCount == 0)
+                return defaultValue;
+            return keys[0];
+        }
+
+        const T* begin = keys;
+        const T* end = keys + keyCount;
+        const T* key1;
+        const T* key2 = std::lower_bound(begin, end, time, [](const T& value, float t) -> bool { return value.time < t; });
+
+        if (key2 != end && key2->time == time)
+            return *key2;
+
+        float key1Time;
+        float key2Time;
+        if (key2 != begin && key2 != end) {
+            key1 = key2 - 1;
+            key1Time = key1->time;
+            key2Time = key2->time;
+        } else {
+            key1 = end - 1;
+            if (key2 == begin) {
+                key1Time = -(duration - key1->time);
+                key2Time = key2->time;
+            } else {
+                key2 = begin;
+                key1Time = key1->time;
+                key2Time = duration;
+            }
+        }
+
+        float timeDelta = key2Time - key1Time;
+        float factor = (timeDelta != 0.0f ? (time - key1Time) / timeDelta : 0.0f);
+
+        T value = interpolate(*key1, *key2, factor);
+        value.time = time;
+
+        return value;
+    }
+
+    void evaluateReference(const MeshData& mesh, const MeshAnimation* animation,
+        const std::vector<ReferenceBoneAnimation>& boneAnimations, float timeInTicks, glm::mat4* matrices)
+    {
+        for (size_t boneIndex = 0; boneIndex < mesh.boneCount; boneIndex++) {
+            const ReferenceBoneAnimation* anim = &boneAnimations[boneIndex];
+
+            glm::mat4 transform;
+            if (anim->positionKeys.empty() && anim->scaleKeys.empty() && anim->rotationKeys.empty())
+                transform = glm::mat4(1.0f);
+            else {
+                ReferencePositionKey pos = interpolatedValue<ReferencePositionKey>(timeInTicks, animation->durationInTicks,
+                    anim->positionKeys.data(), anim->positionKeys.size(), ReferencePositionKey{timeInTicks, glm::vec3(0.0f)},
+                    [](const ReferencePositionKey& key1, const ReferencePositionKey& key2, float factor) -> ReferencePositionKey {
+                        return ReferencePositionKey{0.0f, key1.position + (key2.position - key1.position) * factor};
+                    });
+
+                ReferenceRotationKey rot = interpolatedValue<ReferenceRotationKey>(timeInTicks, animation->durationInTicks,
+                    anim->rotationKeys.data(), anim->rotationKeys.size(), ReferenceRotationKey{timeInTicks, glm::quat()},
+                    [](const ReferenceRotationKey& key1, const ReferenceRotationKey& key2, float factor) -> ReferenceRotationKey {
+                        return ReferenceRotationKey{0.0f, glm::slerp(key1.rotation, key2.rotation, factor)};
+                    });
+
+                ReferenceScaleKey scale = interpolatedValue<ReferenceScaleKey>(timeInTicks, animation->durationInTicks,
+                    anim->scaleKeys.data(), anim->scaleKeys.size(), ReferenceScaleKey{timeInTicks, glm::vec3(1.0f)},
+                    [](const ReferenceScaleKey& key1, const ReferenceScaleKey& key2, float factor) -> ReferenceScaleKey {
+                        return ReferenceScaleKey{0.0f, key1.scale + (key2.scale - key1.scale) * factor};
+                    });
+
+                transform  = glm::translate(glm::mat4(1.0f), pos.position);
+                transform *= glm::mat4_cast(rot.rotation);
+                transform  = glm::scale(transform, scale.scale);
+            }
+
+            uint8_t parentBone = mesh.bones[boneIndex].parentIndex;
+            if (parentBone == MeshBone::InvalidIndex)
+                transform = *mesh.globalInverseTransform * transform;
+            else
+                transform = matrices[parentBone] * transform;
+            matrices[boneIndex] = transform;
+        }
+
+        for (size_t boneIndex = 0; boneIndex < mesh.boneCount; boneIndex++)
+            matrices[boneIndex] *= mesh.bones[boneIndex].matrix;
+    }
+
+    float poseError(const glm::mat4* matrices, const glm::mat4* reference, size_t boneCount)
+    {
+        float maxError = 0.0f;
+        for (size_t i = 0; i < boneCount; i++) {
+            float scale = 0.0f;
+            float error = 0.0f;
+            for (int c = 0; c < 4; c++) {
+                for (int r = 0; r < 4; r++) {
+                    scale = std::max(scale, fabsf(reference[i][c][r]));
+                    error = std::max(error, fabsf(matrices[i][c][r] - reference[i][c][r]));
+                }
+            }
+            maxError = std::max(maxError, error / std::max(scale, 1e-6f));
+        }
+        return maxError;
+    }
+
+    float secondsToTicks(const MeshAnimation* animation, float seconds)
+    {
+        float ticksPerSecond = (animation->ticksPerSecond > 0.0f ? animation->ticksPerSecond : 25.0f);
+        return fmodf(seconds * ticksPerSecond, animation->durationInTicks);
+    }
+
+    // Played forward, which walks the key cursors and wraps around the loop, then random seeks
+    void measureErrors(const Clip& clip, PoseEvaluator& evaluator, const std::vector<ReferenceBoneAnimation>& boneAnimations,
+        float& steppedError, float& seekError)
+    {
+        const MeshData& mesh = *clip.mesh;
+        std::unique_ptr<glm::mat4[]> matrices(new glm::mat4[mesh.boneCount]);
+        std::unique_ptr<glm::mat4[]> reference(new glm::mat4[mesh.boneCount]);
+
+        for (int i = 0; i < SteppedPoses; i++) {
+            float timeInTicks = secondsToTicks(clip.animation, float(i) * FrameTime);
+            evaluator.evaluate(clip.animation, timeInTicks, matrices.get());
+            evaluateReference(mesh, clip.animation, boneAnimations, timeInTicks, reference.get());
+            steppedError = std::max(steppedError, poseError(matrices.get(), reference.get(), mesh.boneCount));
+        }
+
+        srand(1);
+        for (int i = 0; i < SeekPoses; i++) {
+            float timeInTicks = clip.animation->durationInTicks * float(rand()) / float(RAND_MAX);
+            timeInTicks = std::min(timeInTicks, std::nextafter(clip.animation->durationInTicks, 0.0f));
+            evaluator.evaluate(clip.animation, timeInTicks, matrices.get());
+            evaluateReference(mesh, clip.animation, boneAnimations, timeInTicks, reference.get());
+            seekError = std::max(seekError, poseError(matrices.get(), reference.get(), mesh.boneCount));
+        }
+    }
+
+    bool check(const Clip& clip)
+    {
+        const MeshData& mesh = *clip.mesh;
+        std::unique_ptr<glm::mat4[]> matrices(new glm::mat4[mesh.boneCount]);
+        std::unique_ptr<glm::mat4[]> reference(new glm::mat4[mesh.boneCount]);
+        PoseSkeleton skeleton(mesh.bones, mesh.boneCount, *mesh.globalInverseTransform);
+        PoseEvaluator evaluator(skeleton);
+        std::vector<ReferenceBoneAnimation> boneAnimations = referenceAnimation(mesh, clip.animation);
+
+        // Both paths are held to the same bound, whichever of them gets timed below
+        float steppedError = 0.0f;
+        float seekError = 0.0f;
+        measureErrors(clip, evaluator, boneAnimations, steppedError, seekError);
+        if (evaluator.usesAvx()) {
+            PoseEvaluator narrowEvaluator(skeleton, false);
+            measureErrors(clip, narrowEvaluator, boneAnimations, steppedError, seekError);
+        }
+
+        // Both timed over the same forward playback, in alternating runs of which the fastest counts
+        std::vector<float> times(TimedPoses);
+        for (int i = 0; i < TimedPoses; i++)
+            times[i] = secondsToTicks(clip.animation, float(i) * FrameTime);
+
+        double referenceTime = 0.0;
+        double evaluatorTime = 0.0;
+        for (int run = 0; run < TimedRuns; run++) {
+            auto start = Clock::now();
+            for (int i = 0; i < TimedPoses; i++)
+                evaluateReference(mesh, clip.animation, boneAnimations, times[i], reference.get());
+            auto middle = Clock::now();
+            for (int i = 0; i < TimedPoses; i++)
+                evaluator.evaluate(clip.animation, times[i], matrices.get());
+            auto end = Clock::now();
+
+            double runReferenceTime = std::chrono::duration<double, std::micro>(middle - start).count() / TimedPoses;
+            double runEvaluatorTime = std::chrono::duration<double, std::micro>(end - middle).count() / TimedPoses;
+            referenceTime = (run == 0 ? runReferenceTime : std::min(referenceTime, runReferenceTime));
+            evaluatorTime = (run == 0 ? runEvaluatorTime : std::min(evaluatorTime, runEvaluatorTime));
+        }
+
+        double speedup = referenceTime / evaluatorTime;
+
+        printf("pose evaluator, %s (%zu bones): max error %.2e stepped, %.2e seeking; "
+            "%.2f us per pose %s, reference %.2f us (%.1fx, %s the %.1fx target)\n", clip.name, mesh.boneCount,
+            steppedError, seekError, evaluatorTime, (evaluator.usesAvx() ? "with AVX" : "without AVX"), referenceTime,
+            speedup, (speedup < TargetSpeedup ? "below" : "meeting"), TargetSpeedup);
+        return steppedError <= MaxError && seekError <= MaxError && speedup >= TargetSpeedup;
+    }
+}
+
+bool checkPoseEvaluator()
+{
+    bool ok = true;
+    for (const auto& clip : Clips)
+        ok = check(clip) && ok;
+    return ok;
+}
@@ -0,0 +1,184 @@
+#include "Checks.h"
+#include "Engine/Core/Engine.h"
+#include "Engine/Core/IGame.h"
+#include "Engine/Mesh/MeshData.h"
+#include "Engine/Mesh/StaticBatch.h"
+#include "Engine/Mesh/StaticMesh.h"
+#include "Engine/Renderer/IRenderBuffer.h"
+#include "Engine/Renderer/Null/NullRenderDevice.h"
+#include "Engine/Renderer/RenderQueue.h"
+#include "Engine/ResMgr/ResourceManager.h"
+#include "Game/Level.h"
+#include "Resources/Compiled/Levels.h"
+#include "Resources/Compiled/Meshes.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <stdio.h>
+
+namespace
+{
+    const size_t ObjectCounts[] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+    const int FrameCount = 2000;
+
+    // Copies of one mesh, either merged into a static batch or drawn instanced, like the static
+    // objects of a level
+    class Scene : public IGame
+    {
+    public:
+        Scene(Engine* engine, const MeshData* mesh, size_t count, bool instanced)
+            : mEngine(engine)
+            , mCount(count)
+        {
+            std::vector<glm::mat4> matrices;
+            for (size_t i = 0; i < count; i++) {
+                glm::vec3 pos(float(i % 16), float(i / 16), 0.0f);
+                matrices.emplace_back(glm::scale(glm::translate(glm::mat4(1.0f), pos), glm::vec3(0.4f)));
+            }
+
+            if (instanced) {
+                mMesh = engine->resourceManager()->cachedStaticMesh(mesh);
+                mInstanceBuffer = mMesh->createInstanceBuffer(matrices.data(), count);
+            } else {
+                mBatch.reset(new StaticBatch(engine));
+                for (const auto& matrix : matrices)
+                    mBatch->add(mesh, matrix);
+                mBatch->build();
+            }
+        }
+
+        void update(float) override
+        {
+        }
+
+        void render() override
+        {
+            RenderQueue* queue = mEngine->renderQueue();
+            queue->begin(glm::mat4(1.0f));
+            if (mBatch)
+                mBatch->submit(queue);
+            else
+                mMesh->submitInstanced(queue, glm::vec3(0.0f), mInstanceBuffer, unsigned(mCount));
+            queue->flush();
+        }
+
+    private:
+        Engine* mEngine;
+        size_t mCount;
+        std::unique_ptr<StaticBatch> mBatch;
+        std::shared_ptr<StaticMesh> mMesh;
+        std::unique_ptr<IRenderBuffer> mInstanceBuffer;
+    };
+
+    // The shipped level as the game draws it, without the player
+    class LevelScene : public IGame
+    {
+    public:
+        LevelScene(Engine* engine, const LevelData* data)
+            : mEngine(engine)
+            , mLevel(new Level(engine, data))
+        {
+        }
+
+        void update(float) override
+        {
+        }
+
+        void render() override
+        {
+            RenderQueue* queue = mEngine->renderQueue();
+            queue->begin(glm::mat4(1.0f));
+            mLevel->render();
+            queue->flush();
+        }
+
+    private:
+        Engine* mEngine;
+        std::unique_ptr<Level> mLevel;
+    };
+
+    struct Result
+    {
+        double renderTime;
+        double drawCalls;
+        double instances;
+    };
+
+    Result measure(const std::function<IGame*(Engine*)>& createScene)
+    {
+        NullRenderDevice device;
+        Engine engine(&device, createScene);
+
+        Result result = { 0.0, 0.0, 0.0 };
+        for (int i = 0; i < FrameCount; i++) {
+            engine.doOneFrame(1.0f / 60.0f);
+            result.renderTime += engine.frameStats().renderTime * 1e6 / FrameCount;
+            result.drawCalls += double(device.lastFrameCounters().drawCalls) / FrameCount;
+            result.instances += double(device.lastFrameCounters().instancesSubmitted) / FrameCount;
+        }
+        return result;
+    }
+
+    Result measure(const MeshData* mesh, size_t count, bool instanced)
+    {
+        return measure([=](Engine* engine) { return new Scene(engine, mesh, count, instanced); });
+    }
+}
+
+bool checkStaticInstancing()
+{
+    const MeshData* mesh = &Meshes::jarMesh;
+    size_t meshBytes = mesh->vertexCount * sizeof(MeshVertex) + mesh->indexCount * sizeof(uint16_t);
+
+    printf("static objects, jarMesh (%zu vertices, %zu indices), batched vs instanced:\n", mesh->vertexCount, mesh->indexCount);
+    printf("  objects  draws  render us  buffer bytes   | draws  instances  render us  buffer bytes\n");
+
+    bool ok = true;
+    for (size_t count : ObjectCounts) {
+        Result batched = measure(mesh, count, false);
+        Result instanced = measure(mesh, count, true);
+
+        // Batches hold a transformed copy of the mesh per object; instances hold two 3x4 matrices
+        // each and share the mesh
+        size_t batchedBytes = count * meshBytes;
+        size_t instancedBytes = meshBytes + count * sizeof(StaticMesh::Instance);
+
+        printf("  %7zu  %5.1f  %9.2f  %12zu   | %5.1f  %9.1f  %9.2f  %12zu\n", count,
+            batched.drawCalls, batched.renderTime, batchedBytes,
+            instanced.drawCalls, instanced.instances, instanced.renderTime, instancedBytes);
+
+        // One draw per material either way, the instanced ones drawing every object
+        if (instanced.drawCalls != batched.drawCalls || instanced.instances != instanced.drawCalls * double(count))
+            ok = false;
+    }
+
+    // Static objects of the shipped level, which places no mesh often enough to be instanced, and
+    // the same level with every mesh instanced. Either way they are to take fewer draws than drawn
+    // one per object and material element, and instanced, every element of every object is drawn.
+    const LevelData* level = &Levels::level1;
+    LevelData instancedLevel = *level;
+    instancedLevel.minInstancedObjects = 1;
+
+    size_t elementCount = 0;
+    for (size_t i = 0; i < level->staticMeshCount; i++)
+        elementCount += level->staticMeshes[i].mesh->materialCount;
+
+    Result drawn = measure([=](Engine* engine) { return new LevelScene(engine, level); });
+    Result drawnInstanced = measure([&](Engine* engine) { return new LevelScene(engine, &instancedLevel); });
+
+    // The level geometry takes one draw of one instance
+    double objectDraws = drawn.drawCalls - 1.0;
+    double instancedObjectDraws = drawnInstanced.drawCalls - 1.0;
+    double instancedObjectInstances = drawnInstanced.instances - 1.0;
+    printf("level1: %zu static objects (%zu drawn one by one), instanced from %zu copies: %.1f draws, %.1f instances;"
+        " all instanced: %.1f draws, %.1f instances\n", level->staticMeshCount, elementCount, level->minInstancedObjects,
+        objectDraws, drawn.instances - 1.0, instancedObjectDraws, instancedObjectInstances);
+    if (objectDraws >= double(elementCount) || instancedObjectDraws >= double(elementCount))
+        ok = false;
+    if (std::lround(instancedObjectInstances) != long(elementCount))
+        ok = false;
+
+    return ok;
+}
@@ -0,0 +1,355 @@
+#include "BakedCrowd.h"
+#include "Checks.h"
+#include "HeadlessVulkan.h"
+#include "Engine/Core/Engine.h"
+#include "Engine/Core/Profiler.h"
+#include "Engine/Input/InputManager.h"
+#include "Engine/Renderer/Null/NullRenderDevice.h"
+#include "Game/Game.h"
+#include "Resources/Compiled/Levels.h"
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+    struct Options
+    {
+        int frameCount = 1000;
+        int warmupFrameCount = 60;
+        float frameTime = 1.0f / 60.0f;
+        bool requireNoAllocations = false;
+        bool gpuTimings = false;
+        bool bakedCrowd = false;
+        const char* traceFileName = nullptr;
+        const char* checkName = nullptr;
+    };
+
+    struct Check
+    {
+        const char* name;
+        bool (*run)();
+    };
+
+    const Check Checks[] = {
+        { "arena", checkGeometryArena },
+        { "baked", checkBakedPoses },
+        { "lod", checkAnimationLod },
+        { "poses", checkPoseEvaluator },
+        { "statics", checkStaticInstancing },
+    };
+
+    // Reserved up front, so that tracing does not allocate during frames
+    const size_t TraceEventsPerFrame = 64;
+
+    // As NullRenderDevice's viewport
+    const int OffscreenWidth = 1024;
+    const int OffscreenHeight = 768;
+
+    // Durations of a GPU scope over the frames that had it
+    struct GpuScopeTimes
+    {
+        const char* name;
+        unsigned depth;
+        std::vector<double> durations;
+    };
+
+    const Key WalkKeys[] = { KeyLeft, KeyUp, KeyRight, KeyDown };
+    const int FramesPerWalkKey = 45;
+
+    void printUsage(const char* program)
+    {
+        fprintf(stderr, "usage: %s [-n frames] [-w warmupFrames] [-t frameTime] [-p traceFile] [-z] [-g] [-b]\n", program);
+        fprintf(stderr, "       %s -c check\n", program);
+        fprintf(stderr, "  -p  write a Chrome trace of the frames after warmup\n");
+        fprintf(stderr, "  -z  fail if any frame after warmup allocates memory\n");
+        fprintf(stderr, "  -g  render offscreen with Vulkan instead of the null device and report GPU timings\n");
+        fprintf(stderr, "  -b  place a crowd of characters posed from baked poses on the level\n");
+        fprintf(stderr, "  -c  run a check instead of the benchmark, one of:");
+        for (const auto& check : Checks)
+            fprintf(stderr, " %s", check.name);
+        fprintf(stderr, "\n");
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i = 1; i < argc; i++) {
+            if (!strcmp(argv[i], "-z")) {
+                options.requireNoAllocations = true;
+                continue;
+            }
+            if (!strcmp(argv[i], "-g")) {
+                options.gpuTimings = true;
+                continue;
+            }
+            if (!strcmp(argv[i], "-b")) {
+                options.bakedCrowd = true;
+                continue;
+            }
+
+            if (i + 1 >= argc) {
+                printUsage(argv[0]);
+                return false;
+            }
+
+            if (!strcmp(argv[i], "-n"))
+                options.frameCount = atoi(argv[++i]);
+            else if (!strcmp(argv[i], "-w"))
+                options.warmupFrameCount = atoi(argv[++i]);
+            else if (!strcmp(argv[i], "-t"))
+                options.frameTime = float(atof(argv[++i]));
+            else if (!strcmp(argv[i], "-p"))
+                options.traceFileName = argv[++i];
+            else if (!strcmp(argv[i], "-c"))
+                options.checkName = argv[++i];
+            else {
+                printUsage(argv[0]);
+                return false;
+            }
+        }
+
+        if (options.frameCount <= 0 || options.warmupFrameCount < 0 || options.frameTime <= 0.0f) {
+            printUsage(argv[0]);
+            return false;
+        }
+
+        return true;
+    }
+
+    double percentile(const std::vector<double>& sortedValues, double p)
+    {
+        size_t index = size_t(p * double(sortedValues.size() - 1) + 0.5);
+        return sortedValues[std::min(index, sortedValues.size() - 1)];
+    }
+
+    void printTimings(const char* name, std::vector<double>& values, int nameWidth = 8)
+    {
+        std::sort(values.begin(), values.end());
+
+        double sum = 0.0;
+        for (double value : values)
+            sum += value;
+
+        printf("%-*s  mean %9.3f us  p50 %9.3f us  p95 %9.3f us  p99 %9.3f us  max %9.3f us\n", nameWidth, name,
+            sum / double(values.size()) * 1e6,
+            percentile(values, 0.50) * 1e6,
+            percentile(values, 0.95) * 1e6,
+            percentile(values, 0.99) * 1e6,
+            values.back() * 1e6);
+    }
+
+    void printBinds(const char* name, const BindingCounters::Binds& binds, double frameCount)
+    {
+        printf("  %-18s %10.1f %10.1f\n", name, double(binds.requested) / frameCount, double(binds.issued) / frameCount);
+    }
+
+    void addGpuTimings(const std::vector<GpuTiming>& timings, std::vector<GpuScopeTimes>& scopes, int frameCount)
+    {
+        for (const auto& timing : timings) {
+            auto it = std::find_if(scopes.begin(), scopes.end(), [&](const GpuScopeTimes& scope) {
+                return scope.depth == timing.depth && !strcmp(scope.name, timing.name);
+            });
+            if (it == scopes.end()) {
+                it = scopes.insert(scopes.end(), GpuScopeTimes{ timing.name, timing.depth, {} });
+                it->durations.reserve(frameCount);
+            }
+            it->durations.emplace_back(timing.duration);
+        }
+    }
+
+    void simulateInput(Engine* engine, int frame)
+    {
+        int keyIndex = (frame / FramesPerWalkKey) % int(sizeof(WalkKeys) / sizeof(WalkKeys[0]));
+        for (Key key : WalkKeys) {
+            if (key == WalkKeys[keyIndex])
+                engine->inputManager()->injectKeyPress(key);
+            else
+                engine->inputManager()->injectKeyRelease(key);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 1;
+
+    if (options.checkName) {
+        for (const auto& check : Checks) {
+            if (!strcmp(check.name, options.checkName))
+                return check.run() ? 0 : 1;
+        }
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (options.requireNoAllocations && !AllocationTracker::isEnabled()) {
+        fprintf(stderr, "-z needs allocation tracking, configure with -DENGINE_TRACK_ALLOCATIONS=ON.\n");
+        return 1;
+    }
+
+    // The null device counts what the engine asks for, the Vulkan one measures what the GPU does with it
+    std::unique_ptr<IRenderDevice> renderDevice;
+    NullRenderDevice* nullDevice = nullptr;
+    if (options.gpuTimings) {
+        renderDevice = createHeadlessVulkanDevice(OffscreenWidth, OffscreenHeight);
+        if (!renderDevice)
+            return 1;
+    } else {
+        nullDevice = new NullRenderDevice(glm::vec2(OffscreenWidth, OffscreenHeight));
+        renderDevice.reset(nullDevice);
+    }
+
+    auto engine = std::make_unique<Engine>(renderDevice.get(), [](Engine* engine) { return new Game(engine); });
+
+    // Game loads level1; the crowd stands on it
+    std::unique_ptr<BakedCrowd> crowd;
+    if (options.bakedCrowd)
+        crowd = std::make_unique<BakedCrowd>(engine.get(), &Levels::level1);
+
+    for (int i = 0; i < options.warmupFrameCount; i++) {
+        simulateInput(engine.get(), i);
+        if (crowd)
+            crowd->addTime(options.frameTime);
+        engine->doOneFrame(options.frameTime);
+    }
+
+    std::vector<double> updateTimes;
+    std::vector<double> renderTimes;
+    std::vector<double> frameTimes;
+    updateTimes.reserve(options.frameCount);
+    renderTimes.reserve(options.frameCount);
+    frameTimes.reserve(options.frameCount);
+
+    if (options.traceFileName)
+        Profiler::start(size_t(options.frameCount) * TraceEventsPerFrame);
+
+    NullRenderDevice::Counters counters;
+    std::vector<GpuScopeTimes> gpuScopes;
+    BindingCounters bindings;
+    size_t posesEvaluated = 0;
+    size_t posesSkipped = 0;
+    size_t posesBaked = 0;
+    AllocationStats allocations;
+    int allocatingFrames = 0;
+    for (int i = 0; i < options.frameCount; i++) {
+        simulateInput(engine.get(), options.warmupFrameCount + i);
+        if (crowd)
+            crowd->addTime(options.frameTime);
+        engine->doOneFrame(options.frameTime);
+
+        const auto& stats = engine->frameStats();
+        updateTimes.emplace_back(stats.updateTime);
+        renderTimes.emplace_back(stats.renderTime);
+        frameTimes.emplace_back(stats.updateTime + stats.renderTime);
+        posesEvaluated += stats.posesEvaluated;
+        posesSkipped += stats.posesSkipped;
+        posesBaked += stats.posesBaked;
+
+        allocations.total.count += stats.allocations.total.count;
+        allocations.total.bytes += stats.allocations.total.bytes;
+        for (size_t tag = 0; tag < size_t(AllocationTag::Count); tag++) {
+            allocations.tags[tag].count += stats.allocations.tags[tag].count;
+            allocations.tags[tag].bytes += stats.allocations.tags[tag].bytes;
+        }
+        if (stats.allocations.total.count != 0)
+            ++allocatingFrames;
+
+        if (nullDevice) {
+            const auto& frameCounters = nullDevice->lastFrameCounters();
+            counters.bufferUploads += frameCounters.bufferUploads;
+            counters.bufferBytesUploaded += frameCounters.bufferBytesUploaded;
+            counters.uniformChanges += frameCounters.uniformChanges;
+            counters.textureBinds += frameCounters.textureBinds;
+            counters.pipelineBinds += frameCounters.pipelineBinds;
+            counters.vertexBufferBinds += frameCounters.vertexBufferBinds;
+            counters.drawCalls += frameCounters.drawCalls;
+            counters.indicesSubmitted += frameCounters.indicesSubmitted;
+            counters.instancesSubmitted += frameCounters.instancesSubmitted;
+        }
+        bindings += renderDevice->lastFrameBindingCounters();
+
+        // Those of the latest frame the GPU has finished, a frame in flight or two behind
+        addGpuTimings(renderDevice->gpuTimings(), gpuScopes, options.frameCount);
+    }
+
+    if (options.traceFileName) {
+        Profiler::stop();
+        if (!Profiler::writeTrace(options.traceFileName)) {
+            fprintf(stderr, "Unable to write %s.\n", options.traceFileName);
+            return 1;
+        }
+    }
+
+    printf("%d frames (%d warmup), frameTime %.4f s\n", options.frameCount, options.warmupFrameCount, options.frameTime);
+    if (crowd)
+        printf("baked crowd of %zu characters\n", crowd->size());
+    printf("\n");
+    printTimings("update", updateTimes);
+    printTimings("render", renderTimes);
+    printTimings("frame", frameTimes);
+
+    if (options.gpuTimings) {
+        printf("\ngpu, %dx%d offscreen on %s:\n", OffscreenWidth, OffscreenHeight, renderDevice->description().c_str());
+        if (gpuScopes.empty())
+            printf("  no timestamps, the device cannot measure GPU time\n");
+        for (auto& scope : gpuScopes) {
+            char label[64];
+            snprintf(label, sizeof(label), "%*s%s", int(scope.depth) * 2, "", scope.name);
+            printTimings(label, scope.durations, 14);
+        }
+    }
+
+    double n = double(options.frameCount);
+    printf("\nper frame:\n");
+    if (nullDevice) {
+        printf("  draw calls           %10.1f\n", double(counters.drawCalls) / n);
+        printf("  indices submitted    %10.1f\n", double(counters.indicesSubmitted) / n);
+        printf("  instances submitted  %10.1f\n", double(counters.instancesSubmitted) / n);
+        printf("  pipeline binds       %10.1f\n", double(counters.pipelineBinds) / n);
+        printf("  texture binds        %10.1f\n", double(counters.textureBinds) / n);
+        printf("  vertex buffer binds  %10.1f\n", double(counters.vertexBufferBinds) / n);
+        printf("  uniform changes      %10.1f\n", double(counters.uniformChanges) / n);
+        printf("  buffer uploads       %10.1f (%.1f bytes)\n",
+            double(counters.bufferUploads) / n, double(counters.bufferBytesUploaded) / n);
+    }
+    printf("  poses evaluated      %10.1f\n", double(posesEvaluated) / n);
+    printf("  poses skipped        %10.1f\n", double(posesSkipped) / n);
+    printf("  poses baked          %10.1f\n", double(posesBaked) / n);
+    if (!AllocationTracker::isEnabled()) {
+        printf("  allocations          not tracked\n");
+    } else {
+        printf("  allocations          %10.1f (%.1f bytes)\n",
+            double(allocations.total.count) / n, double(allocations.total.bytes) / n);
+    }
+    for (size_t tag = 0; tag < size_t(AllocationTag::Count); tag++) {
+        if (allocations.tags[tag].count == 0)
+            continue;
+        printf("    %-18s %10.1f (%.1f bytes)\n", AllocationTracker::tagName(AllocationTag(tag)),
+            double(allocations.tags[tag].count) / n, double(allocations.tags[tag].bytes) / n);
+    }
+
+    printf("\nbindings per frame:   requested     issued\n");
+    printBinds("pipelines", bindings.pipelines, n);
+    printBinds("vertex buffers", bindings.vertexBuffers, n);
+    printBinds("index buffers", bindings.indexBuffers, n);
+    printBinds("textures", bindings.textures, n);
+    printBinds("uniforms", bindings.uniforms, n);
+
+    crowd.reset();
+    engine.reset();
+    renderDevice.reset();
+    if (options.gpuTimings)
+        destroyHeadlessVulkan();
+
+    if (options.requireNoAllocations && allocatingFrames > 0) {
+        fprintf(stderr, "\n%d of %d frames allocated memory after warmup.\n", allocatingFrames, options.frameCount);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,281 @@
+#include "AllocationTracker.h"
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace
+{
+    const size_t TagCount = size_t(AllocationTag::Count);
+    const unsigned OverflowSlot = AllocationStats::MaxThreads - 1;
+
+    // Written by the owning thread only (except the shared overflow slot), read by snapshot()
+    struct alignas(64) ThreadCounters
+    {
+        std::atomic<uint64_t> count[TagCount];
+        std::atomic<uint64_t> bytes[TagCount];
+    };
+
+    // Zero-initialized before any dynamic initialization, so allocations from static constructors are safe
+    ThreadCounters gThreadCounters[AllocationStats::MaxThreads];
+    std::atomic<unsigned> gThreadCount; // slots used so far, including ones given back
+
+    thread_local AllocationTag tTag = AllocationTag::General;
+
+  #if ENGINE_TRACK_ALLOCATIONS
+    std::atomic<uint32_t> gUsedSlots; // one bit per slot below OverflowSlot
+
+    static_assert(AllocationStats::MaxThreads <= 32, "slots must fit into gUsedSlots");
+
+    unsigned acquireSlot()
+    {
+        uint32_t used = gUsedSlots.load(std::memory_order_relaxed);
+        for (;;) {
+            unsigned slot = 0;
+            while (slot < OverflowSlot && (used & (1u << slot)))
+                ++slot;
+            if (slot == OverflowSlot)
+                break;
+            if (gUsedSlots.compare_exchange_weak(used, used | (1u << slot), std::memory_order_relaxed))
+                return slot;
+        }
+        return OverflowSlot;
+    }
+
+    thread_local int tThreadIndex = -1;
+
+    // Gives the slot back when the thread exits. Counters stay in the slot and keep adding up for the
+    // thread that reuses it, so snapshots still subtract. Allocations made by the destructors of other
+    // thread locals after that go to the overflow slot.
+    struct ThreadSlotRelease
+    {
+        ~ThreadSlotRelease()
+        {
+            if (unsigned(tThreadIndex) != OverflowSlot)
+                gUsedSlots.fetch_and(~(1u << unsigned(tThreadIndex)), std::memory_order_relaxed);
+            tThreadIndex = int(OverflowSlot);
+        }
+    };
+
+    thread_local ThreadSlotRelease tThreadSlotRelease;
+
+    void recordAllocation(size_t size)
+    {
+        if (tThreadIndex < 0) {
+            tThreadIndex = int(acquireSlot());
+            (void)tThreadSlotRelease; // registers the destructor for this thread
+
+            unsigned count = gThreadCount.load(std::memory_order_relaxed);
+            while (count <= unsigned(tThreadIndex)
+                    && !gThreadCount.compare_exchange_weak(count, unsigned(tThreadIndex) + 1, std::memory_order_relaxed)) {
+            }
+        }
+
+        ThreadCounters& counters = gThreadCounters[tThreadIndex];
+        size_t tag = size_t(tTag);
+        counters.count[tag].fetch_add(1, std::memory_order_relaxed);
+        counters.bytes[tag].fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void* allocate(size_t size)
+    {
+        void* ptr = malloc(size > 0 ? size : 1);
+        if (ptr)
+            recordAllocation(size);
+        return ptr;
+    }
+
+    void* allocateAligned(size_t size, size_t alignment)
+    {
+        size_t allocSize = (size > 0 ? size : 1);
+      #ifdef _WIN32
+        void* ptr = _aligned_malloc(allocSize, alignment);
+      #else
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, std::max(alignment, sizeof(void*)), allocSize) != 0)
+            ptr = nullptr;
+      #endif
+        if (ptr)
+            recordAllocation(size);
+        return ptr;
+    }
+
+    void freeAligned(void* ptr)
+    {
+      #ifdef _WIN32
+        _aligned_free(ptr);
+      #else
+        free(ptr);
+      #endif
+    }
+
+    // As the standard operator new: calls the new handler until the allocation succeeds or there is none
+    void* allocateOrThrow(size_t size)
+    {
+        for (;;) {
+            if (void* ptr = allocate(size))
+                return ptr;
+            std::new_handler handler = std::get_new_handler();
+            if (!handler)
+                throw std::bad_alloc();
+            handler();
+        }
+    }
+
+    void* allocateAlignedOrThrow(size_t size, size_t alignment)
+    {
+        for (;;) {
+            if (void* ptr = allocateAligned(size, alignment))
+                return ptr;
+            std::new_handler handler = std::get_new_handler();
+            if (!handler)
+                throw std::bad_alloc();
+            handler();
+        }
+    }
+  #endif
+}
+
+AllocationStats AllocationStats::operator-(const AllocationStats& other) const
+{
+    AllocationStats result;
+    result.total.count = total.count - other.total.count;
+    result.total.bytes = total.bytes - other.total.bytes;
+    for (size_t i = 0; i < TagCount; i++) {
+        result.tags[i].count = tags[i].count - other.tags[i].count;
+        result.tags[i].bytes = tags[i].bytes - other.tags[i].bytes;
+    }
+    for (size_t i = 0; i < MaxThreads; i++) {
+        result.threads[i].count = threads[i].count - other.threads[i].count;
+        result.threads[i].bytes = threads[i].bytes - other.threads[i].bytes;
+    }
+    result.threadCount = threadCount;
+    return result;
+}
+
+bool AllocationTracker::isEnabled()
+{
+    return ENGINE_TRACK_ALLOCATIONS != 0;
+}
+
+AllocationTag AllocationTracker::currentTag()
+{
+    return tTag;
+}
+
+void AllocationTracker::setCurrentTag(AllocationTag tag)
+{
+    tTag = tag;
+}
+
+void AllocationTracker::snapshot(AllocationStats& stats)
+{
+    stats = AllocationStats();
+    stats.threadCount = gThreadCount.load(std::memory_order_relaxed);
+
+    for (unsigned i = 0; i < stats.threadCount; i++) {
+        for (size_t tag = 0; tag < TagCount; tag++) {
+            uint64_t count = gThreadCounters[i].count[tag].load(std::memory_order_relaxed);
+            uint64_t bytes = gThreadCounters[i].bytes[tag].load(std::memory_order_relaxed);
+            stats.threads[i].count += count;
+            stats.threads[i].bytes += bytes;
+            stats.tags[tag].count += count;
+            stats.tags[tag].bytes += bytes;
+            stats.total.count += count;
+            stats.total.bytes += bytes;
+        }
+    }
+}
+
+const char* AllocationTracker::tagName(AllocationTag tag)
+{
+    switch (tag) {
+        case AllocationTag::General: return "general";
+        case AllocationTag::Game: return "game";
+        case AllocationTag::Animation: return "animation";
+        case AllocationTag::Renderer: return "renderer";
+        case AllocationTag::Resources: return "resources";
+        case AllocationTag::Count: break;
+    }
+    return "?";
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if ENGINE_TRACK_ALLOCATIONS
+
+void* operator new(size_t size)
+{
+    return allocateOrThrow(size);
+}
+
+void* operator new[](size_t size)
+{
+    return allocateOrThrow(size);
+}
+
+// The nothrow forms go through the new handler as well, like the standard ones
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return allocateOrThrow(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return allocateOrThrow(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return allocateAlignedOrThrow(size, size_t(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return allocateAlignedOrThrow(size, size_t(alignment));
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    try {
+        return allocateAlignedOrThrow(size, size_t(alignment));
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    try {
+        return allocateAlignedOrThrow(size, size_t(alignment));
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { freeAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { freeAligned(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { freeAligned(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { freeAligned(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { freeAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { freeAligned(ptr); }
+
+#endif
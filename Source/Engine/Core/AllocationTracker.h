@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+enum class AllocationTag : uint8_t
+{
+    General,
+    Game,
+    Animation,
+    Renderer,
+    Resources,
+    Count
+};
+
+struct AllocationCounters
+{
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+// Heap allocations made through operator new, split by the tag active on the allocating thread
+// and by thread. Snapshots count from program start; subtract two of them for a time interval.
+// Slots of threads that exited are reused by later threads.
+struct AllocationStats
+{
+    enum { MaxThreads = 32 }; // threads running beyond this share the last slot
+
+    AllocationCounters total;
+    AllocationCounters tags[size_t(AllocationTag::Count)];
+    AllocationCounters threads[MaxThreads];
+    unsigned threadCount = 0;
+
+    AllocationStats operator-(const AllocationStats& other) const;
+};
+
+// Counts only with the ENGINE_TRACK_ALLOCATIONS CMake option, which replaces the global operator new and
+// delete; otherwise snapshots stay zero.
+class AllocationTracker
+{
+public:
+    static bool isEnabled();
+
+    static AllocationTag currentTag();
+    static void setCurrentTag(AllocationTag tag);
+
+    static void snapshot(AllocationStats& stats);
+
+    static const char* tagName(AllocationTag tag);
+};
+
+// Tags allocations of the current thread until the end of the scope
+class AllocationScope
+{
+public:
+    explicit AllocationScope(AllocationTag tag)
+        : mPreviousTag(AllocationTracker::currentTag())
+    {
+        AllocationTracker::setCurrentTag(tag);
+    }
+
+    ~AllocationScope()
+    {
+        AllocationTracker::setCurrentTag(mPreviousTag);
+    }
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+private:
+    AllocationTag mPreviousTag;
+};
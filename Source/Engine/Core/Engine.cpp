@@ -1,13 +1,22 @@
 #include "Engine.h"
+#include "Engine/Renderer/GeometryArena.h"
 #include "Engine/Renderer/IRenderDevice.h"
+#include "Engine/Renderer/RenderQueue.h"
 #include "Engine/Core/IGame.h"
+#include "Engine/Core/JobSystem.h"
+#include "Engine/Core/Profiler.h"
 #include "Engine/ResMgr/ResourceManager.h"
+#include "Engine/Mesh/AnimatedMesh.h"
 #include "Engine/Input/InputManager.h"
 
 Engine::Engine(IRenderDevice* renderDevice, std::function<IGame*(Engine*)> gameFactory)
     : mRenderDevice(renderDevice)
+    , mCamera(nullptr)
 {
+    mJobSystem.reset(new JobSystem);
     mInputManager.reset(new InputManager(this));
+    mRenderQueue.reset(new RenderQueue(this));
+    mGeometryArena.reset(new GeometryArena(mRenderDevice));
     mResourceManager.reset(new ResourceManager(this));
     mGame.reset(gameFactory(this));
     mPrevTime = std::chrono::high_resolution_clock::now();
@@ -24,10 +33,47 @@ void Engine::doOneFrame()
     mPrevTime = time;
     float frameTime = std::chrono::duration<float>(deltaTime).count();
 
-    mGame->update(frameTime);
+    doOneFrame(frameTime);
+}
+
+void Engine::doOneFrame(float frameTime)
+{
+    AllocationStats allocationsBefore;
+    AllocationTracker::snapshot(allocationsBefore);
+
+    auto updateStart = std::chrono::high_resolution_clock::now();
+    {
+        ProfileScope profileScope("update");
+        AllocationScope allocationScope(AllocationTag::Game);
+        mGame->update(frameTime);
+    }
+    PoseUpdateStats poseStats;
+    {
+        ProfileScope profileScope("animation");
+        AllocationScope allocationScope(AllocationTag::Animation);
+        poseStats = mResourceManager->updateAnimatedMeshes(mCamera);
+    }
+    auto updateEnd = std::chrono::high_resolution_clock::now();
+    mFrameStats.updateTime = std::chrono::duration<double>(updateEnd - updateStart).count();
+    mFrameStats.posesEvaluated = poseStats.evaluated;
+    mFrameStats.posesSkipped = poseStats.skipped;
+    mFrameStats.posesBaked = poseStats.baked;
 
+    // Before any draw of this frame is queued; ranges that frames in flight may still read from
+    // stay retired until those are done
+    mGeometryArena->compact();
+
+    mFrameStats.renderTime = 0.0;
     if (mRenderDevice->beginFrame()) {
+        ProfileScope profileScope("render");
+        AllocationScope allocationScope(AllocationTag::Renderer);
         mGame->render();
         mRenderDevice->endFrame();
+        auto renderEnd = std::chrono::high_resolution_clock::now();
+        mFrameStats.renderTime = std::chrono::duration<double>(renderEnd - updateEnd).count();
     }
+
+    AllocationStats allocationsAfter;
+    AllocationTracker::snapshot(allocationsAfter);
+    mFrameStats.allocations = allocationsAfter - allocationsBefore;
 }
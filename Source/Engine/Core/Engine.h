@@ -1,29 +1,59 @@
 #pragma once
+#include "Engine/Core/AllocationTracker.h"
 #include <functional>
 #include <memory>
 #include <chrono>
 
+class Camera;
+class GeometryArena;
 class IGame;
 class IRenderDevice;
 class InputManager;
+class JobSystem;
+class RenderQueue;
 class ResourceManager;
 
 class Engine
 {
 public:
+    struct FrameStats
+    {
+        double updateTime = 0.0;
+        double renderTime = 0.0;
+        unsigned posesEvaluated = 0;
+        unsigned posesSkipped = 0; // by the animation LOD
+        unsigned posesBaked = 0;   // read from baked pose textures on the GPU instead
+        AllocationStats allocations; // made during doOneFrame()
+    };
+
     Engine(IRenderDevice* renderDevice, std::function<IGame*(Engine*)> gameFactory);
     ~Engine();
 
     IRenderDevice* renderDevice() const { return mRenderDevice; }
+    GeometryArena* geometryArena() const { return mGeometryArena.get(); }
     ResourceManager* resourceManager() const { return mResourceManager.get(); }
     InputManager* inputManager() const { return mInputManager.get(); }
+    JobSystem* jobSystem() const { return mJobSystem.get(); }
+    RenderQueue* renderQueue() const { return mRenderQueue.get(); }
+
+    // Camera used for animation LOD; the game sets it, nullptr disables LOD
+    Camera* camera() const { return mCamera; }
+    void setCamera(Camera* camera) { mCamera = camera; }
+
+    const FrameStats& frameStats() const { return mFrameStats; }
 
     void doOneFrame();
+    void doOneFrame(float frameTime);
 
 private:
     IRenderDevice* mRenderDevice;
+    Camera* mCamera;
+    std::unique_ptr<JobSystem> mJobSystem;
     std::unique_ptr<InputManager> mInputManager;
+    std::unique_ptr<RenderQueue> mRenderQueue;
+    std::unique_ptr<GeometryArena> mGeometryArena; // outlives the meshes allocated from it
     std::unique_ptr<ResourceManager> mResourceManager;
     std::unique_ptr<IGame> mGame;
     std::chrono::time_point<std::chrono::high_resolution_clock> mPrevTime;
+    FrameStats mFrameStats;
 };
@@ -0,0 +1,237 @@
+#include "JobSystem.h"
+#include <cassert>
+
+namespace
+{
+    thread_local const JobSystem* tJobSystem = nullptr;
+    thread_local unsigned tQueueIndex = 0;
+}
+
+JobCounter::JobCounter()
+    : mPendingJobs(0)
+    , mContinuationCount(0)
+{
+}
+
+JobCounter::~JobCounter()
+{
+    // The thread that completed the last job may still hold the mutex
+    std::lock_guard<std::mutex> lock(mMutex);
+    assert(mPendingJobs.load() == 0);
+    assert(mContinuationCount == 0);
+}
+
+// Orderings follow Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models". The
+// capacity is fixed, so the owner never overwrites a slot that a thief can still win with its CAS.
+
+JobSystem::Queue::Queue()
+    : mJobs(new Job[Capacity])
+    , mTop(0)
+    , mBottom(0)
+{
+}
+
+bool JobSystem::Queue::push(const Job& job)
+{
+    int64_t bottom = mBottom.load(std::memory_order_relaxed);
+    int64_t top = mTop.load(std::memory_order_acquire);
+    if (bottom - top >= Capacity)
+        return false;
+
+    mJobs[bottom & (Capacity - 1)] = job;
+    mBottom.store(bottom + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool JobSystem::Queue::pop(Job& job)
+{
+    int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+    mBottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = mTop.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    job = mJobs[bottom & (Capacity - 1)];
+    if (top < bottom)
+        return true;
+
+    // Last job; thieves may be taking it too
+    bool won = mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    mBottom.store(bottom + 1, std::memory_order_relaxed);
+
+    return won;
+}
+
+bool JobSystem::Queue::steal(Job& job)
+{
+    int64_t top = mTop.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = mBottom.load(std::memory_order_acquire);
+    if (top >= bottom)
+        return false;
+
+    // The copy is thrown away if another thread took the job first
+    job = mJobs[top & (Capacity - 1)];
+    return mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+JobSystem::JobSystem(unsigned workerCount)
+    : mOwnerThread(std::this_thread::get_id())
+    , mQueuedJobs(0)
+    , mShutdown(false)
+{
+    if (workerCount == 0) {
+        unsigned hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = (hardwareThreads > 1 ? hardwareThreads - 1 : 0);
+    }
+
+    // Queue 0 belongs to the owning thread
+    mQueueCount = workerCount + 1;
+    mQueues.reset(new Queue[mQueueCount]);
+
+    mWorkers.reserve(workerCount);
+    for (unsigned i = 0; i < workerCount; i++)
+        mWorkers.emplace_back(&JobSystem::workerMain, this, i + 1);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mShutdown = true;
+    }
+    mWakeCondition.notify_all();
+
+    for (auto& worker : mWorkers)
+        worker.join();
+}
+
+void JobSystem::run(JobFunction function, void* data, size_t begin, size_t end, JobCounter* counter)
+{
+    if (counter)
+        counter->mPendingJobs.fetch_add(1, std::memory_order_relaxed);
+
+    push(Job{function, data, begin, end, counter, AllocationTracker::currentTag()});
+}
+
+void JobSystem::runAfter(JobCounter* dependency, JobFunction function, void* data, size_t begin, size_t end, JobCounter* counter)
+{
+    if (counter)
+        counter->mPendingJobs.fetch_add(1, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(dependency->mMutex);
+        if (!dependency->isDone() && dependency->mContinuationCount < JobCounter::MaxContinuations) {
+            dependency->mContinuations[dependency->mContinuationCount++] =
+                JobCounter::Continuation{function, data, begin, end, counter, AllocationTracker::currentTag()};
+            return;
+        }
+    }
+
+    // Too many continuations on a single counter; wait here instead of allocating
+    wait(dependency);
+    push(Job{function, data, begin, end, counter, AllocationTracker::currentTag()});
+}
+
+void JobSystem::wait(JobCounter* counter)
+{
+    unsigned queueIndex = currentQueueIndex();
+    while (!counter->isDone()) {
+        if (!tryRunOneJob(queueIndex))
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::push(const Job& job)
+{
+    // Counted before the job becomes visible, so that whoever takes it never sees the count drop below zero
+    mQueuedJobs.fetch_add(1, std::memory_order_release);
+    if (!mQueues[currentQueueIndex()].push(job)) {
+        mQueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+        execute(job);
+        return;
+    }
+
+    if (mQueueCount > 1) {
+        { std::lock_guard<std::mutex> lock(mSleepMutex); }
+        mWakeCondition.notify_one();
+    }
+}
+
+bool JobSystem::tryRunOneJob(unsigned queueIndex)
+{
+    Job job;
+    bool found = mQueues[queueIndex].pop(job);
+
+    for (unsigned i = 1; !found && i < mQueueCount; i++)
+        found = mQueues[(queueIndex + i) % mQueueCount].steal(job);
+
+    if (!found)
+        return false;
+
+    mQueuedJobs.fetch_sub(1, std::memory_order_acquire);
+    execute(job);
+
+    return true;
+}
+
+void JobSystem::execute(const Job& job)
+{
+    AllocationScope allocationScope(job.tag);
+    job.function(job.data, job.begin, job.end);
+    if (job.counter)
+        finish(job.counter);
+}
+
+void JobSystem::finish(JobCounter* counter)
+{
+    JobCounter::Continuation continuations[JobCounter::MaxContinuations];
+    int continuationCount = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(counter->mMutex);
+        if (counter->mPendingJobs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        continuationCount = counter->mContinuationCount;
+        for (int i = 0; i < continuationCount; i++)
+            continuations[i] = counter->mContinuations[i];
+        counter->mContinuationCount = 0;
+    }
+
+    for (int i = 0; i < continuationCount; i++) {
+        const auto& c = continuations[i];
+        push(Job{c.function, c.data, c.begin, c.end, c.counter, c.tag});
+    }
+}
+
+unsigned JobSystem::currentQueueIndex() const
+{
+    if (tJobSystem == this)
+        return tQueueIndex;
+
+    // Queue 0 has a single owner, like the other deques
+    assert(std::this_thread::get_id() == mOwnerThread);
+    return 0;
+}
+
+void JobSystem::workerMain(unsigned queueIndex)
+{
+    tJobSystem = this;
+    tQueueIndex = queueIndex;
+
+    for (;;) {
+        if (tryRunOneJob(queueIndex))
+            continue;
+
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mWakeCondition.wait(lock, [this] { return mShutdown || mQueuedJobs.load(std::memory_order_acquire) > 0; });
+        if (mShutdown && mQueuedJobs.load(std::memory_order_acquire) <= 0)
+            return;
+    }
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include "Engine/Core/AllocationTracker.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+class JobSystem;
+
+using JobFunction = void(*)(void* data, size_t begin, size_t end);
+
+class JobCounter
+{
+public:
+    JobCounter();
+    ~JobCounter();
+
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool isDone() const { return mPendingJobs.load(std::memory_order_acquire) == 0; }
+
+private:
+    struct Continuation
+    {
+        JobFunction function;
+        void* data;
+        size_t begin;
+        size_t end;
+        JobCounter* counter;
+        AllocationTag tag;
+    };
+
+    enum { MaxContinuations = 16 };
+
+    std::atomic<int> mPendingJobs;
+    std::mutex mMutex;
+    Continuation mContinuations[MaxContinuations];
+    int mContinuationCount;
+
+    friend class JobSystem;
+};
+
+class JobSystem
+{
+public:
+    // workerCount == 0 means "one worker per hardware thread except the calling one". Jobs can be
+    // scheduled and waited for only on the calling thread and in jobs.
+    explicit JobSystem(unsigned workerCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Number of threads that execute jobs, including the thread that owns the job system
+    unsigned threadCount() const { return mQueueCount; }
+
+    void run(JobFunction function, void* data, size_t begin, size_t end, JobCounter* counter);
+    void run(JobFunction function, void* data, JobCounter* counter) { run(function, data, 0, 0, counter); }
+
+    // Schedules a job that starts only after all jobs of `dependency` have completed
+    void runAfter(JobCounter* dependency, JobFunction function, void* data, size_t begin, size_t end, JobCounter* counter);
+
+    // Executes pending jobs on the calling thread until all jobs of `counter` have completed
+    void wait(JobCounter* counter);
+
+    template <class F> void parallelFor(size_t count, size_t grainSize, const F& function);
+    template <class F> void parallelFor(size_t count, const F& function) { parallelFor(count, 0, function); }
+
+private:
+    struct Job
+    {
+        JobFunction function;
+        void* data;
+        size_t begin;
+        size_t end;
+        JobCounter* counter;
+        AllocationTag tag; // of the thread that scheduled the job
+    };
+
+    // Lock-free Chase-Lev deque of fixed capacity. Only the thread owning the queue may push() and
+    // pop(), at the bottom; any thread may steal() from the top.
+    class Queue
+    {
+    public:
+        enum { Capacity = 4096 }; // power of two
+
+        Queue();
+
+        bool push(const Job& job);
+        bool pop(Job& job);
+        bool steal(Job& job);
+
+    private:
+        std::unique_ptr<Job[]> mJobs;
+        std::atomic<int64_t> mTop;
+        std::atomic<int64_t> mBottom;
+    };
+
+    std::vector<std::thread> mWorkers;
+    std::thread::id mOwnerThread; // of queue 0
+    std::unique_ptr<Queue[]> mQueues;
+    unsigned mQueueCount;
+    std::atomic<int> mQueuedJobs;
+    std::mutex mSleepMutex;
+    std::condition_variable mWakeCondition;
+    bool mShutdown;
+
+    void push(const Job& job);
+    bool tryRunOneJob(unsigned queueIndex);
+    void execute(const Job& job);
+    void finish(JobCounter* counter);
+    unsigned currentQueueIndex() const;
+
+    void workerMain(unsigned queueIndex);
+};
+
+template <class F> void JobSystem::parallelFor(size_t count, size_t grainSize, const F& function)
+{
+    if (count == 0)
+        return;
+
+    if (grainSize == 0) {
+        size_t chunkCount = size_t(threadCount()) * 4;
+        grainSize = (count + chunkCount - 1) / chunkCount;
+    }
+
+    if (grainSize >= count) {
+        function(size_t(0), count);
+        return;
+    }
+
+    struct Trampoline
+    {
+        static void run(void* data, size_t begin, size_t end) { (*static_cast<const F*>(data))(begin, end); }
+    };
+
+    void* data = const_cast<void*>(static_cast<const void*>(&function));
+
+    JobCounter counter;
+    size_t begin = 0;
+    for (; begin + grainSize < count; begin += grainSize)
+        run(&Trampoline::run, data, begin, begin + grainSize, &counter);
+
+    function(begin, count);
+    wait(&counter);
+}
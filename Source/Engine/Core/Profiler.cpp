@@ -0,0 +1,131 @@
+#include "Profiler.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace
+{
+    enum { CpuProcessId = 1, GpuProcessId = 2 };
+
+    struct Event
+    {
+        const char* name;
+        double start;
+        double duration;
+        uint32_t processId;
+        uint32_t threadId;
+    };
+
+    std::mutex gMutex;
+    std::vector<Event> gEvents;
+    size_t gCapacity;
+    size_t gDroppedEvents;
+    std::atomic<bool> gRecording;
+    std::atomic<uint32_t> gThreadCount;
+
+    thread_local int tThreadId = -1;
+
+    void addEvent(const Event& event)
+    {
+        std::lock_guard<std::mutex> lock(gMutex);
+        if (!gRecording.load(std::memory_order_relaxed))
+            return;
+        if (gEvents.size() < gCapacity)
+            gEvents.emplace_back(event);
+        else
+            ++gDroppedEvents;
+    }
+
+    void writeString(FILE* f, const char* str)
+    {
+        fputc('"', f);
+        for (; *str; ++str) {
+            if (*str == '"' || *str == '\\')
+                fputc('\\', f);
+            if (uint8_t(*str) >= 0x20)
+                fputc(*str, f);
+        }
+        fputc('"', f);
+    }
+}
+
+double Profiler::time()
+{
+    static const auto epoch = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - epoch).count();
+}
+
+void Profiler::start(size_t capacity)
+{
+    time(); // starts the clock before the first event
+
+    std::lock_guard<std::mutex> lock(gMutex);
+    gEvents.clear();
+    gEvents.reserve(capacity);
+    gCapacity = capacity;
+    gDroppedEvents = 0;
+    gRecording.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::stop()
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    gRecording.store(false, std::memory_order_relaxed);
+}
+
+bool Profiler::isRecording()
+{
+    return gRecording.load(std::memory_order_relaxed);
+}
+
+size_t Profiler::eventCount()
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    return gEvents.size();
+}
+
+size_t Profiler::droppedEventCount()
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    return gDroppedEvents;
+}
+
+void Profiler::addCpuEvent(const char* name, double start, double duration)
+{
+    if (tThreadId < 0)
+        tThreadId = int(gThreadCount.fetch_add(1, std::memory_order_relaxed));
+    addEvent({ name, start, duration, CpuProcessId, uint32_t(tThreadId) });
+}
+
+void Profiler::addGpuEvent(const char* name, double start, double duration)
+{
+    addEvent({ name, start, duration, GpuProcessId, 0 });
+}
+
+bool Profiler::writeTrace(const char* fileName)
+{
+    FILE* f = fopen(fileName, "w");
+    if (!f)
+        return false;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"CPU\"}},\n", CpuProcessId);
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"GPU\"}}", GpuProcessId);
+
+    {
+        std::lock_guard<std::mutex> lock(gMutex);
+        for (const auto& event : gEvents) {
+            // Complete events, in microseconds
+            fprintf(f, ",\n{\"name\":");
+            writeString(f, event.name);
+            fprintf(f, ",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                event.processId, event.threadId, event.start * 1e6, event.duration * 1e6);
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
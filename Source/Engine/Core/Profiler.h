@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+
+// Timeline of named CPU and GPU ranges, written in the Chrome trace event format (chrome://tracing,
+// Perfetto). Events are kept between start() and stop(), up to the capacity passed to start();
+// later ones are dropped, so that recording does not allocate during frames. Event names are kept
+// by pointer and have to outlive the trace, string literals do.
+class Profiler
+{
+public:
+    // Seconds on the clock of all events, counted from the first call
+    static double time();
+
+    static void start(size_t capacity);
+    static void stop();
+    static bool isRecording();
+
+    static size_t eventCount();
+    static size_t droppedEventCount();
+
+    static void addCpuEvent(const char* name, double start, double duration);
+    static void addGpuEvent(const char* name, double start, double duration);
+
+    static bool writeTrace(const char* fileName);
+};
+
+// Records the scope as a CPU event of the current thread
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name)
+        : mName(name)
+        , mStart(Profiler::isRecording() ? Profiler::time() : -1.0)
+    {
+    }
+
+    ~ProfileScope()
+    {
+        if (mStart >= 0.0)
+            Profiler::addCpuEvent(mName, mStart, Profiler::time() - mStart);
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* mName;
+    double mStart;
+};
@@ -2,6 +2,7 @@
 
 InputManager::InputManager(Engine* engine)
     : mEngine(engine)
+    , mPressedKeys{}
 {
 }
 
@@ -11,17 +12,17 @@ InputManager::~InputManager()
 
 bool InputManager::isKeyPressed(Key key) const
 {
-    return mPressedKeys.find(key) != mPressedKeys.end();
+    return (key > KeyNone && key < KeyCount ? mPressedKeys[key] : false);
 }
 
 void InputManager::injectKeyPress(Key key)
 {
-    if (key != KeyNone)
-        mPressedKeys.emplace(key);
+    if (key > KeyNone && key < KeyCount)
+        mPressedKeys[key] = true;
 }
 
 void InputManager::injectKeyRelease(Key key)
 {
-    if (key != KeyNone)
-        mPressedKeys.erase(key);
+    if (key > KeyNone && key < KeyCount)
+        mPressedKeys[key] = false;
 }
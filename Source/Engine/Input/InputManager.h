@@ -1,6 +1,5 @@
 #pragma once
 #include "Engine/Input/Key.h"
-#include <unordered_set>
 
 class Engine;
 
@@ -17,5 +16,5 @@ public:
 
 private:
     Engine* mEngine;
-    std::unordered_set<Key> mPressedKeys;
+    bool mPressedKeys[KeyCount];
 };
@@ -7,4 +7,5 @@ enum Key
     KeyRight,
     KeyUp,
     KeyDown,
+    KeyCount
 };
@@ -1,160 +1,219 @@
 #include "AnimatedMesh.h"
+#include "Engine/Mesh/AnimatedMeshInstance.h"
+#include "Engine/Mesh/AnimationLod.h"
 #include "Engine/Mesh/MeshData.h"
+#include "Engine/Mesh/Material.h"
+#include "Engine/Mesh/PoseEvaluator.h"
 #include "Engine/Core/Engine.h"
+#include "Engine/Core/JobSystem.h"
+#include "Engine/ResMgr/ResourceManager.h"
+#include "Engine/ResMgr/Texture.h"
 #include "Engine/Renderer/IRenderDevice.h"
 #include "Engine/Renderer/IRenderBuffer.h"
+#include <glm/matrix.hpp>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <glm/gtc/matrix_transform.hpp>
 
 AnimatedMesh::AnimatedMesh(Engine* engine, const MeshData* data)
     : StaticMesh(engine, data)
     , mBones(data->bones)
     , mBoneCount(data->boneCount)
     , mGlobalInverseTransform(*data->globalInverseTransform)
-    , mMatrices(new glm::mat4[data->boneCount])
-    , mAnimation(nullptr)
-    , mTime(0.0f)
+    , mSkeleton(new PoseSkeleton(data->bones, data->boneCount, *data->globalInverseTransform))
+    , mBoundingSphereCenter(data->boundingSphereCenter)
+    , mBoundingSphereRadius(data->boundingSphereRadius)
+    , mPaletteCapacity(0)
+    , mSupportsInstancing(true)
+    , mBakedAnimations(data->bakedAnimations)
+    , mBakedAnimationCount(data->bakedAnimationCount)
+    , mBakedFrameRate(data->bakedFrameRate)
+    , mBakedInstanceCapacity(0)
 {
-    mMatrixBuffer = mEngine->renderDevice()->createBuffer(mBoneCount * sizeof(glm::mat4));
-    mSkinningVertexBuffer = mEngine->renderDevice()->createBufferWithData(
-        data->skinningVertices, data->skinningVertexCount * sizeof(MeshSkinningVertex));
-}
+    std::unique_ptr<glm::mat4[]> bindPose(new glm::mat4[mBoneCount]);
+    for (size_t i = 0; i < mBoneCount; i++)
+        bindPose[i] = mBones[i].matrix;
+
+    mBindPoseBuffer = mEngine->renderDevice()->createBufferWithData(bindPose.get(), mBoneCount * sizeof(glm::mat4));
+    assert(geometry().vertexBuffers[1] != nullptr);
+
+    bool supportsBakedPoses = (data->bakedPoses != nullptr);
+    for (const auto& e : mElements) {
+        if (!e.material->supportsInstancing())
+            mSupportsInstancing = false;
+        if (!e.material->supportsBakedPoses())
+            supportsBakedPoses = false;
+    }
 
-AnimatedMesh::~AnimatedMesh()
-{
+    if (supportsBakedPoses)
+        mBakedPoses = mEngine->resourceManager()->cachedTexture(data->bakedPoses);
+    else
+        mBakedAnimationCount = 0;
 }
 
-void AnimatedMesh::addTime(float time)
+AnimatedMesh::~AnimatedMesh()
 {
-    mTime += time;
+    assert(mInstances.empty());
 }
 
-float AnimatedMesh::animationDuration() const
+PoseUpdateStats AnimatedMesh::updateInstancePoses(Camera* camera)
 {
-    if (!mAnimation)
-        return 0.0f;
-
-    float ticksPerSecond = (mAnimation->ticksPerSecond > 0.0f ? mAnimation->ticksPerSecond : 25.0f);
-    return mAnimation->durationInTicks * ticksPerSecond;
+    AnimationLod lod(camera);
+    std::atomic<unsigned> evaluated(0);
+    std::atomic<unsigned> baked(0);
+
+    mEngine->jobSystem()->parallelFor(mInstances.size(), [this, &lod, &evaluated, &baked](size_t begin, size_t end) {
+            unsigned evaluatedCount = 0;
+            unsigned bakedCount = 0;
+            for (size_t i = begin; i < end; i++) {
+                PoseUpdate update = mInstances[i]->updatePose(lod);
+                if (update == PoseUpdate::Evaluated)
+                    ++evaluatedCount;
+                else if (update == PoseUpdate::Baked)
+                    ++bakedCount;
+            }
+            evaluated.fetch_add(evaluatedCount, std::memory_order_relaxed);
+            baked.fetch_add(bakedCount, std::memory_order_relaxed);
+        });
+
+    PoseUpdateStats stats;
+    stats.evaluated = evaluated.load(std::memory_order_relaxed);
+    stats.baked = baked.load(std::memory_order_relaxed);
+    stats.skipped = unsigned(mInstances.size()) - stats.evaluated - stats.baked;
+    return stats;
 }
 
-void AnimatedMesh::setAnimation(const MeshAnimation* anim)
+const MeshBakedAnimation* AnimatedMesh::bakedAnimation(const MeshAnimation* animation) const
 {
-    if (mAnimation != anim) {
-        mAnimation = anim;
-        mTime = 0.0f;
+    for (size_t i = 0; i < mBakedAnimationCount; i++) {
+        if (mBakedAnimations[i].animation == animation)
+            return &mBakedAnimations[i];
     }
+    return nullptr;
 }
 
 void AnimatedMesh::render() const
 {
-    mEngine->renderDevice()->setVertexBuffer(1, mSkinningVertexBuffer);
-
-    calculatePose(mTime);
-    unsigned bufferOffset = mMatrixBuffer->uploadData(mMatrices.get());
-    mEngine->renderDevice()->setVertexBuffer(2, mMatrixBuffer, bufferOffset);
+    renderWithPose(mBindPoseBuffer, 0);
+}
 
+void AnimatedMesh::renderWithPose(const std::unique_ptr<IRenderBuffer>& matrixBuffer, unsigned offset) const
+{
+    mEngine->renderDevice()->setVertexBuffer(1, *geometry().vertexBuffers[1]);
+    mEngine->renderDevice()->setVertexBuffer(2, matrixBuffer, offset);
     StaticMesh::render();
 }
 
-template <class T> T interpolatedValue(float time, float duration, const T* keys, size_t keyCount,
-    const T& defaultValue, const std::function<T(const T&, const T&, float)>& interpolate)
+void AnimatedMesh::renderInstances()
 {
-    if (keyCount < 2) {
-        if (keyCount == 0)
-            return defaultValue;
-        return keys[0];
+    mVisibleInstances.clear();
+    mVisibleBakedInstances.clear();
+    for (const auto* instance : mInstances) {
+        if (!instance->isVisible() || !instance->isOnScreen())
+            continue;
+        if (instance->usesBakedPose())
+            mVisibleBakedInstances.emplace_back(instance);
+        else
+            mVisibleInstances.emplace_back(instance);
     }
 
-    const T* begin = keys;
-    const T* end = keys + keyCount;
-    const T* key1;
-    const T* key2 = std::lower_bound(begin, end, time, [](const T& value, float t) -> bool { return value.time < t; });
-
-    if (key2 != end && key2->time == time)
-        return *key2;
-
-    float key1Time;
-    float key2Time;
-    if (key2 != begin && key2 != end) {
-        key1 = key2 - 1;
-        key1Time = key1->time;
-        key2Time = key2->time;
-    } else {
-        key1 = end - 1;
-        if (key2 == begin) {
-            key1Time = -(duration - key1->time);
-            assert(key1Time <= 0.0f);
-            key2Time = key2->time;
-        } else {
-            key2 = begin;
-            key1Time = key1->time;
-            key2Time = duration;
+    if (!mVisibleInstances.empty())
+        renderEvaluatedInstances();
+    if (!mVisibleBakedInstances.empty())
+        renderBakedInstances();
+}
+
+void AnimatedMesh::renderEvaluatedInstances()
+{
+    if (!mSupportsInstancing) {
+        for (const auto* instance : mVisibleInstances) {
+            mEngine->renderDevice()->setModelMatrix(instance->modelMatrix());
+            instance->render();
         }
+        return;
     }
 
-    float timeDelta = key2Time - key1Time;
-    float factor = (timeDelta != 0.0f ? (time - key1Time) / timeDelta : 0.0f);
-    assert(factor >= 0.0f && factor <= 1.0f);
+    assert(mVisibleInstances.size() <= mPaletteCapacity);
+
+    // Palette of each instance is its model matrix followed by its bone matrices, all transposed
+    // and truncated to 3x4, so the shader can do the affine transforms with three dot products
+    size_t stride = paletteSize();
+    mEngine->jobSystem()->parallelFor(mVisibleInstances.size(), [this, stride](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const auto* instance = mVisibleInstances[i];
+                const glm::mat4* matrices = instance->matrices();
+                glm::mat3x4* palette = &mPalettes[i * stride];
+
+                palette[0] = glm::mat3x4(glm::transpose(instance->modelMatrix()));
+                for (size_t j = 0; j < mBoneCount; j++)
+                    palette[j + 1] = glm::mat3x4(glm::transpose(matrices[j]));
+            }
+        });
+
+    unsigned offset = mPaletteBuffer->uploadData(mPalettes.get(), mVisibleInstances.size() * stride * sizeof(glm::mat3x4));
+
+    const auto& range = geometry();
+    mEngine->renderDevice()->setVertexBuffer(0, *range.vertexBuffers[0]);
+    mEngine->renderDevice()->setVertexBuffer(1, *range.vertexBuffers[1]);
+    mEngine->renderDevice()->setPaletteBuffer(mPaletteBuffer, offset, unsigned(stride));
+    for (const auto& e : mElements) {
+        e.material->bindInstanced();
+        mEngine->renderDevice()->drawIndexedPrimitiveInstanced(*range.indexBuffer, range.firstIndex + e.firstIndex,
+            e.indexCount, unsigned(mVisibleInstances.size()), range.baseVertex);
+    }
+}
+
+void AnimatedMesh::renderBakedInstances()
+{
+    assert(mVisibleBakedInstances.size() <= mBakedInstanceCapacity);
 
-    T value = interpolate(*key1, *key2, factor);
-    value.time = time;
+    for (size_t i = 0; i < mVisibleBakedInstances.size(); i++) {
+        const auto* instance = mVisibleBakedInstances[i];
+        mBakedInstances[i].modelMatrix = glm::mat3x4(glm::transpose(instance->modelMatrix()));
+        mBakedInstances[i].frames = instance->bakedFrames();
+    }
 
-    return value;
+    unsigned offset = mBakedInstanceBuffer->uploadData(mBakedInstances.get(), mVisibleBakedInstances.size() * sizeof(BakedInstance));
+
+    const auto& range = geometry();
+    mEngine->renderDevice()->setVertexBuffer(0, *range.vertexBuffers[0]);
+    mEngine->renderDevice()->setVertexBuffer(1, *range.vertexBuffers[1]);
+    mEngine->renderDevice()->setPaletteBuffer(mBakedInstanceBuffer, offset, 1);
+    for (const auto& e : mElements) {
+        e.material->bindBaked();
+        mEngine->renderDevice()->setTexture(1, mBakedPoses->instance());
+        mEngine->renderDevice()->drawIndexedPrimitiveInstanced(*range.indexBuffer, range.firstIndex + e.firstIndex,
+            e.indexCount, unsigned(mVisibleBakedInstances.size()), range.baseVertex);
+    }
 }
 
-void AnimatedMesh::calculatePose(float time) const
+void AnimatedMesh::reserveInstances(size_t instanceCount)
 {
-    if (!mAnimation) {
-        for (size_t i = 0; i < mBoneCount; i++)
-            mMatrices[i] = mBones[i].matrix;
-        return;
+    // Either list may end up holding every instance, depending on which are on screen
+    if (instanceCount > mVisibleInstances.capacity()) {
+        size_t capacity = std::max(instanceCount, mVisibleInstances.capacity() * 2);
+        mVisibleInstances.reserve(capacity);
+        mVisibleBakedInstances.reserve(capacity);
     }
 
-    float ticksPerSecond = (mAnimation->ticksPerSecond > 0.0f ? mAnimation->ticksPerSecond : 25.0f);
-    float timeInTicks = fmodf(mTime * ticksPerSecond, mAnimation->durationInTicks);
-
-    for (size_t boneIndex = 0; boneIndex < mBoneCount; boneIndex++) {
-        const MeshBoneAnimation* anim = &mAnimation->boneAnimations[boneIndex];
-
-        glm::mat4 transform;
-        if (!anim->positionKeys && !anim->scaleKeys && !anim->rotationKeys)
-            transform = glm::mat4(1.0f);
-        else {
-            MeshPositionKey pos = interpolatedValue<MeshPositionKey>(timeInTicks, mAnimation->durationInTicks,
-                anim->positionKeys, anim->positionKeyCount, MeshPositionKey{timeInTicks, glm::vec3(0.0f)},
-                [](const MeshPositionKey& key1, const MeshPositionKey& key2, float factor) -> MeshPositionKey {
-                    return MeshPositionKey{0.0f, key1.position + (key2.position - key1.position) * factor};
-                });
-
-            MeshRotationKey rot = interpolatedValue<MeshRotationKey>(timeInTicks, mAnimation->durationInTicks,
-                anim->rotationKeys, anim->rotationKeyCount, MeshRotationKey{timeInTicks, glm::quat()},
-                [](const MeshRotationKey& key1, const MeshRotationKey& key2, float factor) -> MeshRotationKey {
-                    return MeshRotationKey{0.0f, glm::slerp(key1.rotation, key2.rotation, factor)};
-                });
-
-            MeshScaleKey scale = interpolatedValue<MeshScaleKey>(timeInTicks, mAnimation->durationInTicks,
-                anim->scaleKeys, anim->scaleKeyCount, MeshScaleKey{timeInTicks, glm::vec3(1.0f)},
-                [](const MeshScaleKey& key1, const MeshScaleKey& key2, float factor) -> MeshScaleKey {
-                    return MeshScaleKey{0.0f, key1.scale + (key2.scale - key1.scale) * factor};
-                });
-
-            transform  = glm::translate(glm::mat4(1.0f), pos.position);
-            transform *= glm::mat4_cast(rot.rotation);
-            transform  = glm::scale(transform, scale.scale);
-        }
-
-        uint8_t parentBone = mBones[boneIndex].parentIndex;
-        if (parentBone == MeshBone::InvalidIndex)
-            transform = mGlobalInverseTransform * transform;
-        else {
-            assert(parentBone < boneIndex);
-            transform = mMatrices[parentBone] * transform;
-        }
+    if (mSupportsInstancing && instanceCount > mPaletteCapacity) {
+        size_t capacity = (mPaletteCapacity > 0 ? mPaletteCapacity : 4);
+        while (capacity < instanceCount)
+            capacity *= 2;
 
-        mMatrices[boneIndex] = transform;
+        size_t matrixCount = capacity * paletteSize();
+        mPalettes.reset(new glm::mat3x4[matrixCount]);
+        mPaletteBuffer = mEngine->renderDevice()->createBuffer(matrixCount * sizeof(glm::mat3x4));
+        mPaletteCapacity = capacity;
     }
 
-    for (size_t boneIndex = 0; boneIndex < mBoneCount; boneIndex++)
-        mMatrices[boneIndex] *= mBones[boneIndex].matrix;
+    if (mBakedAnimationCount > 0 && instanceCount > mBakedInstanceCapacity) {
+        size_t capacity = (mBakedInstanceCapacity > 0 ? mBakedInstanceCapacity : 16);
+        while (capacity < instanceCount)
+            capacity *= 2;
+
+        mBakedInstances.reset(new BakedInstance[capacity]);
+        mBakedInstanceBuffer = mEngine->renderDevice()->createBuffer(capacity * sizeof(BakedInstance));
+        mBakedInstanceCapacity = capacity;
+    }
 }
@@ -1,10 +1,32 @@
 #pragma once
 #include "Engine/Mesh/StaticMesh.h"
+#include <glm/mat3x4.hpp>
 #include <glm/mat4x4.hpp>
 #include <memory>
+#include <vector>
 
-struct MeshAnimation;
 struct MeshBone;
+struct MeshAnimation;
+struct MeshBakedAnimation;
+class AnimatedMeshInstance;
+class PoseSkeleton;
+class Camera;
+class Texture;
+
+struct PoseUpdateStats
+{
+    unsigned evaluated = 0;
+    unsigned skipped = 0; // by the LOD policy
+    unsigned baked = 0;
+
+    PoseUpdateStats& operator+=(const PoseUpdateStats& other)
+    {
+        evaluated += other.evaluated;
+        skipped += other.skipped;
+        baked += other.baked;
+        return *this;
+    }
+};
 
 class AnimatedMesh : public StaticMesh
 {
@@ -12,21 +34,70 @@ public:
     AnimatedMesh(Engine* engine, const MeshData* data);
     ~AnimatedMesh();
 
-    void addTime(float time);
-    float animationDuration() const;
-    void setAnimation(const MeshAnimation* anim);
+    const MeshBone* bones() const { return mBones; }
+    size_t boneCount() const { return mBoneCount; }
+    const glm::mat4& globalInverseTransform() const { return mGlobalInverseTransform; }
+
+    // Shared by the pose evaluators of all instances
+    const PoseSkeleton& skeleton() const { return *mSkeleton; }
+
+    // Bounds in mesh space of the skinned mesh, over the bind pose and all of its animations
+    const glm::vec3& boundingSphereCenter() const { return mBoundingSphereCenter; }
+    float boundingSphereRadius() const { return mBoundingSphereRadius; }
 
+    // Baked clip of the animation, or nullptr if its poses have to be evaluated on the CPU
+    const MeshBakedAnimation* bakedAnimation(const MeshAnimation* animation) const;
+    float bakedFrameRate() const { return mBakedFrameRate; }
+
+    // Evaluates poses of all live instances of this mesh, spread over the job system.
+    // Instances that are small on screen are updated less often and off-screen ones not at all.
+    PoseUpdateStats updateInstancePoses(Camera* camera);
+
+    // Renders the mesh in its bind pose
     void render() const override;
+    void renderWithPose(const std::unique_ptr<IRenderBuffer>& matrixBuffer, unsigned offset) const;
+
+    // Renders all visible instances with one instanced draw per material element. Falls back
+    // to drawing instances one by one if some material has no instanced shader.
+    void renderInstances();
 
 private:
+    struct BakedInstance
+    {
+        glm::mat3x4 modelMatrix;
+        glm::vec4 frames; // two rows of the baked pose texture and the blend factor between them
+    };
+
     const MeshBone* mBones;
     size_t mBoneCount;
     glm::mat4 mGlobalInverseTransform;
-    std::unique_ptr<IRenderBuffer> mSkinningVertexBuffer;
-    std::unique_ptr<IRenderBuffer> mMatrixBuffer;
-    std::unique_ptr<glm::mat4[]> mMatrices;
-    const MeshAnimation* mAnimation;
-    float mTime;
+    std::unique_ptr<PoseSkeleton> mSkeleton;
+    glm::vec3 mBoundingSphereCenter;
+    float mBoundingSphereRadius;
+    std::unique_ptr<IRenderBuffer> mBindPoseBuffer;
+    std::unique_ptr<IRenderBuffer> mPaletteBuffer;
+    std::unique_ptr<glm::mat3x4[]> mPalettes;
+    size_t mPaletteCapacity;
+    bool mSupportsInstancing;
+    std::vector<AnimatedMeshInstance*> mInstances;
+    std::vector<const AnimatedMeshInstance*> mVisibleInstances;
+    std::shared_ptr<Texture> mBakedPoses;
+    const MeshBakedAnimation* mBakedAnimations;
+    size_t mBakedAnimationCount;
+    float mBakedFrameRate;
+    std::unique_ptr<IRenderBuffer> mBakedInstanceBuffer;
+    std::unique_ptr<BakedInstance[]> mBakedInstances;
+    size_t mBakedInstanceCapacity;
+    std::vector<const AnimatedMeshInstance*> mVisibleBakedInstances;
+
+    size_t paletteSize() const { return mBoneCount + 1; }
+
+    // Sized for all instances when they are created, so that the buffers are never replaced while
+    // a frame is recorded. The device releases replaced buffers once frames in flight are done.
+    void reserveInstances(size_t instanceCount);
+
+    void renderEvaluatedInstances();
+    void renderBakedInstances();
 
-    void calculatePose(float time) const;
+    friend class AnimatedMeshInstance;
 };
@@ -0,0 +1,135 @@
+#include "AnimatedMeshInstance.h"
+#include "Engine/Mesh/AnimatedMesh.h"
+#include "Engine/Mesh/MeshData.h"
+#include "Engine/Mesh/PoseEvaluator.h"
+#include "Engine/Mesh/AnimationLod.h"
+#include "Engine/Core/Engine.h"
+#include "Engine/Renderer/IRenderDevice.h"
+#include "Engine/Renderer/IRenderBuffer.h"
+#include <algorithm>
+#include <cmath>
+
+AnimatedMeshInstance::AnimatedMeshInstance(Engine* engine, std::shared_ptr<AnimatedMesh> mesh)
+    : mEngine(engine)
+    , mMesh(std::move(mesh))
+    , mMatrices(new glm::mat4[mMesh->boneCount()])
+    , mModelMatrix(1.0f)
+    , mAnimation(nullptr)
+    , mBakedAnimation(nullptr)
+    , mTime(0.0f)
+    , mVisible(true)
+    , mOnScreen(true)
+    , mUseBakedPose(false)
+{
+    // Spread reduced-rate updates of instances over different frames
+    mFramesSinceUpdate = unsigned(mMesh->mInstances.size() % AnimationLod::MaxUpdateInterval);
+
+    mMesh->mInstances.emplace_back(this);
+    mMesh->reserveInstances(mMesh->mInstances.size());
+    updatePose();
+}
+
+AnimatedMeshInstance::~AnimatedMeshInstance()
+{
+    auto& instances = mMesh->mInstances;
+    instances.erase(std::find(instances.begin(), instances.end(), this));
+}
+
+void AnimatedMeshInstance::addTime(float time)
+{
+    mTime += time;
+}
+
+float AnimatedMeshInstance::animationDuration() const
+{
+    if (!mAnimation)
+        return 0.0f;
+
+    float ticksPerSecond = (mAnimation->ticksPerSecond > 0.0f ? mAnimation->ticksPerSecond : 25.0f);
+    return mAnimation->durationInTicks * ticksPerSecond;
+}
+
+void AnimatedMeshInstance::setAnimation(const MeshAnimation* anim)
+{
+    if (mAnimation != anim) {
+        mAnimation = anim;
+        mBakedAnimation = (anim ? mMesh->bakedAnimation(anim) : nullptr);
+        mTime = 0.0f;
+    }
+}
+
+glm::vec4 AnimatedMeshInstance::bakedFrames() const
+{
+    float ticksPerSecond = (mAnimation->ticksPerSecond > 0.0f ? mAnimation->ticksPerSecond : 25.0f);
+    float frame = timeInTicks() / ticksPerSecond * mMesh->bakedFrameRate();
+
+    unsigned frameCount = mBakedAnimation->frameCount;
+    unsigned frame1 = std::min(unsigned(frame), frameCount - 1);
+    unsigned frame2 = (frame1 + 1) % frameCount;
+
+    return glm::vec4(
+        float(mBakedAnimation->firstFrame + frame1),
+        float(mBakedAnimation->firstFrame + frame2),
+        std::min(frame - float(frame1), 1.0f),
+        0.0f);
+}
+
+void AnimatedMeshInstance::updatePose()
+{
+    if (usesBakedPose())
+        return;
+
+    if (!mAnimation) {
+        const MeshBone* bones = mMesh->bones();
+        for (size_t i = 0; i < mMesh->boneCount(); i++)
+            mMatrices[i] = bones[i].matrix;
+        return;
+    }
+
+    // Instances posed from baked poses never get here, so they do without an evaluator
+    if (!mPoseEvaluator)
+        mPoseEvaluator.reset(new PoseEvaluator(mMesh->skeleton()));
+
+    mPoseEvaluator->evaluate(mAnimation, timeInTicks(), mMatrices.get());
+}
+
+PoseUpdate AnimatedMeshInstance::updatePose(const AnimationLod& lod)
+{
+    glm::vec3 center = glm::vec3(mModelMatrix * glm::vec4(mMesh->boundingSphereCenter(), 1.0f));
+    float scale = glm::max(glm::length(glm::vec3(mModelMatrix[0])),
+        glm::max(glm::length(glm::vec3(mModelMatrix[1])), glm::length(glm::vec3(mModelMatrix[2]))));
+
+    unsigned interval = lod.updateInterval(center, mMesh->boundingSphereRadius() * scale);
+    mOnScreen = (interval != 0);
+    if (!mOnScreen) {
+        // Frozen; refreshed as soon as the instance comes back on screen
+        mFramesSinceUpdate = AnimationLod::MaxUpdateInterval;
+        return PoseUpdate::Skipped;
+    }
+
+    if (usesBakedPose())
+        return PoseUpdate::Baked;
+
+    if (++mFramesSinceUpdate < interval)
+        return PoseUpdate::Skipped;
+
+    mFramesSinceUpdate = 0;
+    updatePose();
+    return PoseUpdate::Evaluated;
+}
+
+void AnimatedMeshInstance::render() const
+{
+    // Instanced and baked draws read the mesh's shared buffers, so only instances drawn alone need one
+    if (!mMatrixBuffer)
+        mMatrixBuffer = mEngine->renderDevice()->createBuffer(mMesh->boneCount() * sizeof(glm::mat4));
+
+    unsigned bufferOffset = mMatrixBuffer->uploadData(mMatrices.get(), mMesh->boneCount() * sizeof(glm::mat4));
+    mMesh->renderWithPose(mMatrixBuffer, bufferOffset);
+}
+
+float AnimatedMeshInstance::timeInTicks() const
+{
+    float ticksPerSecond = (mAnimation->ticksPerSecond > 0.0f ? mAnimation->ticksPerSecond : 25.0f);
+    return fmodf(mTime * ticksPerSecond, mAnimation->durationInTicks);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <memory>
+
+struct MeshAnimation;
+struct MeshBakedAnimation;
+class Engine;
+class AnimatedMesh;
+class IRenderBuffer;
+class PoseEvaluator;
+class AnimationLod;
+
+// What a LOD pass did with an instance's pose
+enum class PoseUpdate
+{
+    Evaluated,
+    Skipped, // off screen, or not due yet at its update interval
+    Baked,   // on screen and read from the baked pose texture, which needs no evaluation
+};
+
+// Playback state and pose of a single character. Geometry is shared with every other
+// instance of the same AnimatedMesh; poses are evaluated in batches by the mesh.
+class AnimatedMeshInstance
+{
+public:
+    AnimatedMeshInstance(Engine* engine, std::shared_ptr<AnimatedMesh> mesh);
+    ~AnimatedMeshInstance();
+
+    const std::shared_ptr<AnimatedMesh>& mesh() const { return mMesh; }
+    const glm::mat4* matrices() const { return mMatrices.get(); }
+
+    const glm::mat4& modelMatrix() const { return mModelMatrix; }
+    void setModelMatrix(const glm::mat4& matrix) { mModelMatrix = matrix; }
+
+    bool isVisible() const { return mVisible; }
+    void setVisible(bool flag) { mVisible = flag; }
+
+    // Result of the last LOD pass; off-screen instances keep their pose and are not drawn
+    bool isOnScreen() const { return mOnScreen; }
+
+    void addTime(float time);
+    float animationDuration() const;
+    void setAnimation(const MeshAnimation* anim);
+
+    // Lets the vertex shader fetch the pose from the mesh's baked pose texture whenever the
+    // current animation has been baked; such instances cost nothing in updatePose(). The pose
+    // evaluator is created on the first pose evaluated on the CPU.
+    void setUseBakedPose(bool flag) { mUseBakedPose = flag; }
+    bool usesBakedPose() const { return mUseBakedPose && mBakedAnimation != nullptr; }
+    glm::vec4 bakedFrames() const;
+
+    void updatePose();
+    // Evaluates the pose if the LOD policy says it is due
+    PoseUpdate updatePose(const AnimationLod& lod);
+
+    // Renders this instance alone, with the model matrix currently set on the render device.
+    // AnimatedMesh::renderInstances() draws all visible instances of a mesh at once instead.
+    // The matrix buffer this needs is created on the first call.
+    void render() const;
+
+private:
+    Engine* mEngine;
+    std::shared_ptr<AnimatedMesh> mMesh;
+    mutable std::unique_ptr<IRenderBuffer> mMatrixBuffer;
+    std::unique_ptr<glm::mat4[]> mMatrices;
+    std::unique_ptr<PoseEvaluator> mPoseEvaluator;
+    glm::mat4 mModelMatrix;
+    const MeshAnimation* mAnimation;
+    const MeshBakedAnimation* mBakedAnimation;
+    float mTime;
+    unsigned mFramesSinceUpdate;
+    bool mVisible;
+    bool mOnScreen;
+    bool mUseBakedPose;
+
+    float timeInTicks() const;
+};
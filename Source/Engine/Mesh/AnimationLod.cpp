@@ -0,0 +1,64 @@
+#include "AnimationLod.h"
+#include "Engine/Math/Camera.h"
+#include <glm/geometric.hpp>
+
+namespace
+{
+    // Fraction of the viewport height covered by the bounding sphere, below which the
+    // update interval doubles
+    const float FullRateScreenSize = 0.1f;
+    const float HalfRateScreenSize = 0.05f;
+    const float QuarterRateScreenSize = 0.025f;
+}
+
+AnimationLod::AnimationLod(Camera* camera)
+    : mViewProjection(1.0f)
+    , mProjectionScale(1.0f)
+    , mEnabled(camera != nullptr)
+{
+    if (!mEnabled)
+        return;
+
+    mViewProjection = camera->projectionMatrix() * camera->viewMatrix();
+    mProjectionScale = camera->projectionMatrix()[1][1];
+
+    // Frustum planes in world space, pointing inside (Gribb & Hartmann)
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++)
+        row[i] = glm::vec4(mViewProjection[0][i], mViewProjection[1][i], mViewProjection[2][i], mViewProjection[3][i]);
+
+    mFrustumPlanes[0] = row[3] + row[0];
+    mFrustumPlanes[1] = row[3] - row[0];
+    mFrustumPlanes[2] = row[3] + row[1];
+    mFrustumPlanes[3] = row[3] - row[1];
+    mFrustumPlanes[4] = row[3] + row[2];
+    mFrustumPlanes[5] = row[3] - row[2];
+
+    for (auto& plane : mFrustumPlanes)
+        plane /= glm::length(glm::vec3(plane));
+}
+
+unsigned AnimationLod::updateInterval(const glm::vec3& center, float radius) const
+{
+    if (!mEnabled)
+        return 1;
+
+    for (const auto& plane : mFrustumPlanes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            return 0;
+    }
+
+    float w = (mViewProjection * glm::vec4(center, 1.0f)).w;
+    if (w <= radius)
+        return 1;
+
+    float screenSize = radius * mProjectionScale / w;
+    if (screenSize >= FullRateScreenSize)
+        return 1;
+    if (screenSize >= HalfRateScreenSize)
+        return 2;
+    if (screenSize >= QuarterRateScreenSize)
+        return 4;
+
+    return MaxUpdateInterval;
+}
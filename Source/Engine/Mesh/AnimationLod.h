@@ -0,0 +1,26 @@
+#pragma once
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+class Camera;
+
+// Chooses how often a skinned instance re-evaluates its pose from how large its bounding
+// sphere appears on screen. Between evaluations the previous pose is reused.
+class AnimationLod
+{
+public:
+    enum { MaxUpdateInterval = 8 };
+
+    // Without a camera every instance is considered on screen and updated every frame
+    explicit AnimationLod(Camera* camera);
+
+    // Number of frames between pose evaluations (1, 2, 4 or 8), or 0 if the sphere is off screen
+    unsigned updateInterval(const glm::vec3& center, float radius) const;
+
+private:
+    glm::mat4 mViewProjection;
+    glm::vec4 mFrustumPlanes[6];
+    float mProjectionScale;
+    bool mEnabled;
+};
@@ -5,11 +5,13 @@
 #include "Engine/ResMgr/Texture.h"
 #include "Engine/Renderer/IRenderDevice.h"
 #include "Engine/Renderer/IPipelineState.h"
+#include "Engine/Renderer/RenderQueue.h"
 #include "Engine/Mesh/MeshData.h"
 #include "Engine/Mesh/MaterialData.h"
 
 Material::Material(Engine* engine, const MaterialData* data)
     : mEngine(engine)
+    , mInstancedSortKey(0)
 {
     mShader = mEngine->resourceManager()->cachedShader(data->shader);
 
@@ -18,6 +20,20 @@ Material::Material(Engine* engine, const MaterialData* data)
         mTextures.emplace_back(mEngine->resourceManager()->cachedTexture(data->textures[i]));
 
     mPipelineState = mEngine->renderDevice()->createPipelineState(Triangles, mShader->instance(), data->vertexFormat());
+    mSortKey = mEngine->renderQueue()->registerMaterial(data->shader);
+
+    if (data->instancedShader) {
+        mInstancedShader = mEngine->resourceManager()->cachedShader(data->instancedShader);
+        mInstancedPipelineState = mEngine->renderDevice()->createPipelineState(
+            Triangles, mInstancedShader->instance(), data->vertexFormat());
+        mInstancedSortKey = mEngine->renderQueue()->registerVariant(mSortKey, data->instancedShader);
+    }
+
+    if (data->bakedShader) {
+        mBakedShader = mEngine->resourceManager()->cachedShader(data->bakedShader);
+        mBakedPipelineState = mEngine->renderDevice()->createPipelineState(
+            Triangles, mBakedShader->instance(), data->vertexFormat());
+    }
 }
 
 Material::~Material()
@@ -27,7 +43,23 @@ Material::~Material()
 void Material::bind() const
 {
     mEngine->renderDevice()->setPipelineState(mPipelineState);
+    bindTextures();
+}
+
+void Material::bindInstanced() const
+{
+    mEngine->renderDevice()->setPipelineState(mInstancedPipelineState);
+    bindTextures();
+}
+
+void Material::bindBaked() const
+{
+    mEngine->renderDevice()->setPipelineState(mBakedPipelineState);
+    bindTextures();
+}
 
+void Material::bindTextures() const
+{
     size_t index = 0;
     for (const auto& texture : mTextures) {
         mEngine->renderDevice()->setTexture(index, texture->instance());
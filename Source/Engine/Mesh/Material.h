@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <memory>
+#include <cstdint>
 
 struct MaterialData;
 class Engine;
@@ -14,11 +15,28 @@ public:
     Material(Engine* engine, const MaterialData* data);
     ~Material();
 
+    bool supportsInstancing() const { return mInstancedPipelineState != nullptr; }
+    bool supportsBakedPoses() const { return mBakedPipelineState != nullptr; }
+
+    // Pipeline and material bits of RenderQueue keys
+    uint32_t sortKey() const { return mSortKey; }
+    uint32_t instancedSortKey() const { return mInstancedSortKey; }
+
     void bind() const;
+    void bindInstanced() const;
+    void bindBaked() const;
 
 private:
     Engine* mEngine;
     std::unique_ptr<IPipelineState> mPipelineState;
+    std::unique_ptr<IPipelineState> mInstancedPipelineState;
+    std::unique_ptr<IPipelineState> mBakedPipelineState;
     std::shared_ptr<Shader> mShader;
+    std::shared_ptr<Shader> mInstancedShader;
+    std::shared_ptr<Shader> mBakedShader;
     std::vector<std::shared_ptr<Texture>> mTextures;
+    uint32_t mSortKey;
+    uint32_t mInstancedSortKey;
+
+    void bindTextures() const;
 };
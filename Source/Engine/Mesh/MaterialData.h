@@ -10,4 +10,6 @@ struct MaterialData
     const TextureData* const* textures;
     const ShaderCode* shader;
     VertexFormat (*vertexFormat)(void);
+    const ShaderCode* instancedShader; // optional
+    const ShaderCode* bakedShader; // optional, instanced skinning from MeshData::bakedPoses
 };
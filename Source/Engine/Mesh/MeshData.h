@@ -4,9 +4,11 @@
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/quaternion.hpp>
+#include <cmath>
 #include <cstdint>
 
 struct MaterialData;
+struct TextureData;
 
 struct MeshVertex
 {
@@ -56,21 +58,51 @@ struct MeshSkeleton
     glm::mat4 globalInverseTransform;
 };
 
+// Key times are frame indices; frame F is at F * MeshAnimation::ticksPerFrame ticks.
+
 struct MeshPositionKey
 {
-    float time;
+    uint16_t frame;
     glm::vec3 position;
 };
 
 struct MeshRotationKey
 {
-    float time;
-    glm::quat rotation;
+    uint16_t frame;
+    uint16_t rotation[3];
+
+    // Smallest-three encoding: the largest component is dropped and rebuilt from the unit length,
+    // the other three are 15-bit fixed point in [-1/sqrt(2), 1/sqrt(2)]. The index of the dropped
+    // component is kept in the top bits of the first two words.
+    glm::quat decodeRotation() const
+    {
+        float q[4];
+        decodeRotation(q);
+        return glm::quat(q[3], q[0], q[1], q[2]);
+    }
+
+    // The same as x, y, z and w, without branching on the dropped component
+    void decodeRotation(float* xyzw) const
+    {
+        static const uint8_t Order[4][4] = { { 3, 0, 1, 2 }, { 0, 3, 1, 2 }, { 0, 1, 3, 2 }, { 0, 1, 2, 3 } };
+
+        const float scale = 1.41421356f / 32767.0f;
+        float v[4];
+        v[0] = float(rotation[0] & 0x7fff) * scale - 0.70710678f;
+        v[1] = float(rotation[1] & 0x7fff) * scale - 0.70710678f;
+        v[2] = float(rotation[2] & 0x7fff) * scale - 0.70710678f;
+        float ww = 1.0f - v[0] * v[0] - v[1] * v[1] - v[2] * v[2];
+        v[3] = std::sqrt(ww > 0.0f ? ww : 0.0f);
+
+        const uint8_t* order = Order[(rotation[0] >> 15) | ((rotation[1] >> 15) << 1)];
+        for (int i = 0; i < 4; i++)
+            xyzw[i] = v[order[i]];
+    }
 };
 
 struct MeshScaleKey
 {
-    float time;
+    uint16_t frame;
     glm::vec3 scale;
 };
 
@@ -88,9 +120,20 @@ struct MeshAnimation
 {
     float durationInTicks;
     float ticksPerSecond;
+    float ticksPerFrame;
     const MeshBoneAnimation* boneAnimations;
 };
 
+// Animation sampled at MeshData::bakedFrameRate into rows firstFrame..firstFrame+frameCount-1
+// of MeshData::bakedPoses. Each row holds the 3x4 skinning matrix of every bone, one matrix
+// row per texel, so bone B of frame F starts at texel (B * 3, F).
+struct MeshBakedAnimation
+{
+    const MeshAnimation* animation;
+    unsigned firstFrame;
+    unsigned frameCount;
+};
+
 struct MeshMaterial
 {
     unsigned firstIndex;
@@ -111,4 +154,11 @@ struct MeshData
     size_t indexCount;
     size_t materialCount;
     size_t boneCount;
+    const TextureData* bakedPoses;
+    const MeshBakedAnimation* bakedAnimations;
+    size_t bakedAnimationCount;
+    float bakedFrameRate;
+    // Encloses the vertices as skinned by the bind pose and by every frame of the animations
+    glm::vec3 boundingSphereCenter;
+    float boundingSphereRadius;
 };
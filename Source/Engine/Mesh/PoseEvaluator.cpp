@@ -0,0 +1,922 @@
+#include "PoseEvaluator.h"
+#include "Engine/Mesh/MeshData.h"
+#include <glm/gtc/quaternion.hpp>
+#include <glm/matrix.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define POSE_EVALUATOR_SSE 1
+#include <emmintrin.h>
+#else
+#define POSE_EVALUATOR_SSE 0
+#endif
+
+// The AVX path is compiled in wherever SSE is and taken if the CPU turns out to have AVX and FMA
+#if POSE_EVALUATOR_SSE && (defined(__GNUC__) || defined(_MSC_VER))
+#define POSE_EVALUATOR_AVX 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define AVX_TARGET
+#else
+#define AVX_TARGET __attribute__((target("avx,fma")))
+#endif
+#else
+#define POSE_EVALUATOR_AVX 0
+#endif
+
+namespace
+{
+    // Below this |dot| the rotation keys are far enough apart for nlerp to visibly drift from slerp
+    const float NlerpMinDot = 0.995f;
+    const float OnlerpA[4] = { 1.0904f, -3.2452f, 3.55645f, -1.43519f };
+    const float OnlerpB[3] = { 0.848013f, -1.06021f, 0.215638f };
+
+    // A cursor that falls further behind than this switches to a binary search of the remaining keys
+    const uint32_t MaxLinearKeySteps = 8;
+
+    // Lanes of four bones, padded to whole pairs so that the AVX path can take eight at a time
+    size_t laneCount(size_t boneCount)
+    {
+        return (boneCount + 7) / 8 * 2;
+    }
+
+    // Finds the keys around time and the times they are at, which may lie outside the animation
+    // when time falls between its last and first key. Both are the same key if time is on one.
+    template <class T> void findKeys(float time, float duration, const T* keys, size_t keyCount,
+        uint32_t& cursor, const T*& key1, const T*& key2, float& key1Time, float& key2Time)
+    {
+        assert(keyCount >= 2);
+
+        const T* begin = keys;
+        const T* end = keys + keyCount;
+        auto compare = [](const T& value, float t) -> bool { return float(value.frame) < t; };
+
+        if (cursor > keyCount)
+            key2 = std::lower_bound(begin, end, time, compare);
+        else {
+            key2 = begin + cursor;
+            for (uint32_t step = 0; key2 != end && float(key2->frame) < time; step++, ++key2) {
+                if (step == MaxLinearKeySteps) {
+                    key2 = std::lower_bound(key2, end, time, compare);
+                    break;
+                }
+            }
+        }
+        cursor = uint32_t(key2 - begin);
+
+        if (key2 != end && float(key2->frame) == time) {
+            key1 = key2;
+            key1Time = key2Time = time;
+            return;
+        }
+
+        if (key2 != begin && key2 != end) {
+            key1 = key2 - 1;
+            key1Time = float(key1->frame);
+            key2Time = float(key2->frame);
+        } else {
+            key1 = end - 1;
+            if (key2 == begin) {
+                key1Time = -(duration - float(key1->frame));
+                assert(key1Time <= 0.0f);
+                key2Time = float(key2->frame);
+            } else {
+                key2 = begin;
+                key1Time = float(key1->frame);
+                key2Time = duration;
+            }
+        }
+        assert(time >= key1Time && time <= key2Time);
+    }
+
+    // The values of a channel hold while time is within [time1, time2]; a single value holds forever
+    inline void setSpan(float& time1, float& time2, float& rate, float key1Time, float key2Time)
+    {
+        time1 = key1Time;
+        time2 = key2Time;
+        rate = (key2Time > key1Time ? 1.0f / (key2Time - key1Time) : 0.0f);
+    }
+
+    inline void setConstant(float& time1, float& time2, float& rate)
+    {
+        time1 = -FLT_MAX;
+        time2 = FLT_MAX;
+        rate = 0.0f;
+    }
+
+  #if POSE_EVALUATOR_SSE
+    inline __m128 lerp(__m128 a, __m128 b, __m128 factor)
+    {
+        return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), factor));
+    }
+
+    // acos(x) for x in [0, 1] (Abramowitz & Stegun 4.4.46), within 2e-8
+    inline __m128 acosUnit(__m128 x)
+    {
+        __m128 p = _mm_set1_ps(-0.0012624911f);
+        p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(0.0066700901f));
+        p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(-0.0170881256f));
+        p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(0.0308918810f));
+        p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(-0.0501743046f));
+        p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(0.0889789874f));
+        p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(-0.2145988016f));
+        p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(1.5707963050f));
+        return _mm_mul_ps(p, _mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), x)));
+    }
+
+    // sin(x) for x in [0, pi/2] by its Taylor series to x^11, within 6e-8
+    inline __m128 sinQuarterTurn(__m128 x)
+    {
+        __m128 x2 = _mm_mul_ps(x, x);
+        __m128 p = _mm_set1_ps(-1.0f / 39916800.0f);
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(1.0f / 362880.0f));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-1.0f / 5040.0f));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(1.0f / 120.0f));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-1.0f / 6.0f));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(1.0f));
+        return _mm_mul_ps(p, x);
+    }
+
+    inline __m128 select(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    // Stores a * m * b for the 3x4 affine matrices of four bones, m an element per register and a
+    // and b in blocks as the evaluator keeps them, a column at a time
+    inline void storeBetween(const float* a, const __m128* m, const float* b, float* result)
+    {
+        #define A(e) _mm_load_ps(a + (e) * 8)
+        #define B(e) _mm_load_ps(b + (e) * 8)
+
+        for (int j = 0; j < 4; j++) {
+            __m128 mb[3];
+            for (int r = 0; r < 3; r++) {
+                mb[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[r], B(j * 3)), _mm_mul_ps(m[3 + r], B(j * 3 + 1))),
+                                   _mm_mul_ps(m[6 + r], B(j * 3 + 2)));
+                if (j == 3)
+                    mb[r] = _mm_add_ps(mb[r], m[9 + r]);
+            }
+            for (int r = 0; r < 3; r++) {
+                __m128 amb = _mm_add_ps(_mm_add_ps(_mm_mul_ps(A(r), mb[0]), _mm_mul_ps(A(3 + r), mb[1])),
+                                        _mm_mul_ps(A(6 + r), mb[2]));
+                if (j == 3)
+                    amb = _mm_add_ps(amb, A(9 + r));
+                _mm_store_ps(result + (j * 3 + r) * 8, amb);
+            }
+        }
+
+        #undef B
+        #undef A
+    }
+  #endif
+
+  #if POSE_EVALUATOR_AVX
+    bool cpuHasAvx()
+    {
+      #if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 1);
+        bool osSavesAvxState = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+        return osSavesAvxState && (info[2] & (1 << 28)) && (info[2] & (1 << 12));
+      #else
+        return __builtin_cpu_supports("avx") && __builtin_cpu_supports("fma");
+      #endif
+    }
+
+    inline int lowestBit(unsigned bits)
+    {
+      #if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return int(index);
+      #else
+        return __builtin_ctz(bits);
+      #endif
+    }
+
+    AVX_TARGET inline __m256 lerp(__m256 a, __m256 b, __m256 factor)
+    {
+        return _mm256_fmadd_ps(_mm256_sub_ps(b, a), factor, a);
+    }
+
+    // As acosUnit() and sinQuarterTurn() above
+    AVX_TARGET inline __m256 acosUnit(__m256 x)
+    {
+        __m256 p = _mm256_set1_ps(-0.0012624911f);
+        p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(0.0066700901f));
+        p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(-0.0170881256f));
+        p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(0.0308918810f));
+        p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(-0.0501743046f));
+        p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(0.0889789874f));
+        p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(-0.2145988016f));
+        p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(1.5707963050f));
+        return _mm256_mul_ps(p, _mm256_sqrt_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), x)));
+    }
+
+    AVX_TARGET inline __m256 sinQuarterTurn(__m256 x)
+    {
+        __m256 x2 = _mm256_mul_ps(x, x);
+        __m256 p = _mm256_set1_ps(-1.0f / 39916800.0f);
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(1.0f / 362880.0f));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(-1.0f / 5040.0f));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(1.0f / 120.0f));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(-1.0f / 6.0f));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(1.0f));
+        return _mm256_mul_ps(p, x);
+    }
+
+    AVX_TARGET inline void storeBetween(const float* a, const __m256* m, const float* b, float* result)
+    {
+        #define A(e) _mm256_loadu_ps(a + (e) * 8)
+        #define B(e) _mm256_loadu_ps(b + (e) * 8)
+
+        for (int j = 0; j < 4; j++) {
+            __m256 mb[3];
+            for (int r = 0; r < 3; r++) {
+                mb[r] = (j == 3 ? _mm256_fmadd_ps(m[r], B(j * 3), m[9 + r]) : _mm256_mul_ps(m[r], B(j * 3)));
+                mb[r] = _mm256_fmadd_ps(m[6 + r], B(j * 3 + 2), _mm256_fmadd_ps(m[3 + r], B(j * 3 + 1), mb[r]));
+            }
+            for (int r = 0; r < 3; r++) {
+                __m256 amb = (j == 3 ? _mm256_fmadd_ps(A(r), mb[0], A(9 + r)) : _mm256_mul_ps(A(r), mb[0]));
+                amb = _mm256_fmadd_ps(A(6 + r), mb[2], _mm256_fmadd_ps(A(3 + r), mb[1], amb));
+                _mm256_storeu_ps(result + (j * 3 + r) * 8, amb);
+            }
+        }
+
+        #undef B
+        #undef A
+    }
+  #endif
+}
+
+PoseSkeleton::PoseSkeleton(const MeshBone* bones, size_t boneCount, const glm::mat4& globalInverseTransform)
+    : mBones(bones)
+    , mBoneCount(boneCount)
+    , mGlobalInverseTransform(globalInverseTransform)
+    , mHierarchyOrder(new uint8_t[boneCount])
+{
+    // Parents come before their children in the bone list, so their depths are known first
+    std::unique_ptr<uint8_t[]> depths(new uint8_t[boneCount]);
+    for (size_t i = 0; i < boneCount; i++) {
+        uint8_t parent = bones[i].parentIndex;
+        assert(parent == MeshBone::InvalidIndex || parent < i);
+        depths[i] = (parent == MeshBone::InvalidIndex ? 0 : depths[parent] + 1);
+        mHierarchyOrder[i] = uint8_t(i);
+    }
+    std::stable_sort(mHierarchyOrder.get(), mHierarchyOrder.get() + boneCount,
+        [&depths](uint8_t a, uint8_t b) { return depths[a] < depths[b]; });
+
+  #if POSE_EVALUATOR_SSE
+    mOffsets.reset(new float[boneCount * 12]);
+    mParentOffsetInverses.reset(new float[boneCount * 12]);
+    for (size_t i = 0; i < boneCount; i++) {
+        const glm::mat4& m = bones[i].matrix;
+        assert(m[0][3] == 0.0f && m[1][3] == 0.0f && m[2][3] == 0.0f && m[3][3] == 1.0f);
+
+        uint8_t parent = bones[i].parentIndex;
+        glm::mat4 inverse = (parent == MeshBone::InvalidIndex ? glm::mat4(1.0f)
+            : glm::mat4(glm::inverse(glm::dmat4(bones[parent].matrix))));
+        for (int j = 0; j < 4; j++) {
+            for (int k = 0; k < 3; k++) {
+                mOffsets[i * 12 + j * 3 + k] = m[j][k];
+                mParentOffsetInverses[i * 12 + j * 3 + k] = inverse[j][k];
+            }
+        }
+    }
+  #endif
+}
+
+PoseSkeleton::~PoseSkeleton()
+{
+}
+
+PoseEvaluator::PoseEvaluator(const PoseSkeleton& skeleton, bool allowAvx)
+    : mSkeleton(&skeleton)
+    , mBones(skeleton.bones())
+    , mBoneCount(skeleton.boneCount())
+    , mLaneCount(laneCount(skeleton.boneCount()))
+    , mChannels(new Lane[ChannelCount * laneCount(skeleton.boneCount())])
+    , mLocalMatrices(new Lane[MatrixElementCount * laneCount(skeleton.boneCount())]())
+  #if POSE_EVALUATOR_SSE
+    , mSlotOffsets(new Lane[MatrixElementCount * laneCount(skeleton.boneCount())]())
+    , mSlotParentOffsetInverses(new Lane[MatrixElementCount * laneCount(skeleton.boneCount())]())
+  #else
+    , mGlobalMatrices(new glm::mat4[skeleton.boneCount()])
+  #endif
+    , mKeyCursors(new KeyCursor[skeleton.boneCount()]())
+    , mBoneSlots(new uint8_t[skeleton.boneCount()])
+    , mSlotBones(new uint8_t[skeleton.boneCount()])
+    , mHierarchySteps(new HierarchyStep[skeleton.boneCount()])
+    , mAnimatedLaneCount(0)
+    , mChangedLanes(new uint32_t[laneCount(skeleton.boneCount())])
+    , mChangedLaneCount(0)
+    , mCursorAnimation(nullptr)
+    , mCursorTime(0.0f)
+  #if POSE_EVALUATOR_AVX
+    , mAvx(allowAvx && cpuHasAvx())
+  #else
+    , mAvx(false)
+  #endif
+{
+  #if !POSE_EVALUATOR_AVX
+    (void)allowAvx;
+  #endif
+
+
+    // Padding bones at the end of the last lane are never sampled; keep them at identity forever
+    for (int c = 0; c < ChannelCount; c++) {
+        float value;
+        switch (c) {
+            case Rotation1W: case Rotation2W:
+            case Scale1X: case Scale1Y: case Scale1Z:
+            case Scale2X: case Scale2Y: case Scale2Z:
+                value = 1.0f;
+                break;
+            case Position1Time: case Rotation1Time: case Scale1Time:
+                value = -FLT_MAX;
+                break;
+            case Position2Time: case Rotation2Time: case Scale2Time:
+                value = FLT_MAX;
+                break;
+            default:
+                value = 0.0f;
+                break;
+        }
+        for (size_t slot = 0; slot < mLaneCount * 4; slot++)
+            slotChannels(slot)[c * 8] = value;
+    }
+}
+
+PoseEvaluator::~PoseEvaluator()
+{
+}
+
+void PoseEvaluator::evaluate(const MeshAnimation* animation, float timeInTicks, glm::mat4* matrices)
+{
+    size_t sampledLaneCount = mAnimatedLaneCount;
+    if (animation != mCursorAnimation) {
+        sampledLaneCount = mLaneCount;
+        assignSlots(animation);
+
+        // Every channel is looked up again; a span starting after any time is never current
+        for (size_t slot = 0; slot < mBoneCount; slot++) {
+            for (Channel c : { Position1Time, Rotation1Time, Scale1Time })
+                slotChannels(slot)[c * 8] = FLT_MAX;
+        }
+        std::fill(mKeyCursors.get(), mKeyCursors.get() + mBoneCount, KeyCursor());
+    } else if (timeInTicks < mCursorTime) {
+        // Spans that still hold the time stay; lookups of the others start over from the first key
+        std::fill(mKeyCursors.get(), mKeyCursors.get() + mBoneCount, KeyCursor());
+    }
+    mCursorAnimation = animation;
+    mCursorTime = timeInTicks;
+
+    // Keys are searched in frames rather than ticks
+    float time = timeInTicks / animation->ticksPerFrame;
+  #if POSE_EVALUATOR_AVX
+    if (mAvx) {
+        sampleKeysAvx(animation, time, sampledLaneCount);
+        interpolateAndComposeAvx(time);
+        buildHierarchyAvx(matrices);
+        return;
+    }
+  #endif
+    sampleKeys(animation, time, sampledLaneCount);
+    interpolateAndCompose(time);
+    buildHierarchy(matrices);
+}
+
+void PoseEvaluator::assignSlots(const MeshAnimation* animation)
+{
+    size_t slot = 0;
+    for (int animated = 1; animated >= 0; animated--) {
+        for (size_t i = 0; i < mBoneCount; i++) {
+            const MeshBoneAnimation& anim = animation->boneAnimations[i];
+            bool hasKeys = (anim.positionKeys && anim.positionKeyCount > 1)
+                || (anim.rotationKeys && anim.rotationKeyCount > 1)
+                || (anim.scaleKeys && anim.scaleKeyCount > 1);
+            if (hasKeys == bool(animated)) {
+                mBoneSlots[i] = uint8_t(slot);
+                mSlotBones[slot++] = uint8_t(i);
+            }
+        }
+        if (animated)
+            mAnimatedLaneCount = laneCount(slot);
+    }
+    assert(slot == mBoneCount);
+
+    for (size_t k = 0; k < mBoneCount; k++) {
+        uint8_t boneIndex = mSkeleton->mHierarchyOrder[k];
+        HierarchyStep& step = mHierarchySteps[k];
+        step.localMatrix = uint16_t(slotMatrix(mLocalMatrices, mBoneSlots[boneIndex]) - mLocalMatrices[0].v);
+        step.bone = boneIndex;
+        step.parent = mBones[boneIndex].parentIndex;
+    }
+
+  #if POSE_EVALUATOR_SSE
+    for (size_t i = 0; i < mBoneCount; i++) {
+        float* offset = slotMatrix(mSlotOffsets, mBoneSlots[i]);
+        float* parentOffsetInverse = slotMatrix(mSlotParentOffsetInverses, mBoneSlots[i]);
+        for (int e = 0; e < MatrixElementCount; e++) {
+            offset[e * 8] = mSkeleton->mOffsets[i * 12 + e];
+            parentOffsetInverse[e * 8] = mSkeleton->mParentOffsetInverses[i * 12 + e];
+        }
+    }
+  #endif
+}
+
+void PoseEvaluator::sampleKeys(const MeshAnimation* animation, float time, size_t sampledLaneCount)
+{
+    mChangedLaneCount = 0;
+    float duration = animation->durationInTicks / animation->ticksPerFrame;
+
+  #if POSE_EVALUATOR_SSE
+    const __m128 t = _mm_set1_ps(time);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (size_t lane = 0; lane < sampledLaneCount; lane++) {
+        const float* ch = slotChannels(lane * 4);
+        #define LOAD(c) _mm_load_ps(ch + (c) * 8)
+        #define STALE(c1, c2) _mm_movemask_ps(_mm_or_ps(_mm_cmplt_ps(t, LOAD(c1)), _mm_cmpgt_ps(t, LOAD(c2))))
+
+        int position = STALE(Position1Time, Position2Time);
+        int rotation = STALE(Rotation1Time, Rotation2Time);
+        int scale = STALE(Scale1Time, Scale2Time);
+
+        // Rates are never negative, so their bits are all zero only if every channel holds one value
+        __m128 rates = _mm_or_ps(_mm_or_ps(LOAD(PositionRate), LOAD(RotationRate)), LOAD(ScaleRate));
+
+        #undef STALE
+        #undef LOAD
+
+        if (position | rotation | scale) {
+            for (int i = 0; i < 4; i++) {
+                int channels = (((position >> i) & 1) ? PositionChannel : 0)
+                    | (((rotation >> i) & 1) ? RotationChannel : 0)
+                    | (((scale >> i) & 1) ? ScaleChannel : 0);
+                if (channels)
+                    sampleBone(animation, lane * 4 + i, channels, time, duration);
+            }
+        } else if (_mm_movemask_ps(_mm_cmpneq_ps(rates, zero)) == 0)
+            continue;
+
+        mChangedLanes[mChangedLaneCount++] = uint32_t(lane);
+    }
+  #else
+    size_t count = std::min(mBoneCount, sampledLaneCount * 4);
+    for (size_t i = 0; i < count; i++) {
+        const float* ch = slotChannels(i);
+        #define CH(c) ch[(c) * 8]
+        int channels = ((time < CH(Position1Time) || time > CH(Position2Time)) ? PositionChannel : 0)
+            | ((time < CH(Rotation1Time) || time > CH(Rotation2Time)) ? RotationChannel : 0)
+            | ((time < CH(Scale1Time) || time > CH(Scale2Time)) ? ScaleChannel : 0);
+        #undef CH
+        if (channels)
+            sampleBone(animation, i, channels, time, duration);
+    }
+  #endif
+}
+
+void PoseEvaluator::sampleBone(const MeshAnimation* animation, size_t i, int channels, float time, float duration)
+{
+    assert(i < mBoneCount);
+
+    size_t boneIndex = mSlotBones[i];
+    const MeshBoneAnimation* anim = &animation->boneAnimations[boneIndex];
+    KeyCursor& cursor = mKeyCursors[boneIndex];
+    float* ch = slotChannels(i);
+    float key1Time;
+    float key2Time;
+
+    #define CH(c) ch[(c) * 8]
+
+    if (channels & PositionChannel) {
+        if (!anim->positionKeys || anim->positionKeyCount < 2) {
+            glm::vec3 position = (anim->positionKeys && anim->positionKeyCount > 0 ? anim->positionKeys->position : glm::vec3(0.0f));
+            for (int c = 0; c < 3; c++)
+                CH(Position1X + c) = CH(Position2X + c) = position[c];
+            setConstant(CH(Position1Time), CH(Position2Time), CH(PositionRate));
+        } else {
+            const MeshPositionKey* key1;
+            const MeshPositionKey* key2;
+            findKeys(time, duration, anim->positionKeys, anim->positionKeyCount, cursor.position, key1, key2, key1Time, key2Time);
+            for (int c = 0; c < 3; c++) {
+                CH(Position1X + c) = key1->position[c];
+                CH(Position2X + c) = key2->position[c];
+            }
+            setSpan(CH(Position1Time), CH(Position2Time), CH(PositionRate), key1Time, key2Time);
+        }
+    }
+
+    if (channels & RotationChannel) {
+        if (!anim->rotationKeys || anim->rotationKeyCount < 2) {
+            glm::quat rotation = (anim->rotationKeys && anim->rotationKeyCount > 0 ? anim->rotationKeys->decodeRotation() : glm::quat());
+            for (int c = 0; c < 4; c++)
+                CH(Rotation1X + c) = CH(Rotation2X + c) = rotation[c];
+            setConstant(CH(Rotation1Time), CH(Rotation2Time), CH(RotationRate));
+        } else {
+            const MeshRotationKey* key1;
+            const MeshRotationKey* key2;
+            findKeys(time, duration, anim->rotationKeys, anim->rotationKeyCount, cursor.rotation, key1, key2, key1Time, key2Time);
+
+            float rotation1[4];
+            float rotation2[4];
+            uint32_t key1Index = uint32_t(key1 - anim->rotationKeys);
+            uint32_t key2Index = uint32_t(key2 - anim->rotationKeys);
+            if (key2Index + 1 != cursor.decodedRotation)
+                key2->decodeRotation(rotation2);
+            else {
+                for (int c = 0; c < 4; c++)
+                    rotation2[c] = CH(Rotation2X + c);
+            }
+            if (key1 == key2) {
+                for (int c = 0; c < 4; c++)
+                    rotation1[c] = rotation2[c];
+            } else if (key1Index + 1 == cursor.decodedRotation) {
+                for (int c = 0; c < 4; c++)
+                    rotation1[c] = CH(Rotation2X + c);
+            } else
+                key1->decodeRotation(rotation1);
+            cursor.decodedRotation = key2Index + 1;
+
+            for (int c = 0; c < 4; c++) {
+                CH(Rotation1X + c) = rotation1[c];
+                CH(Rotation2X + c) = rotation2[c];
+            }
+            setSpan(CH(Rotation1Time), CH(Rotation2Time), CH(RotationRate), key1Time, key2Time);
+        }
+    }
+
+    if (channels & ScaleChannel) {
+        if (!anim->scaleKeys || anim->scaleKeyCount < 2) {
+            glm::vec3 scale = (anim->scaleKeys && anim->scaleKeyCount > 0 ? anim->scaleKeys->scale : glm::vec3(1.0f));
+            for (int c = 0; c < 3; c++)
+                CH(Scale1X + c) = CH(Scale2X + c) = scale[c];
+            setConstant(CH(Scale1Time), CH(Scale2Time), CH(ScaleRate));
+        } else {
+            const MeshScaleKey* key1;
+            const MeshScaleKey* key2;
+            findKeys(time, duration, anim->scaleKeys, anim->scaleKeyCount, cursor.scale, key1, key2, key1Time, key2Time);
+            for (int c = 0; c < 3; c++) {
+                CH(Scale1X + c) = key1->scale[c];
+                CH(Scale2X + c) = key2->scale[c];
+            }
+            setSpan(CH(Scale1Time), CH(Scale2Time), CH(ScaleRate), key1Time, key2Time);
+        }
+    }
+
+    #undef CH
+}
+
+void PoseEvaluator::interpolateAndCompose(float time)
+{
+  #if POSE_EVALUATOR_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 minDot = _mm_set1_ps(NlerpMinDot);
+    const __m128 t = _mm_set1_ps(time);
+
+    for (size_t k = 0; k < mChangedLaneCount; k++) {
+        size_t lane = mChangedLanes[k];
+        const float* ch = slotChannels(lane * 4);
+
+        #define LOAD(c) _mm_load_ps(ch + (c) * 8)
+        #define FACTOR(c1, rate) _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(t, LOAD(c1)), LOAD(rate)), zero), one)
+
+        __m128 pf = FACTOR(Position1Time, PositionRate);
+        __m128 px = lerp(LOAD(Position1X), LOAD(Position2X), pf);
+        __m128 py = lerp(LOAD(Position1Y), LOAD(Position2Y), pf);
+        __m128 pz = lerp(LOAD(Position1Z), LOAD(Position2Z), pf);
+
+        __m128 sf = FACTOR(Scale1Time, ScaleRate);
+        __m128 sx = lerp(LOAD(Scale1X), LOAD(Scale2X), sf);
+        __m128 sy = lerp(LOAD(Scale1Y), LOAD(Scale2Y), sf);
+        __m128 sz = lerp(LOAD(Scale1Z), LOAD(Scale2Z), sf);
+
+        // nlerp along the shortest arc
+        __m128 ax = LOAD(Rotation1X), ay = LOAD(Rotation1Y), az = LOAD(Rotation1Z), aw = LOAD(Rotation1W);
+        __m128 bx = LOAD(Rotation2X), by = LOAD(Rotation2Y), bz = LOAD(Rotation2Z), bw = LOAD(Rotation2W);
+        __m128 rf = FACTOR(Rotation1Time, RotationRate);
+
+        #undef FACTOR
+        #undef LOAD
+
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+                                _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+        __m128 sign = _mm_and_ps(dot, signMask);
+        bx = _mm_xor_ps(bx, sign);
+        by = _mm_xor_ps(by, sign);
+        bz = _mm_xor_ps(bz, sign);
+        bw = _mm_xor_ps(bw, sign);
+
+        __m128 qx = lerp(ax, bx, rf);
+        __m128 qy = lerp(ay, by, rf);
+        __m128 qz = lerp(az, bz, rf);
+        __m128 qw = lerp(aw, bw, rf);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)),
+                                               _mm_add_ps(_mm_mul_ps(qz, qz), _mm_mul_ps(qw, qw))));
+        __m128 invLength = _mm_div_ps(one, length);
+        qx = _mm_mul_ps(qx, invLength);
+        qy = _mm_mul_ps(qy, invLength);
+        qz = _mm_mul_ps(qz, invLength);
+        qw = _mm_mul_ps(qw, invLength);
+
+        // Lanes whose keys are too far apart for nlerp take slerp, computed like glm::slerp does
+        __m128 cosTheta = _mm_xor_ps(dot, sign);
+        __m128 slerpMask = _mm_cmplt_ps(cosTheta, minDot);
+        if (_mm_movemask_ps(slerpMask)) {
+            __m128 theta = acosUnit(_mm_min_ps(cosTheta, one));
+            __m128 invSinTheta = _mm_div_ps(one, sinQuarterTurn(theta));
+            __m128 wa = _mm_mul_ps(sinQuarterTurn(_mm_mul_ps(_mm_sub_ps(one, rf), theta)), invSinTheta);
+            __m128 wb = _mm_mul_ps(sinQuarterTurn(_mm_mul_ps(rf, theta)), invSinTheta);
+
+            qx = select(slerpMask, _mm_add_ps(_mm_mul_ps(ax, wa), _mm_mul_ps(bx, wb)), qx);
+            qy = select(slerpMask, _mm_add_ps(_mm_mul_ps(ay, wa), _mm_mul_ps(by, wb)), qy);
+            qz = select(slerpMask, _mm_add_ps(_mm_mul_ps(az, wa), _mm_mul_ps(bz, wb)), qz);
+            qw = select(slerpMask, _mm_add_ps(_mm_mul_ps(aw, wa), _mm_mul_ps(bw, wb)), qw);
+        }
+
+        // translate(position) * mat4_cast(rotation) * scale(scale), stored as 3x4
+        __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+        __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+        __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+        __m128 m[MatrixElementCount];
+        m[M00] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+        m[M01] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+        m[M02] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+
+        m[M10] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+        m[M11] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+        m[M12] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+
+        m[M20] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+        m[M21] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+        m[M22] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+
+        m[M30] = px;
+        m[M31] = py;
+        m[M32] = pz;
+
+        storeBetween(slotMatrix(mSlotParentOffsetInverses, lane * 4), m, slotMatrix(mSlotOffsets, lane * 4),
+            slotMatrix(mLocalMatrices, lane * 4));
+    }
+  #else
+    for (size_t i = 0; i < mBoneCount; i++) {
+        const float* in = slotChannels(i);
+        #define IN(c) in[(c) * 8]
+        #define OUT(c) slotMatrix(mLocalMatrices, i)[(c) * 8]
+
+        #define FACTOR(c1, rate) glm::clamp((time - IN(c1)) * IN(rate), 0.0f, 1.0f)
+
+        float pf = FACTOR(Position1Time, PositionRate);
+        glm::vec3 p1(IN(Position1X), IN(Position1Y), IN(Position1Z));
+        glm::vec3 p2(IN(Position2X), IN(Position2Y), IN(Position2Z));
+        glm::vec3 p = p1 + (p2 - p1) * pf;
+
+        float sf = FACTOR(Scale1Time, ScaleRate);
+        glm::vec3 s1(IN(Scale1X), IN(Scale1Y), IN(Scale1Z));
+        glm::vec3 s2(IN(Scale2X), IN(Scale2Y), IN(Scale2Z));
+        glm::vec3 s = s1 + (s2 - s1) * sf;
+
+        float rf = FACTOR(Rotation1Time, RotationRate);
+        glm::quat r1(IN(Rotation1W), IN(Rotation1X), IN(Rotation1Y), IN(Rotation1Z));
+        glm::quat r2(IN(Rotation2W), IN(Rotation2X), IN(Rotation2Y), IN(Rotation2Z));
+        float dot = glm::dot(r1, r2);
+        glm::quat q;
+        if (fabsf(dot) < NlerpMinDot)
+            q = glm::slerp(r1, r2, rf);
+        else {
+            if (dot < 0.0f)
+                r2 = -r2;
+            q = glm::normalize(glm::quat(
+                r1.w + (r2.w - r1.w) * rf,
+                r1.x + (r2.x - r1.x) * rf,
+                r1.y + (r2.y - r1.y) * rf,
+                r1.z + (r2.z - r1.z) * rf));
+        }
+
+        glm::mat3 m = glm::mat3_cast(q);
+        OUT(M00) = m[0][0] * s.x; OUT(M01) = m[0][1] * s.x; OUT(M02) = m[0][2] * s.x;
+        OUT(M10) = m[1][0] * s.y; OUT(M11) = m[1][1] * s.y; OUT(M12) = m[1][2] * s.y;
+        OUT(M20) = m[2][0] * s.z; OUT(M21) = m[2][1] * s.z; OUT(M22) = m[2][2] * s.z;
+        OUT(M30) = p.x;           OUT(M31) = p.y;           OUT(M32) = p.z;
+
+        #undef FACTOR
+        #undef IN
+        #undef OUT
+    }
+  #endif
+}
+
+void PoseEvaluator::buildHierarchy(glm::mat4* matrices)
+{
+    for (size_t k = 0; k < mBoneCount; k++) {
+        const HierarchyStep& step = mHierarchySteps[k];
+        size_t boneIndex = step.bone;
+        const float* l = mLocalMatrices[0].v + step.localMatrix;
+        #define L(c) l[(c) * 8]
+
+        uint8_t parentBone = step.parent;
+
+      #if POSE_EVALUATOR_SSE
+        // matrices = parent's * what interpolateAndCompose() left, whose bottom row is (0, 0, 0, 1)
+        const glm::mat4* parent = (parentBone == MeshBone::InvalidIndex ? &mSkeleton->globalInverseTransform() : &matrices[parentBone]);
+        const float* p = &(*parent)[0][0];
+        __m128 p0 = _mm_loadu_ps(p + 0);
+        __m128 p1 = _mm_loadu_ps(p + 4);
+        __m128 p2 = _mm_loadu_ps(p + 8);
+        __m128 p3 = _mm_loadu_ps(p + 12);
+
+        float* out = &matrices[boneIndex][0][0];
+        for (int j = 0; j < 4; j++) {
+            __m128 r = _mm_mul_ps(p0, _mm_set1_ps(L(M00 + j * 3 + 0)));
+            r = _mm_add_ps(r, _mm_mul_ps(p1, _mm_set1_ps(L(M00 + j * 3 + 1))));
+            r = _mm_add_ps(r, _mm_mul_ps(p2, _mm_set1_ps(L(M00 + j * 3 + 2))));
+            if (j == 3)
+                r = _mm_add_ps(r, p3);
+            _mm_storeu_ps(out + j * 4, r);
+        }
+      #else
+        const glm::mat4* parent = (parentBone == MeshBone::InvalidIndex ? &mSkeleton->globalInverseTransform() : &mGlobalMatrices[parentBone]);
+        glm::mat4 transform(
+            L(M00), L(M01), L(M02), 0.0f,
+            L(M10), L(M11), L(M12), 0.0f,
+            L(M20), L(M21), L(M22), 0.0f,
+            L(M30), L(M31), L(M32), 1.0f);
+
+        mGlobalMatrices[boneIndex] = *parent * transform;
+        matrices[boneIndex] = mGlobalMatrices[boneIndex] * mBones[boneIndex].matrix;
+      #endif
+
+        #undef L
+    }
+}
+
+#if POSE_EVALUATOR_AVX
+AVX_TARGET void PoseEvaluator::sampleKeysAvx(const MeshAnimation* animation, float time, size_t sampledLaneCount)
+{
+    mChangedLaneCount = 0;
+    float duration = animation->durationInTicks / animation->ticksPerFrame;
+
+    const __m256 t = _mm256_set1_ps(time);
+    const __m256 zero = _mm256_setzero_ps();
+
+    for (size_t lane = 0; lane < sampledLaneCount; lane += 2) {
+        const float* ch = slotChannels(lane * 4);
+        #define LOAD(c) _mm256_loadu_ps(ch + (c) * 8)
+        #define STALE(c1, c2) _mm256_movemask_ps(_mm256_or_ps(_mm256_cmp_ps(t, LOAD(c1), _CMP_LT_OQ), \
+            _mm256_cmp_ps(t, LOAD(c2), _CMP_GT_OQ)))
+
+        int position = STALE(Position1Time, Position2Time);
+        int rotation = STALE(Rotation1Time, Rotation2Time);
+        int scale = STALE(Scale1Time, Scale2Time);
+
+        __m256 rates = _mm256_or_ps(_mm256_or_ps(LOAD(PositionRate), LOAD(RotationRate)), LOAD(ScaleRate));
+
+        #undef STALE
+        #undef LOAD
+
+        if (unsigned stale = unsigned(position | rotation | scale)) {
+            do {
+                int i = lowestBit(stale);
+                int channels = (((position >> i) & 1) ? PositionChannel : 0)
+                    | (((rotation >> i) & 1) ? RotationChannel : 0)
+                    | (((scale >> i) & 1) ? ScaleChannel : 0);
+                sampleBone(animation, lane * 4 + i, channels, time, duration);
+                stale &= stale - 1;
+            } while (stale);
+        } else if (_mm256_movemask_ps(_mm256_cmp_ps(rates, zero, _CMP_NEQ_UQ)) == 0)
+            continue;
+
+        mChangedLanes[mChangedLaneCount++] = uint32_t(lane);
+    }
+}
+
+AVX_TARGET void PoseEvaluator::interpolateAndComposeAvx(float time)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    const __m256 c0 = _mm256_set1_ps(OnlerpA[0]), c1 = _mm256_set1_ps(OnlerpA[1]);
+    const __m256 c2 = _mm256_set1_ps(OnlerpA[2]), c3 = _mm256_set1_ps(OnlerpA[3]);
+    const __m256 b0 = _mm256_set1_ps(OnlerpB[0]), b1 = _mm256_set1_ps(OnlerpB[1]), b2 = _mm256_set1_ps(OnlerpB[2]);
+    const __m256 t = _mm256_set1_ps(time);
+
+    for (size_t k = 0; k < mChangedLaneCount; k++) {
+        size_t lane = mChangedLanes[k];
+        const float* ch = slotChannels(lane * 4);
+
+        #define LOAD(c) _mm256_loadu_ps(ch + (c) * 8)
+        #define FACTOR(c1, rate) _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(t, LOAD(c1)), LOAD(rate)), zero), one)
+
+        __m256 pf = FACTOR(Position1Time, PositionRate);
+        __m256 px = lerp(LOAD(Position1X), LOAD(Position2X), pf);
+        __m256 py = lerp(LOAD(Position1Y), LOAD(Position2Y), pf);
+        __m256 pz = lerp(LOAD(Position1Z), LOAD(Position2Z), pf);
+
+        __m256 sf = FACTOR(Scale1Time, ScaleRate);
+        __m256 sx = lerp(LOAD(Scale1X), LOAD(Scale2X), sf);
+        __m256 sy = lerp(LOAD(Scale1Y), LOAD(Scale2Y), sf);
+        __m256 sz = lerp(LOAD(Scale1Z), LOAD(Scale2Z), sf);
+
+        __m256 ax = LOAD(Rotation1X), ay = LOAD(Rotation1Y), az = LOAD(Rotation1Z), aw = LOAD(Rotation1W);
+        __m256 bx = LOAD(Rotation2X), by = LOAD(Rotation2Y), bz = LOAD(Rotation2Z), bw = LOAD(Rotation2W);
+        __m256 rf = FACTOR(Rotation1Time, RotationRate);
+
+        #undef FACTOR
+        #undef LOAD
+
+        __m256 dot = _mm256_add_ps(_mm256_fmadd_ps(ax, bx, _mm256_mul_ps(ay, by)), _mm256_fmadd_ps(az, bz, _mm256_mul_ps(aw, bw)));
+        __m256 sign = _mm256_and_ps(dot, signMask);
+        bx = _mm256_xor_ps(bx, sign);
+        by = _mm256_xor_ps(by, sign);
+        bz = _mm256_xor_ps(bz, sign);
+        bw = _mm256_xor_ps(bw, sign);
+
+        // nlerp with the blend factor bent towards slerp's by a cubic fitted over |dot|
+        __m256 d = _mm256_xor_ps(dot, sign);
+        __m256 ka = _mm256_fmadd_ps(_mm256_fmadd_ps(_mm256_fmadd_ps(d, c3, c2), d, c1), d, c0);
+        __m256 kb = _mm256_fmadd_ps(_mm256_fmadd_ps(d, b2, b1), d, b0);
+        __m256 centered = _mm256_sub_ps(rf, half);
+        __m256 bend = _mm256_fmadd_ps(_mm256_mul_ps(ka, centered), centered, kb);
+        rf = _mm256_fmadd_ps(_mm256_mul_ps(_mm256_mul_ps(rf, centered), _mm256_sub_ps(rf, one)), bend, rf);
+
+        __m256 qx = lerp(ax, bx, rf);
+        __m256 qy = lerp(ay, by, rf);
+        __m256 qz = lerp(az, bz, rf);
+        __m256 qw = lerp(aw, bw, rf);
+
+        // The rotation of q / |q|, with 2 / |q|^2 folded into the scale rather than normalizing q first
+        __m256 lengthSquared = _mm256_add_ps(_mm256_fmadd_ps(qx, qx, _mm256_mul_ps(qy, qy)), _mm256_fmadd_ps(qz, qz, _mm256_mul_ps(qw, qw)));
+        __m256 twoOverLengthSquared = _mm256_div_ps(two, lengthSquared);
+        __m256 tx = _mm256_mul_ps(sx, twoOverLengthSquared);
+        __m256 ty = _mm256_mul_ps(sy, twoOverLengthSquared);
+        __m256 tz = _mm256_mul_ps(sz, twoOverLengthSquared);
+
+        __m256 xx = _mm256_mul_ps(qx, qx), yy = _mm256_mul_ps(qy, qy), zz = _mm256_mul_ps(qz, qz);
+        __m256 xy = _mm256_mul_ps(qx, qy), xz = _mm256_mul_ps(qx, qz), yz = _mm256_mul_ps(qy, qz);
+        __m256 wx = _mm256_mul_ps(qw, qx), wy = _mm256_mul_ps(qw, qy), wz = _mm256_mul_ps(qw, qz);
+
+        __m256 m[MatrixElementCount];
+        m[M00] = _mm256_fnmadd_ps(tx, _mm256_add_ps(yy, zz), sx);
+        m[M01] = _mm256_mul_ps(tx, _mm256_add_ps(xy, wz));
+        m[M02] = _mm256_mul_ps(tx, _mm256_sub_ps(xz, wy));
+
+        m[M10] = _mm256_mul_ps(ty, _mm256_sub_ps(xy, wz));
+        m[M11] = _mm256_fnmadd_ps(ty, _mm256_add_ps(xx, zz), sy);
+        m[M12] = _mm256_mul_ps(ty, _mm256_add_ps(yz, wx));
+
+        m[M20] = _mm256_mul_ps(tz, _mm256_add_ps(xz, wy));
+        m[M21] = _mm256_mul_ps(tz, _mm256_sub_ps(yz, wx));
+        m[M22] = _mm256_fnmadd_ps(tz, _mm256_add_ps(xx, yy), sz);
+
+        m[M30] = px;
+        m[M31] = py;
+        m[M32] = pz;
+
+        storeBetween(slotMatrix(mSlotParentOffsetInverses, lane * 4), m, slotMatrix(mSlotOffsets, lane * 4),
+            slotMatrix(mLocalMatrices, lane * 4));
+    }
+}
+
+AVX_TARGET void PoseEvaluator::buildHierarchyAvx(glm::mat4* matrices)
+{
+    // Two columns at a time: the parent's columns are repeated in both halves of a register and
+    // the elements that scale them are splat into one half each
+    const HierarchyStep* steps = mHierarchySteps.get();
+    const glm::mat4* globalInverse = &mSkeleton->globalInverseTransform();
+    const float* localMatrices = mLocalMatrices[0].v;
+
+    for (size_t k = 0; k < mBoneCount; k++) {
+        HierarchyStep step = steps[k];
+        size_t boneIndex = step.bone;
+        const float* l = localMatrices + step.localMatrix;
+        #define L(c1, c2) _mm256_blend_ps(_mm256_broadcast_ss(&l[(c1) * 8]), _mm256_broadcast_ss(&l[(c2) * 8]), 0xf0)
+
+        uint8_t parentBone = step.parent;
+        const glm::mat4* parent = (parentBone == MeshBone::InvalidIndex ? globalInverse : &matrices[parentBone]);
+
+        const float* p = &(*parent)[0][0];
+        __m256 p0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(p + 0));
+        __m256 p1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(p + 4));
+        __m256 p2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(p + 8));
+        __m256 p3 = _mm256_blend_ps(_mm256_setzero_ps(), _mm256_loadu_ps(p + 8), 0xf0);
+
+        float* out = &matrices[boneIndex][0][0];
+        _mm256_storeu_ps(out + 0, _mm256_fmadd_ps(p2, L(M02, M12), _mm256_fmadd_ps(p1, L(M01, M11), _mm256_mul_ps(p0, L(M00, M10)))));
+        _mm256_storeu_ps(out + 8, _mm256_fmadd_ps(p2, L(M22, M32), _mm256_fmadd_ps(p1, L(M21, M31), _mm256_fmadd_ps(p0, L(M20, M30), p3))));
+
+        #undef L
+    }
+}
+#endif
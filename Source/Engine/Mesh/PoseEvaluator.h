@@ -0,0 +1,180 @@
+#pragma once
+#include <glm/mat4x4.hpp>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+struct MeshAnimation;
+struct MeshBone;
+
+// The constant part of a skeleton that evaluators read: its bones, global inverse transform and
+// what the SIMD paths need of the bone offset matrices. Built once per mesh and shared by all of
+// its evaluators, which must not outlive it. Bone offsets have to be affine.
+class PoseSkeleton
+{
+public:
+    PoseSkeleton(const MeshBone* bones, size_t boneCount, const glm::mat4& globalInverseTransform);
+    ~PoseSkeleton();
+
+    const MeshBone* bones() const { return mBones; }
+    size_t boneCount() const { return mBoneCount; }
+    const glm::mat4& globalInverseTransform() const { return mGlobalInverseTransform; }
+
+private:
+    struct alignas(16) Lane
+    {
+        float v[4];
+    };
+
+    const MeshBone* mBones;
+    size_t mBoneCount;
+    glm::mat4 mGlobalInverseTransform;
+    // Top three rows of each bone's offset matrix and of the inverse of its parent's, identity for
+    // roots, twelve floats per bone column by column
+    std::unique_ptr<float[]> mOffsets;
+    std::unique_ptr<float[]> mParentOffsetInverses;
+    // Bones by depth in the hierarchy, so that those composed one after another rarely wait
+    // for each other's matrices
+    std::unique_ptr<uint8_t[]> mHierarchyOrder;
+
+    friend class PoseEvaluator;
+};
+
+// Evaluates skinning matrices for a skeleton. Keys are gathered into structure-of-arrays
+// buffers, so interpolation and TRS composition can run on four bones at a time, or eight
+// where the CPU has AVX and FMA.
+// The pair of keys around the current time is kept for each channel along with the times
+// they span, and is only looked up again once time leaves that span; the check and the blend
+// factors run on four bones at a time too. Most channels of an animation hold a single key
+// and are never looked up again until the animation changes.
+// Key lookups resume from the previous lookup's position while time moves forward; they start
+// over from the first key when the animation changes or time jumps back (loop or seek).
+// Rotation keys are decoded from their compact form as they are gathered, each once per span.
+// The AVX path blends rotations with nlerp, its blend factor bent towards slerp's by a curve
+// fitted over the angle between the keys, and so never needs a square root or a sine.
+// Bones take their places in the lanes per animation, those with keys to interpolate first, so
+// that the lanes of bones that hold still are composed once and left alone.
+// The SIMD paths keep each local matrix between the inverse of the parent's offset and the bone's
+// own offset. A bone's skinning matrix is then its parent's times that, one product per bone in
+// the hierarchy, which has to go bone by bone.
+class PoseEvaluator
+{
+public:
+    // allowAvx = false keeps to four bones at a time, so that checks can compare both paths
+    explicit PoseEvaluator(const PoseSkeleton& skeleton, bool allowAvx = true);
+    ~PoseEvaluator();
+
+    bool usesAvx() const { return mAvx; }
+
+    // Keys are kept between calls for as long as the same animation, told apart by its address,
+    // is evaluated
+    void evaluate(const MeshAnimation* animation, float timeInTicks, glm::mat4* matrices);
+
+private:
+    struct KeyCursor
+    {
+        uint32_t position;
+        uint32_t rotation;
+        uint32_t scale;
+        // One past the index of the rotation key decoded into the Rotation2 channels, or zero. When
+        // time moves on to the next span, that key starts it and needs no decoding again.
+        uint32_t decodedRotation;
+    };
+
+    typedef PoseSkeleton::Lane Lane;
+
+    // A bone's turn in the hierarchy pass: where its local matrix starts, in floats from the first,
+    // and which bones it and its parent are
+    struct HierarchyStep
+    {
+        uint16_t localMatrix;
+        uint8_t bone;
+        uint8_t parent;
+    };
+
+    enum Channel
+    {
+        // Times of the two keys in frames, and 1 / their distance
+        Position1Time, Position2Time, PositionRate,
+        Position1X, Position1Y, Position1Z,
+        Position2X, Position2Y, Position2Z,
+        Rotation1Time, Rotation2Time, RotationRate,
+        Rotation1X, Rotation1Y, Rotation1Z, Rotation1W,
+        Rotation2X, Rotation2Y, Rotation2Z, Rotation2W,
+        Scale1Time, Scale2Time, ScaleRate,
+        Scale1X, Scale1Y, Scale1Z,
+        Scale2X, Scale2Y, Scale2Z,
+        ChannelCount
+    };
+
+    // Elements of the 3x4 matrices kept per bone
+    enum MatrixElement
+    {
+        M00, M01, M02, // column 0
+        M10, M11, M12,
+        M20, M21, M22,
+        M30, M31, M32,
+        MatrixElementCount
+    };
+
+    const PoseSkeleton* mSkeleton;
+    const MeshBone* mBones;
+    size_t mBoneCount;
+    size_t mLaneCount;
+    // Channels per place in the lanes, in blocks of eight places like the matrices below
+    std::unique_ptr<Lane[]> mChannels;
+    // Matrices per place in the lanes, in blocks of eight places, element by element, so that the
+    // elements of any one place lie at fixed distances from each other: local matrices, and the
+    // offset matrices that the SIMD paths put them between
+    std::unique_ptr<Lane[]> mLocalMatrices;
+    std::unique_ptr<Lane[]> mSlotOffsets;
+    std::unique_ptr<Lane[]> mSlotParentOffsetInverses;
+    // Global matrices of the bones, kept by the path without SIMD only
+    std::unique_ptr<glm::mat4[]> mGlobalMatrices;
+    std::unique_ptr<KeyCursor[]> mKeyCursors;
+    // Place of each bone in the lanes, and the bone at each place
+    std::unique_ptr<uint8_t[]> mBoneSlots;
+    std::unique_ptr<uint8_t[]> mSlotBones;
+    // Bones in the order the skeleton composes them, with where their places put them
+    std::unique_ptr<HierarchyStep[]> mHierarchySteps;
+    // Lanes, in whole pairs, that hold bones with keys to interpolate. Once sampled for an
+    // animation, the others never change again.
+    size_t mAnimatedLaneCount;
+    // Lanes whose local matrices change this frame; those of the others are kept from before.
+    // With AVX the lanes go in pairs, listed by the first of each.
+    std::unique_ptr<uint32_t[]> mChangedLanes;
+    size_t mChangedLaneCount;
+    const MeshAnimation* mCursorAnimation;
+    float mCursorTime;
+    bool mAvx;
+
+    // Channel c of a place is at slotChannels(slot)[c * 8]
+    float* slotChannels(size_t slot) const
+    {
+        return mChannels[slot / 8 * ChannelCount * 2].v + slot % 8;
+    }
+    // Element e of the matrix is at slotMatrix(matrices, slot)[e * 8]
+    static float* slotMatrix(const std::unique_ptr<Lane[]>& matrices, size_t slot)
+    {
+        return matrices[slot / 8 * MatrixElementCount * 2].v + slot % 8;
+    }
+
+    enum ChannelMask
+    {
+        PositionChannel = 1,
+        RotationChannel = 2,
+        ScaleChannel = 4,
+    };
+
+    void assignSlots(const MeshAnimation* animation);
+    // Only the first sampledLaneCount lanes are looked at
+    void sampleKeys(const MeshAnimation* animation, float time, size_t sampledLaneCount);
+    void sampleBone(const MeshAnimation* animation, size_t slot, int channels, float time, float duration);
+    void interpolateAndCompose(float time);
+    void buildHierarchy(glm::mat4* matrices);
+
+    // The same on eight bones at a time, compiled for AVX and FMA whatever the rest of the engine targets
+    void sampleKeysAvx(const MeshAnimation* animation, float time, size_t sampledLaneCount);
+    void interpolateAndComposeAvx(float time);
+    void buildHierarchyAvx(glm::mat4* matrices);
+};
@@ -0,0 +1,110 @@
+#include "StaticBatch.h"
+#include "Engine/Core/Engine.h"
+#include "Engine/Mesh/Material.h"
+#include "Engine/Renderer/RenderQueue.h"
+#include "Engine/ResMgr/ResourceManager.h"
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/mat3x3.hpp>
+#include <cassert>
+
+namespace
+{
+    const uint32_t NoVertex = ~0u;
+}
+
+StaticBatch::StaticBatch(Engine* engine)
+    : mEngine(engine)
+    , mBuilt(false)
+{
+}
+
+StaticBatch::~StaticBatch()
+{
+    if (mBuilt) {
+        for (const auto& batch : mBatches)
+            mEngine->geometryArena()->free(batch.geometry);
+    }
+}
+
+void StaticBatch::add(const MeshData* mesh, const glm::mat4& modelMatrix)
+{
+    assert(!mBuilt);
+
+    glm::mat3 matrix = glm::mat3(modelMatrix);
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(matrix));
+
+    for (size_t i = 0; i < mesh->materialCount; i++) {
+        const MeshMaterial& element = mesh->materials[i];
+        const uint16_t* indices = mesh->indices + element.firstIndex;
+
+        // Only the vertices the element uses are copied, numbered in the order they are first used
+        mRemap.assign(mesh->vertexCount, NoVertex);
+        uint32_t vertexCount = 0;
+        for (unsigned j = 0; j < element.indexCount; j++) {
+            if (mRemap[indices[j]] == NoVertex)
+                mRemap[indices[j]] = vertexCount++;
+        }
+
+        auto it = mOpenBatches.find(element.material);
+        if (it == mOpenBatches.end() || mBatches[it->second].vertices.size() + vertexCount > MaxVerticesPerBatch) {
+            Batch batch;
+            batch.materialData = element.material;
+            batch.geometry = GeometryArena::InvalidId;
+            mBatches.emplace_back(std::move(batch));
+            mOpenBatches[element.material] = mBatches.size() - 1;
+            it = mOpenBatches.find(element.material);
+        }
+
+        Batch& batch = mBatches[it->second];
+        size_t firstVertex = batch.vertices.size();
+        batch.vertices.resize(firstVertex + vertexCount);
+        for (size_t j = 0; j < mesh->vertexCount; j++) {
+            if (mRemap[j] == NoVertex)
+                continue;
+
+            const MeshVertex& src = mesh->vertices[j];
+            MeshVertex& dst = batch.vertices[firstVertex + mRemap[j]];
+            dst.position = glm::vec3(modelMatrix * glm::vec4(src.position, 1.0f));
+            dst.normal = glm::normalize(normalMatrix * src.normal);
+            dst.tangent = glm::normalize(matrix * src.tangent);
+            dst.bitangent = glm::normalize(matrix * src.bitangent);
+            dst.texCoord = src.texCoord;
+        }
+
+        for (unsigned j = 0; j < element.indexCount; j++)
+            batch.indices.emplace_back(uint16_t(firstVertex + mRemap[indices[j]]));
+    }
+}
+
+void StaticBatch::build()
+{
+    assert(!mBuilt);
+    mBuilt = true;
+
+    for (auto& batch : mBatches) {
+        batch.material = mEngine->resourceManager()->cachedMaterial(batch.materialData);
+        batch.vertices.shrink_to_fit();
+        batch.indices.shrink_to_fit();
+
+        GeometryArena::Geometry geometry;
+        geometry.streams[0] = batch.vertices.data();
+        geometry.strides[0] = sizeof(MeshVertex);
+        geometry.vertexCount = batch.vertices.size();
+        geometry.indices = batch.indices.data();
+        geometry.indexCount = batch.indices.size();
+        batch.geometry = mEngine->geometryArena()->allocate(geometry);
+    }
+
+    mOpenBatches.clear();
+    std::vector<uint32_t>().swap(mRemap);
+}
+
+void StaticBatch::submit(RenderQueue* queue) const
+{
+    assert(mBuilt);
+    for (const auto& batch : mBatches) {
+        const auto& range = mEngine->geometryArena()->range(batch.geometry);
+        queue->submit(RenderQueue::Opaque, batch.material.get(), glm::mat4(1.0f), *range.vertexBuffers[0], *range.indexBuffer,
+            range.firstIndex, unsigned(batch.indices.size()), range.baseVertex);
+    }
+}
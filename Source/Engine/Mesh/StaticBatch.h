@@ -0,0 +1,53 @@
+#pragma once
+#include "Engine/Mesh/MeshData.h"
+#include "Engine/Renderer/GeometryArena.h"
+#include <glm/mat4x4.hpp>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct MaterialData;
+class Engine;
+class Material;
+class RenderQueue;
+
+// Meshes that never move, transformed into world space and merged per material into one range of
+// the geometry arena each, so that they take a few draws in total. A batch is split where its
+// vertices would no longer fit 16-bit indices.
+class StaticBatch
+{
+public:
+    explicit StaticBatch(Engine* engine);
+    ~StaticBatch();
+
+    StaticBatch(const StaticBatch&) = delete;
+    StaticBatch& operator=(const StaticBatch&) = delete;
+
+    void add(const MeshData* mesh, const glm::mat4& modelMatrix);
+
+    // Uploads the batches; nothing can be added afterwards. Their vertices are kept for the arena,
+    // which uploads them again when it moves them.
+    void build();
+
+    void submit(RenderQueue* queue) const;
+
+    size_t batchCount() const { return mBatches.size(); }
+
+private:
+    enum { MaxVerticesPerBatch = 0x10000 };
+
+    struct Batch
+    {
+        const MaterialData* materialData;
+        std::shared_ptr<Material> material;
+        std::vector<MeshVertex> vertices;
+        std::vector<uint16_t> indices;
+        GeometryArena::Id geometry;
+    };
+
+    Engine* mEngine;
+    std::vector<Batch> mBatches;
+    std::unordered_map<const MaterialData*, size_t> mOpenBatches; // batch still taking vertices per material
+    std::vector<uint32_t> mRemap; // mesh vertex to batch vertex
+    bool mBuilt;
+};
@@ -5,12 +5,27 @@
 #include "Engine/Mesh/Material.h"
 #include "Engine/Renderer/IRenderDevice.h"
 #include "Engine/Renderer/IRenderBuffer.h"
+#include "Engine/Renderer/RenderQueue.h"
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/mat3x3.hpp>
+#include <cassert>
+#include <vector>
 
 StaticMesh::StaticMesh(Engine* engine, const MeshData* data)
     : mEngine(engine)
 {
-    mVertexBuffer = mEngine->renderDevice()->createBufferWithData(data->vertices, data->vertexCount * sizeof(MeshVertex));
-    mIndexBuffer = mEngine->renderDevice()->createBufferWithData(data->indices, data->indexCount * sizeof(uint16_t));
+    GeometryArena::Geometry geometry;
+    geometry.streams[0] = data->vertices;
+    geometry.strides[0] = sizeof(MeshVertex);
+    if (data->skinningVertices) {
+        assert(data->skinningVertexCount == data->vertexCount);
+        geometry.streams[1] = data->skinningVertices;
+        geometry.strides[1] = sizeof(MeshSkinningVertex);
+    }
+    geometry.vertexCount = data->vertexCount;
+    geometry.indices = data->indices;
+    geometry.indexCount = data->indexCount;
+    mGeometry = mEngine->geometryArena()->allocate(geometry);
 
     mElements.reserve(data->materialCount);
     for (size_t i = 0; i < data->materialCount; i++) {
@@ -24,13 +39,60 @@ StaticMesh::StaticMesh(Engine* engine, const MeshData* data)
 
 StaticMesh::~StaticMesh()
 {
+    mEngine->geometryArena()->free(mGeometry);
+}
+
+const GeometryArena::Range& StaticMesh::geometry() const
+{
+    return mEngine->geometryArena()->range(mGeometry);
 }
 
 void StaticMesh::render() const
 {
-    mEngine->renderDevice()->setVertexBuffer(0, mVertexBuffer);
+    const auto& range = geometry();
+    mEngine->renderDevice()->setVertexBuffer(0, *range.vertexBuffers[0]);
     for (const auto& e : mElements) {
         e.material->bind();
-        mEngine->renderDevice()->drawIndexedPrimitive(mIndexBuffer, e.firstIndex, e.indexCount);
+        mEngine->renderDevice()->drawIndexedPrimitive(*range.indexBuffer,
+            range.firstIndex + e.firstIndex, e.indexCount, range.baseVertex);
+    }
+}
+
+void StaticMesh::submit(RenderQueue* queue, const glm::mat4& modelMatrix) const
+{
+    const auto& range = geometry();
+    for (const auto& e : mElements) {
+        queue->submit(RenderQueue::Opaque, e.material.get(), modelMatrix, *range.vertexBuffers[0], *range.indexBuffer,
+            range.firstIndex + e.firstIndex, e.indexCount, range.baseVertex);
+    }
+}
+
+bool StaticMesh::supportsInstancing() const
+{
+    for (const auto& e : mElements) {
+        if (!e.material->supportsInstancing())
+            return false;
+    }
+    return true;
+}
+
+std::unique_ptr<IRenderBuffer> StaticMesh::createInstanceBuffer(const glm::mat4* modelMatrices, size_t count) const
+{
+    std::vector<Instance> instances(count);
+    for (size_t i = 0; i < count; i++) {
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrices[i])));
+        instances[i].modelMatrix = glm::mat3x4(glm::transpose(modelMatrices[i]));
+        instances[i].normalMatrix = glm::mat3x4(glm::transpose(normalMatrix));
+    }
+    return mEngine->renderDevice()->createBufferWithData(instances.data(), count * sizeof(Instance));
+}
+
+void StaticMesh::submitInstanced(RenderQueue* queue, const glm::vec3& position,
+    const std::unique_ptr<IRenderBuffer>& instanceBuffer, unsigned instanceCount) const
+{
+    const auto& range = geometry();
+    for (const auto& e : mElements) {
+        queue->submitInstanced(RenderQueue::Opaque, e.material.get(), position, *range.vertexBuffers[0], *range.indexBuffer,
+            range.firstIndex + e.firstIndex, e.indexCount, instanceBuffer, instanceCount, range.baseVertex);
     }
 }
@@ -1,4 +1,8 @@
 #pragma once
+#include "Engine/Renderer/GeometryArena.h"
+#include <glm/mat3x4.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
 #include <vector>
 #include <memory>
 
@@ -6,15 +10,37 @@ struct MeshData;
 class Engine;
 class Material;
 class IRenderBuffer;
+class RenderQueue;
 
 class StaticMesh
 {
 public:
+    // Per-instance data of instanced shaders, StaticInstance in the shaders. Matrices are transposed
+    // and truncated to 3x4 like the palettes of AnimatedMesh.
+    struct Instance
+    {
+        glm::mat3x4 modelMatrix;
+        glm::mat3x4 normalMatrix;
+    };
+
     StaticMesh(Engine* engine, const MeshData* data);
     virtual ~StaticMesh();
 
     virtual void render() const;
 
+    // Queues a draw per element instead of drawing right away
+    void submit(RenderQueue* queue, const glm::mat4& modelMatrix) const;
+
+    // Whether all materials have an instanced shader
+    bool supportsInstancing() const;
+
+    // Instance buffer for submitInstanced(), to be created once for objects that do not move
+    std::unique_ptr<IRenderBuffer> createInstanceBuffer(const glm::mat4* modelMatrices, size_t count) const;
+
+    // Queues an instanced draw per element; position is where the instances are sorted by depth
+    void submitInstanced(RenderQueue* queue, const glm::vec3& position,
+        const std::unique_ptr<IRenderBuffer>& instanceBuffer, unsigned instanceCount) const;
+
 protected:
     struct Element
     {
@@ -25,6 +51,8 @@ protected:
 
     Engine* mEngine;
     std::vector<Element> mElements;
-    std::unique_ptr<IRenderBuffer> mVertexBuffer;
-    std::unique_ptr<IRenderBuffer> mIndexBuffer;
+    GeometryArena::Id mGeometry; // skinning vertices, if any, are stream 1
+
+    // Where the vertices and indices are in the arena this frame
+    const GeometryArena::Range& geometry() const;
 };
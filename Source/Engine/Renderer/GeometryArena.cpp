@@ -0,0 +1,273 @@
+#include "GeometryArena.h"
+#include "Engine/Renderer/IRenderDevice.h"
+#include "Engine/Renderer/IRenderBuffer.h"
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+GeometryArena::GeometryArena(IRenderDevice* device)
+    : mDevice(device)
+    , mFrame(0)
+    , mFreedSinceCompaction(false)
+{
+    mIndexPool.strides[0] = sizeof(uint16_t);
+    for (int i = 1; i < MaxStreams; i++)
+        mIndexPool.strides[i] = 0;
+    mIndexPool.pageCapacity = IndicesPerPage;
+}
+
+GeometryArena::~GeometryArena()
+{
+    assert(allocationCount() == 0);
+}
+
+GeometryArena::Id GeometryArena::allocate(const Geometry& geometry)
+{
+    assert(geometry.vertexCount > 0 && geometry.indexCount > 0);
+
+    Id id;
+    if (!mFreeIds.empty()) {
+        id = mFreeIds.back();
+        mFreeIds.pop_back();
+    } else {
+        id = Id(mAllocations.size());
+        mAllocations.emplace_back();
+    }
+
+    Allocation& allocation = mAllocations[id];
+    allocation.source = geometry;
+    allocation.vertexPool = vertexPool(geometry);
+    allocation.vertexPage = allocateSpan(allocation.vertexPool, unsigned(geometry.vertexCount), true, allocation.range.baseVertex);
+    allocation.indexPage = allocateSpan(&mIndexPool, unsigned(geometry.indexCount), true, allocation.range.firstIndex);
+    uploadVertices(allocation);
+    uploadIndices(allocation);
+    return id;
+}
+
+void GeometryArena::free(Id id)
+{
+    assert(id < mAllocations.size() && mAllocations[id].vertexPage != nullptr);
+
+    Allocation& allocation = mAllocations[id];
+    retireSpan(allocation.vertexPage, allocation.range.baseVertex, unsigned(allocation.source.vertexCount));
+    retireSpan(allocation.indexPage, allocation.range.firstIndex, unsigned(allocation.source.indexCount));
+    allocation.vertexPage = nullptr;
+    allocation.indexPage = nullptr;
+    mFreeIds.emplace_back(id);
+}
+
+const GeometryArena::Range& GeometryArena::range(Id id) const
+{
+    assert(id < mAllocations.size() && mAllocations[id].vertexPage != nullptr);
+    return mAllocations[id].range;
+}
+
+void GeometryArena::compact()
+{
+    ++mFrame;
+    releaseRetiredSpans();
+
+    if (!mFreedSinceCompaction)
+        return;
+    mFreedSinceCompaction = false;
+
+    // Pages less than a quarter used are emptied into the others, except for the fullest of them,
+    // so that sparse pages can still be merged when the other pages are full
+    auto markRetiring = [](Pool* pool) {
+        Page* fullest = nullptr;
+        for (const auto& page : pool->pages) {
+            page->retiring = (page->used * 4 < page->capacity);
+            if (page->retiring && (!fullest || page->used > fullest->used))
+                fullest = page.get();
+        }
+        if (fullest && fullest->used > 0)
+            fullest->retiring = false;
+    };
+    for (const auto& pool : mVertexPools)
+        markRetiring(pool.get());
+    markRetiring(&mIndexPool);
+
+    // Allocations that find no room elsewhere stay where they are
+    for (auto& allocation : mAllocations) {
+        if (!allocation.vertexPage)
+            continue;
+
+        if (allocation.vertexPage->retiring) {
+            unsigned baseVertex;
+            unsigned count = unsigned(allocation.source.vertexCount);
+            if (Page* page = allocateSpan(allocation.vertexPool, count, false, baseVertex)) {
+                retireSpan(allocation.vertexPage, allocation.range.baseVertex, count);
+                allocation.vertexPage = page;
+                allocation.range.baseVertex = baseVertex;
+                uploadVertices(allocation);
+            }
+        }
+
+        if (allocation.indexPage->retiring) {
+            unsigned firstIndex;
+            unsigned count = unsigned(allocation.source.indexCount);
+            if (Page* page = allocateSpan(&mIndexPool, count, false, firstIndex)) {
+                retireSpan(allocation.indexPage, allocation.range.firstIndex, count);
+                allocation.indexPage = page;
+                allocation.range.firstIndex = firstIndex;
+                uploadIndices(allocation);
+            }
+        }
+    }
+
+    // What was moved out is retired, so the pages emptied are released some frames later
+    for (const auto& pool : mVertexPools) {
+        for (auto& page : pool->pages)
+            page->retiring = false;
+    }
+    for (auto& page : mIndexPool.pages)
+        page->retiring = false;
+}
+
+size_t GeometryArena::pageCount() const
+{
+    size_t count = mIndexPool.pages.size();
+    for (const auto& pool : mVertexPools)
+        count += pool->pages.size();
+    return count;
+}
+
+GeometryArena::Pool* GeometryArena::vertexPool(const Geometry& geometry)
+{
+    for (const auto& pool : mVertexPools) {
+        if (std::equal(pool->strides, pool->strides + MaxStreams, geometry.strides))
+            return pool.get();
+    }
+
+    std::unique_ptr<Pool> pool(new Pool);
+    std::copy(geometry.strides, geometry.strides + MaxStreams, pool->strides);
+    pool->pageCapacity = VerticesPerPage;
+    mVertexPools.emplace_back(std::move(pool));
+    return mVertexPools.back().get();
+}
+
+GeometryArena::Page* GeometryArena::allocateSpan(Pool* pool, unsigned size, bool mayGrow, unsigned& offset)
+{
+    // First fit
+    for (const auto& page : pool->pages) {
+        if (page->retiring)
+            continue;
+
+        for (auto it = page->freeSpans.begin(); it != page->freeSpans.end(); ++it) {
+            if (it->size < size)
+                continue;
+
+            offset = it->offset;
+            it->offset += size;
+            it->size -= size;
+            if (it->size == 0)
+                page->freeSpans.erase(it);
+            page->used += size;
+            return page.get();
+        }
+    }
+
+    if (!mayGrow)
+        return nullptr;
+
+    // Geometry larger than a page gets a page of its own size
+    std::unique_ptr<Page> page(new Page);
+    page->capacity = std::max(pool->pageCapacity, size);
+    page->used = size;
+    page->retired = 0;
+    page->retiring = false;
+    for (int i = 0; i < MaxStreams; i++) {
+        if (pool->strides[i] > 0)
+            page->buffers[i] = mDevice->createStaticBuffer(size_t(page->capacity) * pool->strides[i]);
+    }
+    if (size < page->capacity)
+        page->freeSpans.push_back({ size, page->capacity - size });
+
+    offset = 0;
+    pool->pages.emplace_back(std::move(page));
+    return pool->pages.back().get();
+}
+
+void GeometryArena::retireSpan(Page* page, unsigned offset, unsigned size)
+{
+    assert(page->used >= size);
+    page->used -= size;
+    page->retired += size;
+    mRetiredSpans.push_back({ page, { offset, size }, mFrame });
+}
+
+void GeometryArena::freeSpan(Page* page, unsigned offset, unsigned size)
+{
+    assert(page->retired >= size);
+    page->retired -= size;
+
+    // Merged with the free spans it touches
+    auto next = std::lower_bound(page->freeSpans.begin(), page->freeSpans.end(), offset,
+        [](const Span& span, unsigned value) { return span.offset < value; });
+    bool joinsPrev = (next != page->freeSpans.begin() && std::prev(next)->offset + std::prev(next)->size == offset);
+    bool joinsNext = (next != page->freeSpans.end() && offset + size == next->offset);
+
+    if (joinsPrev && joinsNext) {
+        std::prev(next)->size += size + next->size;
+        page->freeSpans.erase(next);
+    } else if (joinsPrev) {
+        std::prev(next)->size += size;
+    } else if (joinsNext) {
+        next->offset = offset;
+        next->size += size;
+    } else {
+        page->freeSpans.insert(next, { offset, size });
+    }
+}
+
+void GeometryArena::uploadVertices(Allocation& allocation)
+{
+    const Geometry& source = allocation.source;
+    for (int i = 0; i < MaxStreams; i++) {
+        if (source.strides[i] == 0) {
+            allocation.range.vertexBuffers[i] = nullptr;
+            continue;
+        }
+
+        const auto& buffer = allocation.vertexPage->buffers[i];
+        buffer->updateData(size_t(allocation.range.baseVertex) * source.strides[i],
+            source.streams[i], source.vertexCount * source.strides[i]);
+        allocation.range.vertexBuffers[i] = &buffer;
+    }
+}
+
+void GeometryArena::uploadIndices(Allocation& allocation)
+{
+    const Geometry& source = allocation.source;
+    const auto& buffer = allocation.indexPage->buffers[0];
+    buffer->updateData(size_t(allocation.range.firstIndex) * sizeof(uint16_t),
+        source.indices, source.indexCount * sizeof(uint16_t));
+    allocation.range.indexBuffer = &buffer;
+}
+
+void GeometryArena::releaseRetiredSpans()
+{
+    // Spans retired during frame N may be drawn from by frames up to N itself, which are all done
+    // once framesInFlight more frames have begun
+    uint64_t framesInFlight = mDevice->framesInFlight();
+    bool released = false;
+    while (!mRetiredSpans.empty() && mFrame - mRetiredSpans.front().frame > framesInFlight) {
+        const RetiredSpan& retired = mRetiredSpans.front();
+        freeSpan(retired.page, retired.span.offset, retired.span.size);
+        mRetiredSpans.pop_front();
+        released = true;
+    }
+
+    if (released) {
+        for (const auto& pool : mVertexPools)
+            releaseEmptyPages(pool.get());
+        releaseEmptyPages(&mIndexPool);
+        mFreedSinceCompaction = true;
+    }
+}
+
+void GeometryArena::releaseEmptyPages(Pool* pool)
+{
+    pool->pages.erase(std::remove_if(pool->pages.begin(), pool->pages.end(),
+        [](const std::unique_ptr<Page>& page) { return page->used == 0 && page->retired == 0; }), pool->pages.end());
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+class IRenderBuffer;
+class IRenderDevice;
+
+// Vertices and indices of many meshes sub-allocated from a few large static buffers, so that draws
+// of different meshes share their buffer bindings and differ only in base vertex and first index.
+// A base vertex applies to all vertex streams alike, so vertices are kept in a pool per layout
+// whose pages hold one buffer per stream; indices of all layouts share one pool. Freed ranges are
+// reused, and compact() moves allocations out of mostly free pages so that those can be released.
+// Frames in flight may still draw from where an allocation was, so freed ranges are retired for
+// that many frames before they are reused, and pages are released only once they are empty.
+class GeometryArena
+{
+public:
+    enum { MaxStreams = 2 };
+
+    typedef uint32_t Id;
+    static const Id InvalidId = ~0u;
+
+    struct Geometry
+    {
+        const void* streams[MaxStreams] = {};
+        unsigned strides[MaxStreams] = {}; // zero for unused streams
+        size_t vertexCount = 0;
+        const uint16_t* indices = nullptr;
+        size_t indexCount = 0;
+    };
+
+    // Indices are relative to baseVertex, so each allocation still fits 16-bit indices
+    struct Range
+    {
+        const std::unique_ptr<IRenderBuffer>* vertexBuffers[MaxStreams];
+        const std::unique_ptr<IRenderBuffer>* indexBuffer;
+        unsigned baseVertex;
+        unsigned firstIndex;
+    };
+
+    explicit GeometryArena(IRenderDevice* device);
+    ~GeometryArena();
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    // Copies the geometry into the arena. Its data has to stay alive until free(), since compact()
+    // uploads it again where the allocation moves to.
+    Id allocate(const Geometry& geometry);
+    void free(Id id);
+
+    // Where the geometry is now; valid until the next compact()
+    const Range& range(Id id) const;
+
+    // Called once per frame, not while draws are being queued. Makes ranges retired long enough ago
+    // free again and releases pages left empty, then, if that freed something, moves allocations
+    // out of pages that are mostly free.
+    void compact();
+
+    size_t pageCount() const;
+    size_t allocationCount() const { return mAllocations.size() - mFreeIds.size(); }
+
+private:
+    enum
+    {
+        VerticesPerPage = 1 << 17,
+        IndicesPerPage = 1 << 20,
+    };
+
+    struct Span
+    {
+        unsigned offset;
+        unsigned size;
+    };
+
+    struct Page
+    {
+        std::unique_ptr<IRenderBuffer> buffers[MaxStreams];
+        unsigned capacity;
+        unsigned used;
+        unsigned retired;            // in mRetiredSpans, neither used nor free yet
+        std::vector<Span> freeSpans; // sorted by offset, never adjacent
+        bool retiring;               // being emptied by compact()
+    };
+
+    struct Pool
+    {
+        unsigned strides[MaxStreams];
+        unsigned pageCapacity;
+        std::vector<std::unique_ptr<Page>> pages;
+    };
+
+    struct RetiredSpan
+    {
+        Page* page;
+        Span span;
+        uint64_t frame;
+    };
+
+    struct Allocation
+    {
+        Geometry source;
+        Pool* vertexPool;
+        Page* vertexPage;
+        Page* indexPage;
+        Range range;
+    };
+
+    IRenderDevice* mDevice;
+    std::vector<std::unique_ptr<Pool>> mVertexPools;
+    Pool mIndexPool;
+    std::vector<Allocation> mAllocations;
+    std::vector<Id> mFreeIds;
+    std::deque<RetiredSpan> mRetiredSpans; // oldest first
+    uint64_t mFrame; // compact() calls so far
+    bool mFreedSinceCompaction; // retired spans made free again
+
+    Pool* vertexPool(const Geometry& geometry);
+    Page* allocateSpan(Pool* pool, unsigned size, bool mayGrow, unsigned& offset);
+    void retireSpan(Page* page, unsigned offset, unsigned size);
+    static void freeSpan(Page* page, unsigned offset, unsigned size);
+    void uploadVertices(Allocation& allocation);
+    void uploadIndices(Allocation& allocation);
+    void releaseRetiredSpans();
+    static void releaseEmptyPages(Pool* pool);
+};
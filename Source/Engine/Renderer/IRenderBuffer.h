@@ -1,8 +1,13 @@
 #pragma once
+#include <cstddef>
 
 class IRenderBuffer
 {
 public:
     virtual ~IRenderBuffer() = default;
-    virtual unsigned uploadData(const void* data) = 0;
+    // Writes the first size bytes of the buffer's next per-frame copy; returns the copy's offset
+    virtual unsigned uploadData(const void* data, size_t size) = 0;
+
+    // Writes part of a static buffer, which no draw in flight may be reading
+    virtual void updateData(size_t offset, const void* data, size_t size) = 0;
 };
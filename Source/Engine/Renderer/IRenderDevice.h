@@ -2,6 +2,9 @@
 #include <glm/vec2.hpp>
 #include <glm/mat4x4.hpp>
 #include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
 
 struct ShaderCode;
 struct TextureData;
@@ -16,15 +19,65 @@ enum PrimitiveType
     Triangles,
 };
 
+// Bindings requested through the set*() calls of a frame, and those that changed anything and were
+// passed on to the GPU API
+struct BindingCounters
+{
+    struct Binds
+    {
+        uint64_t requested = 0;
+        uint64_t issued = 0;
+
+        Binds& operator+=(const Binds& other)
+        {
+            requested += other.requested;
+            issued += other.issued;
+            return *this;
+        }
+    };
+
+    Binds pipelines;
+    Binds vertexBuffers;
+    Binds indexBuffers;
+    Binds textures;
+    Binds uniforms;
+
+    BindingCounters& operator+=(const BindingCounters& other)
+    {
+        pipelines += other.pipelines;
+        vertexBuffers += other.vertexBuffers;
+        indexBuffers += other.indexBuffers;
+        textures += other.textures;
+        uniforms += other.uniforms;
+        return *this;
+    }
+};
+
+struct GpuTiming
+{
+    const char* name;
+    unsigned depth;     // 0 for the outermost scopes
+    double start;       // seconds since the start of the frame's GPU work
+    double duration;    // seconds
+};
+
 class IRenderDevice
 {
 public:
     virtual ~IRenderDevice() = default;
 
+    // Which device renders and the paths it takes where devices differ, for benchmark reports
+    virtual std::string description() const = 0;
+
     virtual glm::vec2 viewportSize() const = 0;
 
+    // Frames the GPU may still be reading from while the CPU prepares the next one
+    virtual uint32_t framesInFlight() const = 0;
+
     virtual std::unique_ptr<IRenderBuffer> createBuffer(size_t size) = 0;
     virtual std::unique_ptr<IRenderBuffer> createBufferWithData(const void* data, size_t size) = 0;
+    // Like createBufferWithData(), but filled later in parts through IRenderBuffer::updateData()
+    virtual std::unique_ptr<IRenderBuffer> createStaticBuffer(size_t size) = 0;
     virtual std::unique_ptr<ITexture> createTexture(const TextureData* data) = 0;
     virtual std::unique_ptr<IShaderProgram> createShaderProgram(const ShaderCode* code) = 0;
     virtual std::unique_ptr<IPipelineState> createPipelineState(PrimitiveType primitiveType,
@@ -38,12 +91,64 @@ public:
     virtual void setPipelineState(const std::unique_ptr<IPipelineState>& state) = 0;
     virtual void setVertexBuffer(int index, const std::unique_ptr<IRenderBuffer>& buffer, unsigned offset = 0) = 0;
 
+    // Palette of 3x4 row-major matrices for instanced skinning. Instance N reads
+    // paletteSize matrices starting at N * paletteSize.
+    virtual void setPaletteBuffer(const std::unique_ptr<IRenderBuffer>& buffer, unsigned offset, unsigned paletteSize) = 0;
+
     virtual void setLightPosition(const glm::vec3& position) = 0;
     virtual void setAmbientColor(const glm::vec4& color) = 0;
 
     virtual void drawPrimitive(unsigned start, unsigned count) = 0;
-    virtual void drawIndexedPrimitive(const std::unique_ptr<IRenderBuffer>& indexBuffer, unsigned start, unsigned count) = 0;
+    // Indices are relative to baseVertex, so that meshes sharing a vertex buffer keep 16-bit indices
+    virtual void drawIndexedPrimitive(const std::unique_ptr<IRenderBuffer>& indexBuffer,
+        unsigned start, unsigned count, unsigned baseVertex = 0) = 0;
+    virtual void drawIndexedPrimitiveInstanced(const std::unique_ptr<IRenderBuffer>& indexBuffer,
+        unsigned start, unsigned count, unsigned instanceCount, unsigned baseVertex = 0) = 0;
+
+    // Parallel recording: between beginSlices() and endSlices() each slice can be recorded by another
+    // thread, which routes its set/draw calls into the slice from beginSlice() to endSlice(). A slice
+    // starts with the uniforms, textures and buffers set before beginSlices(), but has to set its own
+    // pipeline state and vertex buffers. endSlices() is called on the thread that began them, once all
+    // slices have ended, and submits them in index order no matter which finished first. Pipeline
+    // state and vertex buffers have to be set again afterwards.
+    virtual void beginSlices(unsigned sliceCount) = 0;
+    virtual void beginSlice(unsigned sliceIndex) = 0;
+    virtual void endSlice() = 0;
+    virtual void endSlices() = 0;
+
+    // GPU time spent on the commands recorded between beginGpuScope() and endGpuScope(). Scopes nest,
+    // are only recorded by the thread that began the frame, and name has to outlive the device. The
+    // results are read back once the GPU has finished the frame, without waiting for it; gpuTimings()
+    // has those of the latest finished frame, and is empty if the device cannot measure them. The
+    // Metal device never does: scopes are accepted there but not timed, so gpuTimings() stays empty.
+    virtual void beginGpuScope(const char* name) = 0;
+    virtual void endGpuScope() = 0;
+    virtual const std::vector<GpuTiming>& gpuTimings() const = 0;
+
+    virtual const BindingCounters& lastFrameBindingCounters() const = 0;
 
     virtual bool beginFrame() = 0;
     virtual void endFrame() = 0;
 };
+
+// Times the GPU work recorded until the end of the scope
+class GpuScope
+{
+public:
+    GpuScope(IRenderDevice* device, const char* name)
+        : mDevice(device)
+    {
+        mDevice->beginGpuScope(name);
+    }
+
+    ~GpuScope()
+    {
+        mDevice->endGpuScope();
+    }
+
+    GpuScope(const GpuScope&) = delete;
+    GpuScope& operator=(const GpuScope&) = delete;
+
+private:
+    IRenderDevice* mDevice;
+};
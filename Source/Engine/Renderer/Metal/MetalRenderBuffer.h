@@ -13,7 +13,8 @@ public:
 
     id<MTLBuffer> nativeBuffer() const { return mBuffer; }
 
-    unsigned uploadData(const void* data) override;
+    unsigned uploadData(const void* data, size_t size) override;
+    void updateData(size_t offset, const void* data, size_t size) override;
 
 private:
     MetalRenderDevice* mDevice;
@@ -1,15 +1,13 @@
 #import "MetalRenderBuffer.h"
 #import "MetalRenderDevice.h"
 
-static const int MaxBuffersInFlight = 3;
-
 MetalRenderBuffer::MetalRenderBuffer(MetalRenderDevice* device, size_t size)
     : mDevice(device)
     , mSize(size)
     , mAlignedSize((size + 255) & ~255)
     , mBufferIndex(0)
 {
-    mBuffer = [device->nativeDevice() newBufferWithLength:(mAlignedSize * MaxBuffersInFlight) options:MTLResourceStorageModeShared];
+    mBuffer = [device->nativeDevice() newBufferWithLength:(mAlignedSize * MetalRenderDevice::MaxBuffersInFlight) options:MTLResourceStorageModeShared];
 }
 
 MetalRenderBuffer::MetalRenderBuffer(MetalRenderDevice* device, const void* data, size_t size)
@@ -18,21 +16,26 @@ MetalRenderBuffer::MetalRenderBuffer(MetalRenderDevice* device, const void* data
     , mAlignedSize((size + 255) & ~255)
     , mBufferIndex(0)
 {
-    mBuffer = [device->nativeDevice() newBufferWithBytes:data length:size options:MTLResourceStorageModeManaged];
+    if (data)
+        mBuffer = [device->nativeDevice() newBufferWithBytes:data length:size options:MTLResourceStorageModeManaged];
+    else
+        mBuffer = [device->nativeDevice() newBufferWithLength:size options:MTLResourceStorageModeManaged];
 }
 
 MetalRenderBuffer::~MetalRenderBuffer()
 {
 }
 
-unsigned MetalRenderBuffer::uploadData(const void* data)
+unsigned MetalRenderBuffer::uploadData(const void* data, size_t size)
 {
+    assert(size <= mSize);
+
     if (mSemaphore == nullptr)
-        mSemaphore = dispatch_semaphore_create(MaxBuffersInFlight);
+        mSemaphore = dispatch_semaphore_create(MetalRenderDevice::MaxBuffersInFlight);
 
     dispatch_semaphore_wait(mSemaphore, DISPATCH_TIME_FOREVER);
 
-    mBufferIndex = (mBufferIndex + 1) % MaxBuffersInFlight;
+    mBufferIndex = (mBufferIndex + 1) % MetalRenderDevice::MaxBuffersInFlight;
     unsigned bufferOffset = mAlignedSize * mBufferIndex;
 
     __block dispatch_semaphore_t semaphore = mSemaphore;
@@ -41,7 +44,15 @@ unsigned MetalRenderBuffer::uploadData(const void* data)
         }];
 
     auto bufferPtr = reinterpret_cast<uint8_t*>(mBuffer.contents);
-    memcpy(bufferPtr + bufferOffset, data, mSize);
+    memcpy(bufferPtr + bufferOffset, data, size);
 
     return bufferOffset;
 }
+
+void MetalRenderBuffer::updateData(size_t offset, const void* data, size_t size)
+{
+    assert(offset + size <= mSize);
+    auto bufferPtr = reinterpret_cast<uint8_t*>(mBuffer.contents);
+    memcpy(bufferPtr + offset, data, size);
+    [mBuffer didModifyRange:NSMakeRange(offset, size)];
+}
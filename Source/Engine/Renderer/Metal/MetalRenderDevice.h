@@ -1,21 +1,28 @@
 #import "Engine/Renderer/IRenderDevice.h"
+#import "Engine/Renderer/RenderStateShadow.h"
 #import "Shaders/ShaderTypes.h"
 #import <Metal/Metal.h>
 #import <MetalKit/MetalKit.h>
+#import <vector>
 
 class MetalRenderDevice : public IRenderDevice
 {
 public:
+    enum { MaxBuffersInFlight = 3 };
+
     explicit MetalRenderDevice(MTKView* view);
     ~MetalRenderDevice();
 
     id<MTLDevice> nativeDevice() const { return mDevice; }
     id<MTLCommandBuffer> nativeCommandBuffer() const { return mCommandBuffer; }
 
+    std::string description() const override;
     glm::vec2 viewportSize() const override;
+    uint32_t framesInFlight() const override { return MaxBuffersInFlight; }
 
     std::unique_ptr<IRenderBuffer> createBuffer(size_t size) override;
     std::unique_ptr<IRenderBuffer> createBufferWithData(const void* data, size_t size) override;
+    std::unique_ptr<IRenderBuffer> createStaticBuffer(size_t size) override;
     std::unique_ptr<ITexture> createTexture(const TextureData* data) override;
     std::unique_ptr<IShaderProgram> createShaderProgram(const ShaderCode* code) override;
     std::unique_ptr<IPipelineState> createPipelineState(PrimitiveType primitiveType,
@@ -28,29 +35,66 @@ public:
     void setTexture(int index, const std::unique_ptr<ITexture>& texture) override;
     void setPipelineState(const std::unique_ptr<IPipelineState>& state) override;
     void setVertexBuffer(int index, const std::unique_ptr<IRenderBuffer>& state, unsigned offset) override;
+    void setPaletteBuffer(const std::unique_ptr<IRenderBuffer>& buffer, unsigned offset, unsigned paletteSize) override;
 
     void setLightPosition(const glm::vec3& position) override;
     void setAmbientColor(const glm::vec4& color) override;
 
     void drawPrimitive(unsigned start, unsigned count) override;
-    void drawIndexedPrimitive(const std::unique_ptr<IRenderBuffer>& indexBuffer, unsigned start, unsigned count) override;
+    void drawIndexedPrimitive(const std::unique_ptr<IRenderBuffer>& indexBuffer,
+        unsigned start, unsigned count, unsigned baseVertex) override;
+    void drawIndexedPrimitiveInstanced(const std::unique_ptr<IRenderBuffer>& indexBuffer,
+        unsigned start, unsigned count, unsigned instanceCount, unsigned baseVertex) override;
 
     void onDrawableSizeChanged(float width, float height);
 
+    void beginSlices(unsigned sliceCount) override;
+    void beginSlice(unsigned sliceIndex) override;
+    void endSlice() override;
+    void endSlices() override;
+
+    void beginGpuScope(const char* name) override;
+    void endGpuScope() override;
+    const std::vector<GpuTiming>& gpuTimings() const override;
+
+    const BindingCounters& lastFrameBindingCounters() const override;
+
     bool beginFrame() override;
     void endFrame() override;
 
 private:
+    // State of one encoder; slices are encoded by their own thread into a parallel encoder. The shadow
+    // holds what was set on the encoder, uniforms are set again whenever they changed since the last draw.
+    struct Recorder
+    {
+        id<MTLRenderCommandEncoder> encoder;
+        RenderStateShadow shadow;
+        bool uniformsDirty;
+        MTLPrimitiveType primitiveType;
+        VertexUniforms vertexUniforms;
+        FragmentUniforms fragmentUniforms;
+        InstanceUniforms instanceUniforms;
+        id<MTLTexture> textures[2];
+        id<MTLBuffer> paletteBuffer;
+        unsigned paletteBufferOffset;
+    };
+
     MTKView* mView;
     id<MTLDevice> mDevice;
     id<MTLCommandQueue> mCommandQueue;
     id<MTLCommandBuffer> mCommandBuffer;
     id<MTLDepthStencilState> mDepthStencilState;
-    id<MTLRenderCommandEncoder> mCommandEncoder;
-    MTLPrimitiveType mPrimitiveType;
-    VertexUniforms mVertexUniforms;
-    FragmentUniforms mFragmentUniforms;
+    MTLRenderPassDescriptor* mRenderPassDescriptor; // of the current frame
+    MTLRenderPassDescriptor* mLoadRenderPassDescriptor; // continues the frame after slices
+    id<MTLParallelRenderCommandEncoder> mParallelEncoder;
+    Recorder mMainRecorder;
+    std::vector<Recorder> mSliceRecorders;
     MTLViewport mViewport;
+    std::vector<GpuTiming> mGpuTimings; // always empty
+    BindingCounters mFrameBindingCounters; // of slices ended so far
+    BindingCounters mLastFrameBindingCounters;
 
-    void bindUniforms();
+    Recorder& recorder();
+    void beginEncoder(Recorder& rec, id<MTLRenderCommandEncoder> encoder);
+    void bindUniforms(Recorder& rec);
 };
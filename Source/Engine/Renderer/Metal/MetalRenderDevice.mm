@@ -11,9 +11,16 @@
 #import <glm/mat3x4.hpp>
 #import <cassert>
 
+namespace
+{
+    // Set between beginSlice() and endSlice() on the thread that records the slice
+    thread_local const MetalRenderDevice* tSliceDevice = nullptr;
+    thread_local unsigned tSliceIndex = 0;
+}
+
 MetalRenderDevice::MetalRenderDevice(MTKView* view)
     : mView(view)
-    , mPrimitiveType(MTLPrimitiveTypeTriangle)
+    , mMainRecorder{}
     , mViewport{0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f}
 {
     mDevice = view.device;
@@ -24,22 +31,32 @@ MetalRenderDevice::MetalRenderDevice(MTKView* view)
     depthDesc.depthWriteEnabled = YES;
     mDepthStencilState = [mDevice newDepthStencilStateWithDescriptor:depthDesc];
 
+    Recorder& rec = mMainRecorder;
+    rec.primitiveType = MTLPrimitiveTypeTriangle;
+
     const glm::mat4 identity4 = glm::mat4(1.0f);
     const glm::mat3x4 identity3 = glm::mat3x4(1.0f);
-    memcpy(&mVertexUniforms.projectionMatrix, &identity4[0][0], 16 * sizeof(float));
-    memcpy(&mVertexUniforms.viewMatrix, &identity4[0][0], 16 * sizeof(float));
-    memcpy(&mVertexUniforms.modelMatrix, &identity4[0][0], 16 * sizeof(float));
-    memcpy(&mVertexUniforms.normalMatrix, &identity3[0][0], 12 * sizeof(float));
-    memset(&mVertexUniforms.lightPosition, 0, 3 * sizeof(float));
+    memcpy(&rec.vertexUniforms.projectionMatrix, &identity4[0][0], 16 * sizeof(float));
+    memcpy(&rec.vertexUniforms.viewMatrix, &identity4[0][0], 16 * sizeof(float));
+    memcpy(&rec.vertexUniforms.modelMatrix, &identity4[0][0], 16 * sizeof(float));
+    memcpy(&rec.vertexUniforms.normalMatrix, &identity3[0][0], 12 * sizeof(float));
+    memset(&rec.vertexUniforms.lightPosition, 0, 3 * sizeof(float));
 
     const glm::vec4 ambient = glm::vec4(0.0f);
-    memcpy(&mFragmentUniforms.ambientColor, &ambient[0], 4 * sizeof(float));
+    memcpy(&rec.fragmentUniforms.ambientColor, &ambient[0], 4 * sizeof(float));
+
+    rec.instanceUniforms.paletteSize = 0;
 }
 
 MetalRenderDevice::~MetalRenderDevice()
 {
 }
 
+std::string MetalRenderDevice::description() const
+{
+    return [mDevice.name UTF8String];
+}
+
 glm::vec2 MetalRenderDevice::viewportSize() const
 {
     return glm::vec2(mViewport.width, mViewport.height);
@@ -55,17 +72,45 @@ std::unique_ptr<IRenderBuffer> MetalRenderDevice::createBufferWithData(const voi
     return std::make_unique<MetalRenderBuffer>(this, data, size);
 }
 
+std::unique_ptr<IRenderBuffer> MetalRenderDevice::createStaticBuffer(size_t size)
+{
+    return std::make_unique<MetalRenderBuffer>(this, nullptr, size);
+}
+
+static MTLPixelFormat convertTextureFormat(TextureFormat format)
+{
+    switch (format) {
+        case TextureFormat::RGBA8: return MTLPixelFormatRGBA8Unorm;
+        case TextureFormat::RGBA16F: return MTLPixelFormatRGBA16Float;
+        case TextureFormat::RGBA32F: return MTLPixelFormatRGBA32Float;
+        case TextureFormat::BC1: return MTLPixelFormatBC1_RGBA;
+        case TextureFormat::BC3: return MTLPixelFormatBC3_RGBA;
+        case TextureFormat::BC5: return MTLPixelFormatBC5_RGUnorm;
+        case TextureFormat::BC7: return MTLPixelFormatBC7_RGBAUnorm;
+    }
+
+    assert(false);
+    return MTLPixelFormatRGBA8Unorm;
+}
+
 std::unique_ptr<ITexture> MetalRenderDevice::createTexture(const TextureData* data)
 {
     MTLTextureDescriptor* desc = [[MTLTextureDescriptor alloc] init];
-    desc.pixelFormat = MTLPixelFormatRGBA8Unorm;
+    desc.pixelFormat = convertTextureFormat(data->format);
     desc.width = data->width;
     desc.height = data->height;
+    desc.mipmapLevelCount = data->mipLevels;
 
     id<MTLTexture> texture = [mDevice newTextureWithDescriptor:desc];
 
-    MTLRegion region = { { 0, 0, 0 }, { data->width, data->height, 1 } };
-    [texture replaceRegion:region mipmapLevel:0 withBytes:data->pixels bytesPerRow:(data->width * 4)];
+    auto pixels = static_cast<const uint8_t*>(data->pixels);
+    for (unsigned level = 0; level < data->mipLevels; level++) {
+        unsigned width = mipLevelDimension(data->width, level);
+        unsigned height = mipLevelDimension(data->height, level);
+        MTLRegion region = { { 0, 0, 0 }, { width, height, 1 } };
+        [texture replaceRegion:region mipmapLevel:level withBytes:pixels bytesPerRow:textureRowPitch(data->format, width)];
+        pixels += mipLevelSize(data->format, width, height);
+    }
 
     return std::make_unique<MetalTexture>(this, texture);
 }
@@ -123,20 +168,35 @@ std::unique_ptr<IPipelineState> MetalRenderDevice::createPipelineState(Primitive
 
 void MetalRenderDevice::setProjectionMatrix(const glm::mat4& matrix)
 {
-    memcpy(&mVertexUniforms.projectionMatrix, &matrix[0][0], 16 * sizeof(float));
+    Recorder& rec = recorder();
+    if (!rec.shadow.setProjectionMatrix(matrix))
+        return;
+
+    memcpy(&rec.vertexUniforms.projectionMatrix, &matrix[0][0], 16 * sizeof(float));
+    rec.uniformsDirty = true;
 }
 
 void MetalRenderDevice::setViewMatrix(const glm::mat4& matrix)
 {
-    memcpy(&mVertexUniforms.viewMatrix, &matrix[0][0], 16 * sizeof(float));
+    Recorder& rec = recorder();
+    if (!rec.shadow.setViewMatrix(matrix))
+        return;
+
+    memcpy(&rec.vertexUniforms.viewMatrix, &matrix[0][0], 16 * sizeof(float));
+    rec.uniformsDirty = true;
 }
 
 void MetalRenderDevice::setModelMatrix(const glm::mat4& matrix)
 {
+    Recorder& rec = recorder();
+    if (!rec.shadow.setModelMatrix(matrix))
+        return;
+
     glm::mat3 normalMatrix = glm::mat3(matrix);
     glm::mat3x4 transposedInvertedMatrix = glm::mat3x4(glm::transpose(glm::inverse(normalMatrix)));
-    memcpy(&mVertexUniforms.modelMatrix, &matrix[0][0], 16 * sizeof(float));
-    memcpy(&mVertexUniforms.normalMatrix, &transposedInvertedMatrix[0][0], 12 * sizeof(float));
+    memcpy(&rec.vertexUniforms.modelMatrix, &matrix[0][0], 16 * sizeof(float));
+    memcpy(&rec.vertexUniforms.normalMatrix, &transposedInvertedMatrix[0][0], 12 * sizeof(float));
+    rec.uniformsDirty = true;
 }
 
 void MetalRenderDevice::setTexture(int index, const std::unique_ptr<ITexture>& texture)
@@ -144,7 +204,14 @@ void MetalRenderDevice::setTexture(int index, const std::unique_ptr<ITexture>& t
     assert(dynamic_cast<MetalTexture*>(texture.get()) != nullptr);
     auto metalTexture = static_cast<MetalTexture*>(texture.get());
 
-    [mCommandEncoder setFragmentTexture:metalTexture->nativeTexture() atIndex:index];
+    Recorder& rec = recorder();
+    assert(index >= 0 && index <= 1);
+    if (!rec.shadow.setTexture(index, (__bridge const void*)metalTexture->nativeTexture()))
+        return;
+
+    rec.textures[index] = metalTexture->nativeTexture();
+    [rec.encoder setVertexTexture:metalTexture->nativeTexture() atIndex:index];
+    [rec.encoder setFragmentTexture:metalTexture->nativeTexture() atIndex:index];
 }
 
 static MTLPrimitiveType convertPrimitiveType(PrimitiveType type)
@@ -162,8 +229,10 @@ void MetalRenderDevice::setPipelineState(const std::unique_ptr<IPipelineState>&
     assert(dynamic_cast<MetalPipelineState*>(state.get()) != nullptr);
     auto metalState = static_cast<MetalPipelineState*>(state.get());
 
-    mPrimitiveType = convertPrimitiveType(metalState->primitiveType());
-    [mCommandEncoder setRenderPipelineState:metalState->nativeState()];
+    Recorder& rec = recorder();
+    rec.primitiveType = convertPrimitiveType(metalState->primitiveType());
+    if (rec.shadow.setPipelineState((__bridge const void*)metalState->nativeState()))
+        [rec.encoder setRenderPipelineState:metalState->nativeState()];
 }
 
 void MetalRenderDevice::setVertexBuffer(int index, const std::unique_ptr<IRenderBuffer>& buffer, unsigned offset)
@@ -171,34 +240,76 @@ void MetalRenderDevice::setVertexBuffer(int index, const std::unique_ptr<IRender
     assert(dynamic_cast<MetalRenderBuffer*>(buffer.get()) != nullptr);
     auto metalBuffer = static_cast<MetalRenderBuffer*>(buffer.get());
 
-    [mCommandEncoder setVertexBuffer:metalBuffer->nativeBuffer() offset:offset atIndex:index];
+    Recorder& rec = recorder();
+    if (rec.shadow.setVertexBuffer(index, (__bridge const void*)metalBuffer->nativeBuffer(), offset))
+        [rec.encoder setVertexBuffer:metalBuffer->nativeBuffer() offset:offset atIndex:index];
+}
+
+void MetalRenderDevice::setPaletteBuffer(const std::unique_ptr<IRenderBuffer>& buffer, unsigned offset, unsigned paletteSize)
+{
+    assert(dynamic_cast<MetalRenderBuffer*>(buffer.get()) != nullptr);
+    auto metalBuffer = static_cast<MetalRenderBuffer*>(buffer.get());
+
+    Recorder& rec = recorder();
+    rec.paletteBuffer = metalBuffer->nativeBuffer();
+    rec.paletteBufferOffset = offset;
+    [rec.encoder setVertexBuffer:metalBuffer->nativeBuffer() offset:offset atIndex:VertexInputIndex_SkinningPalettes];
+    rec.instanceUniforms.paletteSize = paletteSize;
 }
 
 void MetalRenderDevice::setLightPosition(const glm::vec3& position)
 {
-    memcpy(&mVertexUniforms.lightPosition, &position[0], 3 * sizeof(float));
+    Recorder& rec = recorder();
+    if (!rec.shadow.setLightPosition(position))
+        return;
+
+    memcpy(&rec.vertexUniforms.lightPosition, &position[0], 3 * sizeof(float));
+    rec.uniformsDirty = true;
 }
 
 void MetalRenderDevice::setAmbientColor(const glm::vec4& color)
 {
-    memcpy(&mFragmentUniforms.ambientColor, &color[0], 4 * sizeof(float));
+    Recorder& rec = recorder();
+    if (!rec.shadow.setAmbientColor(color))
+        return;
+
+    memcpy(&rec.fragmentUniforms.ambientColor, &color[0], 4 * sizeof(float));
+    rec.uniformsDirty = true;
 }
 
 void MetalRenderDevice::drawPrimitive(unsigned start, unsigned count)
 {
-    bindUniforms();
-    [mCommandEncoder drawPrimitives:mPrimitiveType vertexStart:start vertexCount:count];
+    Recorder& rec = recorder();
+    bindUniforms(rec);
+    [rec.encoder drawPrimitives:rec.primitiveType vertexStart:start vertexCount:count];
 }
 
-void MetalRenderDevice::drawIndexedPrimitive(const std::unique_ptr<IRenderBuffer>& indexBuffer, unsigned start, unsigned count)
+void MetalRenderDevice::drawIndexedPrimitive(const std::unique_ptr<IRenderBuffer>& indexBuffer,
+    unsigned start, unsigned count, unsigned baseVertex)
 {
     assert(dynamic_cast<MetalRenderBuffer*>(indexBuffer.get()) != nullptr);
     auto metalBuffer = static_cast<MetalRenderBuffer*>(indexBuffer.get());
 
-    bindUniforms();
-    [mCommandEncoder drawIndexedPrimitives:mPrimitiveType indexCount:count
-        indexType:MTLIndexTypeUInt16 indexBuffer:metalBuffer->nativeBuffer() indexBufferOffset:start
-        instanceCount:1 baseVertex:0 baseInstance:0];
+    Recorder& rec = recorder();
+    bindUniforms(rec);
+    [rec.encoder drawIndexedPrimitives:rec.primitiveType indexCount:count
+        indexType:MTLIndexTypeUInt16 indexBuffer:metalBuffer->nativeBuffer() indexBufferOffset:start * sizeof(uint16_t)
+        instanceCount:1 baseVertex:baseVertex baseInstance:0];
+}
+
+void MetalRenderDevice::drawIndexedPrimitiveInstanced(const std::unique_ptr<IRenderBuffer>& indexBuffer,
+    unsigned start, unsigned count, unsigned instanceCount, unsigned baseVertex)
+{
+    assert(dynamic_cast<MetalRenderBuffer*>(indexBuffer.get()) != nullptr);
+    auto metalBuffer = static_cast<MetalRenderBuffer*>(indexBuffer.get());
+
+    Recorder& rec = recorder();
+    bindUniforms(rec);
+    [rec.encoder setVertexBytes:&rec.instanceUniforms
+        length:sizeof(rec.instanceUniforms) atIndex:VertexInputIndex_InstanceUniforms];
+    [rec.encoder drawIndexedPrimitives:rec.primitiveType indexCount:count
+        indexType:MTLIndexTypeUInt16 indexBuffer:metalBuffer->nativeBuffer() indexBufferOffset:start * sizeof(uint16_t)
+        instanceCount:instanceCount baseVertex:baseVertex baseInstance:0];
 }
 
 void MetalRenderDevice::onDrawableSizeChanged(float width, float height)
@@ -207,35 +318,164 @@ void MetalRenderDevice::onDrawableSizeChanged(float width, float height)
     mViewport.height = height;
 }
 
+void MetalRenderDevice::beginSlices(unsigned sliceCount)
+{
+    assert(tSliceDevice != this && mParallelEncoder == nil && sliceCount > 0);
+
+    // The encoder so far has to store what the slices draw over
+    [mMainRecorder.encoder setDepthStoreAction:MTLStoreActionStore];
+    [mMainRecorder.encoder setStencilStoreAction:MTLStoreActionStore];
+    [mMainRecorder.encoder endEncoding];
+    mMainRecorder.encoder = nil;
+
+    if (!mLoadRenderPassDescriptor) {
+        mLoadRenderPassDescriptor = [mRenderPassDescriptor copy];
+        mLoadRenderPassDescriptor.colorAttachments[0].loadAction = MTLLoadActionLoad;
+        mLoadRenderPassDescriptor.depthAttachment.loadAction = MTLLoadActionLoad;
+        mLoadRenderPassDescriptor.stencilAttachment.loadAction = MTLLoadActionLoad;
+    }
+    mParallelEncoder = [mCommandBuffer parallelRenderCommandEncoderWithDescriptor:mLoadRenderPassDescriptor];
+
+    // Sub-encoders execute in the order they are created, whichever thread finishes first
+    if (mSliceRecorders.size() < sliceCount)
+        mSliceRecorders.resize(sliceCount);
+    for (unsigned i = 0; i < sliceCount; i++) {
+        Recorder& rec = mSliceRecorders[i];
+        rec = mMainRecorder;
+        rec.shadow.resetCounters();
+        beginEncoder(rec, [mParallelEncoder renderCommandEncoder]);
+    }
+}
+
+void MetalRenderDevice::beginSlice(unsigned sliceIndex)
+{
+    assert(tSliceDevice == nullptr && mParallelEncoder != nil);
+    assert(sliceIndex < mSliceRecorders.size() && mSliceRecorders[sliceIndex].encoder != nil);
+    tSliceDevice = this;
+    tSliceIndex = sliceIndex;
+}
+
+void MetalRenderDevice::endSlice()
+{
+    assert(tSliceDevice == this);
+    Recorder& rec = mSliceRecorders[tSliceIndex];
+    [rec.encoder endEncoding];
+    rec.encoder = nil;
+    tSliceDevice = nullptr;
+}
+
+void MetalRenderDevice::endSlices()
+{
+    assert(tSliceDevice != this && mParallelEncoder != nil);
+
+    [mParallelEncoder setDepthStoreAction:MTLStoreActionStore];
+    [mParallelEncoder setStencilStoreAction:MTLStoreActionStore];
+    [mParallelEncoder endEncoding];
+    mParallelEncoder = nil;
+
+    for (const Recorder& rec : mSliceRecorders)
+        mFrameBindingCounters += rec.shadow.counters();
+    for (Recorder& rec : mSliceRecorders)
+        rec.shadow.resetCounters();
+
+    beginEncoder(mMainRecorder, [mCommandBuffer renderCommandEncoderWithDescriptor:mLoadRenderPassDescriptor]);
+}
+
+void MetalRenderDevice::beginGpuScope(const char* name)
+{
+    // Scopes are not timed on Metal, see IRenderDevice
+    (void)name;
+}
+
+void MetalRenderDevice::endGpuScope()
+{
+}
+
+const std::vector<GpuTiming>& MetalRenderDevice::gpuTimings() const
+{
+    return mGpuTimings;
+}
+
+const BindingCounters& MetalRenderDevice::lastFrameBindingCounters() const
+{
+    return mLastFrameBindingCounters;
+}
+
 bool MetalRenderDevice::beginFrame()
 {
     MTLRenderPassDescriptor* renderPassDescriptor = mView.currentRenderPassDescriptor;
     if (!renderPassDescriptor)
         return false;
 
-    mCommandBuffer = [mCommandQueue commandBuffer];
-    mCommandEncoder = [mCommandBuffer renderCommandEncoderWithDescriptor:renderPassDescriptor];
+    // Depth is only stored when slices continue the frame in another encoder
+    mRenderPassDescriptor = renderPassDescriptor;
+    mRenderPassDescriptor.depthAttachment.storeAction = MTLStoreActionUnknown;
+    mRenderPassDescriptor.stencilAttachment.storeAction = MTLStoreActionUnknown;
+    mLoadRenderPassDescriptor = nil;
 
-    [mCommandEncoder setViewport:mViewport];
-    [mCommandEncoder setDepthStencilState:mDepthStencilState];
+    mCommandBuffer = [mCommandQueue commandBuffer];
+    mMainRecorder.shadow.invalidate();
+    beginEncoder(mMainRecorder, [mCommandBuffer renderCommandEncoderWithDescriptor:mRenderPassDescriptor]);
 
     return true;
 }
 
 void MetalRenderDevice::endFrame()
 {
-    [mCommandEncoder endEncoding];
+    assert(mParallelEncoder == nil);
+
+    [mMainRecorder.encoder setDepthStoreAction:MTLStoreActionDontCare];
+    [mMainRecorder.encoder setStencilStoreAction:MTLStoreActionDontCare];
+    [mMainRecorder.encoder endEncoding];
     [mCommandBuffer presentDrawable:mView.currentDrawable];
     [mCommandBuffer commit];
 
     mCommandBuffer = nil;
-    mCommandEncoder = nil;
+    mMainRecorder.encoder = nil;
+    mMainRecorder.textures[0] = nil;
+    mMainRecorder.textures[1] = nil;
+    mMainRecorder.paletteBuffer = nil;
+    mRenderPassDescriptor = nil;
+
+    mLastFrameBindingCounters = mFrameBindingCounters;
+    mLastFrameBindingCounters += mMainRecorder.shadow.counters();
+    mFrameBindingCounters = BindingCounters();
+    mMainRecorder.shadow.resetCounters();
+    mLoadRenderPassDescriptor = nil;
+}
+
+MetalRenderDevice::Recorder& MetalRenderDevice::recorder()
+{
+    return (tSliceDevice == this ? mSliceRecorders[tSliceIndex] : mMainRecorder);
+}
+
+void MetalRenderDevice::beginEncoder(Recorder& rec, id<MTLRenderCommandEncoder> encoder)
+{
+    rec.encoder = encoder;
+    [encoder setViewport:mViewport];
+    [encoder setDepthStencilState:mDepthStencilState];
+
+    // Bindings carry over from the previous encoder, pipeline state, vertex buffers and bytes do not
+    rec.shadow.invalidateBindings();
+    rec.uniformsDirty = true;
+    for (NSUInteger i = 0; i < 2; i++) {
+        if (rec.textures[i] != nil) {
+            [encoder setVertexTexture:rec.textures[i] atIndex:i];
+            [encoder setFragmentTexture:rec.textures[i] atIndex:i];
+        }
+    }
+    if (rec.paletteBuffer != nil)
+        [encoder setVertexBuffer:rec.paletteBuffer offset:rec.paletteBufferOffset atIndex:VertexInputIndex_SkinningPalettes];
 }
 
-void MetalRenderDevice::bindUniforms()
+void MetalRenderDevice::bindUniforms(Recorder& rec)
 {
-    [mCommandEncoder setVertexBytes:&mVertexUniforms
-        length:sizeof(mVertexUniforms) atIndex:VertexInputIndex_VertexUniforms];
-    [mCommandEncoder setFragmentBytes:&mFragmentUniforms
-        length:sizeof(mFragmentUniforms) atIndex:VertexInputIndex_FragmentUniforms];
+    if (!rec.uniformsDirty)
+        return;
+
+    [rec.encoder setVertexBytes:&rec.vertexUniforms
+        length:sizeof(rec.vertexUniforms) atIndex:VertexInputIndex_VertexUniforms];
+    [rec.encoder setFragmentBytes:&rec.fragmentUniforms
+        length:sizeof(rec.fragmentUniforms) atIndex:VertexInputIndex_FragmentUniforms];
+    rec.uniformsDirty = false;
 }
@@ -0,0 +1,17 @@
+#pragma once
+#include "Engine/Renderer/IPipelineState.h"
+#include "Engine/Renderer/IRenderDevice.h"
+
+class NullPipelineState : public IPipelineState
+{
+public:
+    explicit NullPipelineState(PrimitiveType primitiveType)
+        : mPrimitiveType(primitiveType)
+    {
+    }
+
+    PrimitiveType primitiveType() const { return mPrimitiveType; }
+
+private:
+    PrimitiveType mPrimitiveType;
+};
@@ -0,0 +1,35 @@
+#include "NullRenderBuffer.h"
+#include "NullRenderDevice.h"
+#include <cassert>
+#include <cstring>
+
+NullRenderBuffer::NullRenderBuffer(NullRenderDevice* device, size_t size)
+    : mDevice(device)
+    , mSize(size)
+{
+}
+
+NullRenderBuffer::~NullRenderBuffer()
+{
+    if (mContents)
+        mContents->released = true;
+}
+
+unsigned NullRenderBuffer::uploadData(const void* data, size_t size)
+{
+    assert(size <= mSize);
+    mDevice->countBufferUpload(size);
+    return 0;
+}
+
+void NullRenderBuffer::updateData(size_t offset, const void* data, size_t size)
+{
+    assert(offset + size <= mSize);
+    mDevice->countBufferUpload(size);
+
+    if (!mContents) {
+        mContents = std::make_shared<Contents>();
+        mContents->bytes.resize(mSize);
+    }
+    memcpy(mContents->bytes.data() + offset, data, size);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "Engine/Renderer/IRenderBuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class NullRenderDevice;
+
+class NullRenderBuffer : public IRenderBuffer
+{
+public:
+    NullRenderBuffer(NullRenderDevice* device, size_t size);
+    ~NullRenderBuffer();
+
+    // What updateData() wrote, so that checks can read static buffers back. Held on to, it stays
+    // readable after the buffer is destroyed and tells that it was.
+    struct Contents
+    {
+        std::vector<uint8_t> bytes;
+        bool released = false;
+    };
+
+    size_t size() const { return mSize; }
+    const std::shared_ptr<Contents>& contents() const { return mContents; } // null until updateData()
+
+    unsigned uploadData(const void* data, size_t size) override;
+    void updateData(size_t offset, const void* data, size_t size) override;
+
+private:
+    NullRenderDevice* mDevice;
+    size_t mSize;
+    std::shared_ptr<Contents> mContents;
+};
@@ -0,0 +1,256 @@
+#include "NullRenderDevice.h"
+#include "NullRenderBuffer.h"
+#include "NullPipelineState.h"
+#include "NullTexture.h"
+#include "NullShaderProgram.h"
+#include "Engine/Renderer/TextureData.h"
+#include <cassert>
+
+namespace
+{
+    // Set between beginSlice() and endSlice() on the thread that records the slice
+    thread_local const NullRenderDevice* tSliceDevice = nullptr;
+    thread_local unsigned tSliceIndex = 0;
+}
+
+NullRenderDevice::NullRenderDevice(const glm::vec2& viewportSize, uint32_t framesInFlight)
+    : mViewportSize(viewportSize)
+    , mFramesInFlight(framesInFlight)
+    , mFrameCount(0)
+    , mSliceCount(0)
+    , mSlicesInProgress(0)
+    , mGpuScopeDepth(0)
+    , mInFrame(false)
+{
+}
+
+NullRenderDevice::~NullRenderDevice()
+{
+}
+
+void NullRenderDevice::countBufferUpload(size_t size)
+{
+    addToCounters([size](Counters& c) { ++c.bufferUploads; c.bufferBytesUploaded += size; });
+}
+
+std::string NullRenderDevice::description() const
+{
+    return "null device";
+}
+
+glm::vec2 NullRenderDevice::viewportSize() const
+{
+    return mViewportSize;
+}
+
+std::unique_ptr<IRenderBuffer> NullRenderDevice::createBuffer(size_t size)
+{
+    addToCounters([](Counters& c) { ++c.buffersCreated; });
+    return std::make_unique<NullRenderBuffer>(this, size);
+}
+
+std::unique_ptr<IRenderBuffer> NullRenderDevice::createBufferWithData(const void* data, size_t size)
+{
+    addToCounters([size](Counters& c) { ++c.buffersCreated; ++c.bufferUploads; c.bufferBytesUploaded += size; });
+    return std::make_unique<NullRenderBuffer>(this, size);
+}
+
+std::unique_ptr<IRenderBuffer> NullRenderDevice::createStaticBuffer(size_t size)
+{
+    addToCounters([](Counters& c) { ++c.buffersCreated; });
+    return std::make_unique<NullRenderBuffer>(this, size);
+}
+
+std::unique_ptr<ITexture> NullRenderDevice::createTexture(const TextureData* data)
+{
+    addToCounters([](Counters& c) { ++c.texturesCreated; });
+    return std::make_unique<NullTexture>(data->width, data->height);
+}
+
+std::unique_ptr<IShaderProgram> NullRenderDevice::createShaderProgram(const ShaderCode* code)
+{
+    addToCounters([](Counters& c) { ++c.shaderProgramsCreated; });
+    return std::make_unique<NullShaderProgram>();
+}
+
+std::unique_ptr<IPipelineState> NullRenderDevice::createPipelineState(PrimitiveType primitiveType,
+    const std::unique_ptr<IShaderProgram>& shader, const VertexFormat& vertexFormat)
+{
+    assert(dynamic_cast<NullShaderProgram*>(shader.get()) != nullptr);
+    addToCounters([](Counters& c) { ++c.pipelineStatesCreated; });
+    return std::make_unique<NullPipelineState>(primitiveType);
+}
+
+void NullRenderDevice::setProjectionMatrix(const glm::mat4& matrix)
+{
+    shadow().setProjectionMatrix(matrix);
+    addToCounters([](Counters& c) { ++c.uniformChanges; });
+}
+
+void NullRenderDevice::setViewMatrix(const glm::mat4& matrix)
+{
+    shadow().setViewMatrix(matrix);
+    addToCounters([](Counters& c) { ++c.uniformChanges; });
+}
+
+void NullRenderDevice::setModelMatrix(const glm::mat4& matrix)
+{
+    shadow().setModelMatrix(matrix);
+    addToCounters([](Counters& c) { ++c.uniformChanges; });
+}
+
+void NullRenderDevice::setTexture(int index, const std::unique_ptr<ITexture>& texture)
+{
+    assert(dynamic_cast<NullTexture*>(texture.get()) != nullptr);
+    shadow().setTexture(index, texture.get());
+    addToCounters([](Counters& c) { ++c.textureBinds; });
+}
+
+void NullRenderDevice::setPipelineState(const std::unique_ptr<IPipelineState>& state)
+{
+    assert(dynamic_cast<NullPipelineState*>(state.get()) != nullptr);
+    shadow().setPipelineState(state.get());
+    addToCounters([](Counters& c) { ++c.pipelineBinds; });
+}
+
+void NullRenderDevice::setVertexBuffer(int index, const std::unique_ptr<IRenderBuffer>& buffer, unsigned offset)
+{
+    assert(dynamic_cast<NullRenderBuffer*>(buffer.get()) != nullptr);
+    shadow().setVertexBuffer(index, buffer.get(), offset);
+    addToCounters([](Counters& c) { ++c.vertexBufferBinds; });
+}
+
+void NullRenderDevice::setPaletteBuffer(const std::unique_ptr<IRenderBuffer>& buffer, unsigned offset, unsigned paletteSize)
+{
+    assert(dynamic_cast<NullRenderBuffer*>(buffer.get()) != nullptr);
+    addToCounters([](Counters& c) { ++c.vertexBufferBinds; });
+}
+
+void NullRenderDevice::setLightPosition(const glm::vec3& position)
+{
+    shadow().setLightPosition(position);
+    addToCounters([](Counters& c) { ++c.uniformChanges; });
+}
+
+void NullRenderDevice::setAmbientColor(const glm::vec4& color)
+{
+    shadow().setAmbientColor(color);
+    addToCounters([](Counters& c) { ++c.uniformChanges; });
+}
+
+void NullRenderDevice::drawPrimitive(unsigned start, unsigned count)
+{
+    assert(mInFrame);
+    addToCounters([count](Counters& c) { ++c.drawCalls; c.verticesSubmitted += count; ++c.instancesSubmitted; });
+}
+
+void NullRenderDevice::drawIndexedPrimitive(const std::unique_ptr<IRenderBuffer>& indexBuffer,
+    unsigned start, unsigned count, unsigned baseVertex)
+{
+    assert(dynamic_cast<NullRenderBuffer*>(indexBuffer.get()) != nullptr);
+    assert(mInFrame);
+    shadow().setIndexBuffer(indexBuffer.get());
+    addToCounters([count](Counters& c) { ++c.drawCalls; ++c.indexedDrawCalls; c.indicesSubmitted += count; ++c.instancesSubmitted; });
+}
+
+void NullRenderDevice::drawIndexedPrimitiveInstanced(const std::unique_ptr<IRenderBuffer>& indexBuffer,
+    unsigned start, unsigned count, unsigned instanceCount, unsigned baseVertex)
+{
+    assert(dynamic_cast<NullRenderBuffer*>(indexBuffer.get()) != nullptr);
+    assert(mInFrame);
+    shadow().setIndexBuffer(indexBuffer.get());
+    addToCounters([count, instanceCount](Counters& c) {
+            ++c.drawCalls;
+            ++c.indexedDrawCalls;
+            c.indicesSubmitted += uint64_t(count) * instanceCount;
+            c.instancesSubmitted += instanceCount;
+        });
+}
+
+void NullRenderDevice::beginSlices(unsigned sliceCount)
+{
+    assert(mInFrame && mSlicesInProgress == 0 && sliceCount > 0);
+    mSlicesInProgress = sliceCount;
+    mSliceCount += sliceCount;
+
+    if (mSliceShadows.size() < sliceCount)
+        mSliceShadows.resize(sliceCount);
+    for (unsigned i = 0; i < sliceCount; i++)
+        mSliceShadows[i].inherit(mShadow);
+}
+
+void NullRenderDevice::beginSlice(unsigned sliceIndex)
+{
+    assert(tSliceDevice == nullptr && sliceIndex < mSlicesInProgress);
+    tSliceDevice = this;
+    tSliceIndex = sliceIndex;
+}
+
+void NullRenderDevice::endSlice()
+{
+    assert(tSliceDevice == this);
+    tSliceDevice = nullptr;
+}
+
+void NullRenderDevice::endSlices()
+{
+    assert(tSliceDevice != this && mSlicesInProgress > 0);
+    for (unsigned i = 0; i < mSlicesInProgress; i++) {
+        mFrameBindingCounters += mSliceShadows[i].counters();
+        mSliceShadows[i].resetCounters();
+    }
+    mShadow.invalidateBindings();
+    mSlicesInProgress = 0;
+}
+
+void NullRenderDevice::beginGpuScope(const char* name)
+{
+    assert(mInFrame && name != nullptr);
+    (void)name;
+    ++mGpuScopeDepth;
+}
+
+void NullRenderDevice::endGpuScope()
+{
+    assert(mGpuScopeDepth > 0);
+    --mGpuScopeDepth;
+}
+
+const std::vector<GpuTiming>& NullRenderDevice::gpuTimings() const
+{
+    // Nothing is executed, so there is nothing to time
+    return mGpuTimings;
+}
+
+const BindingCounters& NullRenderDevice::lastFrameBindingCounters() const
+{
+    return mLastFrameBindingCounters;
+}
+
+bool NullRenderDevice::beginFrame()
+{
+    assert(!mInFrame);
+    mInFrame = true;
+    mShadow.invalidate();
+    return true;
+}
+
+void NullRenderDevice::endFrame()
+{
+    assert(mInFrame && mSlicesInProgress == 0 && mGpuScopeDepth == 0);
+    mInFrame = false;
+    ++mFrameCount;
+
+    mLastFrameCounters = mFrameCounters;
+    mFrameCounters = Counters();
+
+    mLastFrameBindingCounters = mFrameBindingCounters;
+    mLastFrameBindingCounters += mShadow.counters();
+    mFrameBindingCounters = BindingCounters();
+    mShadow.resetCounters();
+}
+
+RenderStateShadow& NullRenderDevice::shadow()
+{
+    return (tSliceDevice == this ? mSliceShadows[tSliceIndex] : mShadow);
+}
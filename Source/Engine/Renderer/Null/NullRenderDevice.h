@@ -0,0 +1,114 @@
+#pragma once
+#include "Engine/Renderer/IRenderDevice.h"
+#include "Engine/Renderer/RenderStateShadow.h"
+#include <glm/vec2.hpp>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class NullRenderDevice : public IRenderDevice
+{
+public:
+    struct Counters
+    {
+        uint64_t buffersCreated = 0;
+        uint64_t texturesCreated = 0;
+        uint64_t shaderProgramsCreated = 0;
+        uint64_t pipelineStatesCreated = 0;
+        uint64_t bufferUploads = 0;
+        uint64_t bufferBytesUploaded = 0;
+        uint64_t uniformChanges = 0;
+        uint64_t textureBinds = 0;
+        uint64_t pipelineBinds = 0;
+        uint64_t vertexBufferBinds = 0;
+        uint64_t drawCalls = 0;
+        uint64_t indexedDrawCalls = 0;
+        uint64_t verticesSubmitted = 0;
+        uint64_t indicesSubmitted = 0;
+        uint64_t instancesSubmitted = 0;
+    };
+
+    // Nothing runs behind the CPU, but checks may pretend that frames stay in flight
+    explicit NullRenderDevice(const glm::vec2& viewportSize = glm::vec2(1024.0f, 768.0f), uint32_t framesInFlight = 1);
+    ~NullRenderDevice();
+
+    const Counters& totalCounters() const { return mTotalCounters; }
+    const Counters& lastFrameCounters() const { return mLastFrameCounters; }
+    uint64_t frameCount() const { return mFrameCount; }
+    uint64_t sliceCount() const { return mSliceCount; }
+
+    void countBufferUpload(size_t size);
+
+    std::string description() const override;
+    glm::vec2 viewportSize() const override;
+    uint32_t framesInFlight() const override { return mFramesInFlight; }
+
+    std::unique_ptr<IRenderBuffer> createBuffer(size_t size) override;
+    std::unique_ptr<IRenderBuffer> createBufferWithData(const void* data, size_t size) override;
+    std::unique_ptr<IRenderBuffer> createStaticBuffer(size_t size) override;
+    std::unique_ptr<ITexture> createTexture(const TextureData* data) override;
+    std::unique_ptr<IShaderProgram> createShaderProgram(const ShaderCode* code) override;
+    std::unique_ptr<IPipelineState> createPipelineState(PrimitiveType primitiveType,
+        const std::unique_ptr<IShaderProgram>& shader, const VertexFormat& vertexFormat) override;
+
+    void setProjectionMatrix(const glm::mat4& matrix) override;
+    void setViewMatrix(const glm::mat4& matrix) override;
+    void setModelMatrix(const glm::mat4& matrix) override;
+
+    void setTexture(int index, const std::unique_ptr<ITexture>& texture) override;
+    void setPipelineState(const std::unique_ptr<IPipelineState>& state) override;
+    void setVertexBuffer(int index, const std::unique_ptr<IRenderBuffer>& state, unsigned offset) override;
+    void setPaletteBuffer(const std::unique_ptr<IRenderBuffer>& buffer, unsigned offset, unsigned paletteSize) override;
+
+    void setLightPosition(const glm::vec3& position) override;
+    void setAmbientColor(const glm::vec4& color) override;
+
+    void drawPrimitive(unsigned start, unsigned count) override;
+    void drawIndexedPrimitive(const std::unique_ptr<IRenderBuffer>& indexBuffer,
+        unsigned start, unsigned count, unsigned baseVertex) override;
+    void drawIndexedPrimitiveInstanced(const std::unique_ptr<IRenderBuffer>& indexBuffer,
+        unsigned start, unsigned count, unsigned instanceCount, unsigned baseVertex) override;
+
+    void beginSlices(unsigned sliceCount) override;
+    void beginSlice(unsigned sliceIndex) override;
+    void endSlice() override;
+    void endSlices() override;
+
+    void beginGpuScope(const char* name) override;
+    void endGpuScope() override;
+    const std::vector<GpuTiming>& gpuTimings() const override;
+
+    // Filtered like a command buffer backend would: slices keep textures and uniforms, but neither
+    // they nor the main stream after them keep pipeline state and buffers
+    const BindingCounters& lastFrameBindingCounters() const override;
+
+    bool beginFrame() override;
+    void endFrame() override;
+
+private:
+    glm::vec2 mViewportSize;
+    uint32_t mFramesInFlight;
+    Counters mTotalCounters;
+    Counters mFrameCounters;
+    Counters mLastFrameCounters;
+    uint64_t mFrameCount;
+    uint64_t mSliceCount;
+    unsigned mSlicesInProgress;
+    unsigned mGpuScopeDepth;
+    std::vector<GpuTiming> mGpuTimings; // always empty
+    RenderStateShadow mShadow;
+    std::vector<RenderStateShadow> mSliceShadows; // each only used by the thread recording the slice
+    BindingCounters mFrameBindingCounters; // of slices ended so far
+    BindingCounters mLastFrameBindingCounters;
+    bool mInFrame;
+    std::mutex mCountersMutex; // slices count from several threads
+
+    RenderStateShadow& shadow();
+
+    template <typename F> void addToCounters(F&& fn)
+    {
+        std::lock_guard<std::mutex> lock(mCountersMutex);
+        fn(mTotalCounters);
+        fn(mFrameCounters);
+    }
+};
@@ -0,0 +1,8 @@
+#pragma once
+#include "Engine/Renderer/IShaderProgram.h"
+
+class NullShaderProgram : public IShaderProgram
+{
+public:
+    NullShaderProgram() = default;
+};
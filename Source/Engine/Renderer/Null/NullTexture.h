@@ -0,0 +1,19 @@
+#pragma once
+#include "Engine/Renderer/ITexture.h"
+
+class NullTexture : public ITexture
+{
+public:
+    NullTexture(unsigned width, unsigned height)
+        : mWidth(width)
+        , mHeight(height)
+    {
+    }
+
+    unsigned width() const { return mWidth; }
+    unsigned height() const { return mHeight; }
+
+private:
+    unsigned mWidth;
+    unsigned mHeight;
+};
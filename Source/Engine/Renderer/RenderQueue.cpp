@@ -0,0 +1,219 @@
+#include "RenderQueue.h"
+#include "Engine/Core/Engine.h"
+#include "Engine/Core/JobSystem.h"
+#include "Engine/Mesh/Material.h"
+#include "Engine/Renderer/IRenderDevice.h"
+#include <glm/vec4.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+    // Queues with fewer draws are cheaper to record on one thread
+    const size_t PacketsPerSlice = 64;
+
+    // Key layout, from the most significant bit:
+    //   opaque:      pass (2) | pipeline (16) | material (16) | depth (30)
+    //   transparent: pass (2) | inverted depth (30) | pipeline (16) | material (16)
+    const int PassShift = 62;
+    const int MaterialBits = 32; // pipeline and material, see RenderQueue::registerMaterial()
+    const uint32_t DepthMask = (1u << 30) - 1;
+
+    uint32_t depthBits(float depth)
+    {
+        // Non-negative floats order like their bit patterns; the lowest mantissa bit is dropped
+        depth = std::max(depth, 0.0f);
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return (bits >> 1) & DepthMask;
+    }
+}
+
+RenderQueue::RenderQueue(Engine* engine)
+    : mEngine(engine)
+    , mViewMatrix(1.0f)
+    , mMaterialCount(0)
+{
+}
+
+RenderQueue::~RenderQueue()
+{
+}
+
+uint32_t RenderQueue::registerMaterial(const ShaderCode* shader)
+{
+    assert(mMaterialCount <= 0xFFFF);
+    return (pipelineId(shader) << 16) | (mMaterialCount++ & 0xFFFF);
+}
+
+uint32_t RenderQueue::registerVariant(uint32_t materialKey, const ShaderCode* shader)
+{
+    return (pipelineId(shader) << 16) | (materialKey & 0xFFFF);
+}
+
+uint32_t RenderQueue::pipelineId(const ShaderCode* shader)
+{
+    auto it = mPipelineIds.find(shader);
+    if (it == mPipelineIds.end())
+        it = mPipelineIds.emplace(shader, uint32_t(mPipelineIds.size())).first;
+
+    assert(it->second <= 0xFFFF);
+    return it->second;
+}
+
+void RenderQueue::begin(const glm::mat4& viewMatrix)
+{
+    mViewMatrix = viewMatrix;
+    mPackets.clear();
+    mSortEntries.clear();
+}
+
+void RenderQueue::submit(Pass pass, const Material* material, const glm::mat4& modelMatrix,
+    const std::unique_ptr<IRenderBuffer>& vertexBuffer, const std::unique_ptr<IRenderBuffer>& indexBuffer,
+    unsigned firstIndex, unsigned indexCount, unsigned baseVertex)
+{
+    Packet packet;
+    packet.modelMatrix = modelMatrix;
+    packet.material = material;
+    packet.vertexBuffer = &vertexBuffer;
+    packet.indexBuffer = &indexBuffer;
+    packet.instanceBuffer = nullptr;
+    packet.firstIndex = firstIndex;
+    packet.indexCount = indexCount;
+    packet.instanceCount = 1;
+    packet.baseVertex = baseVertex;
+    addPacket(pass, material->sortKey(), glm::vec3(modelMatrix[3]), packet);
+}
+
+void RenderQueue::submitInstanced(Pass pass, const Material* material, const glm::vec3& position,
+    const std::unique_ptr<IRenderBuffer>& vertexBuffer, const std::unique_ptr<IRenderBuffer>& indexBuffer,
+    unsigned firstIndex, unsigned indexCount, const std::unique_ptr<IRenderBuffer>& instanceBuffer, unsigned instanceCount,
+    unsigned baseVertex)
+{
+    assert(material->supportsInstancing());
+
+    Packet packet;
+    packet.modelMatrix = glm::mat4(1.0f);
+    packet.material = material;
+    packet.vertexBuffer = &vertexBuffer;
+    packet.indexBuffer = &indexBuffer;
+    packet.instanceBuffer = &instanceBuffer;
+    packet.firstIndex = firstIndex;
+    packet.indexCount = indexCount;
+    packet.instanceCount = instanceCount;
+    packet.baseVertex = baseVertex;
+    addPacket(pass, material->instancedSortKey(), position, packet);
+}
+
+void RenderQueue::addPacket(Pass pass, uint32_t materialKey, const glm::vec3& position, const Packet& packet)
+{
+    // The camera looks down -z, depth is the distance in front of it
+    glm::vec4 viewPosition = mViewMatrix * glm::vec4(position, 1.0f);
+    uint64_t depth = depthBits(-viewPosition.z);
+
+    uint64_t key = uint64_t(pass) << PassShift;
+    if (pass == Opaque)
+        key |= (uint64_t(materialKey) << (PassShift - MaterialBits)) | depth;
+    else
+        key |= ((~depth & DepthMask) << MaterialBits) | materialKey;
+
+    SortEntry entry;
+    entry.key = key;
+    entry.packet = uint32_t(mPackets.size());
+    mSortEntries.emplace_back(entry);
+    mPackets.emplace_back(packet);
+}
+
+void RenderQueue::flush()
+{
+    if (mPackets.empty())
+        return;
+
+    sort();
+
+    IRenderDevice* device = mEngine->renderDevice();
+    size_t count = mSortEntries.size();
+    if (count <= PacketsPerSlice)
+        replay(0, count);
+    else {
+        // Each chunk of sorted draws is recorded by whichever thread picks it up
+        size_t sliceCount = (count + PacketsPerSlice - 1) / PacketsPerSlice;
+        device->beginSlices(unsigned(sliceCount));
+        mEngine->jobSystem()->parallelFor(count, PacketsPerSlice, [this, device](size_t begin, size_t end) {
+                device->beginSlice(unsigned(begin / PacketsPerSlice));
+                replay(begin, end);
+                device->endSlice();
+            });
+        device->endSlices();
+    }
+
+    mPackets.clear();
+    mSortEntries.clear();
+}
+
+void RenderQueue::sort()
+{
+    // LSD radix sort by bytes; stable, so draws with equal keys keep their submission order
+    size_t count = mSortEntries.size();
+    mSortScratch.resize(count);
+
+    SortEntry* src = mSortEntries.data();
+    SortEntry* dst = mSortScratch.data();
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t offsets[256] = {};
+        for (size_t i = 0; i < count; i++)
+            ++offsets[(src[i].key >> shift) & 0xFF];
+
+        // A byte all keys share leaves the order as it is
+        if (offsets[(src[0].key >> shift) & 0xFF] == count)
+            continue;
+
+        size_t offset = 0;
+        for (size_t& bucket : offsets) {
+            size_t bucketSize = bucket;
+            bucket = offset;
+            offset += bucketSize;
+        }
+
+        for (size_t i = 0; i < count; i++)
+            dst[offsets[(src[i].key >> shift) & 0xFF]++] = src[i];
+        std::swap(src, dst);
+    }
+
+    if (src != mSortEntries.data())
+        mSortEntries.swap(mSortScratch);
+}
+
+void RenderQueue::replay(size_t begin, size_t end) const
+{
+    // Slices start without pipeline state or vertex buffers, so every range binds its own
+    IRenderDevice* device = mEngine->renderDevice();
+    const Material* material = nullptr;
+    bool instanced = false;
+    const std::unique_ptr<IRenderBuffer>* vertexBuffer = nullptr;
+    for (size_t i = begin; i < end; i++) {
+        const Packet& packet = mPackets[mSortEntries[i].packet];
+        bool packetInstanced = (packet.instanceBuffer != nullptr);
+        if (packet.material != material || packetInstanced != instanced) {
+            material = packet.material;
+            instanced = packetInstanced;
+            if (instanced)
+                material->bindInstanced();
+            else
+                material->bind();
+        }
+        if (packet.vertexBuffer != vertexBuffer) {
+            vertexBuffer = packet.vertexBuffer;
+            device->setVertexBuffer(0, *vertexBuffer);
+        }
+        if (instanced) {
+            device->setPaletteBuffer(*packet.instanceBuffer, 0, 1);
+            device->drawIndexedPrimitiveInstanced(*packet.indexBuffer, packet.firstIndex, packet.indexCount,
+                packet.instanceCount, packet.baseVertex);
+        } else {
+            device->setModelMatrix(packet.modelMatrix);
+            device->drawIndexedPrimitive(*packet.indexBuffer, packet.firstIndex, packet.indexCount, packet.baseVertex);
+        }
+    }
+}
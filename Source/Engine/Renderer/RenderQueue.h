@@ -0,0 +1,90 @@
+#pragma once
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct ShaderCode;
+class Engine;
+class IRenderBuffer;
+class Material;
+
+// Draws of a frame, collected in scene order and replayed to the render device sorted by a 64-bit
+// key, so that each material is bound about once per frame. Opaque draws are sorted by pipeline,
+// material and then front to back; transparent draws back to front, then by pipeline and material.
+// Buffers and materials are kept by pointer until flush().
+class RenderQueue
+{
+public:
+    enum Pass
+    {
+        Opaque,
+        Transparent,
+    };
+
+    explicit RenderQueue(Engine* engine);
+    ~RenderQueue();
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    // Key bits of a new material; materials with the same shader share a pipeline
+    uint32_t registerMaterial(const ShaderCode* shader);
+
+    // Key bits of another pipeline of a registered material, such as its instanced one
+    uint32_t registerVariant(uint32_t materialKey, const ShaderCode* shader);
+
+    // Starts collecting; depth is measured along the view direction of viewMatrix
+    void begin(const glm::mat4& viewMatrix);
+
+    void submit(Pass pass, const Material* material, const glm::mat4& modelMatrix,
+        const std::unique_ptr<IRenderBuffer>& vertexBuffer, const std::unique_ptr<IRenderBuffer>& indexBuffer,
+        unsigned firstIndex, unsigned indexCount, unsigned baseVertex = 0);
+
+    // Instanced draw with the material's instanced pipeline; the depth of all instances is taken at
+    // position, and instanceBuffer is bound as the palette buffer
+    void submitInstanced(Pass pass, const Material* material, const glm::vec3& position,
+        const std::unique_ptr<IRenderBuffer>& vertexBuffer, const std::unique_ptr<IRenderBuffer>& indexBuffer,
+        unsigned firstIndex, unsigned indexCount, const std::unique_ptr<IRenderBuffer>& instanceBuffer, unsigned instanceCount,
+        unsigned baseVertex = 0);
+
+    // Sorts and records the draws submitted since begin(), in slices when there are many
+    void flush();
+
+    size_t packetCount() const { return mPackets.size(); }
+
+private:
+    struct Packet
+    {
+        glm::mat4 modelMatrix;
+        const Material* material;
+        const std::unique_ptr<IRenderBuffer>* vertexBuffer;
+        const std::unique_ptr<IRenderBuffer>* indexBuffer;
+        const std::unique_ptr<IRenderBuffer>* instanceBuffer; // null unless instanced
+        unsigned firstIndex;
+        unsigned indexCount;
+        unsigned instanceCount;
+        unsigned baseVertex;
+    };
+
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t packet;
+    };
+
+    Engine* mEngine;
+    glm::mat4 mViewMatrix;
+    std::vector<Packet> mPackets;
+    std::vector<SortEntry> mSortEntries;
+    std::vector<SortEntry> mSortScratch;
+    std::unordered_map<const ShaderCode*, uint32_t> mPipelineIds;
+    uint32_t mMaterialCount;
+
+    uint32_t pipelineId(const ShaderCode* shader);
+    void addPacket(Pass pass, uint32_t materialKey, const glm::vec3& position, const Packet& packet);
+    void sort();
+    void replay(size_t begin, size_t end) const;
+};
@@ -0,0 +1,118 @@
+#include "RenderStateShadow.h"
+#include <cassert>
+
+RenderStateShadow::RenderStateShadow()
+{
+    invalidate();
+}
+
+void RenderStateShadow::invalidate()
+{
+    invalidateBindings();
+    for (auto& texture : mTextures)
+        texture = nullptr;
+    mKnownUniforms = 0;
+}
+
+void RenderStateShadow::invalidateBindings()
+{
+    // Null is never a valid binding, so that the next set*() of anything is issued
+    mPipelineState = nullptr;
+    for (int i = 0; i < MaxVertexBuffers; i++) {
+        mVertexBuffers[i] = nullptr;
+        mVertexBufferOffsets[i] = 0;
+    }
+    mIndexBuffer = nullptr;
+}
+
+void RenderStateShadow::inherit(const RenderStateShadow& other)
+{
+    BindingCounters counters = mCounters;
+    *this = other;
+    mCounters = counters;
+    invalidateBindings();
+}
+
+bool RenderStateShadow::setPipelineState(const void* state)
+{
+    ++mCounters.pipelines.requested;
+    if (mPipelineState == state)
+        return false;
+
+    mPipelineState = state;
+    ++mCounters.pipelines.issued;
+    return true;
+}
+
+bool RenderStateShadow::setVertexBuffer(int index, const void* buffer, unsigned offset)
+{
+    assert(index >= 0 && index < MaxVertexBuffers);
+    ++mCounters.vertexBuffers.requested;
+    if (mVertexBuffers[index] == buffer && mVertexBufferOffsets[index] == offset)
+        return false;
+
+    mVertexBuffers[index] = buffer;
+    mVertexBufferOffsets[index] = offset;
+    ++mCounters.vertexBuffers.issued;
+    return true;
+}
+
+bool RenderStateShadow::setIndexBuffer(const void* buffer)
+{
+    ++mCounters.indexBuffers.requested;
+    if (mIndexBuffer == buffer)
+        return false;
+
+    mIndexBuffer = buffer;
+    ++mCounters.indexBuffers.issued;
+    return true;
+}
+
+bool RenderStateShadow::setTexture(int index, const void* texture)
+{
+    assert(index >= 0 && index < MaxTextures);
+    ++mCounters.textures.requested;
+    if (mTextures[index] == texture)
+        return false;
+
+    mTextures[index] = texture;
+    ++mCounters.textures.issued;
+    return true;
+}
+
+bool RenderStateShadow::setProjectionMatrix(const glm::mat4& matrix)
+{
+    return setUniform(ProjectionMatrix, mProjectionMatrix, matrix);
+}
+
+bool RenderStateShadow::setViewMatrix(const glm::mat4& matrix)
+{
+    return setUniform(ViewMatrix, mViewMatrix, matrix);
+}
+
+bool RenderStateShadow::setModelMatrix(const glm::mat4& matrix)
+{
+    return setUniform(ModelMatrix, mModelMatrix, matrix);
+}
+
+bool RenderStateShadow::setLightPosition(const glm::vec3& position)
+{
+    return setUniform(LightPosition, mLightPosition, position);
+}
+
+bool RenderStateShadow::setAmbientColor(const glm::vec4& color)
+{
+    return setUniform(AmbientColor, mAmbientColor, color);
+}
+
+template <typename T> bool RenderStateShadow::setUniform(Uniform uniform, T& current, const T& value)
+{
+    ++mCounters.uniforms.requested;
+    if ((mKnownUniforms & (1 << uniform)) && current == value)
+        return false;
+
+    current = value;
+    mKnownUniforms |= (1 << uniform);
+    ++mCounters.uniforms.issued;
+    return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "Engine/Renderer/IRenderDevice.h"
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+// Bindings and uniforms of one command stream as they were last passed to the GPU API, so that a
+// device can skip setting them again. Every set*() counts as a request and returns whether the value
+// changed, in which case the device has to issue it. Objects are compared by their native handles,
+// so that two states sharing one native pipeline count as the same.
+class RenderStateShadow
+{
+public:
+    enum { MaxVertexBuffers = 4, MaxTextures = 2 };
+
+    RenderStateShadow();
+
+    // Forgets everything, for a new command buffer or encoder
+    void invalidate();
+
+    // Forgets pipeline and buffers, but keeps textures and uniforms; slices inherit those
+    void invalidateBindings();
+
+    // Starts a slice from the state of the stream it continues, keeping this stream's counters
+    void inherit(const RenderStateShadow& other);
+
+    bool setPipelineState(const void* state);
+    bool setVertexBuffer(int index, const void* buffer, unsigned offset);
+    bool setIndexBuffer(const void* buffer);
+    bool setTexture(int index, const void* texture);
+
+    bool setProjectionMatrix(const glm::mat4& matrix);
+    bool setViewMatrix(const glm::mat4& matrix);
+    bool setModelMatrix(const glm::mat4& matrix);
+    bool setLightPosition(const glm::vec3& position);
+    bool setAmbientColor(const glm::vec4& color);
+
+    const BindingCounters& counters() const { return mCounters; }
+    void resetCounters() { mCounters = BindingCounters(); }
+
+private:
+    enum Uniform
+    {
+        ProjectionMatrix,
+        ViewMatrix,
+        ModelMatrix,
+        LightPosition,
+        AmbientColor,
+    };
+
+    const void* mPipelineState;
+    const void* mVertexBuffers[MaxVertexBuffers];
+    unsigned mVertexBufferOffsets[MaxVertexBuffers];
+    const void* mIndexBuffer;
+    const void* mTextures[MaxTextures];
+    glm::mat4 mProjectionMatrix;
+    glm::mat4 mViewMatrix;
+    glm::mat4 mModelMatrix;
+    glm::vec3 mLightPosition;
+    glm::vec4 mAmbientColor;
+    unsigned mKnownUniforms; // bit per Uniform
+    BindingCounters mCounters;
+
+    template <typename T> bool setUniform(Uniform uniform, T& current, const T& value);
+};
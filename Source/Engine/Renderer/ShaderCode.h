@@ -9,4 +9,8 @@ struct ShaderCode
     size_t vulkanVertexSize;
     const void* vulkanFragment;
     size_t vulkanFragmentSize;
+    const void* vulkanBindlessVertex; // compiled with BINDLESS defined, for devices with a texture table
+    size_t vulkanBindlessVertexSize;
+    const void* vulkanBindlessFragment;
+    size_t vulkanBindlessFragmentSize;
 };
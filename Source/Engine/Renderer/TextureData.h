@@ -1,8 +1,86 @@
 #pragma once
+#include <stddef.h>
+
+enum class TextureFormat
+{
+    RGBA8,
+    RGBA16F,
+    RGBA32F,
+    BC1,    // RGB, 1-bit alpha
+    BC3,    // RGBA
+    BC5,    // two channels, for normal maps; z = sqrt(1 - x^2 - y^2)
+    BC7,    // RGBA
+};
 
 struct TextureData
 {
-    const void* pixels;
+    const void* pixels; // all mip levels, largest first
     unsigned width;
     unsigned height;
+    unsigned mipLevels;
+    TextureFormat format;
 };
+
+inline unsigned bytesPerPixel(TextureFormat format)
+{
+    switch (format) {
+        case TextureFormat::RGBA8: return 4;
+        case TextureFormat::RGBA16F: return 8;
+        case TextureFormat::RGBA32F: return 16;
+        default: break;
+    }
+    return 0;
+}
+
+inline bool isBlockCompressed(TextureFormat format)
+{
+    switch (format) {
+        case TextureFormat::BC1:
+        case TextureFormat::BC3:
+        case TextureFormat::BC5:
+        case TextureFormat::BC7:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Block compressed formats store 4x4 pixel blocks, others are treated as 1x1 blocks
+inline unsigned blockDimension(TextureFormat format)
+{
+    return (isBlockCompressed(format) ? 4 : 1);
+}
+
+inline unsigned bytesPerBlock(TextureFormat format)
+{
+    switch (format) {
+        case TextureFormat::BC1: return 8;
+        case TextureFormat::BC3: return 16;
+        case TextureFormat::BC5: return 16;
+        case TextureFormat::BC7: return 16;
+        default: return bytesPerPixel(format);
+    }
+}
+
+inline unsigned mipLevelDimension(unsigned size, unsigned level)
+{
+    size >>= level;
+    return (size > 0 ? size : 1);
+}
+
+inline size_t textureRowPitch(TextureFormat format, unsigned width)
+{
+    unsigned block = blockDimension(format);
+    return size_t((width + block - 1) / block) * bytesPerBlock(format);
+}
+
+inline size_t textureRowCount(TextureFormat format, unsigned height)
+{
+    unsigned block = blockDimension(format);
+    return size_t((height + block - 1) / block);
+}
+
+inline size_t mipLevelSize(TextureFormat format, unsigned width, unsigned height)
+{
+    return textureRowPitch(format, width) * textureRowCount(format, height);
+}
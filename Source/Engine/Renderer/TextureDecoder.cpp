@@ -0,0 +1,180 @@
+#include "TextureDecoder.h"
+#include <assert.h>
+
+namespace
+{
+    // Interpolation weights of the 4-bit indices of BC7
+    const int Bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    unsigned readBits(const uint8_t* in, unsigned& bitOffset, unsigned bitCount)
+    {
+        unsigned value = 0;
+        for (unsigned i = 0; i < bitCount; i++, bitOffset++) {
+            if (in[bitOffset / 8] & (1u << (bitOffset % 8)))
+                value |= 1u << i;
+        }
+        return value;
+    }
+
+    void unpackRgb565(unsigned packed, uint8_t* color)
+    {
+        unsigned r = (packed >> 11) & 31;
+        unsigned g = (packed >> 5) & 63;
+        unsigned b = packed & 31;
+        color[0] = uint8_t((r << 3) | (r >> 2));
+        color[1] = uint8_t((g << 2) | (g >> 4));
+        color[2] = uint8_t((b << 3) | (b >> 2));
+        color[3] = 255;
+    }
+
+    // Color part of a BC1 or BC3 block; BC3 always uses four colors
+    void decodeColorBlock(const uint8_t* in, bool allowTransparent, uint8_t (*pixels)[4])
+    {
+        unsigned c0 = unsigned(in[0] | (in[1] << 8));
+        unsigned c1 = unsigned(in[2] | (in[3] << 8));
+
+        uint8_t palette[4][4];
+        unpackRgb565(c0, palette[0]);
+        unpackRgb565(c1, palette[1]);
+        if (c0 > c1 || !allowTransparent) {
+            for (unsigned c = 0; c < 3; c++) {
+                palette[2][c] = uint8_t((2 * palette[0][c] + palette[1][c]) / 3);
+                palette[3][c] = uint8_t((palette[0][c] + 2 * palette[1][c]) / 3);
+            }
+            palette[2][3] = palette[3][3] = 255;
+        } else {
+            for (unsigned c = 0; c < 3; c++) {
+                palette[2][c] = uint8_t((palette[0][c] + palette[1][c]) / 2);
+                palette[3][c] = 0;
+            }
+            palette[2][3] = 255;
+            palette[3][3] = 0;
+        }
+
+        uint32_t indices = uint32_t(in[4] | (in[5] << 8) | (in[6] << 16) | (uint32_t(in[7]) << 24));
+        for (unsigned i = 0; i < 16; i++) {
+            const uint8_t* color = palette[(indices >> (i * 2)) & 3];
+            for (unsigned c = 0; c < 4; c++)
+                pixels[i][c] = color[c];
+        }
+    }
+
+    // BC4 block of one channel, also used for the alpha of BC3 and both channels of BC5
+    void decodeChannelBlock(const uint8_t* in, unsigned channel, uint8_t (*pixels)[4])
+    {
+        unsigned a0 = in[0];
+        unsigned a1 = in[1];
+
+        unsigned palette[8];
+        palette[0] = a0;
+        palette[1] = a1;
+        if (a0 > a1) {
+            for (unsigned j = 2; j < 8; j++)
+                palette[j] = ((8 - j) * a0 + (j - 1) * a1) / 7;
+        } else {
+            for (unsigned j = 2; j < 6; j++)
+                palette[j] = ((6 - j) * a0 + (j - 1) * a1) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+
+        unsigned bitOffset = 16;
+        for (unsigned i = 0; i < 16; i++)
+            pixels[i][channel] = uint8_t(palette[readBits(in, bitOffset, 3)]);
+    }
+
+    void decodeBc7Block(const uint8_t* in, uint8_t (*pixels)[4])
+    {
+        unsigned bitOffset = 0;
+        if (readBits(in, bitOffset, 7) != (1u << 6)) {
+            for (unsigned i = 0; i < 16; i++) {
+                pixels[i][0] = pixels[i][1] = pixels[i][2] = 0;
+                pixels[i][3] = 255;
+            }
+            return;
+        }
+
+        unsigned endpoints[2][4];
+        for (unsigned c = 0; c < 4; c++) {
+            endpoints[0][c] = readBits(in, bitOffset, 7);
+            endpoints[1][c] = readBits(in, bitOffset, 7);
+        }
+        unsigned p0 = readBits(in, bitOffset, 1);
+        unsigned p1 = readBits(in, bitOffset, 1);
+
+        for (unsigned i = 0; i < 16; i++) {
+            int weight = Bc7Weights[readBits(in, bitOffset, (i == 0 ? 3 : 4))];
+            for (unsigned c = 0; c < 4; c++) {
+                int v0 = int((endpoints[0][c] << 1) | p0);
+                int v1 = int((endpoints[1][c] << 1) | p1);
+                pixels[i][c] = uint8_t(((64 - weight) * v0 + weight * v1 + 32) >> 6);
+            }
+        }
+        assert(bitOffset == 128);
+    }
+
+    void decodeBlock(TextureFormat format, const uint8_t* in, uint8_t (*pixels)[4])
+    {
+        switch (format) {
+            case TextureFormat::BC1:
+                decodeColorBlock(in, true, pixels);
+                break;
+            case TextureFormat::BC3:
+                decodeColorBlock(in + 8, false, pixels);
+                decodeChannelBlock(in, 3, pixels);
+                break;
+            case TextureFormat::BC5:
+                decodeChannelBlock(in, 0, pixels);
+                decodeChannelBlock(in + 8, 1, pixels);
+                for (unsigned i = 0; i < 16; i++) {
+                    pixels[i][2] = 0;
+                    pixels[i][3] = 255;
+                }
+                break;
+            case TextureFormat::BC7:
+                decodeBc7Block(in, pixels);
+                break;
+            default:
+                assert(false);
+                break;
+        }
+    }
+}
+
+void decodeTexture(const TextureData& data, std::vector<uint8_t>& output)
+{
+    assert(isBlockCompressed(data.format));
+
+    size_t size = 0;
+    for (unsigned level = 0; level < data.mipLevels; level++)
+        size += mipLevelSize(TextureFormat::RGBA8, mipLevelDimension(data.width, level), mipLevelDimension(data.height, level));
+    output.resize(size);
+
+    // Blocks past the right or bottom edge of a level are decoded and dropped
+    auto source = static_cast<const uint8_t*>(data.pixels);
+    uint8_t* target = output.data();
+    const unsigned blockSize = bytesPerBlock(data.format);
+    for (unsigned level = 0; level < data.mipLevels; level++) {
+        unsigned width = mipLevelDimension(data.width, level);
+        unsigned height = mipLevelDimension(data.height, level);
+        unsigned blocksX = unsigned(textureRowPitch(data.format, width) / blockSize);
+        unsigned blocksY = unsigned(textureRowCount(data.format, height));
+
+        for (unsigned blockY = 0; blockY < blocksY; blockY++) {
+            for (unsigned blockX = 0; blockX < blocksX; blockX++, source += blockSize) {
+                uint8_t pixels[16][4];
+                decodeBlock(data.format, source, pixels);
+
+                for (unsigned y = 0; y < 4 && blockY * 4 + y < height; y++) {
+                    for (unsigned x = 0; x < 4 && blockX * 4 + x < width; x++) {
+                        uint8_t* pixel = &target[((blockY * 4 + y) * width + blockX * 4 + x) * 4];
+                        for (unsigned c = 0; c < 4; c++)
+                            pixel[c] = pixels[y * 4 + x][c];
+                    }
+                }
+            }
+        }
+
+        target += size_t(width) * height * 4;
+    }
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include "Engine/Renderer/TextureData.h"
+#include <stdint.h>
+#include <vector>
+
+// Decodes all mip levels of a block compressed texture to RGBA8, largest first, for devices that cannot
+// sample the compressed format. BC5 decodes to (x, y, 0, 255). Of BC7 only mode 6 is decoded, which is
+// all the importer writes; blocks in other modes come out opaque black.
+void decodeTexture(const TextureData& data, std::vector<uint8_t>& output);
@@ -1,6 +1,8 @@
 #include "VulkanCommon.h"
+#include <algorithm>
 #include <memory>
 #include <cassert>
+#include <cstring>
 
 bool vulkanHasValidationLayer;
 VkInstance vulkanInstance;
@@ -12,12 +14,17 @@ PFN_vkEnumerateInstanceExtensionProperties vkEnumerateInstanceExtensionPropertie
 PFN_vkEnumerateInstanceLayerProperties vkEnumerateInstanceLayerProperties;
 PFN_vkEnumeratePhysicalDevices vkEnumeratePhysicalDevices;
 PFN_vkGetPhysicalDeviceProperties vkGetPhysicalDeviceProperties;
+PFN_vkGetPhysicalDeviceFeatures vkGetPhysicalDeviceFeatures;
+PFN_vkGetPhysicalDeviceFeatures2 vkGetPhysicalDeviceFeatures2;
+PFN_vkGetPhysicalDeviceProperties2 vkGetPhysicalDeviceProperties2;
+PFN_vkEnumerateDeviceExtensionProperties vkEnumerateDeviceExtensionProperties;
 PFN_vkGetPhysicalDeviceQueueFamilyProperties vkGetPhysicalDeviceQueueFamilyProperties;
 PFN_vkCreateDevice vkCreateDevice;
 PFN_vkDestroyDevice vkDestroyDevice;
 PFN_vkGetDeviceQueue vkGetDeviceQueue;
 PFN_vkCreateCommandPool vkCreateCommandPool;
 PFN_vkDestroyCommandPool vkDestroyCommandPool;
+PFN_vkResetCommandPool vkResetCommandPool;
 PFN_vkAllocateCommandBuffers vkAllocateCommandBuffers;
 PFN_vkFreeCommandBuffers vkFreeCommandBuffers;
 PFN_vkCreateFence vkCreateFence;
@@ -28,7 +35,9 @@ PFN_vkEndCommandBuffer vkEndCommandBuffer;
 PFN_vkCmdPipelineBarrier vkCmdPipelineBarrier;
 PFN_vkQueueSubmit vkQueueSubmit;
 PFN_vkWaitForFences vkWaitForFences;
+PFN_vkGetFenceStatus vkGetFenceStatus;
 PFN_vkResetFences vkResetFences;
+PFN_vkDeviceWaitIdle vkDeviceWaitIdle;
 PFN_vkDestroySemaphore vkDestroySemaphore;
 PFN_vkResetCommandBuffer vkResetCommandBuffer;
 PFN_vkCreateImageView vkCreateImageView;
@@ -53,6 +62,9 @@ PFN_vkCreateShaderModule vkCreateShaderModule;
 PFN_vkDestroyShaderModule vkDestroyShaderModule;
 PFN_vkCreateGraphicsPipelines vkCreateGraphicsPipelines;
 PFN_vkDestroyPipeline vkDestroyPipeline;
+PFN_vkCreatePipelineCache vkCreatePipelineCache;
+PFN_vkDestroyPipelineCache vkDestroyPipelineCache;
+PFN_vkGetPipelineCacheData vkGetPipelineCacheData;
 PFN_vkCreatePipelineLayout vkCreatePipelineLayout;
 PFN_vkDestroyPipelineLayout vkDestroyPipelineLayout;
 PFN_vkCmdBeginRenderPass vkCmdBeginRenderPass;
@@ -62,16 +74,26 @@ PFN_vkCmdBindVertexBuffers vkCmdBindVertexBuffers;
 PFN_vkCmdBindIndexBuffer vkCmdBindIndexBuffer;
 PFN_vkCmdDraw vkCmdDraw;
 PFN_vkCmdDrawIndexed vkCmdDrawIndexed;
+PFN_vkCmdExecuteCommands vkCmdExecuteCommands;
+PFN_vkCmdPushConstants vkCmdPushConstants;
 PFN_vkCreateDescriptorSetLayout vkCreateDescriptorSetLayout;
 PFN_vkDestroyDescriptorSetLayout vkDestroyDescriptorSetLayout;
 PFN_vkCreateDescriptorPool vkCreateDescriptorPool;
 PFN_vkDestroyDescriptorPool vkDestroyDescriptorPool;
+PFN_vkResetDescriptorPool vkResetDescriptorPool;
 PFN_vkAllocateDescriptorSets vkAllocateDescriptorSets;
+PFN_vkFreeDescriptorSets vkFreeDescriptorSets;
 PFN_vkUpdateDescriptorSets vkUpdateDescriptorSets;
 PFN_vkCmdBindDescriptorSets vkCmdBindDescriptorSets;
+PFN_vkCmdCopyBuffer vkCmdCopyBuffer;
 PFN_vkCmdCopyBufferToImage vkCmdCopyBufferToImage;
 PFN_vkCreateSampler vkCreateSampler;
 PFN_vkDestroySampler vkDestroySampler;
+PFN_vkCreateQueryPool vkCreateQueryPool;
+PFN_vkDestroyQueryPool vkDestroyQueryPool;
+PFN_vkGetQueryPoolResults vkGetQueryPoolResults;
+PFN_vkCmdResetQueryPool vkCmdResetQueryPool;
+PFN_vkCmdWriteTimestamp vkCmdWriteTimestamp;
 
 PFN_vkGetPhysicalDeviceSurfaceSupportKHR vkGetPhysicalDeviceSurfaceSupportKHR;
 PFN_vkGetPhysicalDeviceSurfaceFormatsKHR vkGetPhysicalDeviceSurfaceFormatsKHR;
@@ -133,6 +155,111 @@ void vulkanEnumerateAvailableExtensions()
     vkEnumerateInstanceExtensionProperties(nullptr, &vulkanAvailableExtensionCount, vulkanAvailableExtensions.get());
 }
 
+template <typename T> static bool getVulkanExport(PFN_vkVoidFunction (*getExport)(const char* name), const char* name, T& fn)
+{
+    fn = (T)getExport(name);
+    if (!fn) {
+        char buf[1024];
+        snprintf(buf, sizeof(buf), "Entry point \"%s\" was not found in the Vulkan library.", name);
+        vulkanError(buf);
+        return false;
+    }
+    return true;
+}
+
+bool vulkanLoadExports(PFN_vkVoidFunction (*getExport)(const char* name))
+{
+    if (!getVulkanExport(getExport, "vkCreateInstance", vkCreateInstance) ||
+        !getVulkanExport(getExport, "vkGetInstanceProcAddr", vkGetInstanceProcAddr) ||
+        !getVulkanExport(getExport, "vkEnumerateInstanceExtensionProperties", vkEnumerateInstanceExtensionProperties) ||
+        !getVulkanExport(getExport, "vkEnumerateInstanceLayerProperties", vkEnumerateInstanceLayerProperties) ||
+        !getVulkanExport(getExport, "vkEnumeratePhysicalDevices", vkEnumeratePhysicalDevices) ||
+        !getVulkanExport(getExport, "vkGetPhysicalDeviceProperties", vkGetPhysicalDeviceProperties) ||
+        !getVulkanExport(getExport, "vkGetPhysicalDeviceFeatures", vkGetPhysicalDeviceFeatures) ||
+        !getVulkanExport(getExport, "vkGetPhysicalDeviceFeatures2", vkGetPhysicalDeviceFeatures2) ||
+        !getVulkanExport(getExport, "vkGetPhysicalDeviceProperties2", vkGetPhysicalDeviceProperties2) ||
+        !getVulkanExport(getExport, "vkEnumerateDeviceExtensionProperties", vkEnumerateDeviceExtensionProperties) ||
+        !getVulkanExport(getExport, "vkGetPhysicalDeviceQueueFamilyProperties", vkGetPhysicalDeviceQueueFamilyProperties) ||
+        !getVulkanExport(getExport, "vkCreateDevice", vkCreateDevice) ||
+        !getVulkanExport(getExport, "vkDestroyDevice", vkDestroyDevice) ||
+        !getVulkanExport(getExport, "vkGetDeviceQueue", vkGetDeviceQueue) ||
+        !getVulkanExport(getExport, "vkCreateCommandPool", vkCreateCommandPool) ||
+        !getVulkanExport(getExport, "vkDestroyCommandPool", vkDestroyCommandPool) ||
+        !getVulkanExport(getExport, "vkResetCommandPool", vkResetCommandPool) ||
+        !getVulkanExport(getExport, "vkAllocateCommandBuffers", vkAllocateCommandBuffers) ||
+        !getVulkanExport(getExport, "vkFreeCommandBuffers", vkFreeCommandBuffers) ||
+        !getVulkanExport(getExport, "vkCreateFence", vkCreateFence) ||
+        !getVulkanExport(getExport, "vkDestroyFence", vkDestroyFence) ||
+        !getVulkanExport(getExport, "vkCreateSemaphore", vkCreateSemaphore) ||
+        !getVulkanExport(getExport, "vkBeginCommandBuffer", vkBeginCommandBuffer) ||
+        !getVulkanExport(getExport, "vkEndCommandBuffer", vkEndCommandBuffer) ||
+        !getVulkanExport(getExport, "vkCmdPipelineBarrier", vkCmdPipelineBarrier) ||
+        !getVulkanExport(getExport, "vkQueueSubmit", vkQueueSubmit) ||
+        !getVulkanExport(getExport, "vkWaitForFences", vkWaitForFences) ||
+        !getVulkanExport(getExport, "vkGetFenceStatus", vkGetFenceStatus) ||
+        !getVulkanExport(getExport, "vkResetFences", vkResetFences) ||
+        !getVulkanExport(getExport, "vkDeviceWaitIdle", vkDeviceWaitIdle) ||
+        !getVulkanExport(getExport, "vkDestroySemaphore", vkDestroySemaphore) ||
+        !getVulkanExport(getExport, "vkResetCommandBuffer", vkResetCommandBuffer) ||
+        !getVulkanExport(getExport, "vkCreateImageView", vkCreateImageView) ||
+        !getVulkanExport(getExport, "vkDestroyImageView", vkDestroyImageView) ||
+        !getVulkanExport(getExport, "vkGetPhysicalDeviceMemoryProperties", vkGetPhysicalDeviceMemoryProperties) ||
+        !getVulkanExport(getExport, "vkCreateImage", vkCreateImage) ||
+        !getVulkanExport(getExport, "vkDestroyImage", vkDestroyImage) ||
+        !getVulkanExport(getExport, "vkGetImageMemoryRequirements", vkGetImageMemoryRequirements) ||
+        !getVulkanExport(getExport, "vkAllocateMemory", vkAllocateMemory) ||
+        !getVulkanExport(getExport, "vkFreeMemory", vkFreeMemory) ||
+        !getVulkanExport(getExport, "vkBindImageMemory", vkBindImageMemory) ||
+        !getVulkanExport(getExport, "vkCreateRenderPass", vkCreateRenderPass) ||
+        !getVulkanExport(getExport, "vkDestroyRenderPass", vkDestroyRenderPass) ||
+        !getVulkanExport(getExport, "vkCreateFramebuffer", vkCreateFramebuffer) ||
+        !getVulkanExport(getExport, "vkCreateBuffer", vkCreateBuffer) ||
+        !getVulkanExport(getExport, "vkDestroyBuffer", vkDestroyBuffer) ||
+        !getVulkanExport(getExport, "vkGetBufferMemoryRequirements", vkGetBufferMemoryRequirements) ||
+        !getVulkanExport(getExport, "vkMapMemory", vkMapMemory) ||
+        !getVulkanExport(getExport, "vkUnmapMemory", vkUnmapMemory) ||
+        !getVulkanExport(getExport, "vkBindBufferMemory", vkBindBufferMemory) ||
+        !getVulkanExport(getExport, "vkCreateShaderModule", vkCreateShaderModule) ||
+        !getVulkanExport(getExport, "vkDestroyShaderModule", vkDestroyShaderModule) ||
+        !getVulkanExport(getExport, "vkCreateGraphicsPipelines", vkCreateGraphicsPipelines) ||
+        !getVulkanExport(getExport, "vkDestroyPipeline", vkDestroyPipeline) ||
+        !getVulkanExport(getExport, "vkCreatePipelineCache", vkCreatePipelineCache) ||
+        !getVulkanExport(getExport, "vkDestroyPipelineCache", vkDestroyPipelineCache) ||
+        !getVulkanExport(getExport, "vkGetPipelineCacheData", vkGetPipelineCacheData) ||
+        !getVulkanExport(getExport, "vkCreatePipelineLayout", vkCreatePipelineLayout) ||
+        !getVulkanExport(getExport, "vkDestroyPipelineLayout", vkDestroyPipelineLayout) ||
+        !getVulkanExport(getExport, "vkCmdBeginRenderPass", vkCmdBeginRenderPass) ||
+        !getVulkanExport(getExport, "vkCmdEndRenderPass", vkCmdEndRenderPass) ||
+        !getVulkanExport(getExport, "vkCmdBindPipeline", vkCmdBindPipeline) ||
+        !getVulkanExport(getExport, "vkCmdBindVertexBuffers", vkCmdBindVertexBuffers) ||
+        !getVulkanExport(getExport, "vkCmdBindIndexBuffer", vkCmdBindIndexBuffer) ||
+        !getVulkanExport(getExport, "vkCmdDraw", vkCmdDraw) ||
+        !getVulkanExport(getExport, "vkCmdDrawIndexed", vkCmdDrawIndexed) ||
+        !getVulkanExport(getExport, "vkCmdExecuteCommands", vkCmdExecuteCommands) ||
+        !getVulkanExport(getExport, "vkCmdPushConstants", vkCmdPushConstants) ||
+        !getVulkanExport(getExport, "vkCreateDescriptorSetLayout", vkCreateDescriptorSetLayout) ||
+        !getVulkanExport(getExport, "vkDestroyDescriptorSetLayout", vkDestroyDescriptorSetLayout) ||
+        !getVulkanExport(getExport, "vkCreateDescriptorPool", vkCreateDescriptorPool) ||
+        !getVulkanExport(getExport, "vkDestroyDescriptorPool", vkDestroyDescriptorPool) ||
+        !getVulkanExport(getExport, "vkResetDescriptorPool", vkResetDescriptorPool) ||
+        !getVulkanExport(getExport, "vkAllocateDescriptorSets", vkAllocateDescriptorSets) ||
+        !getVulkanExport(getExport, "vkFreeDescriptorSets", vkFreeDescriptorSets) ||
+        !getVulkanExport(getExport, "vkUpdateDescriptorSets", vkUpdateDescriptorSets) ||
+        !getVulkanExport(getExport, "vkCmdBindDescriptorSets", vkCmdBindDescriptorSets) ||
+        !getVulkanExport(getExport, "vkCmdCopyBuffer", vkCmdCopyBuffer) ||
+        !getVulkanExport(getExport, "vkCmdCopyBufferToImage", vkCmdCopyBufferToImage) ||
+        !getVulkanExport(getExport, "vkCreateSampler", vkCreateSampler) ||
+        !getVulkanExport(getExport, "vkDestroySampler", vkDestroySampler) ||
+        !getVulkanExport(getExport, "vkCreateQueryPool", vkCreateQueryPool) ||
+        !getVulkanExport(getExport, "vkDestroyQueryPool", vkDestroyQueryPool) ||
+        !getVulkanExport(getExport, "vkGetQueryPoolResults", vkGetQueryPoolResults) ||
+        !getVulkanExport(getExport, "vkCmdResetQueryPool", vkCmdResetQueryPool) ||
+        !getVulkanExport(getExport, "vkCmdWriteTimestamp", vkCmdWriteTimestamp))
+        return false;
+
+    return true;
+}
+
 bool vulkanCreateInstance(const std::vector<const char*>& enabledExtensions)
 {
     VkApplicationInfo appInfo;
@@ -160,6 +287,11 @@ bool vulkanCreateInstance(const std::vector<const char*>& enabledExtensions)
         return false;
     }
 
+    // Without a surface the device renders offscreen and needs none of these
+    auto end = enabledExtensions.end();
+    if (std::find_if(enabledExtensions.begin(), end, [](const char* name) { return !strcmp(name, "VK_KHR_surface"); }) == end)
+        return true;
+
     if (!getVulkanProc("vkGetPhysicalDeviceSurfaceSupportKHR", vkGetPhysicalDeviceSurfaceSupportKHR) ||
         !getVulkanProc("vkGetPhysicalDeviceSurfaceFormatsKHR", vkGetPhysicalDeviceSurfaceFormatsKHR) ||
         !getVulkanProc("vkGetPhysicalDeviceSurfaceCapabilitiesKHR", vkGetPhysicalDeviceSurfaceCapabilitiesKHR) ||
@@ -0,0 +1,276 @@
+#include "VulkanMemoryAllocator.h"
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace
+{
+    const VkDeviceSize MegaByte = 1024 * 1024;
+    const VkDeviceSize SmallBlockSize = 64 * MegaByte;
+    const VkDeviceSize LargeBlockSize = 256 * MegaByte;
+    const VkDeviceSize LargeHeapSize = 4096 * MegaByte;
+
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+VulkanMemoryAllocator::VulkanMemoryAllocator(VkDevice device, const VkPhysicalDeviceMemoryProperties& properties, VkDeviceSize bufferImageGranularity)
+    : mDevice(device)
+    , mProperties(properties)
+    , mBufferImageGranularity(std::max(bufferImageGranularity, VkDeviceSize(1)))
+{
+}
+
+VulkanMemoryAllocator::~VulkanMemoryAllocator()
+{
+    for (auto& blocks : mBlocks) {
+        for (auto& block : blocks)
+            destroyBlock(block.get());
+    }
+}
+
+VulkanAllocation VulkanMemoryAllocator::allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, VulkanAllocationType type)
+{
+    assert(memoryType < mProperties.memoryTypeCount);
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    VulkanAllocation allocation;
+    allocation.size = requirements.size;
+    allocation.memoryType = memoryType;
+
+    // Resources larger than half a block get memory of their own
+    VkDeviceSize preferredBlockSize = blockSize(memoryType);
+    if (requirements.size > preferredBlockSize / 2) {
+        Block* block = createBlock(memoryType, requirements.size, true);
+        block->ranges[0] = Range{ requirements.size, type, false };
+        block->allocationCount = 1;
+        allocation.memory = block->memory;
+        allocation.mapped = block->mapped;
+        return allocation;
+    }
+
+    VkDeviceSize alignment = std::max(requirements.alignment, VkDeviceSize(1));
+    for (auto& block : mBlocks[memoryType]) {
+        if (!block->dedicated && allocateFromBlock(block.get(), requirements.size, alignment, type, allocation.offset)) {
+            allocation.memory = block->memory;
+            allocation.mapped = (block->mapped ? block->mapped + allocation.offset : nullptr);
+            return allocation;
+        }
+    }
+
+    Block* block = createBlock(memoryType, preferredBlockSize, false);
+    bool allocated = allocateFromBlock(block, requirements.size, alignment, type, allocation.offset);
+    assert(allocated);
+    (void)allocated;
+
+    allocation.memory = block->memory;
+    allocation.mapped = (block->mapped ? block->mapped + allocation.offset : nullptr);
+    return allocation;
+}
+
+void VulkanMemoryAllocator::free(const VulkanAllocation& allocation)
+{
+    if (!allocation.memory)
+        return;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto& blocks = mBlocks[allocation.memoryType];
+    auto it = std::find_if(blocks.begin(), blocks.end(),
+        [&allocation](const std::unique_ptr<Block>& block) { return block->memory == allocation.memory; });
+    assert(it != blocks.end());
+
+    Block* block = it->get();
+    if (!block->dedicated)
+        freeInBlock(block, allocation.offset);
+    else
+        block->allocationCount = 0;
+
+    // Keep one empty block per memory type around so that reloading does not go back to the driver
+    if (block->allocationCount == 0 && (block->dedicated || blocks.size() > 1)) {
+        destroyBlock(block);
+        blocks.erase(it);
+    }
+}
+
+VulkanMemoryStats VulkanMemoryAllocator::stats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    VulkanMemoryStats stats;
+    for (const auto& blocks : mBlocks) {
+        for (const auto& block : blocks) {
+            ++stats.blockCount;
+            stats.blockBytes += block->size;
+            stats.allocationCount += block->allocationCount;
+
+            for (const auto& range : block->ranges) {
+                if (range.second.free) {
+                    ++stats.freeRangeCount;
+                    stats.freeBytes += range.second.size;
+                    stats.largestFreeRange = std::max(stats.largestFreeRange, range.second.size);
+                } else
+                    stats.usedBytes += range.second.size;
+            }
+        }
+    }
+
+    return stats;
+}
+
+VkDeviceSize VulkanMemoryAllocator::blockSize(uint32_t memoryType) const
+{
+    VkDeviceSize heapSize = mProperties.memoryHeaps[mProperties.memoryTypes[memoryType].heapIndex].size;
+
+    // Small heaps such as the host visible part of video memory must not be taken up by one block
+    VkDeviceSize size = (heapSize >= LargeHeapSize ? LargeBlockSize : SmallBlockSize);
+    return std::min(size, std::max(heapSize / 8, MegaByte));
+}
+
+VulkanMemoryAllocator::Block* VulkanMemoryAllocator::createBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated)
+{
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    std::unique_ptr<Block> block{new Block};
+    block->memory = nullptr;
+    block->size = size;
+    block->mapped = nullptr;
+    block->dedicated = dedicated;
+    block->allocationCount = 0;
+
+    VkResult result = vkAllocateMemory(mDevice, &allocInfo, nullptr, &block->memory);
+    assert(result == VK_SUCCESS);   // FIXME: better error handling
+
+    if (mProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        void* mapped = nullptr;
+        result = vkMapMemory(mDevice, block->memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+        assert(result == VK_SUCCESS);   // FIXME: better error handling
+        block->mapped = static_cast<uint8_t*>(mapped);
+    }
+
+    if (!dedicated) {
+        block->ranges[0] = Range{ size, VulkanAllocationType::Buffer, true };
+        addFreeRange(block.get(), 0, size);
+    }
+
+    mBlocks[memoryType].emplace_back(std::move(block));
+    return mBlocks[memoryType].back().get();
+}
+
+void VulkanMemoryAllocator::destroyBlock(Block* block)
+{
+    if (block->mapped)
+        vkUnmapMemory(mDevice, block->memory);
+    vkFreeMemory(mDevice, block->memory, nullptr);
+}
+
+bool VulkanMemoryAllocator::allocateFromBlock(Block* block, VkDeviceSize size, VkDeviceSize alignment,
+    VulkanAllocationType type, VkDeviceSize& outOffset)
+{
+    // Best fit within the smallest size class that has a suitable range
+    for (unsigned sizeClassIndex = sizeClass(size); sizeClassIndex < SizeClassCount; sizeClassIndex++) {
+        const auto& freeRanges = block->freeRanges[sizeClassIndex];
+        for (auto it = freeRanges.lower_bound(std::make_pair(size, VkDeviceSize(0))); it != freeRanges.end(); ++it) {
+            VkDeviceSize rangeSize = it->first;
+            VkDeviceSize rangeOffset = it->second;
+            auto range = block->ranges.find(rangeOffset);
+            assert(range != block->ranges.end() && range->second.free);
+
+            // Free ranges are coalesced, so both neighbours are in use
+            VkDeviceSize offset = alignUp(rangeOffset, alignment);
+            if (range != block->ranges.begin()) {
+                auto previous = std::prev(range);
+                if (previous->second.type != type && samePage(previous->first + previous->second.size - 1, offset))
+                    offset = alignUp(offset, mBufferImageGranularity);
+            }
+
+            if (offset + size > rangeOffset + rangeSize)
+                continue;
+
+            auto next = std::next(range);
+            if (next != block->ranges.end() && next->second.type != type && samePage(offset + size - 1, next->first))
+                continue;
+
+            removeFreeRange(block, rangeOffset, rangeSize);
+            block->ranges.erase(range);
+
+            if (offset > rangeOffset) {
+                block->ranges[rangeOffset] = Range{ offset - rangeOffset, type, true };
+                addFreeRange(block, rangeOffset, offset - rangeOffset);
+            }
+
+            block->ranges[offset] = Range{ size, type, false };
+
+            VkDeviceSize end = offset + size;
+            VkDeviceSize rangeEnd = rangeOffset + rangeSize;
+            if (rangeEnd > end) {
+                block->ranges[end] = Range{ rangeEnd - end, type, true };
+                addFreeRange(block, end, rangeEnd - end);
+            }
+
+            ++block->allocationCount;
+            outOffset = offset;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void VulkanMemoryAllocator::freeInBlock(Block* block, VkDeviceSize offset)
+{
+    auto range = block->ranges.find(offset);
+    assert(range != block->ranges.end() && !range->second.free);
+
+    range->second.free = true;
+
+    if (range != block->ranges.begin()) {
+        auto previous = std::prev(range);
+        if (previous->second.free) {
+            removeFreeRange(block, previous->first, previous->second.size);
+            previous->second.size += range->second.size;
+            block->ranges.erase(range);
+            range = previous;
+        }
+    }
+
+    auto next = std::next(range);
+    if (next != block->ranges.end() && next->second.free) {
+        removeFreeRange(block, next->first, next->second.size);
+        range->second.size += next->second.size;
+        block->ranges.erase(next);
+    }
+
+    addFreeRange(block, range->first, range->second.size);
+
+    assert(block->allocationCount > 0);
+    --block->allocationCount;
+}
+
+bool VulkanMemoryAllocator::samePage(VkDeviceSize endOfFirst, VkDeviceSize startOfSecond) const
+{
+    return endOfFirst / mBufferImageGranularity == startOfSecond / mBufferImageGranularity;
+}
+
+unsigned VulkanMemoryAllocator::sizeClass(VkDeviceSize size)
+{
+    unsigned sizeClass = 0;
+    while (size >>= 1)
+        ++sizeClass;
+    return sizeClass;
+}
+
+void VulkanMemoryAllocator::addFreeRange(Block* block, VkDeviceSize offset, VkDeviceSize size)
+{
+    block->freeRanges[sizeClass(size)].emplace(size, offset);
+}
+
+void VulkanMemoryAllocator::removeFreeRange(Block* block, VkDeviceSize offset, VkDeviceSize size)
+{
+    block->freeRanges[sizeClass(size)].erase(std::make_pair(size, offset));
+}
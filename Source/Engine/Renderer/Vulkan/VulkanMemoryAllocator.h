@@ -0,0 +1,95 @@
+#pragma once
+#include "Engine/Renderer/Vulkan/VulkanCommon.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+// Buffers and optimal-tiling images may not share a bufferImageGranularity page
+enum class VulkanAllocationType : uint8_t
+{
+    Buffer,
+    Image
+};
+
+struct VulkanAllocation
+{
+    VkDeviceMemory memory = nullptr;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint8_t* mapped = nullptr; // host visible blocks stay mapped while they exist
+    uint32_t memoryType = 0;
+};
+
+struct VulkanMemoryStats
+{
+    size_t blockCount = 0;
+    size_t allocationCount = 0;
+    size_t freeRangeCount = 0;
+    VkDeviceSize blockBytes = 0; // allocated from the driver
+    VkDeviceSize usedBytes = 0;
+    VkDeviceSize freeBytes = 0;
+    VkDeviceSize largestFreeRange = 0;
+
+    // 0 while all free space is a single range, approaching 1 as it splits into small ranges
+    float fragmentation() const { return freeBytes > 0 ? 1.0f - float(largestFreeRange) / float(freeBytes) : 0.0f; }
+};
+
+// Sub-allocates buffers and images from large VkDeviceMemory blocks, one set of blocks per memory type.
+// Free space of a block is kept in power-of-two size classes and coalesced when allocations are freed.
+class VulkanMemoryAllocator
+{
+public:
+    VulkanMemoryAllocator(VkDevice device, const VkPhysicalDeviceMemoryProperties& properties, VkDeviceSize bufferImageGranularity);
+    ~VulkanMemoryAllocator();
+
+    VulkanMemoryAllocator(const VulkanMemoryAllocator&) = delete;
+    VulkanMemoryAllocator& operator=(const VulkanMemoryAllocator&) = delete;
+
+    VulkanAllocation allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, VulkanAllocationType type);
+    void free(const VulkanAllocation& allocation);
+
+    VulkanMemoryStats stats() const;
+
+private:
+    enum { SizeClassCount = 64 };
+
+    struct Range
+    {
+        VkDeviceSize size;
+        VulkanAllocationType type;
+        bool free;
+    };
+
+    struct Block
+    {
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        uint8_t* mapped;
+        bool dedicated;
+        size_t allocationCount;
+        std::map<VkDeviceSize, Range> ranges; // by offset, covering the whole block
+        std::set<std::pair<VkDeviceSize, VkDeviceSize>> freeRanges[SizeClassCount]; // size and offset
+    };
+
+    VkDevice mDevice;
+    VkPhysicalDeviceMemoryProperties mProperties;
+    VkDeviceSize mBufferImageGranularity;
+    std::vector<std::unique_ptr<Block>> mBlocks[VK_MAX_MEMORY_TYPES];
+    mutable std::mutex mMutex;
+
+    VkDeviceSize blockSize(uint32_t memoryType) const;
+    Block* createBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated);
+    void destroyBlock(Block* block);
+
+    bool allocateFromBlock(Block* block, VkDeviceSize size, VkDeviceSize alignment,
+        VulkanAllocationType type, VkDeviceSize& outOffset);
+    void freeInBlock(Block* block, VkDeviceSize offset);
+
+    bool samePage(VkDeviceSize endOfFirst, VkDeviceSize startOfSecond) const;
+    static unsigned sizeClass(VkDeviceSize size);
+    static void addFreeRange(Block* block, VkDeviceSize offset, VkDeviceSize size);
+    static void removeFreeRange(Block* block, VkDeviceSize offset, VkDeviceSize size);
+};
@@ -0,0 +1,155 @@
+#include "VulkanPipelineCache.h"
+#include "Engine/Renderer/VertexFormat.h"
+#include <cassert>
+#include <cstring>
+#include <stdio.h>
+
+namespace
+{
+    // Header that starts the data of every VkPipelineCache
+    const size_t CacheHeaderSize = 16 + VK_UUID_SIZE;
+
+    uint32_t readUint32(const char* data)
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+}
+
+VulkanPipelineKey::VulkanPipelineKey(const ShaderCode* shader, PrimitiveType primitiveType, const VertexFormat& vertexFormat)
+    : shader(shader)
+    , primitiveType(primitiveType)
+{
+    this->vertexFormat.reserve(vertexFormat.attributes().size() * 3 + vertexFormat.bufferCount());
+    for (const auto& attr : vertexFormat.attributes()) {
+        this->vertexFormat.push_back(uint32_t(attr.type));
+        this->vertexFormat.push_back(attr.offset);
+        this->vertexFormat.push_back(uint32_t(attr.bufferIndex));
+    }
+    for (unsigned bufferIndex = 0; bufferIndex < vertexFormat.bufferCount(); bufferIndex++)
+        this->vertexFormat.push_back(vertexFormat.stride(bufferIndex));
+}
+
+size_t VulkanPipelineKeyHash::operator()(const VulkanPipelineKey& key) const
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    auto combine = [&hash](uint64_t value) {
+        hash ^= value;
+        hash *= 1099511628211ull;
+    };
+
+    combine(uint64_t(reinterpret_cast<uintptr_t>(key.shader)));
+    combine(uint64_t(key.primitiveType));
+    for (uint32_t value : key.vertexFormat)
+        combine(value);
+
+    return size_t(hash);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+VulkanPipelineCache::VulkanPipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties, const char* fileName)
+    : mDevice(device)
+    , mProperties(properties)
+    , mFileName(fileName)
+    , mCache(nullptr)
+{
+    std::vector<char> data;
+    bool loaded = load(data);
+
+    VkPipelineCacheCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    info.initialDataSize = (loaded ? data.size() : 0);
+    info.pInitialData = (loaded ? data.data() : nullptr);
+
+    VkResult result = vkCreatePipelineCache(mDevice, &info, nullptr, &mCache);
+    if (result != VK_SUCCESS && loaded) {
+        // Start over rather than fail on data the driver does not like
+        info.initialDataSize = 0;
+        info.pInitialData = nullptr;
+        result = vkCreatePipelineCache(mDevice, &info, nullptr, &mCache);
+    }
+    assert(result == VK_SUCCESS);   // FIXME: better error handling
+}
+
+VulkanPipelineCache::~VulkanPipelineCache()
+{
+    for (const auto& it : mPipelines)
+        vkDestroyPipeline(mDevice, it.second, nullptr);
+    if (mCache)
+        vkDestroyPipelineCache(mDevice, mCache, nullptr);
+}
+
+VkPipeline VulkanPipelineCache::find(const VulkanPipelineKey& key) const
+{
+    auto it = mPipelines.find(key);
+    return (it != mPipelines.end() ? it->second : VK_NULL_HANDLE);
+}
+
+void VulkanPipelineCache::insert(VulkanPipelineKey&& key, VkPipeline pipeline)
+{
+    bool inserted = mPipelines.emplace(std::move(key), pipeline).second;
+    assert(inserted);
+    (void)inserted;
+}
+
+bool VulkanPipelineCache::load(std::vector<char>& data) const
+{
+    FILE* f = fopen(mFileName.c_str(), "rb");
+    if (!f)
+        return false;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    bool success = false;
+    if (size >= long(CacheHeaderSize)) {
+        data.resize(size_t(size));
+        success = (fread(data.data(), 1, data.size(), f) == data.size());
+    }
+    fclose(f);
+
+    if (!success)
+        return false;
+
+    // Data of another driver or device is useless, even if the driver would accept it
+    const char* header = data.data();
+    return readUint32(header + 0) >= CacheHeaderSize
+        && readUint32(header + 4) == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && readUint32(header + 8) == mProperties.vendorID
+        && readUint32(header + 12) == mProperties.deviceID
+        && memcmp(header + 16, mProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+bool VulkanPipelineCache::save() const
+{
+    size_t size = 0;
+    VkResult result = vkGetPipelineCacheData(mDevice, mCache, &size, nullptr);
+    if (result != VK_SUCCESS || size == 0)
+        return false;
+
+    std::vector<char> data(size);
+    result = vkGetPipelineCacheData(mDevice, mCache, &size, data.data());
+    if (result != VK_SUCCESS)
+        return false;
+
+    // Written next to the old file first, so that a crash does not leave a truncated cache behind
+    std::string tempFileName = mFileName + ".tmp";
+    FILE* f = fopen(tempFileName.c_str(), "wb");
+    if (!f)
+        return false;
+
+    bool success = (fwrite(data.data(), 1, size, f) == size);
+    success = (fclose(f) == 0) && success;
+    if (success) {
+        remove(mFileName.c_str());
+        success = (rename(tempFileName.c_str(), mFileName.c_str()) == 0);
+    }
+    if (!success)
+        remove(tempFileName.c_str());
+
+    return success;
+}
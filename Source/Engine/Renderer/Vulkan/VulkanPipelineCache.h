@@ -0,0 +1,61 @@
+#pragma once
+#include "Engine/Renderer/IRenderDevice.h"
+#include "Engine/Renderer/Vulkan/VulkanCommon.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class VertexFormat;
+
+// Everything a pipeline is built from besides the device-wide render pass, layout and viewport.
+// Shaders are identified by their compiled code, which outlives any shader program created from it.
+struct VulkanPipelineKey
+{
+    const ShaderCode* shader;
+    PrimitiveType primitiveType;
+    std::vector<uint32_t> vertexFormat; // attributes and strides
+
+    VulkanPipelineKey(const ShaderCode* shader, PrimitiveType primitiveType, const VertexFormat& vertexFormat);
+
+    bool operator==(const VulkanPipelineKey& other) const
+    {
+        return shader == other.shader && primitiveType == other.primitiveType && vertexFormat == other.vertexFormat;
+    }
+};
+
+struct VulkanPipelineKeyHash
+{
+    size_t operator()(const VulkanPipelineKey& key) const;
+};
+
+// Pipelines shared by all materials with the same key; they live until the device is destroyed.
+// Compilation goes through a VkPipelineCache that is loaded from and saved to disk, so that later
+// runs only compile what changed.
+class VulkanPipelineCache
+{
+public:
+    VulkanPipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties, const char* fileName);
+    ~VulkanPipelineCache();
+
+    VulkanPipelineCache(const VulkanPipelineCache&) = delete;
+    VulkanPipelineCache& operator=(const VulkanPipelineCache&) = delete;
+
+    VkPipelineCache nativeCache() const { return mCache; }
+
+    VkPipeline find(const VulkanPipelineKey& key) const;
+    void insert(VulkanPipelineKey&& key, VkPipeline pipeline);
+
+    size_t pipelineCount() const { return mPipelines.size(); }
+
+    // Writes the driver's cache data back to disk
+    bool save() const;
+
+private:
+    VkDevice mDevice;
+    VkPhysicalDeviceProperties mProperties;
+    std::string mFileName;
+    VkPipelineCache mCache;
+    std::unordered_map<VulkanPipelineKey, VkPipeline, VulkanPipelineKeyHash> mPipelines;
+
+    bool load(std::vector<char>& data) const;
+};
@@ -1,15 +1,11 @@
 #include "VulkanPipelineState.h"
-#include "Engine/Renderer/Vulkan/VulkanRenderDevice.h"
 
-VulkanPipelineState::VulkanPipelineState(VulkanRenderDevice* device, VkPipelineLayout layout, VkPipeline pipeline)
-    : mDevice(device)
-    , mLayout(layout)
+VulkanPipelineState::VulkanPipelineState(VkPipelineLayout layout, VkPipeline pipeline)
+    : mLayout(layout)
     , mPipeline(pipeline)
 {
 }
 
 VulkanPipelineState::~VulkanPipelineState()
 {
-    vkDestroyPipelineLayout(mDevice->nativeDevice(), mLayout, nullptr);
-    vkDestroyPipeline(mDevice->nativeDevice(), mPipeline, nullptr);
 }
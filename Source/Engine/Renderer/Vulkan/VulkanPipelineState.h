@@ -2,19 +2,18 @@
 #include "Engine/Renderer/IPipelineState.h"
 #include "Engine/Renderer/Vulkan/VulkanCommon.h"
 
-class VulkanRenderDevice;
-
+// Refers to a pipeline owned by the VulkanPipelineCache of the device, which may be shared with
+// other pipeline states
 class VulkanPipelineState : public IPipelineState
 {
 public:
-    VulkanPipelineState(VulkanRenderDevice* device, VkPipelineLayout layout, VkPipeline pipeline);
+    VulkanPipelineState(VkPipelineLayout layout, VkPipeline pipeline);
     ~VulkanPipelineState();
 
     VkPipelineLayout nativeLayout() const { return mLayout; }
     VkPipeline nativePipeline() const { return mPipeline; }
 
 private:
-    VulkanRenderDevice* mDevice;
     VkPipelineLayout mLayout;
     VkPipeline mPipeline;
 };
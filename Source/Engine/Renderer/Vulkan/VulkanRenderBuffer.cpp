@@ -1,5 +1,8 @@
 #include "VulkanRenderBuffer.h"
 #include "VulkanRenderDevice.h"
+#include "VulkanUploader.h"
+#include <cassert>
+#include <cstring>
 
 VulkanRenderBuffer::VulkanRenderBuffer(VulkanRenderDevice* device, size_t size, uint32_t maxBuffersInFlight)
     : mDevice(device)
@@ -7,7 +10,7 @@ VulkanRenderBuffer::VulkanRenderBuffer(VulkanRenderDevice* device, size_t size,
     , mAlignedSize((size + 255) & ~255)
     , mMaxBuffersInFlight(maxBuffersInFlight)
 {
-    create(mAlignedSize * mMaxBuffersInFlight);
+    create(mAlignedSize * mMaxBuffersInFlight, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, false);
 }
 
 VulkanRenderBuffer::VulkanRenderBuffer(VulkanRenderDevice* device, const void* data, size_t size)
@@ -16,24 +19,32 @@ VulkanRenderBuffer::VulkanRenderBuffer(VulkanRenderDevice* device, const void* d
     , mAlignedSize((size + 255) & ~255)
     , mMaxBuffersInFlight(1)
 {
-    create(mSize);
-    copyData(data, 0, size);
+    // Static, so it lives in video memory and is filled through the uploader
+    create(mSize, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
+    if (data)
+        mDevice->uploader()->copyToBuffer(mBuffer, 0, data, size);
 }
 
 VulkanRenderBuffer::~VulkanRenderBuffer()
 {
-    vkDestroyBuffer(mDevice->nativeDevice(), mBuffer, nullptr);
-    vkFreeMemory(mDevice->nativeDevice(), mDeviceMemory, nullptr);
+    mDevice->releaseBuffer(mBuffer, mMemory);
 }
 
-unsigned VulkanRenderBuffer::uploadData(const void* data)
+unsigned VulkanRenderBuffer::uploadData(const void* data, size_t size)
 {
+    assert(size <= mSize);
     unsigned bufferOffset = mAlignedSize * mDevice->currentBufferInFlight();
-    copyData(data, bufferOffset, mSize);
+    copyData(data, bufferOffset, size);
     return bufferOffset;
 }
 
-void VulkanRenderBuffer::create(size_t size)
+void VulkanRenderBuffer::updateData(size_t offset, const void* data, size_t size)
+{
+    assert(mMaxBuffersInFlight == 1 && offset + size <= mSize);
+    mDevice->uploader()->copyToBuffer(mBuffer, offset, data, size);
+}
+
+void VulkanRenderBuffer::create(size_t size, VkMemoryPropertyFlags memoryFlags, bool uploaded)
 {
     VkBufferCreateInfo info = {};
     info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -41,26 +52,26 @@ void VulkanRenderBuffer::create(size_t size)
     info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
                | VK_BUFFER_USAGE_INDEX_BUFFER_BIT
                | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
-               | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+               | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+               | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+               | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    if (uploaded)
+        mDevice->shareWithUploader(info);
+    else
+        info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     VkResult result = vkCreateBuffer(mDevice->nativeDevice(), &info, nullptr, &mBuffer);
     assert(result == VK_SUCCESS); // FIXME: better error handling
 
     VkMemoryRequirements memoryRequirements = {};
     vkGetBufferMemoryRequirements(mDevice->nativeDevice(), mBuffer, &memoryRequirements);
-    mDeviceMemory = mDevice->allocDeviceMemory(memoryRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    mMemory = mDevice->allocDeviceMemory(memoryRequirements, memoryFlags, VulkanAllocationType::Buffer);
 
-    result = vkBindBufferMemory(mDevice->nativeDevice(), mBuffer, mDeviceMemory, 0);
+    result = vkBindBufferMemory(mDevice->nativeDevice(), mBuffer, mMemory.memory, mMemory.offset);
     assert(result == VK_SUCCESS); // FIXME: better error handling
 }
 
 void VulkanRenderBuffer::copyData(const void* data, unsigned offset, size_t size)
 {
-    void* mapped;
-    VkResult result = vkMapMemory(mDevice->nativeDevice(), mDeviceMemory, offset, size, 0, &mapped);
-    assert(result == VK_SUCCESS); // FIXME: better error handling
-
-    memcpy(mapped, data, size);
-
-    vkUnmapMemory(mDevice->nativeDevice(), mDeviceMemory);
+    assert(mMemory.mapped != nullptr);
+    memcpy(mMemory.mapped + offset, data, size);
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include "Engine/Renderer/IRenderBuffer.h"
 #include "Engine/Renderer/Vulkan/VulkanCommon.h"
+#include "Engine/Renderer/Vulkan/VulkanMemoryAllocator.h"
 
 class VulkanRenderDevice;
 
@@ -14,16 +15,17 @@ public:
     size_t size() const { return mSize; }
     const VkBuffer& nativeBuffer() const { return mBuffer; }
 
-    unsigned uploadData(const void* data) override;
+    unsigned uploadData(const void* data, size_t size) override;
+    void updateData(size_t offset, const void* data, size_t size) override;
 
 private:
     VulkanRenderDevice* mDevice;
     VkBuffer mBuffer;
-    VkDeviceMemory mDeviceMemory;
+    VulkanAllocation mMemory;
     size_t mSize;
     size_t mAlignedSize;
     uint32_t mMaxBuffersInFlight;
 
-    void create(size_t size);
+    void create(size_t size, VkMemoryPropertyFlags memoryFlags, bool uploaded);
     void copyData(const void* data, unsigned offset, size_t size);
 };
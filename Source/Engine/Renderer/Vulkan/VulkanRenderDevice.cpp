@@ -1,42 +1,83 @@
 #pragma once
 #include "VulkanRenderDevice.h"
 #include "VulkanRenderBuffer.h"
+#include "VulkanPipelineCache.h"
 #include "VulkanPipelineState.h"
 #include "VulkanTexture.h"
+#include "VulkanTextureSetCache.h"
+#include "VulkanTextureTable.h"
 #include "VulkanShaderProgram.h"
+#include "VulkanUniformRing.h"
+#include "VulkanUploader.h"
 #include "VulkanCommon.h"
+#include "Engine/Core/Profiler.h"
 #include "Engine/Renderer/VertexFormat.h"
 #include "Engine/Renderer/TextureData.h"
+#include "Engine/Renderer/TextureDecoder.h"
 #include "Engine/Renderer/ShaderCode.h"
 #include <glm/gtc/matrix_inverse.hpp>
 #include <glm/mat3x3.hpp>
 #include <glm/mat3x4.hpp>
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <string>
 
-VulkanRenderDevice::VulkanRenderDevice()
+static const char PipelineCacheFileName[] = "PipelineCache.vulkan";
+
+namespace
+{
+    // Set between beginSlice() and endSlice() on the thread that records the slice
+    thread_local const VulkanRenderDevice* tSliceDevice = nullptr;
+    thread_local unsigned tSliceIndex = 0;
+
+    bool hasDeviceExtension(VkPhysicalDevice physicalDevice, const char* name)
+    {
+        uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::unique_ptr<VkExtensionProperties[]> extensions{new VkExtensionProperties[extensionCount]};
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.get());
+
+        for (uint32_t i = 0; i < extensionCount; ++i) {
+            if (!strcmp(extensions[i].extensionName, name))
+                return true;
+        }
+        return false;
+    }
+}
+
+VulkanRenderDevice::VulkanRenderDevice(uint32_t framesInFlight)
     : mInitialized(false)
     , mDevice(nullptr)
     , mSwapChain(nullptr)
     , mPresentQueue(nullptr)
+    , mTransferQueue(nullptr)
+    , mQueueFamilyIndices{}
+    , mQueueFamilyCount(1)
     , mCommandPool(nullptr)
     , mSetupCommandBuffer(nullptr)
-    , mDrawCommandBuffer(nullptr)
-    , mPresentCompleteSemaphore(nullptr)
-    , mRenderingCompleteSemaphore(nullptr)
     , mSubmitFence(nullptr)
     , mDepthImage(nullptr)
     , mDepthImageView(nullptr)
+    , mOffscreenImage(nullptr)
     , mRenderPass(nullptr)
-    , mDescriptorSetLayout(nullptr)
-    , mDescriptorPool(nullptr)
-    , mCurrentPipelineLayout(nullptr)
-    , mCurrentImageView{}
-    , mCurrentSampler{}
-    , mCurrentSkinningBuffer(nullptr)
-    , mCurrentSkinningBufferOffset(0)
-    , mCurrentSkinningBufferSize(0)
+    , mLoadRenderPass(nullptr)
+    , mDescriptorSetLayouts{}
+    , mPipelineLayout(nullptr)
+    , mPushConstantStages(VK_SHADER_STAGE_VERTEX_BIT)
+    , mPhysicalDeviceProperties{}
+    , mTimestampQueryPool(nullptr)
+    , mTimestampMask(0)
+    , mTextureCompressionBC(false)
+    , mMainRecorder()
+    , mSliceCount(0)
+    , mRenderPassStarted(false)
+    , mInsideRenderPass(false)
+    , mFrameCount(std::min(std::max(framesInFlight, uint32_t(MinFramesInFlight)), uint32_t(MaxFramesInFlight)))
+    , mFrameIndex(0)
 {
-    VkPhysicalDevice physicalDevice;
+    VkPhysicalDevice physicalDevice = nullptr;
     VkPhysicalDeviceProperties physicalDeviceProperties;
     int presentQueueIndex;
 
@@ -57,8 +98,10 @@ VulkanRenderDevice::VulkanRenderDevice()
         vkGetPhysicalDeviceQueueFamilyProperties(physicalDevices[i], &queueFamilyCount, queueFamilyProperties.get());
 
         for (uint32_t j = 0; j < queueFamilyCount; ++j) {
-            VkBool32 supportsPresent;
-            vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevices[i], j, vulkanSurface, &supportsPresent);
+            // Without a surface any graphics queue will do, frames are rendered offscreen
+            VkBool32 supportsPresent = VK_TRUE;
+            if (vulkanSurface)
+                vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevices[i], j, vulkanSurface, &supportsPresent);
             if (supportsPresent && (queueFamilyProperties[j].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
                 physicalDevice = physicalDevices[i];
                 physicalDeviceProperties = deviceProperties;
@@ -76,34 +119,114 @@ VulkanRenderDevice::VulkanRenderDevice()
         return;
     }
 
+    mPhysicalDeviceProperties = physicalDeviceProperties;
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &mMemoryProperties);
 
+    // Prefer a transfer-only queue family for uploads; it has to copy single rows of an image
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::unique_ptr<VkQueueFamilyProperties[]> queueFamilyProperties{new VkQueueFamilyProperties[queueFamilyCount]};
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyProperties.get());
+
+    // Software implementations such as lavapipe have timestamps too, only some GPUs lack them
+    uint32_t timestampBits = queueFamilyProperties[presentQueueIndex].timestampValidBits;
+    if (timestampBits > 0 && physicalDeviceProperties.limits.timestampPeriod > 0.0f)
+        mTimestampMask = (timestampBits < 64 ? (uint64_t(1) << timestampBits) - 1 : ~uint64_t(0));
+
+    mQueueFamilyIndices[0] = uint32_t(presentQueueIndex);
+    for (uint32_t i = 0; i < queueFamilyCount; ++i) {
+        const VkQueueFamilyProperties& properties = queueFamilyProperties[i];
+        const VkExtent3D& granularity = properties.minImageTransferGranularity;
+        if ((properties.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT)) == VK_QUEUE_TRANSFER_BIT
+                && granularity.width == 1 && granularity.height == 1 && granularity.depth == 1) {
+            mQueueFamilyIndices[1] = i;
+            mQueueFamilyCount = 2;
+            break;
+        }
+    }
+
     // Create rendering device
 
     static const float queuePriorities[] = { 1.0f };
-    static const char* deviceExtensions[] = { "VK_KHR_swapchain" };
+
+    // Textures are block compressed by the importer; devices without BC get them decoded at load
+    VkPhysicalDeviceFeatures supportedFeatures = {};
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+    mTextureCompressionBC = (supportedFeatures.textureCompressionBC == VK_TRUE);
 
     VkPhysicalDeviceFeatures features = {};
     features.shaderClipDistance = VK_TRUE;
+    features.textureCompressionBC = supportedFeatures.textureCompressionBC;
+
+    // With descriptor indexing all textures go into one table that stays bound, and draws select theirs
+    // by push constants. The table is written while frames that use it are pending, which they allow
+    // as long as those frames do not read the entries written.
+    uint32_t textureTableSize = 0;
+    if (physicalDeviceProperties.apiVersion >= VK_MAKE_VERSION(1, 1, 0)
+            && hasDeviceExtension(physicalDevice, "VK_EXT_descriptor_indexing")) {
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+        indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 supportedFeatures2 = {};
+        supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures2.pNext = &indexingFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+
+        VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties = {};
+        indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 properties2 = {};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &indexingProperties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+        if (supportedFeatures.shaderSampledImageArrayDynamicIndexing && indexingFeatures.runtimeDescriptorArray
+                && indexingFeatures.descriptorBindingPartiallyBound
+                && indexingFeatures.descriptorBindingSampledImageUpdateAfterBind
+                && indexingFeatures.descriptorBindingUpdateUnusedWhilePending) {
+            textureTableSize = std::min({ uint32_t(MaxTextureTableSize),
+                indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+                indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+                indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages });
+        }
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    if (textureTableSize > 0) {
+        features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+        indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+        indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    }
 
-    VkDeviceQueueCreateInfo queueCreateInfo;
-    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo.pNext = nullptr;
-    queueCreateInfo.flags = 0;
-    queueCreateInfo.queueFamilyIndex = presentQueueIndex;
-    queueCreateInfo.queueCount = 1;
-    queueCreateInfo.pQueuePriorities = queuePriorities;
+    std::vector<const char*> deviceExtensions;
+    if (vulkanSurface)
+        deviceExtensions.push_back("VK_KHR_swapchain");
+    if (textureTableSize > 0)
+        deviceExtensions.push_back("VK_EXT_descriptor_indexing");
+
+    VkDeviceQueueCreateInfo queueCreateInfo[2];
+    for (uint32_t i = 0; i < mQueueFamilyCount; ++i) {
+        queueCreateInfo[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo[i].pNext = nullptr;
+        queueCreateInfo[i].flags = 0;
+        queueCreateInfo[i].queueFamilyIndex = mQueueFamilyIndices[i];
+        queueCreateInfo[i].queueCount = 1;
+        queueCreateInfo[i].pQueuePriorities = queuePriorities;
+    }
 
     VkDeviceCreateInfo deviceInfo;
     deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceInfo.pNext = nullptr;
+    deviceInfo.pNext = (textureTableSize > 0 ? &indexingFeatures : nullptr);
     deviceInfo.flags = 0;
-    deviceInfo.queueCreateInfoCount = 1;
-    deviceInfo.pQueueCreateInfos = &queueCreateInfo;
+    deviceInfo.queueCreateInfoCount = mQueueFamilyCount;
+    deviceInfo.pQueueCreateInfos = queueCreateInfo;
     deviceInfo.enabledLayerCount = (vulkanHasValidationLayer ? 1 : 0);
     deviceInfo.ppEnabledLayerNames = (vulkanHasValidationLayer ? vulkanValidationLayer : nullptr);
-    deviceInfo.enabledExtensionCount = 1;
-    deviceInfo.ppEnabledExtensionNames = deviceExtensions;
+    deviceInfo.enabledExtensionCount = uint32_t(deviceExtensions.size());
+    deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
     deviceInfo.pEnabledFeatures = &features;
 
     VkResult result = vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &mDevice);
@@ -112,88 +235,27 @@ VulkanRenderDevice::VulkanRenderDevice()
         return;
     }
 
-    // Select color format
-
-    uint32_t formatCount = 0;
-    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, vulkanSurface, &formatCount, nullptr);
-    std::unique_ptr<VkSurfaceFormatKHR[]> surfaceFormats{new VkSurfaceFormatKHR[formatCount]};
-    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, vulkanSurface, &formatCount, surfaceFormats.get());
-
-    VkColorSpaceKHR colorSpace = surfaceFormats[0].colorSpace;
-    VkFormat colorFormat = (formatCount > 1 || surfaceFormats[0].format != VK_FORMAT_UNDEFINED ?
-        surfaceFormats[0].format  : VK_FORMAT_B8G8R8_UNORM);
-
-    // Determine surface capabilities
-
-    VkSurfaceCapabilitiesKHR surfaceCapabilities = {};
-    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, vulkanSurface, &surfaceCapabilities);
+    mMemoryAllocator.reset(new VulkanMemoryAllocator(mDevice, mMemoryProperties,
+        physicalDeviceProperties.limits.bufferImageGranularity));
 
-    uint32_t desiredImageCount = 2;
-    if (desiredImageCount < surfaceCapabilities.minImageCount)
-        desiredImageCount = surfaceCapabilities.minImageCount;
-    else if (surfaceCapabilities.maxImageCount != 0 && desiredImageCount > surfaceCapabilities.maxImageCount)
-        desiredImageCount = surfaceCapabilities.maxImageCount;
+    // Create swap chain, or the image to render into without a surface
 
-    VkExtent2D surfaceResolution = surfaceCapabilities.currentExtent;
-    if (surfaceResolution.width != -1) {
-        mSurfaceWidth = surfaceResolution.width;
-        mSurfaceHeight = surfaceResolution.height;
+    VkFormat colorFormat = VK_FORMAT_B8G8R8A8_UNORM;
+    if (vulkanSurface) {
+        if (!createSwapChain(physicalDevice, colorFormat))
+            return;
     } else {
         getVulkanWindowSize(&mSurfaceWidth, &mSurfaceHeight);
-        surfaceResolution.width = mSurfaceWidth;
-        surfaceResolution.height = mSurfaceHeight;
-    }
-
-    VkSurfaceTransformFlagBitsKHR preTransform = surfaceCapabilities.currentTransform;
-    if (surfaceCapabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
-        preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-
-    // Select presentation mode
-
-    uint32_t presentModeCount = 0;
-    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, vulkanSurface, &presentModeCount, nullptr);
-    std::unique_ptr<VkPresentModeKHR[]> presentModes{new VkPresentModeKHR[presentModeCount]};
-    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, vulkanSurface, &presentModeCount, presentModes.get());
-
-    VkPresentModeKHR presentationMode = VK_PRESENT_MODE_FIFO_KHR; // always supported.
-    for (uint32_t i = 0; i < presentModeCount; ++i) {
-        if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-            presentationMode = VK_PRESENT_MODE_MAILBOX_KHR;
-            break;
-        }
-    }
-
-    // Create swap chain
-
-    VkSwapchainCreateInfoKHR swapChainCreateInfo = {};
-    swapChainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-    swapChainCreateInfo.pNext = nullptr;
-    swapChainCreateInfo.flags = 0;
-    swapChainCreateInfo.surface = vulkanSurface;
-    swapChainCreateInfo.minImageCount = desiredImageCount;
-    swapChainCreateInfo.imageFormat = colorFormat;
-    swapChainCreateInfo.imageColorSpace = colorSpace;
-    swapChainCreateInfo.imageExtent = surfaceResolution;
-    swapChainCreateInfo.imageArrayLayers = 1;
-    swapChainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-    swapChainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    swapChainCreateInfo.queueFamilyIndexCount = 0;
-    swapChainCreateInfo.pQueueFamilyIndices = nullptr;
-    swapChainCreateInfo.preTransform = preTransform;
-    swapChainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    swapChainCreateInfo.presentMode = presentationMode;
-    swapChainCreateInfo.clipped = true;
-    swapChainCreateInfo.oldSwapchain = nullptr;
-
-    result = vkCreateSwapchainKHR(mDevice, &swapChainCreateInfo, nullptr, &mSwapChain);
-    if (result != VK_SUCCESS) {
-        vulkanError("Unable to create Vulkan swap chain.");
-        return;
+        if (!createOffscreenImage(colorFormat))
+            return;
     }
 
     // Create command pool
 
     vkGetDeviceQueue(mDevice, presentQueueIndex, 0, &mPresentQueue);
+    mTransferQueue = mPresentQueue;
+    if (mQueueFamilyCount > 1)
+        vkGetDeviceQueue(mDevice, mQueueFamilyIndices[1], 0, &mTransferQueue);
 
     VkCommandPoolCreateInfo commandPoolCreateInfo;
     commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -222,18 +284,31 @@ VulkanRenderDevice::VulkanRenderDevice()
         return;
     }
 
-    result = vkAllocateCommandBuffers(mDevice, &commandBufferAllocationInfo, &mDrawCommandBuffer);
-    if (result != VK_SUCCESS) {
-        vulkanError("Unable to create draw command buffer.");
-        return;
+    // Create per-frame resources
+
+    mFrames.reset(new Frame[mFrameCount]());
+    for (uint32_t i = 0; i < mFrameCount; ++i) {
+        if (!createFrame(mFrames[i])) {
+            vulkanError("Unable to create frame resources.");
+            return;
+        }
     }
 
-    // Get swap chain images
+    if (mTimestampMask) {
+        VkQueryPoolCreateInfo queryPoolInfo = {};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = TimestampsPerFrame * mFrameCount;
 
-    mImageCount = 0;
-    vkGetSwapchainImagesKHR(mDevice, mSwapChain, &mImageCount, nullptr);
-    mPresentImages.reset(new VkImage[mImageCount]);
-    vkGetSwapchainImagesKHR(mDevice, mSwapChain, &mImageCount, mPresentImages.get());
+        // GPU timings are optional, the device works without them
+        if (vkCreateQueryPool(mDevice, &queryPoolInfo, nullptr, &mTimestampQueryPool) != VK_SUCCESS)
+            mTimestampQueryPool = nullptr;
+    }
+    mOpenGpuScopes.reserve(MaxGpuScopesPerFrame);
+    mTimestamps.resize(TimestampsPerFrame);
+    mGpuTimings.reserve(MaxGpuScopesPerFrame);
+
+    mUploader.reset(new VulkanUploader(this, mQueueFamilyIndices[mQueueFamilyCount - 1], mTransferQueue, mPresentQueue));
 
     VkFenceCreateInfo fenceCreateInfo;
     fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
@@ -242,72 +317,14 @@ VulkanRenderDevice::VulkanRenderDevice()
 
     vkCreateFence(mDevice, &fenceCreateInfo, nullptr, &mSubmitFence);
 
-    std::vector<bool> processed(mImageCount);
-    for (uint32_t processedCount = 0; processedCount < mImageCount; ) {
-        VkSemaphore presentCompleteSemaphore = createSemaphore();
-
-        uint32_t nextImageIndex = 0;
-        vkAcquireNextImageKHR(mDevice, mSwapChain, UINT64_MAX, presentCompleteSemaphore, VK_NULL_HANDLE, &nextImageIndex);
-
-        if (processed[nextImageIndex])
-            destroySemaphore(presentCompleteSemaphore);
-        else {
-            VkCommandBufferBeginInfo beginInfo;
-            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            beginInfo.pNext = nullptr;
-            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-            beginInfo.pInheritanceInfo = nullptr;
-            vkBeginCommandBuffer(mSetupCommandBuffer, &beginInfo);
-
-            VkImageMemoryBarrier layoutTransitionBarrier;
-            layoutTransitionBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            layoutTransitionBarrier.pNext = nullptr;
-            layoutTransitionBarrier.srcAccessMask = 0;
-            layoutTransitionBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-            layoutTransitionBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            layoutTransitionBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-            layoutTransitionBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            layoutTransitionBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            layoutTransitionBarrier.image = mPresentImages[nextImageIndex];
-            layoutTransitionBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-            vkCmdPipelineBarrier(mSetupCommandBuffer,
-                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                0, 0, nullptr, 0, nullptr, 1, &layoutTransitionBarrier);
-
-            vkEndCommandBuffer(mSetupCommandBuffer);
-
-            VkPipelineStageFlags waitStageMash[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-            VkSubmitInfo submitInfo;
-            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            submitInfo.pNext = nullptr;
-            submitInfo.waitSemaphoreCount = 1;
-            submitInfo.pWaitSemaphores = &presentCompleteSemaphore;
-            submitInfo.pWaitDstStageMask = waitStageMash;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &mSetupCommandBuffer;
-            submitInfo.signalSemaphoreCount = 0;
-            submitInfo.pSignalSemaphores = nullptr;
-            result = vkQueueSubmit(mPresentQueue, 1, &submitInfo, mSubmitFence);
-
-            vkWaitForFences(mDevice, 1, &mSubmitFence, VK_TRUE, UINT64_MAX);
-            vkResetFences(mDevice, 1, &mSubmitFence);
-            destroySemaphore(presentCompleteSemaphore);
-            vkResetCommandBuffer(mSetupCommandBuffer, 0);
-
-            processed[nextImageIndex] = true;
-            ++processedCount;
-        }
+    // Get swap chain images, or the offscreen image
 
-        VkPresentInfoKHR presentInfo;
-        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-        presentInfo.pNext = nullptr;
-        presentInfo.waitSemaphoreCount = 0;
-        presentInfo.pWaitSemaphores = nullptr;
-        presentInfo.swapchainCount = 1;
-        presentInfo.pSwapchains = &mSwapChain;
-        presentInfo.pImageIndices = &nextImageIndex;
-        presentInfo.pResults = nullptr;
-        vkQueuePresentKHR(mPresentQueue, &presentInfo);
+    if (mSwapChain)
+        initSwapChainImages();
+    else {
+        mImageCount = 1;
+        mPresentImages.reset(new VkImage[1]);
+        mPresentImages[0] = mOffscreenImage;
     }
 
     std::unique_ptr<VkImageView[]> presentImageViews{new VkImageView[mImageCount]};
@@ -360,8 +377,8 @@ VulkanRenderDevice::VulkanRenderDevice()
 
     VkMemoryRequirements memoryRequirements;
     vkGetImageMemoryRequirements(mDevice, mDepthImage, &memoryRequirements);
-    auto imageMemory = allocDeviceMemory(memoryRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    result = vkBindImageMemory(mDevice, mDepthImage, imageMemory, 0);
+    mDepthImageMemory = allocDeviceMemory(memoryRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VulkanAllocationType::Image);
+    result = vkBindImageMemory(mDevice, mDepthImage, mDepthImageMemory.memory, mDepthImageMemory.offset);
     if (result != VK_SUCCESS) {
         vulkanError("Unable to bind memory for depth image.");
         return;
@@ -393,6 +410,17 @@ VulkanRenderDevice::VulkanRenderDevice()
         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
         0, 0, nullptr, 0, nullptr, 1, &layoutTransitionBarrier);
 
+    // The offscreen image is never presented, so it stays in the layout the render pass expects
+    if (mOffscreenImage) {
+        layoutTransitionBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        layoutTransitionBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        layoutTransitionBarrier.image = mOffscreenImage;
+        layoutTransitionBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        vkCmdPipelineBarrier(mSetupCommandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &layoutTransitionBarrier);
+    }
+
     vkEndCommandBuffer(mSetupCommandBuffer);
 
     VkPipelineStageFlags waitStageMask[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
@@ -459,7 +487,7 @@ VulkanRenderDevice::VulkanRenderDevice()
     passAttachments[1].format = VK_FORMAT_D16_UNORM;
     passAttachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
     passAttachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    passAttachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    passAttachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE; // kept for passes that continue the frame
     passAttachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     passAttachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     passAttachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
@@ -472,12 +500,35 @@ VulkanRenderDevice::VulkanRenderDevice()
     renderPassCreateInfo.subpassCount = 1;
     renderPassCreateInfo.pSubpasses = &subpass;
 
+    // The depth buffer is shared by all frames in flight, so wait for the previous frame's depth writes.
+    // A pass that continues the frame also waits for the color and depth writes of the one before.
+    VkSubpassDependency dependency = {};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+        | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    renderPassCreateInfo.dependencyCount = 1;
+    renderPassCreateInfo.pDependencies = &dependency;
+
     result = vkCreateRenderPass(mDevice, &renderPassCreateInfo, nullptr, &mRenderPass);
     if (result != VK_SUCCESS) {
         vulkanError("Unable to create render pass.");
         return;
     }
 
+    // Same pass without the clear, for when parallel recorded slices split the frame into several passes
+    passAttachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    passAttachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+
+    result = vkCreateRenderPass(mDevice, &renderPassCreateInfo, nullptr, &mLoadRenderPass);
+    if (result != VK_SUCCESS) {
+        vulkanError("Unable to create render pass.");
+        return;
+    }
+
     // Create framebuffer
 
     VkImageView frameBufferAttachments[2];
@@ -504,125 +555,202 @@ VulkanRenderDevice::VulkanRenderDevice()
 
     // Create descriptor set layouts
 
-    VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[5] = {};
-    descriptorSetLayoutBindings[0].binding = 0;
-    descriptorSetLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorSetLayoutBindings[0].descriptorCount = 1;
-    descriptorSetLayoutBindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    descriptorSetLayoutBindings[1].binding = 1;
-    descriptorSetLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorSetLayoutBindings[1].descriptorCount = 1;
-    descriptorSetLayoutBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    descriptorSetLayoutBindings[2].binding = 2;
-    descriptorSetLayoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorSetLayoutBindings[2].descriptorCount = 1;
-    descriptorSetLayoutBindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    descriptorSetLayoutBindings[3].binding = 3;
-    descriptorSetLayoutBindings[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorSetLayoutBindings[3].descriptorCount = 1;
-    descriptorSetLayoutBindings[3].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    descriptorSetLayoutBindings[4].binding = 4;
-    descriptorSetLayoutBindings[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorSetLayoutBindings[4].descriptorCount = 1;
-    descriptorSetLayoutBindings[4].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 5;
-    layoutInfo.pBindings = descriptorSetLayoutBindings;
-
-    result = vkCreateDescriptorSetLayout(mDevice, &layoutInfo, nullptr, &mDescriptorSetLayout);
-    if (result != VK_SUCCESS) {
-        vulkanError("Unable to create descriptor set layout.");
-        return;
-    }
+    VkDescriptorSetLayoutBinding frameBindings[2] = {};
+    frameBindings[0].binding = 0;
+    frameBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    frameBindings[0].descriptorCount = 1;
+    frameBindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    frameBindings[1].binding = 1;
+    frameBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    frameBindings[1].descriptorCount = 1;
+    frameBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    // Both textures are visible to both stages, so that one write updates the whole set
+    VkDescriptorSetLayoutBinding materialBindings[2] = {};
+    materialBindings[0].binding = 0;
+    materialBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    materialBindings[0].descriptorCount = 1;
+    materialBindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    materialBindings[1].binding = 1;
+    materialBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    materialBindings[1].descriptorCount = 1;
+    materialBindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutBinding objectBindings[2] = {};
+    objectBindings[0].binding = 0;
+    objectBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    objectBindings[0].descriptorCount = 1;
+    objectBindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    objectBindings[1].binding = 1;
+    objectBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    objectBindings[1].descriptorCount = 1;
+    objectBindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    // Or the texture table in place of the material sets, with entries that may stay unwritten
+    VkDescriptorSetLayoutBinding tableBinding = {};
+    tableBinding.binding = 0;
+    tableBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    tableBinding.descriptorCount = textureTableSize;
+    tableBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorBindingFlagsEXT tableBindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+        | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT tableFlagsInfo = {};
+    tableFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    tableFlagsInfo.bindingCount = 1;
+    tableFlagsInfo.pBindingFlags = &tableBindingFlags;
+
+    const VkDescriptorSetLayoutBinding* setBindings[DescriptorSetCount] = { frameBindings, materialBindings, objectBindings };
+    for (int i = 0; i < DescriptorSetCount; i++) {
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 2;
+        layoutInfo.pBindings = setBindings[i];
+        if (i == MaterialDescriptorSet && textureTableSize > 0) {
+            layoutInfo.pNext = &tableFlagsInfo;
+            layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+            layoutInfo.bindingCount = 1;
+            layoutInfo.pBindings = &tableBinding;
+        }
 
-    // Create descriptor sets
+        result = vkCreateDescriptorSetLayout(mDevice, &layoutInfo, nullptr, &mDescriptorSetLayouts[i]);
+        if (result != VK_SUCCESS) {
+            vulkanError("Unable to create descriptor set layout.");
+            return;
+        }
+    }
 
-    VkDescriptorPoolSize poolSizes[5] = {};
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = mImageCount;
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[1].descriptorCount = mImageCount;
-    poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[2].descriptorCount = mImageCount;
-    poolSizes[3].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[3].descriptorCount = mImageCount;
-    poolSizes[4].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[4].descriptorCount = mImageCount;
+    if (textureTableSize > 0) {
+        mTextureTable.reset(new VulkanTextureTable(mDevice, mDescriptorSetLayouts[MaterialDescriptorSet],
+            textureTableSize, mFrameCount));
+    } else
+        mTextureSets.reset(new VulkanTextureSetCache(mDevice, mDescriptorSetLayouts[MaterialDescriptorSet], mFrameCount));
+
+    // Create pipeline layout and cache
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(InstanceUniforms);
+    if (mTextureTable) {
+        pushConstantRange.stageFlags |= VK_SHADER_STAGE_FRAGMENT_BIT;
+        pushConstantRange.size += sizeof(MaterialUniforms);
+    }
+    mPushConstantStages = pushConstantRange.stageFlags;
 
-    VkDescriptorPoolCreateInfo poolInfo = {};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = 5;
-    poolInfo.pPoolSizes = poolSizes;
-    poolInfo.maxSets = mImageCount;
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = DescriptorSetCount;
+    pipelineLayoutInfo.pSetLayouts = mDescriptorSetLayouts;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
-    result = vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &mDescriptorPool);
+    result = vkCreatePipelineLayout(mDevice, &pipelineLayoutInfo, nullptr, &mPipelineLayout);
     if (result != VK_SUCCESS) {
-        vulkanError("Unable to create descriptor pool.");
+        vulkanError("Unable to create pipeline layout.");
         return;
     }
 
-    std::vector<VkDescriptorSetLayout> layouts(mImageCount, mDescriptorSetLayout);
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = mDescriptorPool;
-    allocInfo.descriptorSetCount = mImageCount;
-    allocInfo.pSetLayouts = layouts.data();
+    mPipelineCache.reset(new VulkanPipelineCache(mDevice, physicalDeviceProperties, PipelineCacheFileName));
 
-    mDescriptorSets.resize(mImageCount);
-    result = vkAllocateDescriptorSets(mDevice, &allocInfo, mDescriptorSets.data());
-    if (result != VK_SUCCESS) {
-        vulkanError("Unable to allocate descriptor sets.");
+    // Create per-frame uniform and descriptor storage
+
+    if (!createRecorder(mMainRecorder, false)) {
+        vulkanError("Unable to create recording resources.");
         return;
     }
 
     // Setup initial uniform values
 
-    mVertexUniforms.projectionMatrix = glm::mat4(1.0f);
-    mVertexUniforms.viewMatrix = glm::mat4(1.0f);
-    mVertexUniforms.modelMatrix = glm::mat4(1.0f);
-    mVertexUniforms.normalMatrix = glm::mat3x4(1.0f);
-    mVertexUniforms.lightPosition = glm::vec4(0.0f);
+    mMainRecorder.vertexUniforms.projectionMatrix = glm::mat4(1.0f);
+    mMainRecorder.vertexUniforms.viewMatrix = glm::mat4(1.0f);
+    mMainRecorder.vertexUniforms.modelMatrix = glm::mat4(1.0f);
+    mMainRecorder.vertexUniforms.normalMatrix = glm::mat3x4(1.0f);
+    mMainRecorder.vertexUniforms.lightPosition = glm::vec4(0.0f);
+
+    mMainRecorder.fragmentUniforms.ambientColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
 
-    mFragmentUniforms.ambientColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    static const uint8_t placeholderPixel[4] = { 128, 128, 128, 255 };
+    TextureData placeholderData = { placeholderPixel, 1, 1, 1, TextureFormat::RGBA8 };
+    mPlaceholderTexture = createTexture(&placeholderData);
+    mUploader->finish();
 
     mInitialized = true;
 }
 
 VulkanRenderDevice::~VulkanRenderDevice()
 {
-    mUsedUniformBuffers.clear();
-    mFreeUniformBuffers.clear();
+    if (mDevice)
+        vkDeviceWaitIdle(mDevice);
+
+    mPlaceholderTexture.reset();
+    mUploader.reset();
+
+    for (auto& rec : mSliceRecorders)
+        destroyRecorder(*rec);
+    mSliceRecorders.clear();
+    destroyRecorder(mMainRecorder);
+    mTextureSets.reset();
+    mTextureTable.reset();
+
+    if (mPipelineCache) {
+        mPipelineCache->save();
+        mPipelineCache.reset();
+    }
+
+    destroyReleases(mPendingReleases);
+    if (mFrames) {
+        for (uint32_t i = 0; i < mFrameCount; ++i)
+            destroyFrame(mFrames[i]);
+    }
 
+    if (mLoadRenderPass)
+        vkDestroyRenderPass(mDevice, mLoadRenderPass, nullptr);
     if (mRenderPass)
         vkDestroyRenderPass(mDevice, mRenderPass, nullptr);
-    if (mDescriptorPool)
-        vkDestroyDescriptorPool(mDevice, mDescriptorPool, nullptr);
-    if (mDescriptorSetLayout)
-        vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayout, nullptr);
+    if (mPipelineLayout)
+        vkDestroyPipelineLayout(mDevice, mPipelineLayout, nullptr);
+    if (mTimestampQueryPool)
+        vkDestroyQueryPool(mDevice, mTimestampQueryPool, nullptr);
+    for (auto layout : mDescriptorSetLayouts) {
+        if (layout)
+            vkDestroyDescriptorSetLayout(mDevice, layout, nullptr);
+    }
     if (mSubmitFence)
         vkDestroyFence(mDevice, mSubmitFence, nullptr);
     if (mDepthImageView)
         vkDestroyImageView(mDevice, mDepthImageView, nullptr);
     if (mDepthImage)
         vkDestroyImage(mDevice, mDepthImage, nullptr);
-    if (mDrawCommandBuffer)
-        vkFreeCommandBuffers(mDevice, mCommandPool, 1, &mDrawCommandBuffer);
+    if (mOffscreenImage)
+        vkDestroyImage(mDevice, mOffscreenImage, nullptr);
+    if (mMemoryAllocator) {
+        mMemoryAllocator->free(mDepthImageMemory);
+        mMemoryAllocator->free(mOffscreenImageMemory);
+        mMemoryAllocator.reset();
+    }
     if (mSetupCommandBuffer)
         vkFreeCommandBuffers(mDevice, mCommandPool, 1, &mSetupCommandBuffer);
     if (mCommandPool)
         vkDestroyCommandPool(mDevice, mCommandPool, nullptr);
     if (mSwapChain)
         vkDestroySwapchainKHR(mDevice, mSwapChain, nullptr);
-    if (mPresentCompleteSemaphore)
-        vkDestroySemaphore(mDevice, mPresentCompleteSemaphore, nullptr);
-    if (mRenderingCompleteSemaphore)
-        vkDestroySemaphore(mDevice, mRenderingCompleteSemaphore, nullptr);
     if (mDevice)
         vkDestroyDevice(mDevice, nullptr);
 }
 
+std::string VulkanRenderDevice::description() const
+{
+    std::string description = mPhysicalDeviceProperties.deviceName;
+    if (mTextureTable)
+        description += ", textures in a descriptor indexing table of " + std::to_string(mTextureTable->size());
+    else
+        description += ", textures in per-material descriptor sets";
+    if (!mTextureCompressionBC)
+        description += ", BC textures decoded to RGBA8";
+    return description;
+}
+
 glm::vec2 VulkanRenderDevice::viewportSize() const
 {
     return glm::vec2(mSurfaceWidth, mSurfaceHeight);
@@ -641,19 +769,14 @@ uint32_t VulkanRenderDevice::findDeviceMemory(const VkMemoryRequirements& memory
     return 0;
 }
 
-VkDeviceMemory VulkanRenderDevice::allocDeviceMemory(const VkMemoryRequirements& memory, VkMemoryPropertyFlags desiredFlags)
+VulkanAllocation VulkanRenderDevice::allocDeviceMemory(const VkMemoryRequirements& memory, VkMemoryPropertyFlags desiredFlags, VulkanAllocationType type)
 {
-    VkMemoryAllocateInfo allocInfo;
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.pNext = nullptr;
-    allocInfo.allocationSize = memory.size;
-    allocInfo.memoryTypeIndex = findDeviceMemory(memory, desiredFlags);
-
-    VkDeviceMemory allocatedMemory = nullptr;
-    VkResult result = vkAllocateMemory(mDevice, &allocInfo, nullptr, &allocatedMemory);
-    assert(result == VK_SUCCESS);   // FIXME: better error handling
+    return mMemoryAllocator->allocate(memory, findDeviceMemory(memory, desiredFlags), type);
+}
 
-    return allocatedMemory;
+void VulkanRenderDevice::freeDeviceMemory(const VulkanAllocation& allocation)
+{
+    mMemoryAllocator->free(allocation);
 }
 
 VkSemaphore VulkanRenderDevice::createSemaphore()
@@ -675,9 +798,29 @@ void VulkanRenderDevice::destroySemaphore(VkSemaphore semaphore)
     vkDestroySemaphore(mDevice, semaphore, nullptr);
 }
 
+void VulkanRenderDevice::releaseBuffer(VkBuffer buffer, const VulkanAllocation& memory)
+{
+    std::lock_guard<std::mutex> lock(mReleaseMutex);
+    mPendingReleases.push_back({ buffer, nullptr, nullptr, nullptr, memory });
+}
+
+void VulkanRenderDevice::releaseImage(VkImage image, VkImageView imageView, VkSampler sampler, const VulkanAllocation& memory)
+{
+    std::lock_guard<std::mutex> lock(mReleaseMutex);
+    mPendingReleases.push_back({ nullptr, image, imageView, sampler, memory });
+}
+
+void VulkanRenderDevice::releaseTextureSets(VkImageView imageView, uint32_t tableIndex)
+{
+    if (mTextureSets)
+        mTextureSets->release(imageView);
+    if (mTextureTable && tableIndex != VulkanTextureTable::InvalidIndex)
+        mTextureTable->release(tableIndex);
+}
+
 std::unique_ptr<IRenderBuffer> VulkanRenderDevice::createBuffer(size_t size)
 {
-    return std::make_unique<VulkanRenderBuffer>(this, size, mImageCount);
+    return std::make_unique<VulkanRenderBuffer>(this, size, mFrameCount);
 }
 
 std::unique_ptr<IRenderBuffer> VulkanRenderDevice::createBufferWithData(const void* data, size_t size)
@@ -685,9 +828,41 @@ std::unique_ptr<IRenderBuffer> VulkanRenderDevice::createBufferWithData(const vo
     return std::make_unique<VulkanRenderBuffer>(this, data, size);
 }
 
+std::unique_ptr<IRenderBuffer> VulkanRenderDevice::createStaticBuffer(size_t size)
+{
+    return std::make_unique<VulkanRenderBuffer>(this, nullptr, size);
+}
+
+static VkFormat convertTextureFormat(TextureFormat format)
+{
+    switch (format) {
+        case TextureFormat::RGBA8: return VK_FORMAT_R8G8B8A8_UNORM;
+        case TextureFormat::RGBA16F: return VK_FORMAT_R16G16B16A16_SFLOAT;
+        case TextureFormat::RGBA32F: return VK_FORMAT_R32G32B32A32_SFLOAT;
+        case TextureFormat::BC1: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case TextureFormat::BC3: return VK_FORMAT_BC3_UNORM_BLOCK;
+        case TextureFormat::BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+        case TextureFormat::BC7: return VK_FORMAT_BC7_UNORM_BLOCK;
+    }
+
+    assert(false);
+    return VK_FORMAT_R8G8B8A8_UNORM;
+}
+
 std::unique_ptr<ITexture> VulkanRenderDevice::createTexture(const TextureData* data)
 {
-    VulkanRenderBuffer stagingBuffer(this, data->pixels, data->width * data->height * 4);
+    // The uploader copies the pixels into staging memory before copyToImage() returns
+    std::vector<uint8_t> decodedPixels;
+    TextureData decodedData;
+    if (isBlockCompressed(data->format) && !mTextureCompressionBC) {
+        decodeTexture(*data, decodedPixels);
+        decodedData = *data;
+        decodedData.pixels = decodedPixels.data();
+        decodedData.format = TextureFormat::RGBA8;
+        data = &decodedData;
+    }
+
+    VkFormat format = convertTextureFormat(data->format);
 
     VkImageCreateInfo imageInfo = {};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -695,13 +870,13 @@ std::unique_ptr<ITexture> VulkanRenderDevice::createTexture(const TextureData* d
     imageInfo.extent.width = uint32_t(data->width);
     imageInfo.extent.height = uint32_t(data->height);
     imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
+    imageInfo.mipLevels = data->mipLevels;
     imageInfo.arrayLayers = 1;
-    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.format = format;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    shareWithUploader(imageInfo);
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 
     VkImage texture;
@@ -711,58 +886,20 @@ std::unique_ptr<ITexture> VulkanRenderDevice::createTexture(const TextureData* d
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(mDevice, texture, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findDeviceMemory(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    VkDeviceMemory textureMemory;
-    result = vkAllocateMemory(mDevice, &allocInfo, nullptr, &textureMemory);
-    assert(result == VK_SUCCESS);   // FIXME: better error handling
-
-    vkBindImageMemory(mDevice, texture, textureMemory, 0);
-
-    VkCommandBufferBeginInfo beginInfo;
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.pNext = nullptr;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    beginInfo.pInheritanceInfo = nullptr;
-    vkBeginCommandBuffer(mSetupCommandBuffer, &beginInfo);
-
-    VkBufferImageCopy region = {};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-    region.imageOffset = { 0, 0, 0 };
-    region.imageExtent = { data->width, data->height, 1 };
-    vkCmdCopyBufferToImage(mSetupCommandBuffer, stagingBuffer.nativeBuffer(), texture,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-    vkEndCommandBuffer(mSetupCommandBuffer);
-
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &mSetupCommandBuffer;
-    result = vkQueueSubmit(mPresentQueue, 1, &submitInfo, mSubmitFence);
-    assert(result == VK_SUCCESS);   // FIXME: better error handling
+    VulkanAllocation textureMemory = allocDeviceMemory(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VulkanAllocationType::Image);
+    vkBindImageMemory(mDevice, texture, textureMemory.memory, textureMemory.offset);
 
-    vkWaitForFences(mDevice, 1, &mSubmitFence, VK_TRUE, UINT64_MAX);
-    vkResetFences(mDevice, 1, &mSubmitFence);
-    vkResetCommandBuffer(mSetupCommandBuffer, 0);
+    // Sampled once the upload has completed; the placeholder is bound until then
+    uint64_t uploadSerial = mUploader->copyToImage(texture, *data);
 
     VkImageViewCreateInfo viewInfo = {};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     viewInfo.image = texture;
     viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    viewInfo.format = format;
     viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.levelCount = data->mipLevels;
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount = 1;
 
@@ -774,6 +911,8 @@ std::unique_ptr<ITexture> VulkanRenderDevice::createTexture(const TextureData* d
     samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
     samplerInfo.magFilter = VK_FILTER_LINEAR;
     samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.maxLod = float(data->mipLevels);
     samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
     samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
@@ -783,28 +922,41 @@ std::unique_ptr<ITexture> VulkanRenderDevice::createTexture(const TextureData* d
     result = vkCreateSampler(mDevice, &samplerInfo, nullptr, &sampler);
     assert(result == VK_SUCCESS);   // FIXME: better error handling
 
-    return std::make_unique<VulkanTexture>(this, texture, textureMemory, imageView, sampler);
+    // A texture left out of a full table is drawn as the placeholder, which is always in it
+    uint32_t tableIndex = VulkanTextureTable::InvalidIndex;
+    if (mTextureTable) {
+        tableIndex = mTextureTable->add(imageView, sampler);
+        if (tableIndex == VulkanTextureTable::InvalidIndex) {
+            char buf[1024];
+            snprintf(buf, sizeof(buf), "Texture table is full (%u textures); the texture is drawn as a placeholder.",
+                unsigned(mTextureTable->size()));
+            vulkanError(buf);
+        }
+    }
+
+    return std::make_unique<VulkanTexture>(this, texture, textureMemory, imageView, sampler, uploadSerial, tableIndex);
 }
 
 std::unique_ptr<IShaderProgram> VulkanRenderDevice::createShaderProgram(const ShaderCode* code)
 {
+    // The bindless variant reads the material's textures from the table
     VkShaderModuleCreateInfo info = {};
     info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    info.codeSize = code->vulkanVertexSize;
-    info.pCode = reinterpret_cast<const uint32_t*>(code->vulkanVertex);
+    info.codeSize = (mTextureTable ? code->vulkanBindlessVertexSize : code->vulkanVertexSize);
+    info.pCode = reinterpret_cast<const uint32_t*>(mTextureTable ? code->vulkanBindlessVertex : code->vulkanVertex);
 
     VkShaderModule vertexShader;
     VkResult result = vkCreateShaderModule(mDevice, &info, nullptr, &vertexShader);
     assert(result == VK_SUCCESS);   // FIXME: better error handling
 
-    info.codeSize = code->vulkanFragmentSize;
-    info.pCode = reinterpret_cast<const uint32_t*>(code->vulkanFragment);
+    info.codeSize = (mTextureTable ? code->vulkanBindlessFragmentSize : code->vulkanFragmentSize);
+    info.pCode = reinterpret_cast<const uint32_t*>(mTextureTable ? code->vulkanBindlessFragment : code->vulkanFragment);
 
     VkShaderModule fragmentShader;
     result = vkCreateShaderModule(mDevice, &info, nullptr, &fragmentShader);
     assert(result == VK_SUCCESS);   // FIXME: better error handling
 
-    return std::make_unique<VulkanShaderProgram>(this, vertexShader, fragmentShader);
+    return std::make_unique<VulkanShaderProgram>(this, code, vertexShader, fragmentShader);
 }
 
 std::unique_ptr<IPipelineState> VulkanRenderDevice::createPipelineState(PrimitiveType primitiveType,
@@ -813,9 +965,22 @@ std::unique_ptr<IPipelineState> VulkanRenderDevice::createPipelineState(Primitiv
     assert(dynamic_cast<VulkanShaderProgram*>(shader.get()) != nullptr);
     auto vulkanShader = static_cast<VulkanShaderProgram*>(shader.get());
 
-    int i = 0;
-    std::vector<VkVertexInputAttributeDescription> attributes;
-    for (const auto& attr : vertexFormat.attributes()) {
+    VulkanPipelineKey key(vulkanShader->code(), primitiveType, vertexFormat);
+    VkPipeline pipeline = mPipelineCache->find(key);
+    if (!pipeline) {
+        pipeline = createPipeline(primitiveType, vulkanShader, vertexFormat);
+        mPipelineCache->insert(std::move(key), pipeline);
+    }
+
+    return std::make_unique<VulkanPipelineState>(mPipelineLayout, pipeline);
+}
+
+VkPipeline VulkanRenderDevice::createPipeline(PrimitiveType primitiveType,
+    const VulkanShaderProgram* shader, const VertexFormat& vertexFormat)
+{
+    int i = 0;
+    std::vector<VkVertexInputAttributeDescription> attributes;
+    for (const auto& attr : vertexFormat.attributes()) {
         VkVertexInputAttributeDescription desc = {};
         switch (attr.type) {
             case VertexType::Float2: desc.format = VK_FORMAT_R32G32_SFLOAT; break;
@@ -839,26 +1004,15 @@ std::unique_ptr<IPipelineState> VulkanRenderDevice::createPipelineState(Primitiv
         bindings.emplace_back(std::move(desc));
     }
 
-    VkPipelineLayoutCreateInfo info = {};
-    info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    info.setLayoutCount = 1;
-    info.pSetLayouts = &mDescriptorSetLayout;
-    info.pushConstantRangeCount = 0;
-    info.pPushConstantRanges = nullptr;
-
-    VkPipelineLayout pipelineLayout;
-    VkResult result = vkCreatePipelineLayout(mDevice, &info, nullptr, &pipelineLayout);
-    assert(result == VK_SUCCESS);   // FIXME: better error handling
-
     VkPipelineShaderStageCreateInfo shaderStageCreateInfo[2] = {};
     shaderStageCreateInfo[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     shaderStageCreateInfo[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-    shaderStageCreateInfo[0].module = vulkanShader->vertex();
+    shaderStageCreateInfo[0].module = shader->vertex();
     shaderStageCreateInfo[0].pName = "main";
     shaderStageCreateInfo[0].pSpecializationInfo = nullptr;
     shaderStageCreateInfo[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     shaderStageCreateInfo[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    shaderStageCreateInfo[1].module = vulkanShader->fragment();
+    shaderStageCreateInfo[1].module = shader->fragment();
     shaderStageCreateInfo[1].pName = "main";
     shaderStageCreateInfo[1].pSpecializationInfo = nullptr;
 
@@ -977,33 +1131,48 @@ std::unique_ptr<IPipelineState> VulkanRenderDevice::createPipelineState(Primitiv
     pipelineCreateInfo.pDepthStencilState = &depthState;
     pipelineCreateInfo.pColorBlendState = &colorBlendState;
     pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
-    pipelineCreateInfo.layout = pipelineLayout;
+    pipelineCreateInfo.layout = mPipelineLayout;
     pipelineCreateInfo.renderPass = mRenderPass;
     pipelineCreateInfo.subpass = 0;
     pipelineCreateInfo.basePipelineHandle = nullptr;
     pipelineCreateInfo.basePipelineIndex = 0;
 
     VkPipeline pipeline;
-    result = vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline);
+    VkResult result = vkCreateGraphicsPipelines(mDevice, mPipelineCache->nativeCache(), 1, &pipelineCreateInfo, nullptr, &pipeline);
     assert(result == VK_SUCCESS);   // FIXME: better error handling
 
-    return std::make_unique<VulkanPipelineState>(this, pipelineLayout, pipeline);
+    return pipeline;
 }
 
 void VulkanRenderDevice::setProjectionMatrix(const glm::mat4& matrix)
 {
-    mVertexUniforms.projectionMatrix = matrix;
+    Recorder& rec = recorder();
+    if (!rec.shadow.setProjectionMatrix(matrix))
+        return;
+
+    rec.vertexUniforms.projectionMatrix = matrix;
+    rec.uniformsDirty = true;
 }
 
 void VulkanRenderDevice::setViewMatrix(const glm::mat4& matrix)
 {
-    mVertexUniforms.viewMatrix = matrix;
+    Recorder& rec = recorder();
+    if (!rec.shadow.setViewMatrix(matrix))
+        return;
+
+    rec.vertexUniforms.viewMatrix = matrix;
+    rec.uniformsDirty = true;
 }
 
 void VulkanRenderDevice::setModelMatrix(const glm::mat4& matrix)
 {
-    mVertexUniforms.modelMatrix = matrix;
-    mVertexUniforms.normalMatrix = glm::mat3x4(glm::transpose(glm::inverse(glm::mat3(matrix))));
+    Recorder& rec = recorder();
+    if (!rec.shadow.setModelMatrix(matrix))
+        return;
+
+    rec.vertexUniforms.modelMatrix = matrix;
+    rec.vertexUniforms.normalMatrix = glm::mat3x4(glm::transpose(glm::inverse(glm::mat3(matrix))));
+    rec.uniformsDirty = true;
 }
 
 void VulkanRenderDevice::setTexture(int index, const std::unique_ptr<ITexture>& texture)
@@ -1011,9 +1180,17 @@ void VulkanRenderDevice::setTexture(int index, const std::unique_ptr<ITexture>&
     assert(dynamic_cast<VulkanTexture*>(texture.get()) != nullptr);
     auto vulkanTexture = static_cast<VulkanTexture*>(texture.get());
 
+    if (!mUploader->isComplete(vulkanTexture->uploadSerial()) || (mTextureTable && vulkanTexture->tableIndex() == VulkanTextureTable::InvalidIndex))
+        vulkanTexture = static_cast<VulkanTexture*>(mPlaceholderTexture.get());
+
+    Recorder& rec = recorder();
     assert(index >= 0 && index <= 1);
-    mCurrentImageView[index] = vulkanTexture->nativeImageView();
-    mCurrentSampler[index] = vulkanTexture->nativeSampler();
+    if (rec.shadow.setTexture(index, vulkanTexture->nativeImageView()) || rec.currentSampler[index] != vulkanTexture->nativeSampler()) {
+        rec.currentImageView[index] = vulkanTexture->nativeImageView();
+        rec.currentSampler[index] = vulkanTexture->nativeSampler();
+        rec.materialUniforms.textureIndices[index] = vulkanTexture->tableIndex();
+        rec.dirtyDescriptorSets |= (1 << MaterialDescriptorSet);
+    }
 }
 
 void VulkanRenderDevice::setPipelineState(const std::unique_ptr<IPipelineState>& state)
@@ -1021,8 +1198,16 @@ void VulkanRenderDevice::setPipelineState(const std::unique_ptr<IPipelineState>&
     assert(dynamic_cast<VulkanPipelineState*>(state.get()) != nullptr);
     auto vulkanState = static_cast<VulkanPipelineState*>(state.get());
 
-    mCurrentPipelineLayout = vulkanState->nativeLayout();
-    vkCmdBindPipeline(mDrawCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanState->nativePipeline());
+    // Descriptor sets stay bound across pipelines with the same layout
+    Recorder& rec = recorder();
+    if (rec.currentPipelineLayout != vulkanState->nativeLayout()) {
+        rec.currentPipelineLayout = vulkanState->nativeLayout();
+        rec.unboundDescriptorSets = AllDescriptorSets;
+    }
+
+    // Materials with the same shader share one native pipeline
+    if (rec.shadow.setPipelineState(vulkanState->nativePipeline()))
+        vkCmdBindPipeline(rec.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanState->nativePipeline());
 }
 
 void VulkanRenderDevice::setVertexBuffer(int index, const std::unique_ptr<IRenderBuffer>& buffer, unsigned offset)
@@ -1030,56 +1215,287 @@ void VulkanRenderDevice::setVertexBuffer(int index, const std::unique_ptr<IRende
     assert(dynamic_cast<VulkanRenderBuffer*>(buffer.get()) != nullptr);
     auto vulkanBuffer = static_cast<VulkanRenderBuffer*>(buffer.get());
 
+    Recorder& rec = recorder();
+    if (!rec.shadow.setVertexBuffer(index, vulkanBuffer->nativeBuffer(), offset))
+        return;
+
     if (index == 2) {
-        mCurrentSkinningBuffer = vulkanBuffer->nativeBuffer();
-        mCurrentSkinningBufferOffset = offset;
-        mCurrentSkinningBufferSize = vulkanBuffer->size();
+        if (rec.currentSkinningBuffer != vulkanBuffer->nativeBuffer() || rec.currentSkinningBufferOffset != offset) {
+            rec.currentSkinningBuffer = vulkanBuffer->nativeBuffer();
+            rec.currentSkinningBufferOffset = offset;
+            rec.currentSkinningBufferSize = vulkanBuffer->size();
+            rec.dirtyDescriptorSets |= (1 << ObjectDescriptorSet);
+        }
     } else {
         VkDeviceSize offsets = offset;
-        vkCmdBindVertexBuffers(mDrawCommandBuffer, index, 1, &vulkanBuffer->nativeBuffer(), &offsets);
+        vkCmdBindVertexBuffers(rec.commandBuffer, index, 1, &vulkanBuffer->nativeBuffer(), &offsets);
     }
 }
 
+void VulkanRenderDevice::setPaletteBuffer(const std::unique_ptr<IRenderBuffer>& buffer, unsigned offset, unsigned paletteSize)
+{
+    assert(dynamic_cast<VulkanRenderBuffer*>(buffer.get()) != nullptr);
+    auto vulkanBuffer = static_cast<VulkanRenderBuffer*>(buffer.get());
+
+    Recorder& rec = recorder();
+    if (rec.currentPaletteBuffer != vulkanBuffer->nativeBuffer() || rec.currentPaletteBufferOffset != offset) {
+        rec.currentPaletteBuffer = vulkanBuffer->nativeBuffer();
+        rec.currentPaletteBufferOffset = offset;
+        rec.currentPaletteBufferSize = vulkanBuffer->size();
+        rec.dirtyDescriptorSets |= (1 << ObjectDescriptorSet);
+    }
+    rec.instanceUniforms.paletteSize = paletteSize;
+}
+
 void VulkanRenderDevice::setLightPosition(const glm::vec3& position)
 {
-    mVertexUniforms.lightPosition = glm::vec4(position, 0.0f);
+    Recorder& rec = recorder();
+    if (!rec.shadow.setLightPosition(position))
+        return;
+
+    rec.vertexUniforms.lightPosition = glm::vec4(position, 0.0f);
+    rec.uniformsDirty = true;
 }
 
 void VulkanRenderDevice::setAmbientColor(const glm::vec4& color)
 {
-    mFragmentUniforms.ambientColor = color;
+    Recorder& rec = recorder();
+    if (!rec.shadow.setAmbientColor(color))
+        return;
+
+    rec.fragmentUniforms.ambientColor = color;
+    rec.uniformsDirty = true;
 }
 
 void VulkanRenderDevice::drawPrimitive(unsigned start, unsigned count)
 {
-    bindUniforms();
-    vkCmdDraw(mDrawCommandBuffer, count, 1, start, 0);
+    Recorder& rec = recorder();
+    prepareDraw(rec);
+    vkCmdDraw(rec.commandBuffer, count, 1, start, 0);
+}
+
+void VulkanRenderDevice::drawIndexedPrimitive(const std::unique_ptr<IRenderBuffer>& indexBuffer,
+    unsigned start, unsigned count, unsigned baseVertex)
+{
+    assert(dynamic_cast<VulkanRenderBuffer*>(indexBuffer.get()) != nullptr);
+    auto vulkanBuffer = static_cast<VulkanRenderBuffer*>(indexBuffer.get());
+
+    Recorder& rec = recorder();
+    if (rec.shadow.setIndexBuffer(vulkanBuffer->nativeBuffer()))
+        vkCmdBindIndexBuffer(rec.commandBuffer, vulkanBuffer->nativeBuffer(), 0, VK_INDEX_TYPE_UINT16);
+
+    prepareDraw(rec);
+    vkCmdDrawIndexed(rec.commandBuffer, count, 1, start, int32_t(baseVertex), 0);
 }
 
-void VulkanRenderDevice::drawIndexedPrimitive(const std::unique_ptr<IRenderBuffer>& indexBuffer, unsigned start, unsigned count)
+void VulkanRenderDevice::drawIndexedPrimitiveInstanced(const std::unique_ptr<IRenderBuffer>& indexBuffer,
+    unsigned start, unsigned count, unsigned instanceCount, unsigned baseVertex)
 {
     assert(dynamic_cast<VulkanRenderBuffer*>(indexBuffer.get()) != nullptr);
     auto vulkanBuffer = static_cast<VulkanRenderBuffer*>(indexBuffer.get());
 
-    vkCmdBindIndexBuffer(mDrawCommandBuffer, vulkanBuffer->nativeBuffer(), 0, VK_INDEX_TYPE_UINT16);
+    Recorder& rec = recorder();
+    if (rec.shadow.setIndexBuffer(vulkanBuffer->nativeBuffer()))
+        vkCmdBindIndexBuffer(rec.commandBuffer, vulkanBuffer->nativeBuffer(), 0, VK_INDEX_TYPE_UINT16);
 
-    bindUniforms();
-    vkCmdDrawIndexed(mDrawCommandBuffer, count, 1, start, 0, 0);
+    prepareDraw(rec);
+    vkCmdPushConstants(rec.commandBuffer, rec.currentPipelineLayout, mPushConstantStages,
+        0, sizeof(rec.instanceUniforms), &rec.instanceUniforms);
+    vkCmdDrawIndexed(rec.commandBuffer, count, instanceCount, start, int32_t(baseVertex), 0);
+}
+
+void VulkanRenderDevice::beginSlices(unsigned sliceCount)
+{
+    assert(tSliceDevice != this && mSliceCount == 0 && sliceCount > 0);
+
+    while (mSliceRecorders.size() < sliceCount) {
+        std::unique_ptr<Recorder> rec(new Recorder());
+        bool created = createRecorder(*rec, true);
+        assert(created);   // FIXME: better error handling
+        (void)created;
+        resetRecorder(*rec);
+        mSliceRecorders.emplace_back(std::move(rec));
+    }
+
+    for (unsigned i = 0; i < sliceCount; i++) {
+        Recorder& rec = *mSliceRecorders[i];
+
+        SliceCommands& commands = rec.sliceCommands[mFrameIndex];
+        if (commands.usedBuffers == commands.buffers.size()) {
+            VkCommandBufferAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = commands.pool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+
+            VkCommandBuffer commandBuffer = nullptr;
+            VkResult result = vkAllocateCommandBuffers(mDevice, &allocInfo, &commandBuffer);
+            assert(result == VK_SUCCESS);   // FIXME: better error handling
+            commands.buffers.push_back(commandBuffer);
+        }
+
+        // Slices start from what has been set so far, but write uniforms into their own ring
+        static_cast<RecordingState&>(rec) = mMainRecorder;
+        rec.shadow.inherit(mMainRecorder.shadow);
+        rec.commandBuffer = commands.buffers[commands.usedBuffers++];
+        rec.currentUniformBuffer = nullptr;
+        rec.uniformsDirty = true;
+        rec.dirtyDescriptorSets |= (1 << FrameDescriptorSet);
+        rec.unboundDescriptorSets = AllDescriptorSets;
+    }
+
+    mSliceCount = sliceCount;
+}
+
+void VulkanRenderDevice::beginSlice(unsigned sliceIndex)
+{
+    assert(tSliceDevice == nullptr && sliceIndex < mSliceCount);
+    tSliceDevice = this;
+    tSliceIndex = sliceIndex;
+
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = mRenderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = mFramebuffers[mNextImageIndex];
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    vkBeginCommandBuffer(mSliceRecorders[sliceIndex]->commandBuffer, &beginInfo);
+}
+
+void VulkanRenderDevice::endSlice()
+{
+    assert(tSliceDevice == this);
+    vkEndCommandBuffer(mSliceRecorders[tSliceIndex]->commandBuffer);
+    tSliceDevice = nullptr;
+}
+
+void VulkanRenderDevice::endSlices()
+{
+    assert(tSliceDevice != this && mSliceCount > 0);
+
+    // Secondary command buffers need a render pass of their own
+    if (mInsideRenderPass) {
+        vkCmdEndRenderPass(mMainRecorder.commandBuffer);
+        mInsideRenderPass = false;
+    }
+    beginRenderPass(VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+    mSliceCommandBuffers.clear();
+    for (unsigned i = 0; i < mSliceCount; i++)
+        mSliceCommandBuffers.push_back(mSliceRecorders[i]->commandBuffer);
+    vkCmdExecuteCommands(mMainRecorder.commandBuffer, uint32_t(mSliceCommandBuffers.size()), mSliceCommandBuffers.data());
+
+    vkCmdEndRenderPass(mMainRecorder.commandBuffer);
+    mSliceCount = 0;
+
+    // Bindings of the primary command buffer are undefined after executing secondaries
+    mMainRecorder.unboundDescriptorSets = AllDescriptorSets;
+    mMainRecorder.shadow.invalidateBindings();
+}
+
+void VulkanRenderDevice::beginGpuScope(const char* name)
+{
+    if (!mTimestampQueryPool || tSliceDevice == this)
+        return;
+
+    Frame& frame = mFrames[mFrameIndex];
+    if (frame.gpuScopes.size() == MaxGpuScopesPerFrame) {
+        mOpenGpuScopes.push_back(NoGpuScope);
+        return;
+    }
+
+    uint32_t scope = uint32_t(frame.gpuScopes.size());
+    frame.gpuScopes.push_back({ name, unsigned(mOpenGpuScopes.size()) });
+    mOpenGpuScopes.push_back(scope);
+
+    vkCmdWriteTimestamp(mMainRecorder.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        mTimestampQueryPool, mFrameIndex * TimestampsPerFrame + 2 * scope);
+}
+
+void VulkanRenderDevice::endGpuScope()
+{
+    if (!mTimestampQueryPool || tSliceDevice == this)
+        return;
+
+    assert(!mOpenGpuScopes.empty());
+    uint32_t scope = mOpenGpuScopes.back();
+    mOpenGpuScopes.pop_back();
+
+    if (scope != NoGpuScope) {
+        vkCmdWriteTimestamp(mMainRecorder.commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            mTimestampQueryPool, mFrameIndex * TimestampsPerFrame + 2 * scope + 1);
+    }
+}
+
+const std::vector<GpuTiming>& VulkanRenderDevice::gpuTimings() const
+{
+    return mGpuTimings;
+}
+
+const BindingCounters& VulkanRenderDevice::lastFrameBindingCounters() const
+{
+    return mLastFrameBindingCounters;
 }
 
 bool VulkanRenderDevice::beginFrame()
 {
-    VkSemaphoreCreateInfo semaphoreCreateInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, 0, 0 };
-    vkCreateSemaphore(mDevice, &semaphoreCreateInfo, nullptr, &mPresentCompleteSemaphore);
-    vkCreateSemaphore(mDevice, &semaphoreCreateInfo, nullptr, &mRenderingCompleteSemaphore);
+    Frame& frame = mFrames[mFrameIndex];
+
+    // Only blocks when the CPU is mFrameCount frames ahead of the GPU
+    vkWaitForFences(mDevice, 1, &frame.submitFence, VK_TRUE, UINT64_MAX);
+    readGpuTimings(mFrameIndex);
+    destroyReleases(frame.releases);
 
     mNextImageIndex = 0;
-    vkAcquireNextImageKHR(mDevice, mSwapChain, UINT64_MAX, mPresentCompleteSemaphore, VK_NULL_HANDLE, &mNextImageIndex);
+    if (mSwapChain) {
+        VkResult result = vkAcquireNextImageKHR(mDevice, mSwapChain, UINT64_MAX,
+            frame.imageAcquiredSemaphore, VK_NULL_HANDLE, &mNextImageIndex);
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+            return false;
+    }
+
+    vkResetFences(mDevice, 1, &frame.submitFence);
+
+    mUploader->update();
+
+    if (mTextureSets)
+        mTextureSets->beginFrame(mFrameIndex);
+    if (mTextureTable)
+        mTextureTable->beginFrame(mFrameIndex);
+    resetRecorder(mMainRecorder);
+    for (auto& rec : mSliceRecorders)
+        resetRecorder(*rec);
+
+    // Material sets persist, the others were allocated from the pools just reset
+    mMainRecorder.commandBuffer = frame.commandBuffer;
+    mMainRecorder.currentUniformBuffer = nullptr;
+    mMainRecorder.uniformsDirty = true;
+    mMainRecorder.dirtyDescriptorSets = AllDescriptorSets;
+    mMainRecorder.unboundDescriptorSets = AllDescriptorSets;
+    mMainRecorder.shadow.invalidate();
+
+    // The render pass begins with the first draw, or the first slices, whichever needs it
+    mRenderPassStarted = false;
+    mInsideRenderPass = false;
 
     VkCommandBufferBeginInfo beginInfo = {};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    vkBeginCommandBuffer(mDrawCommandBuffer, &beginInfo);
+    vkBeginCommandBuffer(mMainRecorder.commandBuffer, &beginInfo);
+
+    // Queries are reset outside of render passes, so before the whole frame
+    if (mTimestampQueryPool) {
+        vkCmdResetQueryPool(mMainRecorder.commandBuffer, mTimestampQueryPool, mFrameIndex * TimestampsPerFrame, TimestampsPerFrame);
+        beginGpuScope("frame");
+    }
+
+    // The offscreen image is always a color attachment
+    if (!mSwapChain)
+        return true;
 
     VkImageMemoryBarrier layoutTransitionBarrier = {};
     layoutTransitionBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1092,165 +1508,697 @@ bool VulkanRenderDevice::beginFrame()
     layoutTransitionBarrier.image = mPresentImages[mNextImageIndex];
     layoutTransitionBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 
-    vkCmdPipelineBarrier(mDrawCommandBuffer,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+    // Must not run before the image is acquired, which endFrame() waits for at this stage
+    vkCmdPipelineBarrier(mMainRecorder.commandBuffer,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
         0, 0, nullptr, 0, nullptr, 1, &layoutTransitionBarrier);
 
+    return true;
+}
+
+void VulkanRenderDevice::endFrame()
+{
+    assert(mSliceCount == 0);
+
+    // A frame without any draws still has to be cleared
+    if (!mRenderPassStarted) {
+        beginRenderPass(VK_SUBPASS_CONTENTS_INLINE);
+        mInsideRenderPass = true;
+    }
+    if (mInsideRenderPass) {
+        vkCmdEndRenderPass(mMainRecorder.commandBuffer);
+        mInsideRenderPass = false;
+    }
+
+    if (mSwapChain) {
+        VkImageMemoryBarrier prePresentBarrier = {};
+        prePresentBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        prePresentBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        prePresentBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        prePresentBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        prePresentBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        prePresentBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        prePresentBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        prePresentBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        prePresentBarrier.image = mPresentImages[mNextImageIndex];
+
+        vkCmdPipelineBarrier(mMainRecorder.commandBuffer,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &prePresentBarrier);
+    }
+
+    endGpuScope();
+    assert(mOpenGpuScopes.empty());
+
+    vkEndCommandBuffer(mMainRecorder.commandBuffer);
+
+    mLastFrameBindingCounters = mMainRecorder.shadow.counters();
+    mMainRecorder.shadow.resetCounters();
+    for (auto& rec : mSliceRecorders) {
+        mLastFrameBindingCounters += rec->shadow.counters();
+        rec->shadow.resetCounters();
+    }
+
+    Frame& frame = mFrames[mFrameIndex];
+
+    // Resources created since the last frame
+    mUploader->flush();
+
+    mSubmitWaitSemaphores.clear();
+    mSubmitWaitStages.clear();
+    if (mSwapChain) {
+        mSubmitWaitSemaphores.push_back(frame.imageAcquiredSemaphore);
+        mSubmitWaitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    }
+    mUploader->takeGraphicsWaits(mSubmitWaitSemaphores, mSubmitWaitStages);
+
+    // Buffer copies on the transfer queue wait for this frame to be done reading. Offscreen frames
+    // are not presented, and nothing would wait for the rendering to complete.
+    VkSemaphore signalSemaphores[2];
+    uint32_t signalSemaphoreCount = 0;
+    if (mSwapChain)
+        signalSemaphores[signalSemaphoreCount++] = frame.renderingCompleteSemaphore;
+    if (frame.uploadSemaphore)
+        signalSemaphores[signalSemaphoreCount++] = frame.uploadSemaphore;
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = uint32_t(mSubmitWaitSemaphores.size());
+    submitInfo.pWaitSemaphores = mSubmitWaitSemaphores.data();
+    submitInfo.pWaitDstStageMask = mSubmitWaitStages.data();
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &mMainRecorder.commandBuffer;
+    submitInfo.signalSemaphoreCount = signalSemaphoreCount;
+    submitInfo.pSignalSemaphores = signalSemaphores;
+    frame.submitTime = Profiler::time();
+    VkResult result = vkQueueSubmit(mPresentQueue, 1, &submitInfo, frame.submitFence);
+    assert(result == VK_SUCCESS); // FIXME: better error handling
+    if (frame.uploadSemaphore)
+        mUploader->setFrameSemaphore(frame.uploadSemaphore);
+
+    // The fence also covers everything submitted before, so resources released by now are destroyed
+    // when it has signaled
+    {
+        std::lock_guard<std::mutex> lock(mReleaseMutex);
+        assert(frame.releases.empty());
+        frame.releases.swap(mPendingReleases);
+    }
+
+    if (mSwapChain) {
+        VkPresentInfoKHR presentInfo = {};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = &frame.renderingCompleteSemaphore;
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = &mSwapChain;
+        presentInfo.pImageIndices = &mNextImageIndex;
+        presentInfo.pResults = nullptr;
+        vkQueuePresentKHR(mPresentQueue, &presentInfo);
+    }
+
+    mFrameIndex = (mFrameIndex + 1) % mFrameCount;
+}
+
+// Picks the surface's color format and creates a swap chain the size of the surface
+bool VulkanRenderDevice::createSwapChain(VkPhysicalDevice physicalDevice, VkFormat& colorFormat)
+{
+    // Select color format
+
+    uint32_t formatCount = 0;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, vulkanSurface, &formatCount, nullptr);
+    std::unique_ptr<VkSurfaceFormatKHR[]> surfaceFormats{new VkSurfaceFormatKHR[formatCount]};
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, vulkanSurface, &formatCount, surfaceFormats.get());
+
+    VkColorSpaceKHR colorSpace = surfaceFormats[0].colorSpace;
+    colorFormat = (formatCount > 1 || surfaceFormats[0].format != VK_FORMAT_UNDEFINED ?
+        surfaceFormats[0].format  : VK_FORMAT_B8G8R8_UNORM);
+
+    // Determine surface capabilities
+
+    VkSurfaceCapabilitiesKHR surfaceCapabilities = {};
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, vulkanSurface, &surfaceCapabilities);
+
+    uint32_t desiredImageCount = 2;
+    if (desiredImageCount < surfaceCapabilities.minImageCount)
+        desiredImageCount = surfaceCapabilities.minImageCount;
+    else if (surfaceCapabilities.maxImageCount != 0 && desiredImageCount > surfaceCapabilities.maxImageCount)
+        desiredImageCount = surfaceCapabilities.maxImageCount;
+
+    VkExtent2D surfaceResolution = surfaceCapabilities.currentExtent;
+    if (surfaceResolution.width != -1) {
+        mSurfaceWidth = surfaceResolution.width;
+        mSurfaceHeight = surfaceResolution.height;
+    } else {
+        getVulkanWindowSize(&mSurfaceWidth, &mSurfaceHeight);
+        surfaceResolution.width = mSurfaceWidth;
+        surfaceResolution.height = mSurfaceHeight;
+    }
+
+    VkSurfaceTransformFlagBitsKHR preTransform = surfaceCapabilities.currentTransform;
+    if (surfaceCapabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
+        preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+
+    // Select presentation mode
+
+    uint32_t presentModeCount = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, vulkanSurface, &presentModeCount, nullptr);
+    std::unique_ptr<VkPresentModeKHR[]> presentModes{new VkPresentModeKHR[presentModeCount]};
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, vulkanSurface, &presentModeCount, presentModes.get());
+
+    VkPresentModeKHR presentationMode = VK_PRESENT_MODE_FIFO_KHR; // always supported.
+    for (uint32_t i = 0; i < presentModeCount; ++i) {
+        if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
+            presentationMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            break;
+        }
+    }
+
+    // Create swap chain
+
+    VkSwapchainCreateInfoKHR swapChainCreateInfo = {};
+    swapChainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    swapChainCreateInfo.pNext = nullptr;
+    swapChainCreateInfo.flags = 0;
+    swapChainCreateInfo.surface = vulkanSurface;
+    swapChainCreateInfo.minImageCount = desiredImageCount;
+    swapChainCreateInfo.imageFormat = colorFormat;
+    swapChainCreateInfo.imageColorSpace = colorSpace;
+    swapChainCreateInfo.imageExtent = surfaceResolution;
+    swapChainCreateInfo.imageArrayLayers = 1;
+    swapChainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    swapChainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    swapChainCreateInfo.queueFamilyIndexCount = 0;
+    swapChainCreateInfo.pQueueFamilyIndices = nullptr;
+    swapChainCreateInfo.preTransform = preTransform;
+    swapChainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    swapChainCreateInfo.presentMode = presentationMode;
+    swapChainCreateInfo.clipped = true;
+    swapChainCreateInfo.oldSwapchain = nullptr;
+
+    VkResult result = vkCreateSwapchainKHR(mDevice, &swapChainCreateInfo, nullptr, &mSwapChain);
+    if (result != VK_SUCCESS) {
+        vulkanError("Unable to create Vulkan swap chain.");
+        return false;
+    }
+
+    return true;
+}
+
+// Brings each swap chain image into the layout endFrame() expects, which takes presenting them once
+void VulkanRenderDevice::initSwapChainImages()
+{
+    mImageCount = 0;
+    vkGetSwapchainImagesKHR(mDevice, mSwapChain, &mImageCount, nullptr);
+    mPresentImages.reset(new VkImage[mImageCount]);
+    vkGetSwapchainImagesKHR(mDevice, mSwapChain, &mImageCount, mPresentImages.get());
+
+    std::vector<bool> processed(mImageCount);
+    for (uint32_t processedCount = 0; processedCount < mImageCount; ) {
+        VkSemaphore presentCompleteSemaphore = createSemaphore();
+
+        uint32_t nextImageIndex = 0;
+        vkAcquireNextImageKHR(mDevice, mSwapChain, UINT64_MAX, presentCompleteSemaphore, VK_NULL_HANDLE, &nextImageIndex);
+
+        if (processed[nextImageIndex])
+            destroySemaphore(presentCompleteSemaphore);
+        else {
+            VkCommandBufferBeginInfo beginInfo;
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.pNext = nullptr;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            beginInfo.pInheritanceInfo = nullptr;
+            vkBeginCommandBuffer(mSetupCommandBuffer, &beginInfo);
+
+            VkImageMemoryBarrier layoutTransitionBarrier;
+            layoutTransitionBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            layoutTransitionBarrier.pNext = nullptr;
+            layoutTransitionBarrier.srcAccessMask = 0;
+            layoutTransitionBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+            layoutTransitionBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            layoutTransitionBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+            layoutTransitionBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            layoutTransitionBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            layoutTransitionBarrier.image = mPresentImages[nextImageIndex];
+            layoutTransitionBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+            vkCmdPipelineBarrier(mSetupCommandBuffer,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &layoutTransitionBarrier);
+
+            vkEndCommandBuffer(mSetupCommandBuffer);
+
+            VkPipelineStageFlags waitStageMash[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+            VkSubmitInfo submitInfo;
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.pNext = nullptr;
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = &presentCompleteSemaphore;
+            submitInfo.pWaitDstStageMask = waitStageMash;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &mSetupCommandBuffer;
+            submitInfo.signalSemaphoreCount = 0;
+            submitInfo.pSignalSemaphores = nullptr;
+            vkQueueSubmit(mPresentQueue, 1, &submitInfo, mSubmitFence);
+
+            vkWaitForFences(mDevice, 1, &mSubmitFence, VK_TRUE, UINT64_MAX);
+            vkResetFences(mDevice, 1, &mSubmitFence);
+            destroySemaphore(presentCompleteSemaphore);
+            vkResetCommandBuffer(mSetupCommandBuffer, 0);
+
+            processed[nextImageIndex] = true;
+            ++processedCount;
+        }
+
+        VkPresentInfoKHR presentInfo;
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        presentInfo.pNext = nullptr;
+        presentInfo.waitSemaphoreCount = 0;
+        presentInfo.pWaitSemaphores = nullptr;
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = &mSwapChain;
+        presentInfo.pImageIndices = &nextImageIndex;
+        presentInfo.pResults = nullptr;
+        vkQueuePresentKHR(mPresentQueue, &presentInfo);
+    }
+}
+
+// Without a surface the frames are rendered into a single image, which stays a color attachment
+bool VulkanRenderDevice::createOffscreenImage(VkFormat colorFormat)
+{
+    VkImageCreateInfo imageCreateInfo = {};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.format = colorFormat;
+    imageCreateInfo.extent = { uint32_t(mSurfaceWidth), uint32_t(mSurfaceHeight), 1 };
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult result = vkCreateImage(mDevice, &imageCreateInfo, nullptr, &mOffscreenImage);
+    if (result != VK_SUCCESS) {
+        vulkanError("Unable to create offscreen image.");
+        return false;
+    }
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(mDevice, mOffscreenImage, &memoryRequirements);
+    mOffscreenImageMemory = allocDeviceMemory(memoryRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VulkanAllocationType::Image);
+    result = vkBindImageMemory(mDevice, mOffscreenImage, mOffscreenImageMemory.memory, mOffscreenImageMemory.offset);
+    if (result != VK_SUCCESS) {
+        vulkanError("Unable to bind memory for offscreen image.");
+        return false;
+    }
+
+    return true;
+}
+
+bool VulkanRenderDevice::createFrame(Frame& frame)
+{
+    VkCommandBufferAllocateInfo commandBufferAllocationInfo = {};
+    commandBufferAllocationInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAllocationInfo.commandPool = mCommandPool;
+    commandBufferAllocationInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferAllocationInfo.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(mDevice, &commandBufferAllocationInfo, &frame.commandBuffer) != VK_SUCCESS)
+        return false;
+
+    // Created signaled so that the first beginFrame() of this frame does not wait
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    if (vkCreateFence(mDevice, &fenceCreateInfo, nullptr, &frame.submitFence) != VK_SUCCESS)
+        return false;
+
+    frame.imageAcquiredSemaphore = createSemaphore();
+    frame.renderingCompleteSemaphore = createSemaphore();
+    frame.uploadSemaphore = (mQueueFamilyCount > 1 ? createSemaphore() : nullptr);
+    frame.gpuScopes.reserve(MaxGpuScopesPerFrame);
+
+    return true;
+}
+
+void VulkanRenderDevice::destroyFrame(Frame& frame)
+{
+    if (frame.uploadSemaphore)
+        destroySemaphore(frame.uploadSemaphore);
+    if (frame.renderingCompleteSemaphore)
+        destroySemaphore(frame.renderingCompleteSemaphore);
+    if (frame.imageAcquiredSemaphore)
+        destroySemaphore(frame.imageAcquiredSemaphore);
+    if (frame.submitFence)
+        vkDestroyFence(mDevice, frame.submitFence, nullptr);
+    if (frame.commandBuffer)
+        vkFreeCommandBuffers(mDevice, mCommandPool, 1, &frame.commandBuffer);
+    destroyReleases(frame.releases);
+}
+
+void VulkanRenderDevice::destroyReleases(std::vector<Release>& releases)
+{
+    for (const auto& release : releases) {
+        if (release.buffer)
+            vkDestroyBuffer(mDevice, release.buffer, nullptr);
+        if (release.sampler)
+            vkDestroySampler(mDevice, release.sampler, nullptr);
+        if (release.imageView)
+            vkDestroyImageView(mDevice, release.imageView, nullptr);
+        if (release.image)
+            vkDestroyImage(mDevice, release.image, nullptr);
+        mMemoryAllocator->free(release.memory);
+    }
+    releases.clear();
+}
+
+void VulkanRenderDevice::readGpuTimings(uint32_t frameIndex)
+{
+    // The frame's fence has signaled, so its timestamps are available without waiting
+    Frame& frame = mFrames[frameIndex];
+    if (frame.gpuScopes.empty())
+        return;
+
+    uint32_t queryCount = 2 * uint32_t(frame.gpuScopes.size());
+    VkResult result = vkGetQueryPoolResults(mDevice, mTimestampQueryPool, frameIndex * TimestampsPerFrame, queryCount,
+        queryCount * sizeof(uint64_t), mTimestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+    if (result == VK_SUCCESS) {
+        // Scope 0 is the whole frame; the masked differences survive the counter wrapping around
+        double secondsPerTick = double(mPhysicalDeviceProperties.limits.timestampPeriod) * 1e-9;
+        uint64_t frameStart = mTimestamps[0];
+        bool recording = Profiler::isRecording();
+
+        mGpuTimings.clear();
+        for (size_t i = 0; i < frame.gpuScopes.size(); i++) {
+            uint64_t begin = mTimestamps[2 * i];
+            uint64_t end = mTimestamps[2 * i + 1];
+
+            GpuTiming timing;
+            timing.name = frame.gpuScopes[i].name;
+            timing.depth = frame.gpuScopes[i].depth;
+            timing.start = double((begin - frameStart) & mTimestampMask) * secondsPerTick;
+            timing.duration = double((end - begin) & mTimestampMask) * secondsPerTick;
+            mGpuTimings.push_back(timing);
+
+            // Without calibrated timestamps the GPU work is placed as if it started on submission
+            if (recording)
+                Profiler::addGpuEvent(timing.name, frame.submitTime + timing.start, timing.duration);
+        }
+    }
+
+    frame.gpuScopes.clear();
+}
+
+bool VulkanRenderDevice::createRecorder(Recorder& rec, bool slice)
+{
+    rec.uniformRing.reset(new VulkanUniformRing(this, mFrameCount,
+        mPhysicalDeviceProperties.limits.minUniformBufferOffsetAlignment));
+
+    for (uint32_t i = 0; i < mFrameCount; ++i) {
+        DescriptorPools& descriptorPools = rec.descriptorPools[i];
+        descriptorPools.pools.emplace_back(createDescriptorPool());
+        descriptorPools.currentPool = 0;
+        descriptorPools.setsInCurrentPool = 0;
+
+        // One pool per slice and frame, so that no two threads ever record from the same pool
+        SliceCommands& commands = rec.sliceCommands[i];
+        commands.usedBuffers = 0;
+        if (slice) {
+            VkCommandPoolCreateInfo poolInfo = {};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            poolInfo.queueFamilyIndex = mQueueFamilyIndices[0];
+            if (vkCreateCommandPool(mDevice, &poolInfo, nullptr, &commands.pool) != VK_SUCCESS)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void VulkanRenderDevice::destroyRecorder(Recorder& rec)
+{
+    for (uint32_t i = 0; i < mFrameCount; ++i) {
+        DescriptorPools& descriptorPools = rec.descriptorPools[i];
+        for (auto pool : descriptorPools.pools)
+            vkDestroyDescriptorPool(mDevice, pool, nullptr);
+        descriptorPools.pools.clear();
+
+        // Destroying the pool frees its command buffers
+        SliceCommands& commands = rec.sliceCommands[i];
+        if (commands.pool)
+            vkDestroyCommandPool(mDevice, commands.pool, nullptr);
+        commands.pool = nullptr;
+        commands.buffers.clear();
+    }
+
+    rec.uniformRing.reset();
+}
+
+void VulkanRenderDevice::resetRecorder(Recorder& rec)
+{
+    DescriptorPools& descriptorPools = rec.descriptorPools[mFrameIndex];
+    for (size_t i = 0; i <= descriptorPools.currentPool && i < descriptorPools.pools.size(); i++)
+        vkResetDescriptorPool(mDevice, descriptorPools.pools[i], 0);
+    descriptorPools.currentPool = 0;
+    descriptorPools.setsInCurrentPool = 0;
+
+    SliceCommands& commands = rec.sliceCommands[mFrameIndex];
+    if (commands.usedBuffers > 0) {
+        vkResetCommandPool(mDevice, commands.pool, 0);
+        commands.usedBuffers = 0;
+    }
+
+    rec.uniformRing->beginFrame(mFrameIndex);
+}
+
+VulkanRenderDevice::Recorder& VulkanRenderDevice::recorder()
+{
+    return (tSliceDevice == this ? *mSliceRecorders[tSliceIndex] : mMainRecorder);
+}
+
+void VulkanRenderDevice::beginRenderPass(VkSubpassContents contents)
+{
+    // Only the first pass of the frame clears, later ones continue on what it left behind
     VkClearValue clearValue[] = { { 0.0f, 0.0f, 0.0f, 1.0f }, { 1.0, 0.0 } };
     VkRenderPassBeginInfo renderPassBeginInfo = {};
     renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassBeginInfo.renderPass = mRenderPass;
+    renderPassBeginInfo.renderPass = (mRenderPassStarted ? mLoadRenderPass : mRenderPass);
     renderPassBeginInfo.framebuffer = mFramebuffers[mNextImageIndex];
     renderPassBeginInfo.renderArea = { 0, 0, uint32_t(mSurfaceWidth), uint32_t(mSurfaceHeight) };
     renderPassBeginInfo.clearValueCount = 2;
     renderPassBeginInfo.pClearValues = clearValue;
-    vkCmdBeginRenderPass(mDrawCommandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(mMainRecorder.commandBuffer, &renderPassBeginInfo, contents);
 
-    return true;
+    mRenderPassStarted = true;
 }
 
-void VulkanRenderDevice::endFrame()
+VkDescriptorPool VulkanRenderDevice::createDescriptorPool()
 {
-    vkCmdEndRenderPass(mDrawCommandBuffer);
-
-    VkImageMemoryBarrier prePresentBarrier = {};
-    prePresentBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    prePresentBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    prePresentBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    prePresentBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    prePresentBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-    prePresentBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    prePresentBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    prePresentBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-    prePresentBarrier.image = mPresentImages[mNextImageIndex];
-
-    vkCmdPipelineBarrier(mDrawCommandBuffer,
-        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-        0, 0, nullptr, 0, nullptr, 1, &prePresentBarrier);
-
-    vkEndCommandBuffer(mDrawCommandBuffer);
-
-    VkFence renderFence;
-    VkFenceCreateInfo fenceCreateInfo = {};
-    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    vkCreateFence(mDevice, &fenceCreateInfo, nullptr, &renderFence );
+    // Frame and object sets; material sets come from VulkanTextureSetCache
+    VkDescriptorPoolSize poolSizes[3] = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = 2 * DescriptorSetsPerPool;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[1].descriptorCount = DescriptorSetsPerPool;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[2].descriptorCount = DescriptorSetsPerPool;
 
-    VkSubmitInfo submitInfo = {};
-    VkPipelineStageFlags waitStageMask = { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT };
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &mPresentCompleteSemaphore;
-    submitInfo.pWaitDstStageMask = &waitStageMask;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &mDrawCommandBuffer;
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &mRenderingCompleteSemaphore;
-    vkQueueSubmit(mPresentQueue, 1, &submitInfo, renderFence);
-
-    vkWaitForFences(mDevice, 1, &renderFence, VK_TRUE, UINT64_MAX);
-    vkDestroyFence(mDevice, renderFence, nullptr);
-
-    VkPresentInfoKHR presentInfo = {};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = &mRenderingCompleteSemaphore;
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = &mSwapChain;
-    presentInfo.pImageIndices = &mNextImageIndex;
-    presentInfo.pResults = nullptr;
-    vkQueuePresentKHR(mPresentQueue, &presentInfo);
-
-    vkDestroySemaphore(mDevice, mPresentCompleteSemaphore, nullptr);
-    vkDestroySemaphore(mDevice, mRenderingCompleteSemaphore, nullptr);
-    mPresentCompleteSemaphore = nullptr;
-    mRenderingCompleteSemaphore = nullptr;
-
-    while (!mUsedUniformBuffers.empty()) {
-        auto buffer = std::move(mUsedUniformBuffers.back());
-        mUsedUniformBuffers.pop_back();
-        mFreeUniformBuffers.emplace_back(std::move(buffer));
-    }
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 3;
+    poolInfo.pPoolSizes = poolSizes;
+    poolInfo.maxSets = DescriptorSetsPerPool;
+
+    VkDescriptorPool pool = nullptr;
+    VkResult result = vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &pool);
+    assert(result == VK_SUCCESS);   // FIXME: better error handling
+
+    return pool;
 }
 
-std::unique_ptr<VulkanRenderBuffer> VulkanRenderDevice::allocUniformBuffer()
+VkDescriptorSet VulkanRenderDevice::allocDescriptorSet(Recorder& rec, DescriptorSetIndex index)
 {
-    std::unique_ptr<VulkanRenderBuffer> uniformBuffer;
-    if (mFreeUniformBuffers.empty()) {
-        uniformBuffer = std::make_unique<VulkanRenderBuffer>(this,
-            sizeof(mVertexUniforms) + sizeof(mFragmentUniforms), mImageCount);
-    } else {
-        uniformBuffer = std::move(mFreeUniformBuffers.back());
-        mFreeUniformBuffers.pop_back();
+    auto& descriptorPools = rec.descriptorPools[mFrameIndex];
+    if (descriptorPools.setsInCurrentPool == DescriptorSetsPerPool) {
+        if (++descriptorPools.currentPool == descriptorPools.pools.size())
+            descriptorPools.pools.emplace_back(createDescriptorPool());
+        descriptorPools.setsInCurrentPool = 0;
     }
-    return uniformBuffer;
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPools.pools[descriptorPools.currentPool];
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &mDescriptorSetLayouts[index];
+
+    VkDescriptorSet descriptorSet = nullptr;
+    VkResult result = vkAllocateDescriptorSets(mDevice, &allocInfo, &descriptorSet);
+    assert(result == VK_SUCCESS);   // FIXME: better error handling
+    ++descriptorPools.setsInCurrentPool;
+
+    return descriptorSet;
 }
 
-void VulkanRenderDevice::bindUniforms()
+void VulkanRenderDevice::writeFrameDescriptorSet(const Recorder& rec, VkDescriptorSet descriptorSet)
 {
-    auto uniformBuffer = allocUniformBuffer();
-
-    // FIXME: hack!!! copies both mVertexUniforms and mFragmentUniforms into the uniform buffer
-    unsigned offset = uniformBuffer->uploadData(&mVertexUniforms);
-
-    VkDescriptorBufferInfo bufferInfo[3] = {};
-    bufferInfo[0].buffer = uniformBuffer->nativeBuffer();
-    bufferInfo[0].offset = offset;
-    bufferInfo[0].range = sizeof(mVertexUniforms);
-    bufferInfo[1].buffer = uniformBuffer->nativeBuffer();
-    bufferInfo[1].offset = offset + sizeof(mVertexUniforms);
-    bufferInfo[1].range = sizeof(mFragmentUniforms);
-    bufferInfo[2].buffer = (mCurrentSkinningBuffer ? mCurrentSkinningBuffer : uniformBuffer->nativeBuffer());
-    bufferInfo[2].offset = (mCurrentSkinningBuffer ? mCurrentSkinningBufferOffset : offset);
-    bufferInfo[2].range = (mCurrentSkinningBuffer ? mCurrentSkinningBufferOffset : sizeof(mVertexUniforms));
-
-    VkDescriptorImageInfo imageInfo[2] = {};
-    imageInfo[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo[0].imageView = mCurrentImageView[0];
-    imageInfo[0].sampler = mCurrentSampler[0];
-    imageInfo[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo[1].imageView = (mCurrentImageView[1] ? mCurrentImageView[1] : mCurrentImageView[0]);
-    imageInfo[1].sampler = (mCurrentImageView[1] ? mCurrentSampler[1] : mCurrentSampler[0]);
-
-    VkWriteDescriptorSet descriptorWrites[5] = {};
+    // Both bindings are dynamic; their offsets are passed when the set is bound
+    VkDescriptorBufferInfo bufferInfo[2] = {};
+    bufferInfo[0].buffer = rec.currentUniformBuffer;
+    bufferInfo[0].offset = 0;
+    bufferInfo[0].range = sizeof(rec.vertexUniforms);
+    bufferInfo[1].buffer = rec.currentUniformBuffer;
+    bufferInfo[1].offset = 0;
+    bufferInfo[1].range = sizeof(rec.fragmentUniforms);
+
+    VkWriteDescriptorSet descriptorWrites[2] = {};
     descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = mDescriptorSets[mNextImageIndex];
+    descriptorWrites[0].dstSet = descriptorSet;
     descriptorWrites[0].dstBinding = 0;
     descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     descriptorWrites[0].descriptorCount = 1;
     descriptorWrites[0].pBufferInfo = &bufferInfo[0];
     descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[1].dstSet = mDescriptorSets[mNextImageIndex];
+    descriptorWrites[1].dstSet = descriptorSet;
     descriptorWrites[1].dstBinding = 1;
     descriptorWrites[1].dstArrayElement = 0;
-    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     descriptorWrites[1].descriptorCount = 1;
     descriptorWrites[1].pBufferInfo = &bufferInfo[1];
-    descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[2].dstSet = mDescriptorSets[mNextImageIndex];
-    descriptorWrites[2].dstBinding = 2;
-    descriptorWrites[2].dstArrayElement = 0;
-    descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[2].descriptorCount = 1;
-    descriptorWrites[2].pImageInfo = &imageInfo[0];
-    descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[3].dstSet = mDescriptorSets[mNextImageIndex];
-    descriptorWrites[3].dstBinding = 3;
-    descriptorWrites[3].dstArrayElement = 0;
-    descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[3].descriptorCount = 1;
-    descriptorWrites[3].pImageInfo = &imageInfo[1];
-    descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[4].dstSet = mDescriptorSets[mNextImageIndex];
-    descriptorWrites[4].dstBinding = 4;
-    descriptorWrites[4].dstArrayElement = 0;
-    descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrites[4].descriptorCount = 1;
-    descriptorWrites[4].pBufferInfo = &bufferInfo[2];
-    vkUpdateDescriptorSets(mDevice, 5, descriptorWrites, 0, nullptr);
-
-    vkCmdBindDescriptorSets(mDrawCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-        mCurrentPipelineLayout, 0, 1, &mDescriptorSets[mNextImageIndex], 0, nullptr);
-
-    mUsedUniformBuffers.emplace_back(std::move(uniformBuffer));
+    vkUpdateDescriptorSets(mDevice, 2, descriptorWrites, 0, nullptr);
+}
+
+void VulkanRenderDevice::writeObjectDescriptorSet(const Recorder& rec, VkDescriptorSet descriptorSet)
+{
+    // Bindings that were never set stay unwritten; no shader that reads them draws without them
+    VkDescriptorBufferInfo bufferInfo[2] = {};
+    bufferInfo[0].buffer = rec.currentSkinningBuffer;
+    bufferInfo[0].offset = rec.currentSkinningBufferOffset;
+    bufferInfo[0].range = rec.currentSkinningBufferSize;
+    bufferInfo[1].buffer = rec.currentPaletteBuffer;
+    bufferInfo[1].offset = rec.currentPaletteBufferOffset;
+    bufferInfo[1].range = rec.currentPaletteBufferSize;
+
+    uint32_t writeCount = 0;
+    VkWriteDescriptorSet descriptorWrites[2] = {};
+    if (rec.currentSkinningBuffer) {
+        VkWriteDescriptorSet& write = descriptorWrites[writeCount++];
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptorSet;
+        write.dstBinding = 0;
+        write.dstArrayElement = 0;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        write.descriptorCount = 1;
+        write.pBufferInfo = &bufferInfo[0];
+    }
+    if (rec.currentPaletteBuffer) {
+        VkWriteDescriptorSet& write = descriptorWrites[writeCount++];
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptorSet;
+        write.dstBinding = 1;
+        write.dstArrayElement = 0;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.descriptorCount = 1;
+        write.pBufferInfo = &bufferInfo[1];
+    }
+    vkUpdateDescriptorSets(mDevice, writeCount, descriptorWrites, 0, nullptr);
+}
+
+void VulkanRenderDevice::bindUniforms(Recorder& rec)
+{
+    // Unchanged uniforms keep their previous copy in the ring
+    if (rec.uniformsDirty) {
+        VkDeviceSize fragmentOffset = rec.uniformRing->align(sizeof(rec.vertexUniforms));
+
+        VkBuffer buffer;
+        uint32_t offset;
+        auto data = static_cast<uint8_t*>(rec.uniformRing->allocate(fragmentOffset + sizeof(rec.fragmentUniforms), buffer, offset));
+        memcpy(data, &rec.vertexUniforms, sizeof(rec.vertexUniforms));
+        memcpy(data + fragmentOffset, &rec.fragmentUniforms, sizeof(rec.fragmentUniforms));
+
+        if (rec.currentUniformBuffer != buffer) {
+            rec.currentUniformBuffer = buffer;
+            rec.dirtyDescriptorSets |= (1 << FrameDescriptorSet);
+        }
+
+        // New dynamic offsets only take binding the frame set again
+        rec.dynamicOffsets[0] = offset;
+        rec.dynamicOffsets[1] = offset + uint32_t(fragmentOffset);
+        rec.uniformsDirty = false;
+        rec.unboundDescriptorSets |= (1 << FrameDescriptorSet);
+    }
+
+    if (rec.dirtyDescriptorSets) {
+        if (rec.dirtyDescriptorSets & (1 << FrameDescriptorSet)) {
+            VkDescriptorSet descriptorSet = allocDescriptorSet(rec, FrameDescriptorSet);
+            writeFrameDescriptorSet(rec, descriptorSet);
+            rec.currentDescriptorSets[FrameDescriptorSet] = descriptorSet;
+        }
+
+        // The table stays bound while the textures change, only their indices are pushed again
+        if ((rec.dirtyDescriptorSets & (1 << MaterialDescriptorSet)) && mTextureTable) {
+            rec.currentDescriptorSets[MaterialDescriptorSet] = mTextureTable->set();
+            rec.materialUniformsDirty = true;
+            rec.dirtyDescriptorSets &= ~(1 << MaterialDescriptorSet);
+        }
+
+        if (rec.dirtyDescriptorSets & (1 << MaterialDescriptorSet)) {
+            VkDescriptorSet descriptorSet = nullptr;
+            if (rec.currentImageView[0]) {
+                VkImageView imageViews[2] = { rec.currentImageView[0], rec.currentImageView[1] };
+                VkSampler samplers[2] = { rec.currentSampler[0], rec.currentSampler[1] };
+                if (!imageViews[1]) {
+                    imageViews[1] = imageViews[0];
+                    samplers[1] = samplers[0];
+                }
+                descriptorSet = mTextureSets->find(imageViews, samplers);
+            }
+            rec.currentDescriptorSets[MaterialDescriptorSet] = descriptorSet;
+        }
+
+        if (rec.dirtyDescriptorSets & (1 << ObjectDescriptorSet)) {
+            VkDescriptorSet descriptorSet = nullptr;
+            if (rec.currentSkinningBuffer || rec.currentPaletteBuffer) {
+                descriptorSet = allocDescriptorSet(rec, ObjectDescriptorSet);
+                writeObjectDescriptorSet(rec, descriptorSet);
+            }
+            rec.currentDescriptorSets[ObjectDescriptorSet] = descriptorSet;
+        }
+
+        rec.unboundDescriptorSets |= rec.dirtyDescriptorSets;
+        rec.dirtyDescriptorSets = 0;
+    }
+
+    if (rec.unboundDescriptorSets) {
+        for (uint32_t i = 0; i < DescriptorSetCount; i++) {
+            if (!(rec.unboundDescriptorSets & (1 << i)) || !rec.currentDescriptorSets[i])
+                continue;
+
+            bool dynamic = (i == FrameDescriptorSet);
+            vkCmdBindDescriptorSets(rec.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, rec.currentPipelineLayout,
+                i, 1, &rec.currentDescriptorSets[i], (dynamic ? 2 : 0), (dynamic ? rec.dynamicOffsets : nullptr));
+        }
+
+        // Push constants are undefined wherever the bindings are
+        if (mTextureTable && (rec.unboundDescriptorSets & (1 << MaterialDescriptorSet)))
+            rec.materialUniformsDirty = true;
+        rec.unboundDescriptorSets = 0;
+    }
+
+    if (rec.materialUniformsDirty) {
+        vkCmdPushConstants(rec.commandBuffer, rec.currentPipelineLayout, mPushConstantStages,
+            sizeof(rec.instanceUniforms), sizeof(rec.materialUniforms), &rec.materialUniforms);
+        rec.materialUniformsDirty = false;
+    }
+}
+
+void VulkanRenderDevice::prepareDraw(Recorder& rec)
+{
+    // Slices are recorded into a render pass that endSlices() begins
+    if (&rec == &mMainRecorder && !mInsideRenderPass) {
+        beginRenderPass(VK_SUBPASS_CONTENTS_INLINE);
+        mInsideRenderPass = true;
+    }
+
+    bindUniforms(rec);
 }
@@ -1,35 +1,73 @@
 #pragma once
 #include "Engine/Renderer/IRenderDevice.h"
+#include "Engine/Renderer/RenderStateShadow.h"
 #include "Engine/Renderer/Vulkan/VulkanCommon.h"
+#include "Engine/Renderer/Vulkan/VulkanMemoryAllocator.h"
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <glm/mat3x4.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/vec4.hpp>
 
+class VulkanPipelineCache;
 class VulkanRenderBuffer;
+class VulkanShaderProgram;
+class VulkanTextureSetCache;
+class VulkanTextureTable;
+class VulkanUniformRing;
+class VulkanUploader;
 
 class VulkanRenderDevice : public IRenderDevice
 {
 public:
-    VulkanRenderDevice();
+    enum { MinFramesInFlight = 2, MaxFramesInFlight = 3, DefaultFramesInFlight = 2 };
+
+    explicit VulkanRenderDevice(uint32_t framesInFlight = DefaultFramesInFlight);
     ~VulkanRenderDevice();
 
     bool initialized() const { return mInitialized; }
 
     VkDevice nativeDevice() const { return mDevice; }
 
+    std::string description() const override;
     glm::vec2 viewportSize() const override;
-    uint32_t currentBufferInFlight() const { return mNextImageIndex; }
+    uint32_t framesInFlight() const override { return mFrameCount; }
+    uint32_t currentBufferInFlight() const { return mFrameIndex; }
 
     uint32_t findDeviceMemory(const VkMemoryRequirements& memory, VkMemoryPropertyFlags desiredFlags) const;
-    VkDeviceMemory allocDeviceMemory(const VkMemoryRequirements& memory, VkMemoryPropertyFlags desiredFlags);
+    VulkanAllocation allocDeviceMemory(const VkMemoryRequirements& memory, VkMemoryPropertyFlags desiredFlags, VulkanAllocationType type);
+    void freeDeviceMemory(const VulkanAllocation& allocation);
+    VulkanMemoryStats memoryStats() const { return mMemoryAllocator->stats(); }
+
+    VulkanUploader* uploader() const { return mUploader.get(); }
+
+    // Resources written by the uploader are shared with its queue family when that is a separate one
+    template <typename CreateInfo> void shareWithUploader(CreateInfo& info) const
+    {
+        if (mQueueFamilyCount > 1) {
+            info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            info.queueFamilyIndexCount = mQueueFamilyCount;
+            info.pQueueFamilyIndices = mQueueFamilyIndices;
+        } else
+            info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
 
     VkSemaphore createSemaphore();
     void destroySemaphore(VkSemaphore semaphore);
 
+    // Destroyed once the frames submitted so far have completed, since their command buffers may
+    // still refer to them. The image view and sampler are optional.
+    void releaseBuffer(VkBuffer buffer, const VulkanAllocation& memory);
+    void releaseImage(VkImage image, VkImageView imageView, VkSampler sampler, const VulkanAllocation& memory);
+
+    // Called when a texture is destroyed, so that no material descriptor set or table entry refers to
+    // it any more
+    void releaseTextureSets(VkImageView imageView, uint32_t tableIndex);
+
     std::unique_ptr<IRenderBuffer> createBuffer(size_t size) override;
     std::unique_ptr<IRenderBuffer> createBufferWithData(const void* data, size_t size) override;
+    std::unique_ptr<IRenderBuffer> createStaticBuffer(size_t size) override;
     std::unique_ptr<ITexture> createTexture(const TextureData* data) override;
     std::unique_ptr<IShaderProgram> createShaderProgram(const ShaderCode* code) override;
     std::unique_ptr<IPipelineState> createPipelineState(PrimitiveType primitiveType,
@@ -42,12 +80,27 @@ public:
     void setTexture(int index, const std::unique_ptr<ITexture>& texture) override;
     void setPipelineState(const std::unique_ptr<IPipelineState>& state) override;
     void setVertexBuffer(int index, const std::unique_ptr<IRenderBuffer>& state, unsigned offset) override;
+    void setPaletteBuffer(const std::unique_ptr<IRenderBuffer>& buffer, unsigned offset, unsigned paletteSize) override;
 
     void setLightPosition(const glm::vec3& position) override;
     void setAmbientColor(const glm::vec4& color) override;
 
     void drawPrimitive(unsigned start, unsigned count) override;
-    void drawIndexedPrimitive(const std::unique_ptr<IRenderBuffer>& indexBuffer, unsigned start, unsigned count) override;
+    void drawIndexedPrimitive(const std::unique_ptr<IRenderBuffer>& indexBuffer,
+        unsigned start, unsigned count, unsigned baseVertex) override;
+    void drawIndexedPrimitiveInstanced(const std::unique_ptr<IRenderBuffer>& indexBuffer,
+        unsigned start, unsigned count, unsigned instanceCount, unsigned baseVertex) override;
+
+    void beginSlices(unsigned sliceCount) override;
+    void beginSlice(unsigned sliceIndex) override;
+    void endSlice() override;
+    void endSlices() override;
+
+    void beginGpuScope(const char* name) override;
+    void endGpuScope() override;
+    const std::vector<GpuTiming>& gpuTimings() const override;
+
+    const BindingCounters& lastFrameBindingCounters() const override;
 
     bool beginFrame() override;
     void endFrame() override;
@@ -67,40 +120,197 @@ private:
         glm::vec4 ambientColor;
     };
 
+    struct InstanceUniforms // push constants
+    {
+        uint32_t paletteSize;
+    };
+
+    struct MaterialUniforms // push constants after InstanceUniforms, with a texture table only
+    {
+        uint32_t textureIndices[2];
+    };
+
+    enum { DescriptorSetsPerPool = 256 };
+    enum { MaxTextureTableSize = 4096 };
+    enum { MaxGpuScopesPerFrame = 256, TimestampsPerFrame = 2 * MaxGpuScopesPerFrame };
+    enum : uint32_t { NoGpuScope = ~0u }; // open past MaxGpuScopesPerFrame, not timed
+
+    // Scope N of a frame writes timestamps 2N and 2N + 1 of the frame's range in the query pool
+    struct GpuScopeRecord
+    {
+        const char* name;
+        unsigned depth;
+    };
+
+    // Descriptor sets by update frequency. Frame sets hold the uniform ring block, which only changes
+    // when a block fills up; uniforms move by dynamic offset. Material sets hold the textures and live
+    // in VulkanTextureSetCache, or with descriptor indexing the material set is the VulkanTextureTable,
+    // bound once, and draws push the indices of their textures. Object sets hold the skinning and
+    // palette buffers.
+    enum DescriptorSetIndex
+    {
+        FrameDescriptorSet,
+        MaterialDescriptorSet,
+        ObjectDescriptorSet,
+        DescriptorSetCount
+    };
+
+    enum { AllDescriptorSets = (1 << DescriptorSetCount) - 1 };
+
+    // Frame and object sets are allocated whenever their contents change; the pools of a frame in
+    // flight are reset when it is reused
+    struct DescriptorPools
+    {
+        std::vector<VkDescriptorPool> pools;
+        size_t currentPool;
+        unsigned setsInCurrentPool;
+    };
+
+    // Secondary command buffers of a slice recorder for one frame in flight. A frame may record
+    // several batches of slices, each takes the next buffer.
+    struct SliceCommands
+    {
+        VkCommandPool pool;
+        std::vector<VkCommandBuffer> buffers;
+        size_t usedBuffers;
+    };
+
+    // Bindings and uniforms as set through the IRenderDevice API
+    struct RecordingState
+    {
+        VkCommandBuffer commandBuffer;
+        VkPipelineLayout currentPipelineLayout;
+        VkImageView currentImageView[2];
+        VkSampler currentSampler[2];
+        VkBuffer currentSkinningBuffer;
+        unsigned currentSkinningBufferOffset;
+        unsigned currentSkinningBufferSize;
+        VkBuffer currentPaletteBuffer;
+        unsigned currentPaletteBufferOffset;
+        unsigned currentPaletteBufferSize;
+        VertexUniforms vertexUniforms;
+        FragmentUniforms fragmentUniforms;
+        InstanceUniforms instanceUniforms;
+        MaterialUniforms materialUniforms;
+        VkBuffer currentUniformBuffer;
+        VkDescriptorSet currentDescriptorSets[DescriptorSetCount];
+        uint32_t dynamicOffsets[2]; // vertex and fragment uniforms in currentUniformBuffer
+        bool uniformsDirty;
+        bool materialUniformsDirty;
+        unsigned dirtyDescriptorSets; // bit per DescriptorSetIndex whose contents changed
+        unsigned unboundDescriptorSets; // bit per DescriptorSetIndex to bind before the next draw
+    };
+
+    // The main recorder writes the frame's primary command buffer. Slice recorders write secondary
+    // command buffers on other threads, so they own everything they allocate from while recording.
+    // The shadow holds what was issued into the recorder's current command buffer.
+    struct Recorder : RecordingState
+    {
+        RenderStateShadow shadow;
+        std::unique_ptr<VulkanUniformRing> uniformRing;
+        DescriptorPools descriptorPools[MaxFramesInFlight];
+        SliceCommands sliceCommands[MaxFramesInFlight];
+    };
+
+    // A buffer or an image with its view and sampler, whichever handles are set
+    struct Release
+    {
+        VkBuffer buffer;
+        VkImage image;
+        VkImageView imageView;
+        VkSampler sampler;
+        VulkanAllocation memory;
+    };
+
+    // Everything the GPU may still be reading while the CPU records the following frames
+    struct Frame
+    {
+        VkCommandBuffer commandBuffer;
+        VkFence submitFence;
+        VkSemaphore imageAcquiredSemaphore;
+        VkSemaphore renderingCompleteSemaphore;
+        VkSemaphore uploadSemaphore; // for the uploader's transfer queue, null without one
+        std::vector<GpuScopeRecord> gpuScopes; // read back when the frame is reused
+        double submitTime; // Profiler::time(), where the trace puts the first timestamp
+        std::vector<Release> releases; // released before the frame was submitted
+    };
+
     bool mInitialized;
     VkDevice mDevice;
-    VkSwapchainKHR mSwapChain;
+    VkSwapchainKHR mSwapChain; // null when rendering offscreen
     VkQueue mPresentQueue;
+    VkQueue mTransferQueue;
+    uint32_t mQueueFamilyIndices[2]; // graphics and present, transfer
+    uint32_t mQueueFamilyCount;
     VkCommandPool mCommandPool;
     VkCommandBuffer mSetupCommandBuffer;
-    VkCommandBuffer mDrawCommandBuffer;
-    VkSemaphore mPresentCompleteSemaphore;
-    VkSemaphore mRenderingCompleteSemaphore;
     VkFence mSubmitFence;
     VkImage mDepthImage;
+    VulkanAllocation mDepthImageMemory;
     VkImageView mDepthImageView;
+    VkImage mOffscreenImage; // rendered into instead of a swap chain without a surface
+    VulkanAllocation mOffscreenImageMemory;
     VkRenderPass mRenderPass;
-    VkDescriptorSetLayout mDescriptorSetLayout;
-    VkDescriptorPool mDescriptorPool;
-    VkPipelineLayout mCurrentPipelineLayout;
-    VkImageView mCurrentImageView[2];
-    VkSampler mCurrentSampler[2];
-    VkBuffer mCurrentSkinningBuffer;
-    unsigned mCurrentSkinningBufferOffset;
-    unsigned mCurrentSkinningBufferSize;
+    VkRenderPass mLoadRenderPass; // compatible with mRenderPass, continues where another pass ended
+    VkDescriptorSetLayout mDescriptorSetLayouts[DescriptorSetCount];
+    VkPipelineLayout mPipelineLayout; // shared by all pipelines
+    VkShaderStageFlags mPushConstantStages; // of the push constant range, every push has to name them all
+    VkPhysicalDeviceProperties mPhysicalDeviceProperties;
+    VkQueryPool mTimestampQueryPool; // TimestampsPerFrame per frame in flight, null if timestamps are unsupported
+    uint64_t mTimestampMask; // valid bits of the graphics queue's timestamps
+    bool mTextureCompressionBC; // otherwise block compressed textures are decoded to RGBA8 at load
     VkPhysicalDeviceMemoryProperties mMemoryProperties;
-    VertexUniforms mVertexUniforms;
-    FragmentUniforms mFragmentUniforms; // should go immediately after mVertexUniforms
+    std::unique_ptr<VulkanMemoryAllocator> mMemoryAllocator;
+    std::unique_ptr<VulkanUploader> mUploader;
+    std::unique_ptr<VulkanPipelineCache> mPipelineCache;
+    std::unique_ptr<VulkanTextureSetCache> mTextureSets; // without descriptor indexing
+    std::unique_ptr<VulkanTextureTable> mTextureTable; // with descriptor indexing
+    std::unique_ptr<ITexture> mPlaceholderTexture; // bound while a texture is being uploaded
+    std::vector<VkSemaphore> mSubmitWaitSemaphores;
+    std::vector<VkPipelineStageFlags> mSubmitWaitStages;
+    std::vector<VkCommandBuffer> mSliceCommandBuffers; // executed in slice order
+    std::vector<uint32_t> mOpenGpuScopes; // indices into gpuScopes of the current frame
+    std::vector<uint64_t> mTimestamps;
+    std::vector<GpuTiming> mGpuTimings;
+    BindingCounters mLastFrameBindingCounters;
     std::unique_ptr<VkImage[]> mPresentImages;
     std::unique_ptr<VkFramebuffer[]> mFramebuffers;
-    std::vector<std::unique_ptr<VulkanRenderBuffer>> mUsedUniformBuffers;
-    std::vector<std::unique_ptr<VulkanRenderBuffer>> mFreeUniformBuffers;
-    std::vector<VkDescriptorSet> mDescriptorSets;
+    std::unique_ptr<Frame[]> mFrames;
+    std::vector<Release> mPendingReleases; // since the last submit, go to the next frame submitted
+    std::mutex mReleaseMutex;
+    Recorder mMainRecorder;
+    std::vector<std::unique_ptr<Recorder>> mSliceRecorders;
+    unsigned mSliceCount; // of the batch being recorded, 0 if none
+    bool mRenderPassStarted; // by any command of the current frame
+    bool mInsideRenderPass; // recording inline into the main command buffer
+    uint32_t mFrameCount;
+    uint32_t mFrameIndex;
     uint32_t mImageCount;
     uint32_t mNextImageIndex;
     int mSurfaceWidth;
     int mSurfaceHeight;
 
-    std::unique_ptr<VulkanRenderBuffer> allocUniformBuffer();
-    void bindUniforms();
+    bool createSwapChain(VkPhysicalDevice physicalDevice, VkFormat& colorFormat);
+    void initSwapChainImages();
+    bool createOffscreenImage(VkFormat colorFormat);
+    bool createFrame(Frame& frame);
+    void destroyFrame(Frame& frame);
+    void readGpuTimings(uint32_t frameIndex);
+    void destroyReleases(std::vector<Release>& releases);
+
+    bool createRecorder(Recorder& rec, bool slice);
+    void destroyRecorder(Recorder& rec);
+    void resetRecorder(Recorder& rec);
+    Recorder& recorder();
+
+    void beginRenderPass(VkSubpassContents contents);
+
+    VkPipeline createPipeline(PrimitiveType primitiveType, const VulkanShaderProgram* shader, const VertexFormat& vertexFormat);
+
+    VkDescriptorPool createDescriptorPool();
+    VkDescriptorSet allocDescriptorSet(Recorder& rec, DescriptorSetIndex index);
+    void writeFrameDescriptorSet(const Recorder& rec, VkDescriptorSet descriptorSet);
+    void writeObjectDescriptorSet(const Recorder& rec, VkDescriptorSet descriptorSet);
+    void bindUniforms(Recorder& rec);
+    void prepareDraw(Recorder& rec);
 };
@@ -2,8 +2,9 @@
 #include "VulkanShaderProgram.h"
 #include "VulkanRenderDevice.h"
 
-VulkanShaderProgram::VulkanShaderProgram(VulkanRenderDevice* device, VkShaderModule vertex, VkShaderModule fragment)
+VulkanShaderProgram::VulkanShaderProgram(VulkanRenderDevice* device, const ShaderCode* code, VkShaderModule vertex, VkShaderModule fragment)
     : mDevice(device)
+    , mCode(code)
     , mVertex(vertex)
     , mFragment(fragment)
 {
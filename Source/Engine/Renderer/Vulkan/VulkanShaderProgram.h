@@ -3,18 +3,22 @@
 #include "Engine/Renderer/Vulkan/VulkanCommon.h"
 
 class VulkanRenderDevice;
+struct ShaderCode;
 
 class VulkanShaderProgram : public IShaderProgram
 {
 public:
-    VulkanShaderProgram(VulkanRenderDevice* device, VkShaderModule vertex, VkShaderModule fragment);
+    VulkanShaderProgram(VulkanRenderDevice* device, const ShaderCode* code, VkShaderModule vertex, VkShaderModule fragment);
     ~VulkanShaderProgram();
 
+    const ShaderCode* code() const { return mCode; }
+
     VkShaderModule vertex() const { return mVertex; }
     VkShaderModule fragment() const { return mFragment; }
 
 private:
     VulkanRenderDevice* mDevice;
+    const ShaderCode* mCode;
     VkShaderModule mVertex;
     VkShaderModule mFragment;
 };
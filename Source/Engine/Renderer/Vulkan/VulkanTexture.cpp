@@ -2,19 +2,20 @@
 #include "VulkanTexture.h"
 #include "VulkanRenderDevice.h"
 
-VulkanTexture::VulkanTexture(VulkanRenderDevice* device, VkImage texture, VkDeviceMemory textureMemory, VkImageView imageView, VkSampler sampler)
+VulkanTexture::VulkanTexture(VulkanRenderDevice* device, VkImage texture, const VulkanAllocation& textureMemory, VkImageView imageView,
+        VkSampler sampler, uint64_t uploadSerial, uint32_t tableIndex)
     : mDevice(device)
     , mTexture(texture)
     , mTextureMemory(textureMemory)
     , mImageView(imageView)
     , mSampler(sampler)
+    , mUploadSerial(uploadSerial)
+    , mTableIndex(tableIndex)
 {
 }
 
 VulkanTexture::~VulkanTexture()
 {
-    vkDestroySampler(mDevice->nativeDevice(), mSampler, nullptr);
-    vkDestroyImageView(mDevice->nativeDevice(), mImageView, nullptr);
-    vkDestroyImage(mDevice->nativeDevice(), mTexture, nullptr);
-    vkFreeMemory(mDevice->nativeDevice(), mTextureMemory, nullptr);
+    mDevice->releaseTextureSets(mImageView, mTableIndex);
+    mDevice->releaseImage(mTexture, mImageView, mSampler, mTextureMemory);
 }
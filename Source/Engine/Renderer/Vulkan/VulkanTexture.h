@@ -1,22 +1,28 @@
 #pragma once
 #include "Engine/Renderer/ITexture.h"
 #include "Engine/Renderer/Vulkan/VulkanCommon.h"
+#include "Engine/Renderer/Vulkan/VulkanMemoryAllocator.h"
 
 class VulkanRenderDevice;
 
 class VulkanTexture : public ITexture
 {
 public:
-    VulkanTexture(VulkanRenderDevice* device, VkImage texture, VkDeviceMemory textureMemory, VkImageView imageView, VkSampler sampler);
+    VulkanTexture(VulkanRenderDevice* device, VkImage texture, const VulkanAllocation& textureMemory, VkImageView imageView,
+        VkSampler sampler, uint64_t uploadSerial, uint32_t tableIndex);
     ~VulkanTexture();
 
     VkImageView nativeImageView() const { return mImageView; }
     VkSampler nativeSampler() const { return mSampler; }
+    uint64_t uploadSerial() const { return mUploadSerial; }
+    uint32_t tableIndex() const { return mTableIndex; } // in VulkanTextureTable, if the device has one with room for it
 
 private:
     VulkanRenderDevice* mDevice;
     VkImage mTexture;
-    VkDeviceMemory mTextureMemory;
+    VulkanAllocation mTextureMemory;
     VkImageView mImageView;
     VkSampler mSampler;
+    uint64_t mUploadSerial;
+    uint32_t mTableIndex;
 };
@@ -0,0 +1,143 @@
+#include "VulkanTextureSetCache.h"
+#include <cassert>
+
+size_t VulkanTextureSetCache::KeyHash::operator()(const Key& key) const
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    auto combine = [&hash](uint64_t value) {
+        hash ^= value;
+        hash *= 1099511628211ull;
+    };
+
+    for (int i = 0; i < 2; i++) {
+        combine(uint64_t(reinterpret_cast<uintptr_t>(key.imageViews[i])));
+        combine(uint64_t(reinterpret_cast<uintptr_t>(key.samplers[i])));
+    }
+
+    return size_t(hash);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+VulkanTextureSetCache::VulkanTextureSetCache(VkDevice device, VkDescriptorSetLayout layout, uint32_t framesInFlight)
+    : mDevice(device)
+    , mLayout(layout)
+    , mReleased(new std::vector<Entry>[framesInFlight])
+    , mFrameCount(framesInFlight)
+    , mFrameIndex(0)
+{
+}
+
+VulkanTextureSetCache::~VulkanTextureSetCache()
+{
+    // Destroying the pools frees their sets
+    for (auto pool : mPools)
+        vkDestroyDescriptorPool(mDevice, pool, nullptr);
+}
+
+VkDescriptorSet VulkanTextureSetCache::find(const VkImageView imageViews[2], const VkSampler samplers[2])
+{
+    Key key = { { imageViews[0], imageViews[1] }, { samplers[0], samplers[1] } };
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto it = mSets.find(key);
+    if (it != mSets.end())
+        return it->second.set;
+
+    Entry entry = allocate();
+
+    VkDescriptorImageInfo imageInfo[2] = {};
+    for (int i = 0; i < 2; i++) {
+        imageInfo[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo[i].imageView = imageViews[i];
+        imageInfo[i].sampler = samplers[i];
+    }
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = entry.set;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 2; // continues into binding 1
+    descriptorWrite.pImageInfo = imageInfo;
+    vkUpdateDescriptorSets(mDevice, 1, &descriptorWrite, 0, nullptr);
+
+    mSets.emplace(key, entry);
+    return entry.set;
+}
+
+void VulkanTextureSetCache::release(VkImageView imageView)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto& released = mReleased[mFrameIndex];
+    for (auto it = mSets.begin(); it != mSets.end(); ) {
+        if (it->first.imageViews[0] == imageView || it->first.imageViews[1] == imageView) {
+            released.push_back(it->second);
+            it = mSets.erase(it);
+        } else
+            ++it;
+    }
+}
+
+void VulkanTextureSetCache::beginFrame(uint32_t frameIndex)
+{
+    assert(frameIndex < mFrameCount);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mFrameIndex = frameIndex;
+    for (const auto& entry : mReleased[frameIndex])
+        vkFreeDescriptorSets(mDevice, entry.pool, 1, &entry.set);
+    mReleased[frameIndex].clear();
+}
+
+size_t VulkanTextureSetCache::setCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSets.size();
+}
+
+VulkanTextureSetCache::Entry VulkanTextureSetCache::allocate()
+{
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &mLayout;
+
+    Entry entry = { nullptr, nullptr };
+    if (!mPools.empty()) {
+        allocInfo.descriptorPool = mPools.back();
+        if (vkAllocateDescriptorSets(mDevice, &allocInfo, &entry.set) == VK_SUCCESS) {
+            entry.pool = mPools.back();
+            return entry;
+        }
+    }
+
+    // The last pool is full, or too fragmented by freed sets
+    VkDescriptorPoolSize poolSize = {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = 2 * SetsPerPool;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = SetsPerPool;
+
+    VkDescriptorPool pool = nullptr;
+    VkResult result = vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &pool);
+    assert(result == VK_SUCCESS);   // FIXME: better error handling
+    mPools.push_back(pool);
+
+    allocInfo.descriptorPool = pool;
+    result = vkAllocateDescriptorSets(mDevice, &allocInfo, &entry.set);
+    assert(result == VK_SUCCESS);   // FIXME: better error handling
+    entry.pool = pool;
+
+    return entry;
+}
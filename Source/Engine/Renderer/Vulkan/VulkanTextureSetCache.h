@@ -0,0 +1,67 @@
+#pragma once
+#include "Engine/Renderer/Vulkan/VulkanCommon.h"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Descriptor sets of the textures a material binds. Each set is written once and then reused by every
+// draw with the same textures, until one of them is destroyed. Sets are freed only after the frame
+// that released them comes around again, so that the GPU is done with them.
+class VulkanTextureSetCache
+{
+public:
+    enum { SetsPerPool = 256 };
+
+    VulkanTextureSetCache(VkDevice device, VkDescriptorSetLayout layout, uint32_t framesInFlight);
+    ~VulkanTextureSetCache();
+
+    VulkanTextureSetCache(const VulkanTextureSetCache&) = delete;
+    VulkanTextureSetCache& operator=(const VulkanTextureSetCache&) = delete;
+
+    // Set of the two textures, creating it on first use; safe to call while recording slices
+    VkDescriptorSet find(const VkImageView imageViews[2], const VkSampler samplers[2]);
+
+    // Forgets all sets that use the image view
+    void release(VkImageView imageView);
+
+    // Frees the sets released when the given frame was last recorded
+    void beginFrame(uint32_t frameIndex);
+
+    size_t setCount() const;
+
+private:
+    struct Key
+    {
+        VkImageView imageViews[2];
+        VkSampler samplers[2];
+
+        bool operator==(const Key& other) const
+        {
+            return imageViews[0] == other.imageViews[0] && imageViews[1] == other.imageViews[1]
+                && samplers[0] == other.samplers[0] && samplers[1] == other.samplers[1];
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry
+    {
+        VkDescriptorSet set;
+        VkDescriptorPool pool;
+    };
+
+    VkDevice mDevice;
+    VkDescriptorSetLayout mLayout;
+    mutable std::mutex mMutex;
+    std::unordered_map<Key, Entry, KeyHash> mSets;
+    std::vector<VkDescriptorPool> mPools;
+    std::unique_ptr<std::vector<Entry>[]> mReleased; // per frame in flight
+    uint32_t mFrameCount;
+    uint32_t mFrameIndex;
+
+    Entry allocate();
+};
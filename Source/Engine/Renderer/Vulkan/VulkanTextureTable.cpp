@@ -0,0 +1,105 @@
+#include "VulkanTextureTable.h"
+#include <cassert>
+
+VulkanTextureTable::VulkanTextureTable(VkDevice device, VkDescriptorSetLayout layout, uint32_t size, uint32_t framesInFlight)
+    : mDevice(device)
+    , mPool(nullptr)
+    , mSet(nullptr)
+    , mReleased(new std::vector<uint32_t>[framesInFlight])
+    , mSize(size)
+    , mNextIndex(0)
+    , mFrameCount(framesInFlight)
+    , mFrameIndex(0)
+{
+    VkDescriptorPoolSize poolSize = {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = size;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 1;
+
+    VkResult result = vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &mPool);
+    assert(result == VK_SUCCESS);   // FIXME: better error handling
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = mPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    result = vkAllocateDescriptorSets(mDevice, &allocInfo, &mSet);
+    assert(result == VK_SUCCESS);   // FIXME: better error handling
+}
+
+VulkanTextureTable::~VulkanTextureTable()
+{
+    // Destroying the pool frees the set
+    if (mPool)
+        vkDestroyDescriptorPool(mDevice, mPool, nullptr);
+}
+
+uint32_t VulkanTextureTable::add(VkImageView imageView, VkSampler sampler)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    uint32_t index;
+    if (!mFreeIndices.empty()) {
+        index = mFreeIndices.back();
+        mFreeIndices.pop_back();
+    } else {
+        if (mNextIndex >= mSize)
+            return InvalidIndex;
+        index = mNextIndex++;
+    }
+
+    VkDescriptorImageInfo imageInfo = {};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = imageView;
+    imageInfo.sampler = sampler;
+
+    // Pending frames never read a free entry, so it may be written while they run
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = mSet;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = index;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(mDevice, 1, &descriptorWrite, 0, nullptr);
+
+    return index;
+}
+
+void VulkanTextureTable::release(uint32_t index)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    assert(index < mNextIndex);
+    mReleased[mFrameIndex].push_back(index);
+}
+
+void VulkanTextureTable::beginFrame(uint32_t frameIndex)
+{
+    assert(frameIndex < mFrameCount);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mFrameIndex = frameIndex;
+    auto& released = mReleased[frameIndex];
+    mFreeIndices.insert(mFreeIndices.end(), released.begin(), released.end());
+    released.clear();
+}
+
+size_t VulkanTextureTable::textureCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    size_t releasedCount = 0;
+    for (uint32_t i = 0; i < mFrameCount; i++)
+        releasedCount += mReleased[i].size();
+    return mNextIndex - mFreeIndices.size() - releasedCount;
+}
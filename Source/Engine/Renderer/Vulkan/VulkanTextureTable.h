@@ -0,0 +1,46 @@
+#pragma once
+#include "Engine/Renderer/Vulkan/VulkanCommon.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// All textures in one descriptor set, for devices with descriptor indexing. Draws select their textures
+// by index, so materials need no descriptor sets of their own. Entries are written when a texture is
+// created and may change while the set is bound; the index of a destroyed texture is reused only after
+// the frame that released it comes around again, so that the GPU is done with it.
+class VulkanTextureTable
+{
+public:
+    enum : uint32_t { InvalidIndex = ~0u };
+
+    VulkanTextureTable(VkDevice device, VkDescriptorSetLayout layout, uint32_t size, uint32_t framesInFlight);
+    ~VulkanTextureTable();
+
+    VulkanTextureTable(const VulkanTextureTable&) = delete;
+    VulkanTextureTable& operator=(const VulkanTextureTable&) = delete;
+
+    VkDescriptorSet set() const { return mSet; }
+
+    // Writes the texture into a free entry and returns its index, or InvalidIndex if every entry is
+    // taken; safe to call while recording slices
+    uint32_t add(VkImageView imageView, VkSampler sampler);
+    void release(uint32_t index);
+
+    // Frees the indices released when the given frame was last recorded
+    void beginFrame(uint32_t frameIndex);
+
+    size_t textureCount() const;
+    uint32_t size() const { return mSize; }
+
+private:
+    VkDevice mDevice;
+    VkDescriptorPool mPool;
+    VkDescriptorSet mSet;
+    mutable std::mutex mMutex;
+    std::vector<uint32_t> mFreeIndices;
+    std::unique_ptr<std::vector<uint32_t>[]> mReleased; // per frame in flight
+    uint32_t mSize;
+    uint32_t mNextIndex; // entries from here on have never been used
+    uint32_t mFrameCount;
+    uint32_t mFrameIndex;
+};
@@ -0,0 +1,79 @@
+#include "VulkanUniformRing.h"
+#include "VulkanRenderDevice.h"
+#include <algorithm>
+#include <cassert>
+
+VulkanUniformRing::VulkanUniformRing(VulkanRenderDevice* device, uint32_t framesInFlight, VkDeviceSize alignment)
+    : mDevice(device)
+    , mAlignment(std::max(alignment, VkDeviceSize(16)))
+    , mFrames(new std::vector<Block>[framesInFlight])
+    , mFrameCount(framesInFlight)
+    , mFrameIndex(0)
+    , mBlockIndex(0)
+    , mOffset(0)
+{
+    assert((mAlignment & (mAlignment - 1)) == 0);
+
+    for (uint32_t i = 0; i < mFrameCount; i++)
+        mFrames[i].emplace_back(createBlock());
+}
+
+VulkanUniformRing::~VulkanUniformRing()
+{
+    for (uint32_t i = 0; i < mFrameCount; i++) {
+        for (const auto& block : mFrames[i])
+            mDevice->releaseBuffer(block.buffer, block.memory);
+    }
+}
+
+void VulkanUniformRing::beginFrame(uint32_t frameIndex)
+{
+    assert(frameIndex < mFrameCount);
+    mFrameIndex = frameIndex;
+    mBlockIndex = 0;
+    mOffset = 0;
+}
+
+void* VulkanUniformRing::allocate(size_t size, VkBuffer& outBuffer, uint32_t& outOffset)
+{
+    assert(size <= BlockSize);
+
+    auto& blocks = mFrames[mFrameIndex];
+    if (mOffset + size > BlockSize) {
+        if (++mBlockIndex == blocks.size())
+            blocks.emplace_back(createBlock());
+        mOffset = 0;
+    }
+
+    const Block& block = blocks[mBlockIndex];
+    outBuffer = block.buffer;
+    outOffset = uint32_t(mOffset);
+
+    void* data = block.memory.mapped + mOffset;
+    mOffset = align(mOffset + size);
+
+    return data;
+}
+
+VulkanUniformRing::Block VulkanUniformRing::createBlock()
+{
+    Block block;
+
+    VkBufferCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = BlockSize;
+    info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkResult result = vkCreateBuffer(mDevice->nativeDevice(), &info, nullptr, &block.buffer);
+    assert(result == VK_SUCCESS); // FIXME: better error handling
+
+    VkMemoryRequirements memoryRequirements = {};
+    vkGetBufferMemoryRequirements(mDevice->nativeDevice(), block.buffer, &memoryRequirements);
+    block.memory = mDevice->allocDeviceMemory(memoryRequirements,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VulkanAllocationType::Buffer);
+
+    result = vkBindBufferMemory(mDevice->nativeDevice(), block.buffer, block.memory.memory, block.memory.offset);
+    assert(result == VK_SUCCESS); // FIXME: better error handling
+
+    return block;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "Engine/Renderer/Vulkan/VulkanCommon.h"
+#include "Engine/Renderer/Vulkan/VulkanMemoryAllocator.h"
+#include <memory>
+#include <vector>
+
+class VulkanRenderDevice;
+
+// Per-draw uniform data, bump-allocated from persistently mapped host-coherent blocks. Every frame
+// in flight owns its blocks, which are reused once that frame comes around again. A frame that
+// runs out of space moves on to another block, so callers must rebind when the buffer changes.
+class VulkanUniformRing
+{
+public:
+    enum { BlockSize = 1024 * 1024 };
+
+    VulkanUniformRing(VulkanRenderDevice* device, uint32_t framesInFlight, VkDeviceSize alignment);
+    ~VulkanUniformRing();
+
+    VulkanUniformRing(const VulkanUniformRing&) = delete;
+    VulkanUniformRing& operator=(const VulkanUniformRing&) = delete;
+
+    VkDeviceSize alignment() const { return mAlignment; }
+    VkDeviceSize align(VkDeviceSize size) const { return (size + mAlignment - 1) & ~(mAlignment - 1); }
+
+    // Starts reusing the blocks of the given frame; the GPU must be done with them
+    void beginFrame(uint32_t frameIndex);
+
+    // Returns mapped memory for `size` bytes; outBuffer and outOffset locate it for the GPU
+    void* allocate(size_t size, VkBuffer& outBuffer, uint32_t& outOffset);
+
+private:
+    struct Block
+    {
+        VkBuffer buffer;
+        VulkanAllocation memory;
+    };
+
+    VulkanRenderDevice* mDevice;
+    VkDeviceSize mAlignment;
+    std::unique_ptr<std::vector<Block>[]> mFrames;
+    uint32_t mFrameCount;
+    uint32_t mFrameIndex;
+    size_t mBlockIndex;
+    VkDeviceSize mOffset;
+
+    Block createBlock();
+};
@@ -0,0 +1,359 @@
+#include "VulkanUploader.h"
+#include "VulkanRenderDevice.h"
+#include "Engine/Renderer/TextureData.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+VulkanUploader::VulkanUploader(VulkanRenderDevice* device, uint32_t queueFamilyIndex, VkQueue queue, VkQueue graphicsQueue)
+    : mDevice(device)
+    , mCommandPool(nullptr)
+    , mQueue(queue)
+    , mGraphicsQueue(graphicsQueue)
+    , mBatches{}
+    , mCurrentBatch(0)
+    , mLastSerial(0)
+    , mCompletedSerial(0)
+    , mFrameSemaphore(nullptr)
+{
+    VkDevice nativeDevice = mDevice->nativeDevice();
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+    VkResult result = vkCreateCommandPool(nativeDevice, &commandPoolCreateInfo, nullptr, &mCommandPool);
+    assert(result == VK_SUCCESS); // FIXME: better error handling
+
+    for (auto& batch : mBatches) {
+        VkCommandBufferAllocateInfo commandBufferAllocationInfo = {};
+        commandBufferAllocationInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferAllocationInfo.commandPool = mCommandPool;
+        commandBufferAllocationInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferAllocationInfo.commandBufferCount = 1;
+        result = vkAllocateCommandBuffers(nativeDevice, &commandBufferAllocationInfo, &batch.commandBuffer);
+        assert(result == VK_SUCCESS); // FIXME: better error handling
+
+        VkFenceCreateInfo fenceCreateInfo = {};
+        fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        result = vkCreateFence(nativeDevice, &fenceCreateInfo, nullptr, &batch.fence);
+        assert(result == VK_SUCCESS); // FIXME: better error handling
+
+        if (usesTransferQueue())
+            batch.semaphore = mDevice->createSemaphore();
+
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = BatchStagingSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        result = vkCreateBuffer(nativeDevice, &bufferInfo, nullptr, &batch.stagingBuffer);
+        assert(result == VK_SUCCESS); // FIXME: better error handling
+
+        VkMemoryRequirements memoryRequirements = {};
+        vkGetBufferMemoryRequirements(nativeDevice, batch.stagingBuffer, &memoryRequirements);
+        batch.stagingMemory = mDevice->allocDeviceMemory(memoryRequirements,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VulkanAllocationType::Buffer);
+
+        result = vkBindBufferMemory(nativeDevice, batch.stagingBuffer, batch.stagingMemory.memory, batch.stagingMemory.offset);
+        assert(result == VK_SUCCESS); // FIXME: better error handling
+
+        batch.state = BatchState::Idle;
+    }
+}
+
+VulkanUploader::~VulkanUploader()
+{
+    finish();
+
+    // The graphics queue may still be waiting on the semaphores
+    VkDevice nativeDevice = mDevice->nativeDevice();
+    vkDeviceWaitIdle(nativeDevice);
+
+    for (auto& batch : mBatches) {
+        if (batch.state == BatchState::Recording)
+            vkEndCommandBuffer(batch.commandBuffer);
+
+        vkDestroyBuffer(nativeDevice, batch.stagingBuffer, nullptr);
+        mDevice->freeDeviceMemory(batch.stagingMemory);
+        if (batch.semaphore)
+            mDevice->destroySemaphore(batch.semaphore);
+        vkDestroyFence(nativeDevice, batch.fence, nullptr);
+        vkFreeCommandBuffers(nativeDevice, mCommandPool, 1, &batch.commandBuffer);
+    }
+
+    vkDestroyCommandPool(nativeDevice, mCommandPool, nullptr);
+}
+
+void VulkanUploader::copyToBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // Large copies are split over several batches
+    auto source = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        Batch& batch = recordingBatch(std::min(size, VkDeviceSize(BatchStagingSize / 4)), 4);
+
+        VkBufferCopy region = {};
+        region.srcOffset = alignUp(batch.used, 4);
+        region.dstOffset = offset;
+        region.size = std::min(size, BatchStagingSize - region.srcOffset);
+
+        memcpy(batch.stagingMemory.mapped + region.srcOffset, source, size_t(region.size));
+        vkCmdCopyBuffer(batch.commandBuffer, batch.stagingBuffer, buffer, 1, &region);
+
+        batch.used = region.srcOffset + region.size;
+        batch.containsBuffers = true;
+        source += region.size;
+        offset += region.size;
+        size -= region.size;
+    }
+}
+
+uint64_t VulkanUploader::copyToImage(VkImage image, const TextureData& data)
+{
+    assert(textureRowPitch(data.format, data.width) <= BatchStagingSize);
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, data.mipLevels, 0, 1 };
+
+    Batch* batch = &recordingBatch(textureRowPitch(data.format, data.width), 16);
+    vkCmdPipelineBarrier(batch->commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    // Levels that do not fit into a batch are copied a few rows of blocks at a time; the layout carries over
+    const uint32_t blockSize = blockDimension(data.format);
+    auto source = static_cast<const uint8_t*>(data.pixels);
+    for (uint32_t level = 0; level < data.mipLevels; level++) {
+        uint32_t width = mipLevelDimension(data.width, level);
+        uint32_t height = mipLevelDimension(data.height, level);
+        VkDeviceSize bytesPerRow = textureRowPitch(data.format, width);
+        uint32_t rows = uint32_t(textureRowCount(data.format, height));
+
+        for (uint32_t row = 0; row < rows; ) {
+            batch = &recordingBatch(bytesPerRow, 16);
+
+            VkDeviceSize stagingOffset = alignUp(batch->used, 16);
+            uint32_t rowCount = std::min(rows - row, uint32_t((BatchStagingSize - stagingOffset) / bytesPerRow));
+            memcpy(batch->stagingMemory.mapped + stagingOffset, source, size_t(rowCount * bytesPerRow));
+
+            // Extents are in pixels and may end within the last block
+            uint32_t y = row * blockSize;
+            VkBufferImageCopy region = {};
+            region.bufferOffset = stagingOffset;
+            region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+            region.imageOffset = { 0, int32_t(y), 0 };
+            region.imageExtent = { width, std::min(rowCount * blockSize, height - y), 1 };
+            vkCmdCopyBufferToImage(batch->commandBuffer, batch->stagingBuffer, image,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+            batch->used = stagingOffset + rowCount * bytesPerRow;
+            source += rowCount * bytesPerRow;
+            row += rowCount;
+        }
+    }
+
+    // A transfer queue cannot name shader stages; the semaphore wait of the graphics queue covers them
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = (usesTransferQueue() ? 0 : VK_ACCESS_SHADER_READ_BIT);
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(batch->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        (usesTransferQueue() ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT),
+        0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    return batch->serial;
+}
+
+void VulkanUploader::update()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    VkDevice nativeDevice = mDevice->nativeDevice();
+    for (auto& batch : mBatches) {
+        if (batch.state == BatchState::Submitted && vkGetFenceStatus(nativeDevice, batch.fence) == VK_SUCCESS)
+            completeBatch(batch);
+    }
+}
+
+void VulkanUploader::flush()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    Batch& batch = mBatches[mCurrentBatch];
+    if (batch.state == BatchState::Recording)
+        submitBatch(batch);
+}
+
+void VulkanUploader::finish()
+{
+    flush();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto& batch : mBatches)
+        waitForBatch(batch);
+}
+
+void VulkanUploader::takeGraphicsWaits(std::vector<VkSemaphore>& semaphores, std::vector<VkPipelineStageFlags>& stages)
+{
+    if (!usesTransferQueue())
+        return;
+
+    const VkPipelineStageFlags readStages =
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto& batch : mBatches) {
+        if (batch.state == BatchState::Completed) {
+            semaphores.push_back(batch.semaphore);
+            stages.push_back(readStages);
+            batch.state = BatchState::Idle;
+        } else if (batch.state == BatchState::Submitted && batch.containsBuffers && !batch.graphicsWaitTaken) {
+            // Geometry has no placeholder, so drawing waits for it on the GPU
+            semaphores.push_back(batch.semaphore);
+            stages.push_back(readStages);
+            batch.graphicsWaitTaken = true;
+        }
+    }
+
+    // No buffer copy needed the last frame's semaphore. It has to be unsignaled before the frame
+    // signals it again, by a wait that holds up no stage.
+    if (mFrameSemaphore) {
+        semaphores.push_back(mFrameSemaphore);
+        stages.push_back(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+        mFrameSemaphore = nullptr;
+    }
+}
+
+void VulkanUploader::setFrameSemaphore(VkSemaphore semaphore)
+{
+    assert(usesTransferQueue());
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    assert(mFrameSemaphore == nullptr);
+    mFrameSemaphore = semaphore;
+}
+
+VulkanUploader::Batch& VulkanUploader::recordingBatch(VkDeviceSize minimumSpace, VkDeviceSize alignment)
+{
+    Batch* batch = &mBatches[mCurrentBatch];
+    if (batch->state == BatchState::Recording && alignUp(batch->used, alignment) + minimumSpace > BatchStagingSize) {
+        submitBatch(*batch);
+        batch = &mBatches[mCurrentBatch];
+    }
+
+    if (batch->state != BatchState::Recording) {
+        waitForBatch(*batch);
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(batch->commandBuffer, &beginInfo);
+
+        // Copies wait for earlier batches, and on the graphics queue for the draws submitted before,
+        // so that nothing still read is overwritten; a transfer queue waits for draws by semaphore
+        VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        if (!usesTransferQueue())
+            srcStages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        vkCmdPipelineBarrier(batch->commandBuffer, srcStages, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+        batch->used = 0;
+        batch->serial = ++mLastSerial;
+        batch->state = BatchState::Recording;
+        batch->containsBuffers = false;
+        batch->graphicsWaitTaken = false;
+    }
+
+    return *batch;
+}
+
+void VulkanUploader::submitBatch(Batch& batch)
+{
+    // On the graphics queue, make the copied buffers visible to everything that reads geometry or uniforms
+    if (!usesTransferQueue()) {
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT
+                              | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    vkEndCommandBuffer(batch.commandBuffer);
+
+    // Batches after this one are ordered after it by their barrier
+    VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    VkSemaphore frameSemaphore = nullptr;
+    if (batch.containsBuffers)
+        std::swap(frameSemaphore, mFrameSemaphore);
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = (frameSemaphore ? 1 : 0);
+    submitInfo.pWaitSemaphores = &frameSemaphore;
+    submitInfo.pWaitDstStageMask = &waitStageMask;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+    submitInfo.signalSemaphoreCount = (usesTransferQueue() ? 1 : 0);
+    submitInfo.pSignalSemaphores = &batch.semaphore;
+    VkResult result = vkQueueSubmit(mQueue, 1, &submitInfo, batch.fence);
+    assert(result == VK_SUCCESS); // FIXME: better error handling
+
+    // Later submissions to the same queue are ordered after the copies
+    if (!usesTransferQueue())
+        mCompletedSerial = std::max(mCompletedSerial, batch.serial);
+
+    batch.state = BatchState::Submitted;
+    mCurrentBatch = (mCurrentBatch + 1) % BatchCount;
+}
+
+void VulkanUploader::completeBatch(Batch& batch)
+{
+    vkResetFences(mDevice->nativeDevice(), 1, &batch.fence);
+    mCompletedSerial = std::max(mCompletedSerial, batch.serial);
+
+    bool semaphorePending = (usesTransferQueue() && !batch.graphicsWaitTaken);
+    batch.state = (semaphorePending ? BatchState::Completed : BatchState::Idle);
+}
+
+void VulkanUploader::waitForBatch(Batch& batch)
+{
+    if (batch.state == BatchState::Submitted) {
+        vkWaitForFences(mDevice->nativeDevice(), 1, &batch.fence, VK_TRUE, UINT64_MAX);
+        completeBatch(batch);
+    }
+
+    // No frame has waited for the semaphore yet; it has to be unsignaled before the batch is submitted again
+    if (batch.state == BatchState::Completed) {
+        VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &batch.semaphore;
+        submitInfo.pWaitDstStageMask = &waitStageMask;
+        VkResult result = vkQueueSubmit(mGraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+        assert(result == VK_SUCCESS); // FIXME: better error handling
+
+        batch.state = BatchState::Idle;
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include "Engine/Renderer/Vulkan/VulkanCommon.h"
+#include "Engine/Renderer/Vulkan/VulkanMemoryAllocator.h"
+#include <mutex>
+#include <vector>
+
+class VulkanRenderDevice;
+struct TextureData;
+
+// Copies data into device local buffers and images through host visible staging memory. Copies are
+// recorded into batches that are submitted together, once per frame or when the staging memory of a
+// batch runs out; the batches are used round robin and reused once the GPU has finished with them.
+//
+// Batches go to a transfer-only queue when the device has one. The graphics queue then waits for
+// batches with buffer copies before drawing, while textures are sampled only after the fence of their
+// batch has been seen signaled, so frames never wait for texture uploads. The other way round, buffer
+// copies may overwrite what earlier frames read, so batches with them wait for the semaphore that
+// the last frame submitted signals, and each batch is ordered after the batches before it.
+class VulkanUploader
+{
+public:
+    enum { BatchCount = 4, BatchStagingSize = 8 * 1024 * 1024 };
+
+    VulkanUploader(VulkanRenderDevice* device, uint32_t queueFamilyIndex, VkQueue queue, VkQueue graphicsQueue);
+    ~VulkanUploader();
+
+    VulkanUploader(const VulkanUploader&) = delete;
+    VulkanUploader& operator=(const VulkanUploader&) = delete;
+
+    bool usesTransferQueue() const { return mQueue != mGraphicsQueue; }
+
+    void copyToBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+
+    // Copies all mip levels and leaves the image in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL. Returns
+    // the serial to pass to isComplete() before the image may be sampled.
+    uint64_t copyToImage(VkImage image, const TextureData& data);
+
+    bool isComplete(uint64_t serial) const { return serial <= mCompletedSerial; }
+
+    // Checks the fences of submitted batches, called once per frame
+    void update();
+
+    // Submits the recorded copies
+    void flush();
+
+    // Waits until all submitted copies are complete
+    void finish();
+
+    // Semaphores the next graphics submission has to wait for, and the stages that wait; they count
+    // as waited on afterwards
+    void takeGraphicsWaits(std::vector<VkSemaphore>& semaphores, std::vector<VkPipelineStageFlags>& stages);
+
+    // Signaled by the graphics submission that was just made, only when copies go to a transfer queue
+    void setFrameSemaphore(VkSemaphore semaphore);
+
+private:
+    enum class BatchState
+    {
+        Idle,
+        Recording,
+        Submitted,
+        Completed, // but the graphics queue has not waited for its semaphore yet
+    };
+
+    struct Batch
+    {
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+        VkSemaphore semaphore;
+        VkBuffer stagingBuffer;
+        VulkanAllocation stagingMemory;
+        VkDeviceSize used;
+        uint64_t serial;
+        BatchState state;
+        bool containsBuffers;
+        bool graphicsWaitTaken;
+    };
+
+    VulkanRenderDevice* mDevice;
+    VkCommandPool mCommandPool;
+    VkQueue mQueue;
+    VkQueue mGraphicsQueue;
+    Batch mBatches[BatchCount];
+    unsigned mCurrentBatch;
+    uint64_t mLastSerial;
+    uint64_t mCompletedSerial;
+    VkSemaphore mFrameSemaphore; // of the last frame submitted, until some submission waits for it
+    std::mutex mMutex;
+
+    Batch& recordingBatch(VkDeviceSize minimumSpace, VkDeviceSize alignment);
+    void submitBatch(Batch& batch);
+    void completeBatch(Batch& batch);
+    void waitForBatch(Batch& batch);
+};
@@ -5,6 +5,7 @@
 #include "Engine/Mesh/StaticMesh.h"
 #include "Engine/Mesh/AnimatedMesh.h"
 #include "Engine/Core/Engine.h"
+#include "Engine/Core/AllocationTracker.h"
 #include "Engine/Renderer/IRenderDevice.h"
 
 namespace
@@ -19,6 +20,7 @@ namespace
                 return ptr;
         }
 
+        AllocationScope allocationScope(AllocationTag::Resources);
         auto obj = construct();
         map[key] = obj;
 
@@ -69,3 +71,14 @@ std::shared_ptr<StaticMesh> ResourceManager::cachedStaticMesh(const MeshData* da
             return std::make_shared<StaticMesh>(mEngine, data);
         });
 }
+
+PoseUpdateStats ResourceManager::updateAnimatedMeshes(Camera* camera)
+{
+    PoseUpdateStats stats;
+    for (const auto& it : mAnimatedMeshes) {
+        auto mesh = it.second.lock();
+        if (mesh)
+            stats += mesh->updateInstancePoses(camera);
+    }
+    return stats;
+}
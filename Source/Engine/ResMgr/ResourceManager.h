@@ -6,7 +6,9 @@ struct TextureData;
 struct MaterialData;
 struct MeshData;
 struct ShaderCode;
+struct PoseUpdateStats;
 class Engine;
+class Camera;
 class Texture;
 class Shader;
 class Material;
@@ -25,6 +27,8 @@ public:
     std::shared_ptr<AnimatedMesh> cachedAnimatedMesh(const MeshData* data);
     std::shared_ptr<StaticMesh> cachedStaticMesh(const MeshData* data);
 
+    PoseUpdateStats updateAnimatedMeshes(Camera* camera);
+
 private:
     Engine* mEngine;
     std::unordered_map<const ShaderCode*, std::weak_ptr<Shader>> mShaders;
@@ -5,7 +5,9 @@
 #include "Engine/Core/Engine.h"
 #include "Engine/Input/InputManager.h"
 #include "Engine/Renderer/IRenderDevice.h"
+#include "Engine/Renderer/RenderQueue.h"
 #include "Engine/Mesh/AnimatedMesh.h"
+#include "Engine/Mesh/AnimatedMeshInstance.h"
 #include "Engine/ResMgr/ResourceManager.h"
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -20,12 +22,16 @@ Game::Game(Engine* engine)
 
     loadLevel(&Levels::level1);
 
-    mPlayerMesh = engine->resourceManager()->cachedAnimatedMesh(&Meshes::character);
+    mPlayerMesh = std::make_unique<AnimatedMeshInstance>(engine,
+        engine->resourceManager()->cachedAnimatedMesh(&Meshes::character));
     mPlayerMesh->setAnimation(&Animations::characterIdle);
+
+    engine->setCamera(&mCamera);
 }
 
 Game::~Game()
 {
+    mEngine->setCamera(nullptr);
 }
 
 void Game::update(float frameTime)
@@ -87,6 +93,14 @@ void Game::update(float frameTime)
     mCamera.setPosition(mPlayerPos + glm::vec3(0.0f, 2.0f, 3.0f));
     mCamera.setTarget(mPlayerPos);
 
+    // Model matrix is needed before render, for animation LOD
+    glm::mat4 m = glm::mat4(1.0f);
+    m = glm::translate(m, mPlayerPos);
+    m = glm::rotate(m, 3.1415f * 0.5f, glm::vec3(1.0f, 0.0f, 0.0f));
+    m = glm::rotate(m, mPlayerRotation * 3.1415f / 180.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+    m = glm::scale(m, glm::vec3(0.005f, 0.0025f, 0.005f));
+    mPlayerMesh->setModelMatrix(m);
+
     mEngine->renderDevice()->setLightPosition(glm::vec3(mPlayerPos.x, mPlayerPos.y, mPlayerPos.z + 2.0f));
 }
 
@@ -95,17 +109,18 @@ void Game::render()
     mEngine->renderDevice()->setProjectionMatrix(mCamera.projectionMatrix());
     mEngine->renderDevice()->setViewMatrix(mCamera.viewMatrix());
 
+    // Level draws are sorted by material before they reach the device
+    RenderQueue* queue = mEngine->renderQueue();
+    queue->begin(mCamera.viewMatrix());
     mLevel->render();
+    {
+        GpuScope gpuScope(mEngine->renderDevice(), "level");
+        queue->flush();
+    }
 
     // render character
-
-    glm::mat4 m = glm::mat4(1.0f);
-    m = glm::translate(m, mPlayerPos);
-    m = glm::rotate(m, 3.1415f * 0.5f, glm::vec3(1.0f, 0.0f, 0.0f));
-    m = glm::rotate(m, mPlayerRotation * 3.1415f / 180.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-    m = glm::scale(m, glm::vec3(0.005f, 0.0025f, 0.005f));
-    mEngine->renderDevice()->setModelMatrix(m);
-    mPlayerMesh->render();
+    GpuScope gpuScope(mEngine->renderDevice(), "characters");
+    mPlayerMesh->mesh()->renderInstances();
 }
 
 void Game::loadLevel(const LevelData* level)
@@ -5,7 +5,7 @@
 
 class Engine;
 class Level;
-class AnimatedMesh;
+class AnimatedMeshInstance;
 struct LevelData;
 
 class Game : public IGame
@@ -21,7 +21,7 @@ private:
     Engine* mEngine;
     PerspectiveCamera mCamera;
     std::unique_ptr<Level> mLevel;
-    std::shared_ptr<AnimatedMesh> mPlayerMesh;
+    std::unique_ptr<AnimatedMeshInstance> mPlayerMesh;
     glm::vec3 mPlayerPos;
     glm::vec3 mPlayerTarget;
     float mPlayerRotation;
@@ -5,34 +5,68 @@
 #include "Engine/Renderer/IPipelineState.h"
 #include "Engine/Renderer/ITexture.h"
 #include "Engine/Renderer/IShaderProgram.h"
+#include "Engine/Renderer/RenderQueue.h"
 #include "Engine/Mesh/Material.h"
+#include "Engine/Mesh/StaticBatch.h"
 #include "Engine/Mesh/StaticMesh.h"
 #include "Engine/ResMgr/ResourceManager.h"
 #include "Compiled/Materials.h"
+#include <unordered_map>
 #include <vector>
 #include <cstring>
 
 Level::Level(Engine* engine, const LevelData* data)
     : mEngine(engine)
+    , mStaticBatch(new StaticBatch(engine))
     , mIndexCount(data->indexCount)
 {
     memcpy(mWalkable, data->walkable, LevelWidth * LevelHeight * sizeof(bool));
 
-    mStaticObjects.reserve(data->staticMeshCount);
+    // Objects are grouped by mesh in the order the meshes first appear
+    std::vector<const MeshData*> meshes;
+    std::unordered_map<const MeshData*, std::vector<glm::mat4>> matrices;
     for (size_t i = 0; i < data->staticMeshCount; i++) {
-        StaticObject obj;
-        obj.matrix = data->staticMeshes[i].matrix;
-        obj.mesh = mEngine->resourceManager()->cachedStaticMesh(data->staticMeshes[i].mesh);
-        mStaticObjects.emplace_back(std::move(obj));
+        auto& meshMatrices = matrices[data->staticMeshes[i].mesh];
+        if (meshMatrices.empty())
+            meshes.emplace_back(data->staticMeshes[i].mesh);
+        meshMatrices.emplace_back(data->staticMeshes[i].matrix);
     }
 
-    mVertexBuffer = mEngine->renderDevice()->createBufferWithData(data->vertices, data->vertexCount * sizeof(LevelVertex));
-    mIndexBuffer = mEngine->renderDevice()->createBufferWithData(data->indices, data->indexCount * sizeof(uint16_t));
+    for (const MeshData* meshData : meshes) {
+        const auto& meshMatrices = matrices[meshData];
+        if (meshMatrices.size() >= data->minInstancedObjects) {
+            auto mesh = mEngine->resourceManager()->cachedStaticMesh(meshData);
+            if (mesh->supportsInstancing()) {
+                StaticGroup group;
+                group.mesh = mesh;
+                group.instanceBuffer = mesh->createInstanceBuffer(meshMatrices.data(), meshMatrices.size());
+                group.instanceCount = unsigned(meshMatrices.size());
+                group.center = glm::vec3(0.0f);
+                for (const auto& matrix : meshMatrices)
+                    group.center += glm::vec3(matrix[3]) / float(meshMatrices.size());
+                mStaticGroups.emplace_back(std::move(group));
+                continue;
+            }
+        }
+
+        for (const auto& matrix : meshMatrices)
+            mStaticBatch->add(meshData, matrix);
+    }
+    mStaticBatch->build();
+
+    GeometryArena::Geometry geometry;
+    geometry.streams[0] = data->vertices;
+    geometry.strides[0] = sizeof(LevelVertex);
+    geometry.vertexCount = data->vertexCount;
+    geometry.indices = data->indices;
+    geometry.indexCount = data->indexCount;
+    mGeometry = mEngine->geometryArena()->allocate(geometry);
     mMaterial = mEngine->resourceManager()->cachedMaterial(&Materials::levelMaterial);
 }
 
 Level::~Level()
 {
+    mEngine->geometryArena()->free(mGeometry);
 }
 
 bool Level::isWalkable(int x, int y) const
@@ -44,14 +78,12 @@ bool Level::isWalkable(int x, int y) const
 
 void Level::render() const
 {
-    mEngine->renderDevice()->setModelMatrix(glm::mat4(1.0f));
+    RenderQueue* queue = mEngine->renderQueue();
+    const auto& range = mEngine->geometryArena()->range(mGeometry);
+    queue->submit(RenderQueue::Opaque, mMaterial.get(), glm::mat4(1.0f), *range.vertexBuffers[0], *range.indexBuffer,
+        range.firstIndex, unsigned(mIndexCount), range.baseVertex);
 
-    mMaterial->bind();
-    mEngine->renderDevice()->setVertexBuffer(0, mVertexBuffer);
-    mEngine->renderDevice()->drawIndexedPrimitive(mIndexBuffer, 0, mIndexCount);
-
-    for (const auto& obj : mStaticObjects) {
-        mEngine->renderDevice()->setModelMatrix(obj.matrix);
-        obj.mesh->render();
-    }
+    mStaticBatch->submit(queue);
+    for (const auto& group : mStaticGroups)
+        group.mesh->submitInstanced(queue, group.center, group.instanceBuffer, group.instanceCount);
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include "Engine/Renderer/GeometryArena.h"
 #include "Engine/Renderer/VertexFormat.h"
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
@@ -14,6 +15,7 @@ enum
 
 struct MeshData;
 class Engine;
+class StaticBatch;
 class StaticMesh;
 class Material;
 class IRenderBuffer;
@@ -51,6 +53,9 @@ struct LevelData
     size_t vertexCount;
     size_t indexCount;
     size_t staticMeshCount;
+    // Meshes placed at least this many times are drawn instanced, the others batched. Set per level
+    // in the asset config.
+    size_t minInstancedObjects;
 };
 
 class Level
@@ -61,20 +66,25 @@ public:
 
     bool isWalkable(int x, int y) const;
 
+    // Submits the level geometry and static objects to the engine's render queue
     void render() const;
 
 private:
-    struct StaticObject
+    // Static objects sharing a mesh placed at least LevelData::minInstancedObjects times, drawn with
+    // one instanced draw per material
+    struct StaticGroup
     {
-        glm::mat4 matrix;
         std::shared_ptr<StaticMesh> mesh;
+        std::unique_ptr<IRenderBuffer> instanceBuffer;
+        unsigned instanceCount;
+        glm::vec3 center; // of the instances, where the group is sorted by depth
     };
 
     Engine* mEngine;
     bool mWalkable[LevelWidth * LevelHeight];
-    std::unique_ptr<IRenderBuffer> mVertexBuffer;
-    std::unique_ptr<IRenderBuffer> mIndexBuffer;
+    GeometryArena::Id mGeometry;
     std::shared_ptr<Material> mMaterial;
-    std::vector<StaticObject> mStaticObjects;
+    std::unique_ptr<StaticBatch> mStaticBatch;
+    std::vector<StaticGroup> mStaticGroups;
     size_t mIndexCount;
 };
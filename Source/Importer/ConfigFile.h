@@ -1,4 +1,5 @@
 #pragma once
+#include "Engine/Renderer/TextureData.h"
 #include <glm/vec3.hpp>
 #include <functional>
 #include <unordered_map>
@@ -15,6 +16,7 @@ public:
     {
         std::string id;
         std::string file;
+        unsigned minInstancedObjects;
 
         static constexpr char Tag[] = "level";
         bool parse(ConfigFile* config, const TiXmlElement* e);
@@ -24,6 +26,8 @@ public:
     {
         std::string id;
         std::string file;
+        TextureFormat format;
+        unsigned mipLevels; // 0 for a full chain down to 1x1
 
         static constexpr char Tag[] = "texture";
         bool parse(ConfigFile* config, const TiXmlElement* e);
@@ -33,6 +37,8 @@ public:
     {
         std::string id;
         std::string shaderId;
+        std::string instancedShaderId;
+        std::string bakedShaderId;
         std::vector<std::string> textureIds;
         std::string vertexFormat;
 
@@ -57,6 +63,16 @@ public:
         glm::vec3 translate;
         glm::vec3 scale;
         bool loadSkeleton;
+        float bakeFrameRate; // 0 if animations should not be baked into a texture
+        // RGBA32F by default, which keeps the poses the CPU evaluates. RGBA16F halves the texture
+        // but moves the character's vertices by up to 3e-4 of its size (frame_bench -c baked).
+        TextureFormat bakeFormat;
+        // Animations are resampled at this rate, then keys that interpolation rebuilds within
+        // the given errors are dropped
+        float animationSampleRate;
+        float maxPositionError;
+        float maxRotationError; // radians
+        float maxScaleError;
 
         static constexpr char Tag[] = "mesh";
         bool parse(ConfigFile* config, const TiXmlElement* e);
@@ -140,6 +140,7 @@ bool LevelProcessor::process(const ConfigFile::Level& level)
     mCxx << "        /* .vertexCount = */ " << meshBuilder.vertexCount() << ",\n";
     mCxx << "        /* .indexCount = */ " << meshBuilder.indexCount() << ",\n";
     mCxx << "        /* .staticMeshCount = */ " << staticMeshes.size() << ",\n";
+    mCxx << "        /* .minInstancedObjects = */ " << level.minInstancedObjects << ",\n";
     mCxx << "    };\n\n";
 
     mCxx << "    const LevelStaticMesh " << level.id << "StaticMeshes[] = {\n";
@@ -40,6 +40,14 @@ bool MaterialProcessor::process(const ConfigFile::Material& material)
     mCxx << "        /* .textures = */ " << material.id << "Textures,\n";
     mCxx << "        /* .shader = */ &Shaders::" << material.shaderId << ",\n";
     mCxx << "        /* .vertexFormat = */ &" << material.vertexFormat << "::format,\n";
+    if (material.instancedShaderId.empty())
+        mCxx << "        /* .instancedShader = */ nullptr,\n";
+    else
+        mCxx << "        /* .instancedShader = */ &Shaders::" << material.instancedShaderId << ",\n";
+    if (material.bakedShaderId.empty())
+        mCxx << "        /* .bakedShader = */ nullptr,\n";
+    else
+        mCxx << "        /* .bakedShader = */ &Shaders::" << material.bakedShaderId << ",\n";
     mCxx << "    };\n\n";
 
     return true;
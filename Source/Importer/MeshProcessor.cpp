@@ -1,5 +1,9 @@
 #include "MeshProcessor.h"
 #include "Util.h"
+#include "Engine/Mesh/PoseEvaluator.h"
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <cmath>
 #include <mutex>
 #include <assimp/Importer.hpp>
 #include <assimp/IOStream.hpp>
@@ -13,6 +17,156 @@ namespace
 {
     std::once_flag initOnce;
 
+    const unsigned MaxBakedTextureSize = 4096;
+
+    // Must match PoseEvaluator, so that key reduction measures what the runtime will produce
+    const float NlerpMinDot = 0.995f;
+
+    template <class T> struct SourceKey
+    {
+        float time;
+        T value;
+    };
+
+    template <class T, class F> T sampleSourceKeys(const std::vector<SourceKey<T>>& keys, float time, F interpolate)
+    {
+        auto it = std::lower_bound(keys.begin(), keys.end(), time,
+            [](const SourceKey<T>& key, float t) -> bool { return key.time < t; });
+        if (it == keys.begin())
+            return keys.front().value;
+        if (it == keys.end())
+            return keys.back().value;
+
+        auto prev = it - 1;
+        float timeDelta = it->time - prev->time;
+        return interpolate(prev->value, it->value, (timeDelta > 0.0f ? (time - prev->time) / timeDelta : 0.0f));
+    }
+
+    // Picks the frames to keep so that interpolating `stored` values between them stays within
+    // maxError of the source animation. The error is measured at every source key and at every
+    // frame, where `exact` holds the source sampled on the frame grid; `stored` is what is kept for
+    // each frame, which may differ from `exact` by quantization. Both curves are piecewise linear,
+    // so their largest distance is at one of these points. A channel that never leaves maxError
+    // of its first value keeps a single key. Returns false, keeping every frame, if even that
+    // exceeds maxError, which happens when source keys fall between frames.
+    template <class T, class I, class E> bool reduceKeys(const std::vector<SourceKey<T>>& source,
+        const std::vector<T>& exact, const std::vector<T>& stored, float ticksPerFrame,
+        I interpolate, E error, float maxError, std::vector<size_t>& frames)
+    {
+        size_t last = exact.size() - 1;
+        auto sourceValue = [&](const SourceKey<T>& key) -> const T& {
+            // Keys that share a time act as a step; the first of them is the value from then on
+            auto it = std::lower_bound(source.begin(), source.end(), key.time,
+                [](const SourceKey<T>& k, float t) -> bool { return k.time < t; });
+            return it->value;
+        };
+        auto sourceBetween = [&](size_t from, size_t to) {
+            auto begin = std::upper_bound(source.begin(), source.end(), float(from) * ticksPerFrame,
+                [](float t, const SourceKey<T>& k) -> bool { return t < k.time; });
+            auto end = std::lower_bound(begin, source.end(), float(to) * ticksPerFrame,
+                [](const SourceKey<T>& k, float t) -> bool { return k.time < t; });
+            return std::make_pair(begin, end);
+        };
+
+        auto fits = [&](size_t from, size_t to) -> bool {
+            for (size_t i = from + 1; i < to; i++) {
+                float factor = float(i - from) / float(to - from);
+                if (error(interpolate(stored[from], stored[to], factor), exact[i]) > maxError)
+                    return false;
+            }
+            auto keys = sourceBetween(from, to);
+            for (auto it = keys.first; it != keys.second; ++it) {
+                float factor = (it->time / ticksPerFrame - float(from)) / float(to - from);
+                if (error(interpolate(stored[from], stored[to], factor), sourceValue(*it)) > maxError)
+                    return false;
+            }
+            return true;
+        };
+
+        frames.assign(1, 0);
+
+        bool constant = true;
+        for (size_t i = 0; i <= last && constant; i++)
+            constant = (error(stored[0], exact[i]) <= maxError);
+        for (size_t i = 0; i < source.size() && constant; i++)
+            constant = (error(stored[0], sourceValue(source[i])) <= maxError);
+        if (constant)
+            return true;
+
+        bool feasible = true;
+        for (size_t i = 0; i <= last && feasible; i++)
+            feasible = (error(stored[i], exact[i]) <= maxError && (i == last || fits(i, i + 1)));
+        if (!feasible) {
+            for (size_t i = 1; i <= last; i++)
+                frames.emplace_back(i);
+            return false;
+        }
+
+        size_t anchor = 0;
+        while (anchor < last) {
+            size_t next = anchor + 1;
+            while (next < last && fits(anchor, next + 1))
+                ++next;
+            frames.emplace_back(next);
+            anchor = next;
+        }
+
+        return true;
+    }
+
+    glm::vec3 lerpVector(const glm::vec3& a, const glm::vec3& b, float factor)
+    {
+        return a + (b - a) * factor;
+    }
+
+    float vectorError(const glm::vec3& a, const glm::vec3& b)
+    {
+        return glm::distance(a, b);
+    }
+
+    glm::quat interpolateRotation(const glm::quat& a, glm::quat b, float factor)
+    {
+        float dot = glm::dot(a, b);
+        if (fabsf(dot) < NlerpMinDot)
+            return glm::slerp(a, b, factor);
+        if (dot < 0.0f)
+            b = -b;
+        return glm::normalize(a * (1.0f - factor) + b * factor);
+    }
+
+    // Angle between two rotations, computed from the chord length as acos() of the dot product
+    // is too imprecise near 1 for sub-degree tolerances
+    float rotationError(const glm::quat& a, const glm::quat& b)
+    {
+        glm::quat delta = (glm::dot(a, b) < 0.0f ? a + b : a + (-b));
+        return 4.0f * asinf(std::min(1.0f, glm::length(delta) * 0.5f));
+    }
+
+    // See MeshRotationKey::decodeRotation()
+    void encodeRotation(glm::quat q, uint16_t* out)
+    {
+        q = glm::normalize(q);
+
+        int largest = 0;
+        for (int i = 1; i < 4; i++) {
+            if (fabsf(q[i]) > fabsf(q[largest]))
+                largest = i;
+        }
+        if (q[largest] < 0.0f)
+            q = -q;
+
+        int j = 0;
+        for (int i = 0; i < 4; i++) {
+            if (i == largest)
+                continue;
+            float value = glm::clamp(q[i] * 0.70710678f + 0.5f, 0.0f, 1.0f);
+            out[j++] = uint16_t(lroundf(value * 32767.0f));
+        }
+
+        out[0] |= uint16_t((largest & 1) << 15);
+        out[1] |= uint16_t((largest >> 1) << 15);
+    }
+
     class AssimpLogStream : public Assimp::LogStream
     {
     public:
@@ -45,6 +199,8 @@ MeshProcessor::MeshProcessor(const ConfigFile& config)
 
     mCxx << "#include \"Meshes.h\"\n";
     mCxx << "#include \"Materials.h\"\n";
+    mCxx << "#include \"Animations.h\"\n";
+    mCxx << "#include \"Engine/Renderer/TextureData.h\"\n";
     mCxx << std::endl;
     mCxx << "namespace Meshes\n";
     mCxx << "{\n";
@@ -241,6 +397,17 @@ bool MeshProcessor::process(const ConfigFile::Mesh& mesh)
                     }
                 }
             }
+
+            // Instanced and baked skinning use affine 3x4 matrices, which lack the perspective divide
+            // that made the 4x4 path immune to weights not summing to one
+            for (size_t i = baseVertex; i < vertices.size(); i++) {
+                float* weights = skinningVertices[i].boneWeights;
+                float sum = weights[0] + weights[1] + weights[2] + weights[3];
+                if (sum > 0.0f) {
+                    for (int index = 0; index < 4; index++)
+                        weights[index] /= sum;
+                }
+            }
         }
 
         size_t firstIndex = indices.size();
@@ -277,8 +444,14 @@ bool MeshProcessor::process(const ConfigFile::Mesh& mesh)
     }
 
     mAnimations.clear();
-    for (const auto& anim : mesh.animations)
-        loadAnimations(anim);
+    for (const auto& anim : mesh.animations) {
+        if (!loadAnimations(mesh, anim))
+            return false;
+    }
+
+    glm::vec3 boundingSphereCenter;
+    float boundingSphereRadius;
+    calculateBounds(vertices, skinningVertices, globalInverseTransform, boundingSphereCenter, boundingSphereRadius);
 
     mCxx << "    static const MeshVertex " << mesh.id << "Vertices[] = {\n";
     for (const auto& vertex : vertices) {
@@ -362,21 +535,21 @@ bool MeshProcessor::process(const ConfigFile::Mesh& mesh)
             if (!jt.positionKeys.empty()) {
                 mAnimCxx << "    static const MeshPositionKey " << it.first << "Positions_" << jt.name << "[] = {\n";
                 for (const auto& key : jt.positionKeys)
-                    mAnimCxx << "        { " << key.time << ", { " << key.position.x << ", " << key.position.y << ", " << key.position.z << " } },\n";
+                    mAnimCxx << "        { " << key.frame << ", { " << key.position.x << ", " << key.position.y << ", " << key.position.z << " } },\n";
                 mAnimCxx << "    };\n\n";
             }
 
             if (!jt.rotationKeys.empty()) {
                 mAnimCxx << "    static const MeshRotationKey " << it.first << "Rotations_" << jt.name << "[] = {\n";
                 for (const auto& key : jt.rotationKeys)
-                    mAnimCxx << "        { " << key.time << ", { " << key.rotation.w << ", " << key.rotation.x << ", " << key.rotation.y << ", " << key.rotation.z << " } },\n";
+                    mAnimCxx << "        { " << key.frame << ", { " << key.rotation[0] << ", " << key.rotation[1] << ", " << key.rotation[2] << " } },\n";
                 mAnimCxx << "    };\n\n";
             }
 
             if (!jt.scaleKeys.empty()) {
                 mAnimCxx << "    static const MeshScaleKey " << it.first << "Scale_" << jt.name << "[] = {\n";
                 for (const auto& key : jt.scaleKeys)
-                    mAnimCxx << "        { " << key.time << ", { " << key.scale.x << ", " << key.scale.y << ", " << key.scale.z << " } },\n";
+                    mAnimCxx << "        { " << key.frame << ", { " << key.scale.x << ", " << key.scale.y << ", " << key.scale.z << " } },\n";
                 mAnimCxx << "    };\n\n";
             }
         }
@@ -410,10 +583,16 @@ bool MeshProcessor::process(const ConfigFile::Mesh& mesh)
         mAnimCxx << "    const MeshAnimation " << it.first << " = {\n";
         mAnimCxx << "        /* durationInTicks = */ " << it.second.info.durationInTicks << ",\n";
         mAnimCxx << "        /* ticksPerSecond = */ " << it.second.info.ticksPerSecond << ",\n";
+        mAnimCxx << "        /* ticksPerFrame = */ " << it.second.info.ticksPerFrame << ",\n";
         mAnimCxx << "        /* boneAnimations = */ " << it.first << "BoneAnimations,\n";
         mAnimCxx << "    };\n\n";
     }
 
+    if (mesh.bakeFrameRate > 0.0f && !mAnimations.empty()) {
+        if (!bakeAnimations(mesh, globalInverseTransform))
+            return false;
+    }
+
     mCxx << "    static const MeshMaterial " << mesh.id << "Materials[] = {\n";
     size_t i = 0;
     for (const auto& material : materials) {
@@ -444,6 +623,20 @@ bool MeshProcessor::process(const ConfigFile::Mesh& mesh)
     mCxx << "        /* .indexCount = */ " << indices.size() << ",\n";
     mCxx << "        /* .materialCount = */ " << materials.size() << ",\n";
     mCxx << "        /* .boneCount = */ " << mBoneList.size() << ",\n";
+    if (mesh.bakeFrameRate > 0.0f && !mAnimations.empty()) {
+        mCxx << "        /* .bakedPoses = */ &" << mesh.id << "BakedPoses,\n";
+        mCxx << "        /* .bakedAnimations = */ " << mesh.id << "BakedAnimations,\n";
+        mCxx << "        /* .bakedAnimationCount = */ " << mAnimations.size() << ",\n";
+        mCxx << "        /* .bakedFrameRate = */ " << mesh.bakeFrameRate << ",\n";
+    } else {
+        mCxx << "        /* .bakedPoses = */ nullptr,\n";
+        mCxx << "        /* .bakedAnimations = */ nullptr,\n";
+        mCxx << "        /* .bakedAnimationCount = */ 0,\n";
+        mCxx << "        /* .bakedFrameRate = */ 0.0f,\n";
+    }
+    mCxx << "        /* .boundingSphereCenter = */ { " << boundingSphereCenter.x << ", "
+        << boundingSphereCenter.y << ", " << boundingSphereCenter.z << " },\n";
+    mCxx << "        /* .boundingSphereRadius = */ " << boundingSphereRadius << ",\n";
     mCxx << "    };\n\n";
 
     return true;
@@ -474,7 +667,7 @@ void MeshProcessor::readBoneHierarchy(const aiNode* rootNode, size_t parentBoneI
         readBoneHierarchy(rootNode->mChildren[i], boneIndex);
 }
 
-bool MeshProcessor::loadAnimations(const ConfigFile::MeshAnimations& anim)
+bool MeshProcessor::loadAnimations(const ConfigFile::Mesh& mesh, const ConfigFile::MeshAnimations& anim)
 {
     const aiScene* scene = nullptr;
     const unsigned flags =
@@ -501,50 +694,316 @@ bool MeshProcessor::loadAnimations(const ConfigFile::MeshAnimations& anim)
         Anim animItem;
         animItem.info.durationInTicks = float(sceneAnimation->mDuration);
         animItem.info.ticksPerSecond = float(sceneAnimation->mTicksPerSecond);
-        animItem.bones.resize(mBoneList.size());
 
-        for (size_t j = 0; j < sceneAnimation->mNumChannels; j++) {
-            const aiNodeAnim* channel = sceneAnimation->mChannels[j];
+        // Keys are resampled on a uniform grid, so that their times fit into 16-bit frame indices
+        float ticksPerSecond = (animItem.info.ticksPerSecond > 0.0f ? animItem.info.ticksPerSecond : 25.0f);
+        float duration = animItem.info.durationInTicks / ticksPerSecond;
+        size_t frameCount = std::max(size_t(1), size_t(std::ceil(duration * mesh.animationSampleRate)));
+        if (frameCount > 65535) {
+            fprintf(stderr, "Animation \"%s\" in file \"%s\" is too long to sample at %g frames per second.\n",
+                animationName.c_str(), anim.file.c_str(), mesh.animationSampleRate);
+            return false;
+        }
 
-            std::string boneName{channel->mNodeName.data, channel->mNodeName.length};
-            auto it = mBoneMap.find(boneName);
-            if (it == mBoneMap.end()) {
-                fprintf(stderr, "Unknown bone \"%s\" in file \"%s\".\n", boneName.c_str(), anim.file.c_str());
+        // The grid is made finer until keys on it can rebuild every channel within its error bound
+        for (;;) {
+            bool withinBounds = true;
+            if (!compressAnimation(mesh, sceneAnimation, anim, frameCount, animItem, withinBounds))
                 return false;
+            if (withinBounds)
+                break;
+
+            if (frameCount * 2 > 65535) {
+                fprintf(stderr, "Warning: animation \"%s\" in file \"%s\" exceeds its error bounds "
+                    "at the finest frame grid.\n", animationName.c_str(), anim.file.c_str());
+                break;
             }
+            frameCount *= 2;
+        }
+
+        if (mAnimations.find(animationName) != mAnimations.end()) {
+            fprintf(stderr, "Duplicate animation id \"%s\" in file \"%s\".\n", animationName.c_str(), anim.file.c_str());
+            return false;
+        }
+
+        mAnimations[animationName] = std::move(animItem);
+    }
+
+    return true;
+}
+
+bool MeshProcessor::compressAnimation(const ConfigFile::Mesh& mesh, const aiAnimation* sceneAnimation,
+    const ConfigFile::MeshAnimations& anim, size_t frameCount, Anim& animItem, bool& withinBounds)
+{
+    float ticksPerFrame = animItem.info.durationInTicks / float(frameCount);
+    animItem.info.ticksPerFrame = (ticksPerFrame > 0.0f ? ticksPerFrame : 1.0f);
+    auto frameTime = [&animItem, frameCount](size_t frame) -> float {
+        return (frame < frameCount ? float(frame) * animItem.info.ticksPerFrame : animItem.info.durationInTicks);
+    };
+
+    animItem.bones.assign(mBoneList.size(), BoneAnim());
+    std::vector<size_t> frames;
+    for (size_t j = 0; j < sceneAnimation->mNumChannels; j++) {
+        const aiNodeAnim* channel = sceneAnimation->mChannels[j];
+
+        std::string boneName{channel->mNodeName.data, channel->mNodeName.length};
+        auto it = mBoneMap.find(boneName);
+        if (it == mBoneMap.end()) {
+            fprintf(stderr, "Unknown bone \"%s\" in file \"%s\".\n", boneName.c_str(), anim.file.c_str());
+            return false;
+        }
 
-            BoneAnim& boneAnim = animItem.bones[it->second];
-            boneAnim.name = boneName;
+        BoneAnim& boneAnim = animItem.bones[it->second];
+        boneAnim.name = boneName;
 
-            boneAnim.positionKeys.reserve(channel->mNumPositionKeys);
+        if (channel->mNumPositionKeys > 0) {
+            std::vector<SourceKey<glm::vec3>> sourceKeys;
+            sourceKeys.reserve(channel->mNumPositionKeys);
             for (size_t k = 0; k < channel->mNumPositionKeys; k++) {
                 const aiVectorKey& key = channel->mPositionKeys[k];
                 glm::vec3 position(key.mValue.x, key.mValue.y, key.mValue.z);
-                boneAnim.positionKeys.emplace_back(MeshPositionKey{float(key.mTime), position});
+                sourceKeys.emplace_back(SourceKey<glm::vec3>{float(key.mTime), position});
             }
 
-            boneAnim.rotationKeys.reserve(channel->mNumRotationKeys);
+            std::vector<glm::vec3> samples(frameCount + 1);
+            for (size_t f = 0; f <= frameCount; f++)
+                samples[f] = sampleSourceKeys(sourceKeys, frameTime(f), lerpVector);
+
+            if (!reduceKeys(sourceKeys, samples, samples, animItem.info.ticksPerFrame,
+                    lerpVector, vectorError, mesh.maxPositionError, frames))
+                withinBounds = false;
+            for (size_t f : frames)
+                boneAnim.positionKeys.emplace_back(MeshPositionKey{uint16_t(f), samples[f]});
+        }
+
+        if (channel->mNumRotationKeys > 0) {
+            std::vector<SourceKey<glm::quat>> sourceKeys;
+            sourceKeys.reserve(channel->mNumRotationKeys);
             for (size_t k = 0; k < channel->mNumRotationKeys; k++) {
                 const aiQuatKey& key = channel->mRotationKeys[k];
                 glm::quat rotation(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z);
-                boneAnim.rotationKeys.emplace_back(MeshRotationKey{float(key.mTime), rotation});
+                sourceKeys.emplace_back(SourceKey<glm::quat>{float(key.mTime), rotation});
             }
 
-            boneAnim.scaleKeys.reserve(channel->mNumScalingKeys);
+            // Reduction interpolates the quantized rotations, so the error bound includes quantization
+            std::vector<glm::quat> samples(frameCount + 1);
+            std::vector<glm::quat> decoded(frameCount + 1);
+            std::vector<MeshRotationKey> encoded(frameCount + 1);
+            for (size_t f = 0; f <= frameCount; f++) {
+                samples[f] = sampleSourceKeys(sourceKeys, frameTime(f),
+                    [](const glm::quat& a, const glm::quat& b, float factor) { return glm::slerp(a, b, factor); });
+                encoded[f].frame = uint16_t(f);
+                encodeRotation(samples[f], encoded[f].rotation);
+                decoded[f] = encoded[f].decodeRotation();
+            }
+
+            if (!reduceKeys(sourceKeys, samples, decoded, animItem.info.ticksPerFrame,
+                    interpolateRotation, rotationError, mesh.maxRotationError, frames))
+                withinBounds = false;
+            for (size_t f : frames)
+                boneAnim.rotationKeys.emplace_back(encoded[f]);
+        }
+
+        if (channel->mNumScalingKeys > 0) {
+            std::vector<SourceKey<glm::vec3>> sourceKeys;
+            sourceKeys.reserve(channel->mNumScalingKeys);
             for (size_t k = 0; k < channel->mNumScalingKeys; k++) {
                 const aiVectorKey& key = channel->mScalingKeys[k];
                 glm::vec3 scale(key.mValue.x, key.mValue.y, key.mValue.z);
-                boneAnim.scaleKeys.emplace_back(MeshScaleKey{float(key.mTime), scale});
+                sourceKeys.emplace_back(SourceKey<glm::vec3>{float(key.mTime), scale});
             }
+
+            std::vector<glm::vec3> samples(frameCount + 1);
+            for (size_t f = 0; f <= frameCount; f++)
+                samples[f] = sampleSourceKeys(sourceKeys, frameTime(f), lerpVector);
+
+            if (!reduceKeys(sourceKeys, samples, samples, animItem.info.ticksPerFrame,
+                    lerpVector, vectorError, mesh.maxScaleError, frames))
+                withinBounds = false;
+            for (size_t f : frames)
+                boneAnim.scaleKeys.emplace_back(MeshScaleKey{uint16_t(f), samples[f]});
         }
+    }
 
-        if (mAnimations.find(animationName) != mAnimations.end()) {
-            fprintf(stderr, "Duplicate animation id \"%s\" in file \"%s\".\n", animationName.c_str(), anim.file.c_str());
-            return false;
+    return true;
+}
+
+bool MeshProcessor::bakeAnimations(const ConfigFile::Mesh& mesh, const glm::mat4& globalInverseTransform)
+{
+    struct Clip
+    {
+        const std::string* id;
+        unsigned firstFrame;
+        unsigned frameCount;
+    };
+
+    const size_t boneCount = mBoneList.size();
+    const unsigned width = unsigned(boneCount * 3);
+    if (width > MaxBakedTextureSize) {
+        fprintf(stderr, "Mesh \"%s\" has too many bones to bake animations.\n", mesh.file.c_str());
+        return false;
+    }
+
+    std::vector<Clip> clips;
+    unsigned height = 0;
+    for (const auto& it : mAnimations) {
+        float ticksPerSecond = (it.second.info.ticksPerSecond > 0.0f ? it.second.info.ticksPerSecond : 25.0f);
+        float duration = it.second.info.durationInTicks / ticksPerSecond;
+        unsigned frameCount = std::max(1u, unsigned(std::ceil(duration * mesh.bakeFrameRate)));
+        clips.emplace_back(Clip{&it.first, height, frameCount});
+        height += frameCount;
+    }
+
+    if (height > MaxBakedTextureSize) {
+        fprintf(stderr, "Animations of mesh \"%s\" are too long to bake at %g frames per second.\n",
+            mesh.file.c_str(), mesh.bakeFrameRate);
+        return false;
+    }
+
+    std::vector<float> pixels(size_t(width) * height * 4);
+    std::vector<glm::mat4> matrices(boneCount);
+    std::vector<MeshBoneAnimation> boneAnimations;
+
+    // Same evaluator as the runtime uses, so baked poses match CPU-evaluated ones
+    PoseSkeleton skeleton(mBoneList.data(), boneCount, globalInverseTransform);
+
+    size_t clipIndex = 0;
+    for (const auto& it : mAnimations) {
+        const Clip& clip = clips[clipIndex++];
+
+        MeshAnimation animation = animationData(it.second, boneAnimations);
+        float ticksPerSecond = (animation.ticksPerSecond > 0.0f ? animation.ticksPerSecond : 25.0f);
+
+        PoseEvaluator evaluator(skeleton);
+        for (unsigned frame = 0; frame < clip.frameCount; frame++) {
+            float timeInTicks = float(frame) / mesh.bakeFrameRate * ticksPerSecond;
+            if (animation.durationInTicks > 0.0f)
+                timeInTicks = fmodf(timeInTicks, animation.durationInTicks);
+
+            evaluator.evaluate(&animation, timeInTicks, matrices.data());
+
+            float* row = &pixels[size_t(clip.firstFrame + frame) * width * 4];
+            for (size_t bone = 0; bone < boneCount; bone++) {
+                for (int r = 0; r < 3; r++) {
+                    for (int c = 0; c < 4; c++)
+                        row[(bone * 3 + r) * 4 + c] = matrices[bone][c][r];
+                }
+            }
         }
+    }
 
-        mAnimations[animationName] = std::move(animItem);
+    const bool halfFloat = (mesh.bakeFormat == TextureFormat::RGBA16F);
+    mCxx << "    static const " << (halfFloat ? "uint16_t " : "float ") << mesh.id << "BakedPosePixels[] = {\n";
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+        mCxx << "       ";
+        for (size_t j = i; j < i + 4; j++) {
+            if (halfFloat)
+                mCxx << " " << glm::packHalf1x16(pixels[j]) << ",";
+            else
+                mCxx << " " << pixels[j] << ",";
+        }
+        mCxx << std::endl;
     }
+    mCxx << "    };\n\n";
+
+    mCxx << "    static const TextureData " << mesh.id << "BakedPoses = {\n";
+    mCxx << "        /* .pixels = */ " << mesh.id << "BakedPosePixels,\n";
+    mCxx << "        /* .width = */ " << width << ",\n";
+    mCxx << "        /* .height = */ " << height << ",\n";
+    mCxx << "        /* .mipLevels = */ 1,\n";
+    mCxx << "        /* .format = */ " << (halfFloat ? "TextureFormat::RGBA16F" : "TextureFormat::RGBA32F") << ",\n";
+    mCxx << "    };\n\n";
+
+    mCxx << "    static const MeshBakedAnimation " << mesh.id << "BakedAnimations[] = {\n";
+    for (const auto& clip : clips) {
+        mCxx << "        {\n";
+        mCxx << "            /* .animation = */ &Animations::" << *clip.id << ",\n";
+        mCxx << "            /* .firstFrame = */ " << clip.firstFrame << ",\n";
+        mCxx << "            /* .frameCount = */ " << clip.frameCount << ",\n";
+        mCxx << "        },\n";
+    }
+    mCxx << "    };\n\n";
 
     return true;
 }
+
+MeshAnimation MeshProcessor::animationData(const Anim& anim, std::vector<MeshBoneAnimation>& boneAnimations)
+{
+    boneAnimations.resize(anim.bones.size());
+    for (size_t i = 0; i < anim.bones.size(); i++) {
+        const BoneAnim& bone = anim.bones[i];
+        boneAnimations[i].positionKeys = (bone.positionKeys.empty() ? nullptr : bone.positionKeys.data());
+        boneAnimations[i].rotationKeys = (bone.rotationKeys.empty() ? nullptr : bone.rotationKeys.data());
+        boneAnimations[i].scaleKeys = (bone.scaleKeys.empty() ? nullptr : bone.scaleKeys.data());
+        boneAnimations[i].positionKeyCount = bone.positionKeys.size();
+        boneAnimations[i].rotationKeyCount = bone.rotationKeys.size();
+        boneAnimations[i].scaleKeyCount = bone.scaleKeys.size();
+    }
+
+    MeshAnimation animation = anim.info;
+    animation.boneAnimations = boneAnimations.data();
+    return animation;
+}
+
+void MeshProcessor::calculateBounds(const std::vector<MeshVertex>& vertices,
+    const std::vector<MeshSkinningVertex>& skinningVertices, const glm::mat4& globalInverseTransform,
+    glm::vec3& center, float& radius) const
+{
+    center = glm::vec3(0.0f);
+    radius = 0.0f;
+    if (vertices.empty())
+        return;
+
+    std::vector<glm::vec3> positions;
+    if (skinningVertices.empty() || mBoneList.empty()) {
+        for (const auto& vertex : vertices)
+            positions.emplace_back(vertex.position);
+    } else {
+        // Skinned like the vertex shaders do it, from the poses AnimatedMeshInstance can be in
+        const size_t boneCount = mBoneList.size();
+        std::vector<glm::mat4> matrices(boneCount);
+        auto skin = [&]() {
+            for (size_t i = 0; i < vertices.size(); i++) {
+                const MeshSkinningVertex& v = skinningVertices[i];
+                glm::mat4 m = matrices[v.boneIndices[0]] * v.boneWeights[0];
+                for (int j = 1; j < 4; j++)
+                    m += matrices[v.boneIndices[j]] * v.boneWeights[j];
+                positions.emplace_back(glm::vec3(m * glm::vec4(vertices[i].position, 1.0f)));
+            }
+        };
+
+        for (size_t i = 0; i < boneCount; i++)
+            matrices[i] = mBoneList[i].matrix;
+        skin();
+
+        PoseSkeleton skeleton(mBoneList.data(), boneCount, globalInverseTransform);
+        std::vector<MeshBoneAnimation> boneAnimations;
+        for (const auto& it : mAnimations) {
+            MeshAnimation animation = animationData(it.second, boneAnimations);
+            PoseEvaluator evaluator(skeleton);
+            if (animation.durationInTicks <= 0.0f) {
+                evaluator.evaluate(&animation, 0.0f, matrices.data());
+                skin();
+                continue;
+            }
+
+            size_t sampleCount = 2 * size_t(std::ceil(animation.durationInTicks / animation.ticksPerFrame));
+            for (size_t sample = 0; sample < sampleCount; sample++) {
+                float timeInTicks = float(sample) * 0.5f * animation.ticksPerFrame;
+                evaluator.evaluate(&animation, fmodf(timeInTicks, animation.durationInTicks), matrices.data());
+                skin();
+            }
+        }
+    }
+
+    glm::vec3 min = positions[0];
+    glm::vec3 max = min;
+    for (const auto& position : positions) {
+        min = glm::min(min, position);
+        max = glm::max(max, position);
+    }
+
+    center = (min + max) * 0.5f;
+    for (const auto& position : positions)
+        radius = glm::max(radius, glm::length(position - center));
+}
@@ -8,6 +8,7 @@
 #include <memory>
 #include <sstream>
 
+struct aiAnimation;
 struct aiNode;
 
 class MeshProcessor
@@ -47,5 +48,18 @@ private:
 
     void readBoneHierarchy(const aiNode* rootNode, size_t parentBoneIndex);
 
-    bool loadAnimations(const ConfigFile::MeshAnimations& anim);
+    bool loadAnimations(const ConfigFile::Mesh& mesh, const ConfigFile::MeshAnimations& anim);
+    // Samples every channel on a grid of frameCount frames and drops the keys within the error
+    // bounds; withinBounds is cleared if some channel cannot meet its bound on this grid
+    bool compressAnimation(const ConfigFile::Mesh& mesh, const aiAnimation* sceneAnimation,
+        const ConfigFile::MeshAnimations& anim, size_t frameCount, Anim& animItem, bool& withinBounds);
+    bool bakeAnimations(const ConfigFile::Mesh& mesh, const glm::mat4& globalInverseTransform);
+
+    // The animation as PoseEvaluator reads it; boneAnimations holds its channels
+    static MeshAnimation animationData(const Anim& anim, std::vector<MeshBoneAnimation>& boneAnimations);
+    // Sphere around the vertices in the bind pose and in every pose of the animations, sampled
+    // twice per frame of their key grids. Characters are culled and their animation LOD is
+    // chosen by it, so it must hold the model as it is drawn, not as it is stored.
+    void calculateBounds(const std::vector<MeshVertex>& vertices, const std::vector<MeshSkinningVertex>& skinningVertices,
+        const glm::mat4& globalInverseTransform, glm::vec3& center, float& radius) const;
 };
@@ -2,6 +2,7 @@
 #include "Util.h"
 #include <StandAlone/ResourceLimits.h>
 #include <glslang_c_interface.h>
+#include <cstring>
 
 ShaderProcessor::ShaderProcessor(const ConfigFile& config)
     : mConfig(config)
@@ -86,6 +87,10 @@ bool ShaderProcessor::process(const ConfigFile::Shader& shader)
     mCxx << "        /* .vulkanVertexSize = */ 0,\n";
     mCxx << "        /* .vulkanFragment = */ nullptr,\n";
     mCxx << "        /* .vulkanFragmentSize = */ 0,\n";
+    mCxx << "        /* .vulkanBindlessVertex = */ nullptr,\n";
+    mCxx << "        /* .vulkanBindlessVertexSize = */ 0,\n";
+    mCxx << "        /* .vulkanBindlessFragment = */ nullptr,\n";
+    mCxx << "        /* .vulkanBindlessFragmentSize = */ 0,\n";
   #else
     mCxx << "        /* .metal = */ nullptr,\n";
     mCxx << "        /* .metalSize = */ 0,\n";
@@ -93,6 +98,10 @@ bool ShaderProcessor::process(const ConfigFile::Shader& shader)
     mCxx << "        /* .vulkanVertexSize = */ sizeof(Vulkan::" << shader.id << "Vertex),\n";
     mCxx << "        /* .vulkanFragment = */ &Vulkan::" << shader.id << "Fragment,\n";
     mCxx << "        /* .vulkanFragmentSize = */ sizeof(Vulkan::" << shader.id << "Fragment),\n";
+    mCxx << "        /* .vulkanBindlessVertex = */ &Vulkan::" << shader.id << "BindlessVertex,\n";
+    mCxx << "        /* .vulkanBindlessVertexSize = */ sizeof(Vulkan::" << shader.id << "BindlessVertex),\n";
+    mCxx << "        /* .vulkanBindlessFragment = */ &Vulkan::" << shader.id << "BindlessFragment,\n";
+    mCxx << "        /* .vulkanBindlessFragmentSize = */ sizeof(Vulkan::" << shader.id << "BindlessFragment),\n";
   #endif
     mCxx << "    };\n\n";
 
@@ -218,8 +227,31 @@ static bool compileVulkan(glslang_stage_t stage, const std::string& bytes, std::
 
     return true;
 }
+
+// Devices with descriptor indexing read the textures from a table instead of a set per material. Shaders
+// declare both ways, the variant for the table defines BINDLESS, which has to follow the #version line.
+static std::string bindlessShader(const std::string& code)
+{
+    static const char defines[] = "#extension GL_EXT_nonuniform_qualifier : require\n#define BINDLESS\n";
+
+    size_t versionStart = code.find("#version");
+    size_t versionEnd = (versionStart != std::string::npos ? code.find('\n', versionStart) : std::string::npos);
+    if (versionEnd == std::string::npos)
+        return defines + code;
+
+    return code.substr(0, versionEnd + 1) + defines + code.substr(versionEnd + 1);
+}
 #endif
 
+void ShaderProcessor::writeVulkanShader(const std::string& name, const std::string& spirv)
+{
+    mHdrVulkan << "    extern const unsigned char " << name << "[" << spirv.length() << "];\n";
+    mCxxVulkan << "    const unsigned char " << name << "[" << spirv.length() << "] = {\n";
+    for (auto ch : spirv)
+        mCxxVulkan << "        " << unsigned(uint8_t(ch)) << ",\n";
+    mCxxVulkan << "    };\n\n";
+}
+
 bool ShaderProcessor::compileVulkanShader(const ConfigFile::Shader& shader)
 {
   #ifndef __APPLE__
@@ -228,28 +260,30 @@ bool ShaderProcessor::compileVulkanShader(const ConfigFile::Shader& shader)
         return false;
 
     std::string bytes = data.str();
+    std::string vertexCode = extractShader(bytes, "vertex");
+    std::string fragmentCode = extractShader(bytes, "fragment");
 
     glslang_initialize_process();
 
     std::string vertex;
-    if (!compileVulkan(GLSLANG_STAGE_VERTEX, extractShader(bytes, "vertex"), vertex))
+    if (!compileVulkan(GLSLANG_STAGE_VERTEX, vertexCode, vertex))
         return false;
-
-    mHdrVulkan << "    extern const unsigned char " << shader.id << "Vertex[" << vertex.length() << "];\n";
-    mCxxVulkan << "    const unsigned char " << shader.id << "Vertex[" << vertex.length() << "] = {\n";
-    for (auto ch : vertex)
-        mCxxVulkan << "        " << unsigned(uint8_t(ch)) << ",\n";
-    mCxxVulkan << "    };\n\n";
+    writeVulkanShader(shader.id + "Vertex", vertex);
 
     std::string fragment;
-    if (!compileVulkan(GLSLANG_STAGE_FRAGMENT, extractShader(bytes, "fragment"), fragment))
+    if (!compileVulkan(GLSLANG_STAGE_FRAGMENT, fragmentCode, fragment))
         return false;
+    writeVulkanShader(shader.id + "Fragment", fragment);
 
-    mHdrVulkan << "    extern const unsigned char " << shader.id << "Fragment[" << fragment.length() << "];\n";
-    mCxxVulkan << "    const unsigned char " << shader.id << "Fragment[" << fragment.length() << "] = {\n";
-    for (auto ch : fragment)
-        mCxxVulkan << "        " << unsigned(uint8_t(ch)) << ",\n";
-    mCxxVulkan << "    };\n\n";
+    std::string bindlessVertex;
+    if (!compileVulkan(GLSLANG_STAGE_VERTEX, bindlessShader(vertexCode), bindlessVertex))
+        return false;
+    writeVulkanShader(shader.id + "BindlessVertex", bindlessVertex);
+
+    std::string bindlessFragment;
+    if (!compileVulkan(GLSLANG_STAGE_FRAGMENT, bindlessShader(fragmentCode), bindlessFragment))
+        return false;
+    writeVulkanShader(shader.id + "BindlessFragment", bindlessFragment);
   #endif
 
     return true;
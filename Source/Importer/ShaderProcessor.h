@@ -23,4 +23,5 @@ private:
 
     bool compileMetalShader(const ConfigFile::Shader& shader);
     bool compileVulkanShader(const ConfigFile::Shader& shader);
+    void writeVulkanShader(const std::string& name, const std::string& spirv);
 };
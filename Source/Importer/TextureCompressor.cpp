@@ -0,0 +1,452 @@
+#include "TextureCompressor.h"
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
+namespace
+{
+    struct PixelBlock
+    {
+        float pixels[16][4];
+        bool transparent[16]; // BC1 only keeps one bit of alpha
+    };
+
+    // Interpolation weights of the 4-bit indices of BC7
+    const int Bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    float clampColor(float value)
+    {
+        return std::min(std::max(value, 0.0f), 255.0f);
+    }
+
+    void loadBlock(const uint8_t* pixels, unsigned width, unsigned height, unsigned blockX, unsigned blockY, PixelBlock& block)
+    {
+        for (unsigned y = 0; y < 4; y++) {
+            for (unsigned x = 0; x < 4; x++) {
+                unsigned px = std::min(blockX * 4 + x, width - 1);
+                unsigned py = std::min(blockY * 4 + y, height - 1);
+                const uint8_t* pixel = &pixels[(py * width + px) * 4];
+                for (unsigned c = 0; c < 4; c++)
+                    block.pixels[y * 4 + x][c] = pixel[c];
+                block.transparent[y * 4 + x] = (pixel[3] < 128);
+            }
+        }
+    }
+
+    // Endpoints of the line through the pixels along their principal axis, ignoring transparent pixels
+    void principalEndpoints(const PixelBlock& block, unsigned channels, bool skipTransparent, float* e0, float* e1)
+    {
+        float mean[4] = {};
+        unsigned count = 0;
+        for (unsigned i = 0; i < 16; i++) {
+            if (skipTransparent && block.transparent[i])
+                continue;
+            for (unsigned c = 0; c < channels; c++)
+                mean[c] += block.pixels[i][c];
+            ++count;
+        }
+        for (unsigned c = 0; c < channels; c++)
+            mean[c] /= float(count);
+
+        float covariance[4][4] = {};
+        for (unsigned i = 0; i < 16; i++) {
+            if (skipTransparent && block.transparent[i])
+                continue;
+            for (unsigned a = 0; a < channels; a++) {
+                for (unsigned b = 0; b < channels; b++)
+                    covariance[a][b] += (block.pixels[i][a] - mean[a]) * (block.pixels[i][b] - mean[b]);
+            }
+        }
+
+        // Power iteration, starting from the channel that varies most
+        unsigned largest = 0;
+        for (unsigned c = 1; c < channels; c++) {
+            if (covariance[c][c] > covariance[largest][largest])
+                largest = c;
+        }
+
+        float axis[4] = {};
+        for (unsigned c = 0; c < channels; c++)
+            axis[c] = covariance[largest][c];
+
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float next[4] = {};
+            float length = 0.0f;
+            for (unsigned a = 0; a < channels; a++) {
+                for (unsigned b = 0; b < channels; b++)
+                    next[a] += covariance[a][b] * axis[b];
+                length = std::max(length, fabsf(next[a]));
+            }
+            if (length <= 0.0f)
+                break;
+            for (unsigned c = 0; c < channels; c++)
+                axis[c] = next[c] / length;
+        }
+
+        float length = 0.0f;
+        for (unsigned c = 0; c < channels; c++)
+            length += axis[c] * axis[c];
+        length = sqrtf(length);
+
+        float minT = 0.0f, maxT = 0.0f;
+        if (length > 0.0f) {
+            for (unsigned c = 0; c < channels; c++)
+                axis[c] /= length;
+
+            minT = maxT = 0.0f;
+            bool first = true;
+            for (unsigned i = 0; i < 16; i++) {
+                if (skipTransparent && block.transparent[i])
+                    continue;
+                float t = 0.0f;
+                for (unsigned c = 0; c < channels; c++)
+                    t += (block.pixels[i][c] - mean[c]) * axis[c];
+                minT = (first ? t : std::min(minT, t));
+                maxT = (first ? t : std::max(maxT, t));
+                first = false;
+            }
+        }
+
+        for (unsigned c = 0; c < channels; c++) {
+            e0[c] = clampColor(mean[c] + minT * axis[c]);
+            e1[c] = clampColor(mean[c] + maxT * axis[c]);
+        }
+    }
+
+    // Least squares fit of the endpoints to the pixels, given where each pixel lies between the
+    // endpoints; pixels with a negative weight are ignored. Returns false if the fit is degenerate.
+    bool refineEndpoints(const PixelBlock& block, unsigned channels, const float* weights, float* e0, float* e1)
+    {
+        float a = 0.0f, b = 0.0f, c = 0.0f;
+        float x0[4] = {}, x1[4] = {};
+        for (unsigned i = 0; i < 16; i++) {
+            float w = weights[i];
+            if (w < 0.0f)
+                continue;
+            a += (1.0f - w) * (1.0f - w);
+            b += (1.0f - w) * w;
+            c += w * w;
+            for (unsigned ch = 0; ch < channels; ch++) {
+                x0[ch] += (1.0f - w) * block.pixels[i][ch];
+                x1[ch] += w * block.pixels[i][ch];
+            }
+        }
+
+        float determinant = a * c - b * b;
+        if (fabsf(determinant) < 1e-6f)
+            return false;
+
+        for (unsigned ch = 0; ch < channels; ch++) {
+            e0[ch] = clampColor((c * x0[ch] - b * x1[ch]) / determinant);
+            e1[ch] = clampColor((a * x1[ch] - b * x0[ch]) / determinant);
+        }
+        return true;
+    }
+
+    void writeBits(uint8_t* out, unsigned& bitOffset, unsigned value, unsigned bitCount)
+    {
+        for (unsigned i = 0; i < bitCount; i++, bitOffset++) {
+            if (value & (1u << i))
+                out[bitOffset / 8] |= uint8_t(1u << (bitOffset % 8));
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    uint16_t packRgb565(const float* color)
+    {
+        unsigned r = unsigned(color[0] * 31.0f / 255.0f + 0.5f);
+        unsigned g = unsigned(color[1] * 63.0f / 255.0f + 0.5f);
+        unsigned b = unsigned(color[2] * 31.0f / 255.0f + 0.5f);
+        return uint16_t((r << 11) | (g << 5) | b);
+    }
+
+    void unpackRgb565(uint16_t packed, float* color)
+    {
+        unsigned r = (packed >> 11) & 31;
+        unsigned g = (packed >> 5) & 63;
+        unsigned b = packed & 31;
+        color[0] = float((r << 3) | (r >> 2));
+        color[1] = float((g << 2) | (g >> 4));
+        color[2] = float((b << 3) | (b >> 2));
+    }
+
+    // Encodes the color part of a BC1 or BC3 block with the given endpoints. Three color mode leaves
+    // index 3 for transparent pixels. Returns the squared error and where each pixel ended up.
+    float encodeColorEndpoints(const PixelBlock& block, const float* e0, const float* e1, bool threeColor,
+        uint8_t* out, float* weights)
+    {
+        uint16_t c0 = packRgb565(e0);
+        uint16_t c1 = packRgb565(e1);
+
+        // The order of the endpoints selects the mode
+        if (threeColor ? c0 > c1 : c0 < c1)
+            std::swap(c0, c1);
+
+        float palette[4][3];
+        unpackRgb565(c0, palette[0]);
+        unpackRgb565(c1, palette[1]);
+        float paletteWeights[4];
+        unsigned paletteSize;
+        if (threeColor || c0 == c1) {
+            for (unsigned c = 0; c < 3; c++)
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2.0f;
+            paletteWeights[0] = 0.0f;
+            paletteWeights[1] = 1.0f;
+            paletteWeights[2] = 0.5f;
+            paletteSize = 3;
+        } else {
+            for (unsigned c = 0; c < 3; c++) {
+                palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+                palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+            }
+            paletteWeights[0] = 0.0f;
+            paletteWeights[1] = 1.0f;
+            paletteWeights[2] = 1.0f / 3.0f;
+            paletteWeights[3] = 2.0f / 3.0f;
+            paletteSize = 4;
+        }
+
+        float error = 0.0f;
+        uint32_t indices = 0;
+        for (unsigned i = 0; i < 16; i++) {
+            if (threeColor && block.transparent[i]) {
+                indices |= 3u << (i * 2);
+                weights[i] = -1.0f;
+                continue;
+            }
+
+            unsigned bestIndex = 0;
+            float bestError = 0.0f;
+            for (unsigned j = 0; j < paletteSize; j++) {
+                float e = 0.0f;
+                for (unsigned c = 0; c < 3; c++) {
+                    float d = block.pixels[i][c] - palette[j][c];
+                    e += d * d;
+                }
+                if (j == 0 || e < bestError) {
+                    bestIndex = j;
+                    bestError = e;
+                }
+            }
+
+            indices |= bestIndex << (i * 2);
+            weights[i] = paletteWeights[bestIndex];
+            error += bestError;
+        }
+
+        out[0] = uint8_t(c0);
+        out[1] = uint8_t(c0 >> 8);
+        out[2] = uint8_t(c1);
+        out[3] = uint8_t(c1 >> 8);
+        for (unsigned i = 0; i < 4; i++)
+            out[4 + i] = uint8_t(indices >> (i * 8));
+
+        return error;
+    }
+
+    void encodeColorBlock(const PixelBlock& block, bool allowTransparent, uint8_t* out)
+    {
+        bool threeColor = false;
+        if (allowTransparent) {
+            unsigned transparentCount = 0;
+            for (unsigned i = 0; i < 16; i++)
+                transparentCount += (block.transparent[i] ? 1 : 0);
+
+            if (transparentCount == 16) {
+                // Both endpoints black selects three color mode, index 3 is transparent
+                for (unsigned i = 0; i < 8; i++)
+                    out[i] = (i < 4 ? 0 : 0xff);
+                return;
+            }
+
+            threeColor = (transparentCount > 0);
+        }
+
+        float e0[4], e1[4], weights[16];
+        principalEndpoints(block, 3, threeColor, e0, e1);
+        float error = encodeColorEndpoints(block, e0, e1, threeColor, out, weights);
+
+        uint8_t refined[8];
+        if (refineEndpoints(block, 3, weights, e0, e1)) {
+            float refinedWeights[16];
+            if (encodeColorEndpoints(block, e0, e1, threeColor, refined, refinedWeights) < error)
+                std::copy(refined, refined + 8, out);
+        }
+    }
+
+    // BC4 block of one channel, also used for the alpha of BC3 and both channels of BC5
+    void encodeChannelBlock(const PixelBlock& block, unsigned channel, uint8_t* out)
+    {
+        float minValue = 255.0f, maxValue = 0.0f;
+        for (unsigned i = 0; i < 16; i++) {
+            minValue = std::min(minValue, block.pixels[i][channel]);
+            maxValue = std::max(maxValue, block.pixels[i][channel]);
+        }
+
+        // Eight value mode: the first endpoint is the larger one
+        unsigned a0 = unsigned(maxValue + 0.5f);
+        unsigned a1 = unsigned(minValue + 0.5f);
+
+        float palette[8];
+        palette[0] = float(a0);
+        palette[1] = float(a1);
+        for (unsigned j = 2; j < 8; j++)
+            palette[j] = float((8 - j) * a0 + (j - 1) * a1) / 7.0f;
+
+        std::fill(out, out + 8, 0);
+        out[0] = uint8_t(a0);
+        out[1] = uint8_t(a1);
+
+        unsigned bitOffset = 16;
+        for (unsigned i = 0; i < 16; i++) {
+            unsigned bestIndex = 0;
+            float bestError = 0.0f;
+            for (unsigned j = 0; j < (a0 > a1 ? 8u : 1u); j++) {
+                float e = fabsf(block.pixels[i][channel] - palette[j]);
+                if (j == 0 || e < bestError) {
+                    bestIndex = j;
+                    bestError = e;
+                }
+            }
+            writeBits(out, bitOffset, bestIndex, 3);
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Encodes a BC7 mode 6 block: one subset, RGBA 7-bit endpoints with a shared bit each and 4-bit
+    // indices. Returns the squared error and where each pixel ended up.
+    float encodeBc7Endpoints(const PixelBlock& block, const float* e0, const float* e1, uint8_t* out, float* weights)
+    {
+        // Each endpoint picks the shared low bit that quantizes it best
+        unsigned endpoints[2][4];
+        unsigned pBits[2];
+        const float* sources[2] = { e0, e1 };
+        for (unsigned e = 0; e < 2; e++) {
+            float bestError = 0.0f;
+            for (unsigned p = 0; p < 2; p++) {
+                unsigned quantized[4];
+                float error = 0.0f;
+                for (unsigned c = 0; c < 4; c++) {
+                    int value = int(floorf((sources[e][c] - float(p)) / 2.0f + 0.5f));
+                    quantized[c] = unsigned(std::min(std::max(value, 0), 127));
+                    float d = float((quantized[c] << 1) | p) - sources[e][c];
+                    error += d * d;
+                }
+                if (p == 0 || error < bestError) {
+                    bestError = error;
+                    pBits[e] = p;
+                    std::copy(quantized, quantized + 4, endpoints[e]);
+                }
+            }
+        }
+
+        float palette[16][4];
+        for (unsigned c = 0; c < 4; c++) {
+            int v0 = int((endpoints[0][c] << 1) | pBits[0]);
+            int v1 = int((endpoints[1][c] << 1) | pBits[1]);
+            for (unsigned j = 0; j < 16; j++)
+                palette[j][c] = float(((64 - Bc7Weights[j]) * v0 + Bc7Weights[j] * v1 + 32) >> 6);
+        }
+
+        float error = 0.0f;
+        unsigned indices[16];
+        for (unsigned i = 0; i < 16; i++) {
+            float bestError = 0.0f;
+            for (unsigned j = 0; j < 16; j++) {
+                float e = 0.0f;
+                for (unsigned c = 0; c < 4; c++) {
+                    float d = block.pixels[i][c] - palette[j][c];
+                    e += d * d;
+                }
+                if (j == 0 || e < bestError) {
+                    indices[i] = j;
+                    bestError = e;
+                }
+            }
+            error += bestError;
+        }
+
+        // The most significant bit of the first index is implied to be zero
+        bool swap = (indices[0] >= 8);
+        if (swap) {
+            std::swap(endpoints[0], endpoints[1]);
+            std::swap(pBits[0], pBits[1]);
+            for (unsigned i = 0; i < 16; i++)
+                indices[i] = 15 - indices[i];
+        }
+
+        for (unsigned i = 0; i < 16; i++)
+            weights[i] = float(Bc7Weights[indices[i]]) / 64.0f;
+
+        std::fill(out, out + 16, 0);
+        unsigned bitOffset = 0;
+        writeBits(out, bitOffset, 1u << 6, 7);
+        for (unsigned c = 0; c < 4; c++) {
+            writeBits(out, bitOffset, endpoints[0][c], 7);
+            writeBits(out, bitOffset, endpoints[1][c], 7);
+        }
+        writeBits(out, bitOffset, pBits[0], 1);
+        writeBits(out, bitOffset, pBits[1], 1);
+        for (unsigned i = 0; i < 16; i++)
+            writeBits(out, bitOffset, indices[i], (i == 0 ? 3 : 4));
+        assert(bitOffset == 128);
+
+        return error;
+    }
+
+    void encodeBc7Block(const PixelBlock& block, uint8_t* out)
+    {
+        float e0[4], e1[4], weights[16];
+        principalEndpoints(block, 4, false, e0, e1);
+        float error = encodeBc7Endpoints(block, e0, e1, out, weights);
+
+        uint8_t refined[16];
+        if (refineEndpoints(block, 4, weights, e0, e1)) {
+            float refinedWeights[16];
+            if (encodeBc7Endpoints(block, e0, e1, refined, refinedWeights) < error)
+                std::copy(refined, refined + 16, out);
+        }
+    }
+}
+
+void compressTexture(TextureFormat format, const uint8_t* pixels, unsigned width, unsigned height, std::vector<uint8_t>& output)
+{
+    assert(isBlockCompressed(format));
+
+    const unsigned blockBytes = bytesPerBlock(format);
+    const unsigned blocksX = (width + 3) / 4;
+    const unsigned blocksY = (height + 3) / 4;
+
+    PixelBlock block;
+    for (unsigned blockY = 0; blockY < blocksY; blockY++) {
+        for (unsigned blockX = 0; blockX < blocksX; blockX++) {
+            loadBlock(pixels, width, height, blockX, blockY, block);
+
+            size_t offset = output.size();
+            output.resize(offset + blockBytes);
+            uint8_t* out = &output[offset];
+
+            switch (format) {
+                case TextureFormat::BC1:
+                    encodeColorBlock(block, true, out);
+                    break;
+                case TextureFormat::BC3:
+                    encodeChannelBlock(block, 3, out);
+                    encodeColorBlock(block, false, out + 8);
+                    break;
+                case TextureFormat::BC5:
+                    encodeChannelBlock(block, 0, out);
+                    encodeChannelBlock(block, 1, out + 8);
+                    break;
+                case TextureFormat::BC7:
+                    encodeBc7Block(block, out);
+                    break;
+                default:
+                    assert(false);
+                    break;
+            }
+        }
+    }
+}
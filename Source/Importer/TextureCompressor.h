@@ -0,0 +1,10 @@
+#pragma once
+#include "Engine/Renderer/TextureData.h"
+#include <stdint.h>
+#include <vector>
+
+// Appends the 4x4 blocks of an RGBA8 image in the given block compressed format, row by row. Edge
+// blocks of images that are not a multiple of 4 in size repeat the last row and column.
+//
+// BC5 stores the red and green channels only, which holds the x and y of a tangent space normal.
+void compressTexture(TextureFormat format, const uint8_t* pixels, unsigned width, unsigned height, std::vector<uint8_t>& output);
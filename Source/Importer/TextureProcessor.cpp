@@ -1,6 +1,50 @@
 #include "TextureProcessor.h"
+#include "TextureCompressor.h"
 #include "Util.h"
 #include <stb_image.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+namespace
+{
+    // Box filters the level down to half its size
+    void downsample(const std::vector<uint8_t>& source, unsigned width, unsigned height, bool normalMap, std::vector<uint8_t>& target)
+    {
+        unsigned targetWidth = std::max(width / 2, 1u);
+        unsigned targetHeight = std::max(height / 2, 1u);
+        target.resize(targetWidth * targetHeight * 4);
+
+        for (unsigned y = 0; y < targetHeight; y++) {
+            for (unsigned x = 0; x < targetWidth; x++) {
+                float sum[4] = {};
+                for (unsigned i = 0; i < 4; i++) {
+                    unsigned sx = std::min(x * 2 + (i & 1), width - 1);
+                    unsigned sy = std::min(y * 2 + (i >> 1), height - 1);
+                    for (unsigned c = 0; c < 4; c++)
+                        sum[c] += source[(sy * width + sx) * 4 + c];
+                }
+
+                uint8_t* pixel = &target[(y * targetWidth + x) * 4];
+                if (normalMap) {
+                    // Averaged normals get shorter, bring them back to unit length
+                    float n[3], length = 0.0f;
+                    for (unsigned c = 0; c < 3; c++) {
+                        n[c] = sum[c] / (4.0f * 127.5f) - 1.0f;
+                        length += n[c] * n[c];
+                    }
+                    length = (length > 0.0f ? sqrtf(length) : 1.0f);
+                    for (unsigned c = 0; c < 3; c++)
+                        pixel[c] = uint8_t((n[c] / length + 1.0f) * 127.5f + 0.5f);
+                    pixel[3] = uint8_t(sum[3] / 4.0f + 0.5f);
+                } else {
+                    for (unsigned c = 0; c < 4; c++)
+                        pixel[c] = uint8_t(sum[c] / 4.0f + 0.5f);
+                }
+            }
+        }
+    }
+}
 
 TextureProcessor::TextureProcessor(const ConfigFile& config)
     : mConfig(config)
@@ -31,23 +75,59 @@ bool TextureProcessor::process(const ConfigFile::Texture& texture)
         return false;
     }
 
+    unsigned mipLevels = 1;
+    while ((w >> mipLevels) > 0 || (h >> mipLevels) > 0)
+        ++mipLevels;
+    if (texture.mipLevels > 0)
+        mipLevels = std::min(mipLevels, texture.mipLevels);
+
+    // Levels are stored one after the other, largest first
+    const bool normalMap = (texture.format == TextureFormat::BC5);
+    std::vector<uint8_t> level(data, data + w * h * 4);
+    std::vector<uint8_t> nextLevel;
+    std::vector<uint8_t> levels;
+    for (unsigned i = 0; i < mipLevels; i++) {
+        unsigned width = mipLevelDimension(w, i);
+        unsigned height = mipLevelDimension(h, i);
+        if (i > 0) {
+            downsample(level, mipLevelDimension(w, i - 1), mipLevelDimension(h, i - 1), normalMap, nextLevel);
+            level.swap(nextLevel);
+        }
+
+        if (isBlockCompressed(texture.format))
+            compressTexture(texture.format, level.data(), width, height, levels);
+        else
+            levels.insert(levels.end(), level.begin(), level.end());
+    }
+
     mHdr << "    extern const TextureData " << texture.id << ";\n";
 
+    // One pixel or block per line
+    const size_t lineSize = bytesPerBlock(texture.format);
     mCxx << "    static const unsigned char " << texture.id << "Pixels[] = {\n";
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            mCxx << "        ";
-            for (int i = 0; i < 4; i++)
-                mCxx << unsigned(data[(y * w + x) * 4 + i]) << ',';
-            mCxx << std::endl;
-        }
+    for (size_t i = 0; i < levels.size(); i += lineSize) {
+        mCxx << "        ";
+        for (size_t j = i; j < i + lineSize; j++)
+            mCxx << unsigned(levels[j]) << ',';
+        mCxx << std::endl;
     }
     mCxx << "    };\n\n";
 
+    const char* format = "RGBA8";
+    switch (texture.format) {
+        case TextureFormat::BC1: format = "BC1"; break;
+        case TextureFormat::BC3: format = "BC3"; break;
+        case TextureFormat::BC5: format = "BC5"; break;
+        case TextureFormat::BC7: format = "BC7"; break;
+        default: break;
+    }
+
     mCxx << "    const TextureData " << texture.id << " = {\n";
     mCxx << "        /* .pixels = */ " << texture.id <<  "Pixels,\n";
     mCxx << "        /* .width = */ " << w << ",\n";
     mCxx << "        /* .height = */ " << h << ",\n";
+    mCxx << "        /* .mipLevels = */ " << mipLevels << ",\n";
+    mCxx << "        /* .format = */ TextureFormat::" << format << ",\n";
     mCxx << "    };\n\n";
 
     stbi_image_free(data);
@@ -6,16 +6,11 @@
 
 static VkDebugReportCallbackEXT debugCallback;
 
-template <typename T> static bool getVulkanAPI(HMODULE hVulkanDll, const char* name, T& fn)
+static HMODULE hVulkanDll;
+
+static PFN_vkVoidFunction getVulkanDllExport(const char* name)
 {
-    fn = (T)GetProcAddress(hVulkanDll, name);
-    if (!fn) {
-        TCHAR buf[1024];
-        wsprintf(buf, TEXT("Entry point \"%hs\" was not found in the Vulkan DLL."), name);
-        MessageBox(hWnd, buf, TEXT("Error"), MB_ICONERROR | MB_OK);
-        return false;
-    }
-    return true;
+    return (PFN_vkVoidFunction)GetProcAddress(hVulkanDll, name);
 }
 
 #ifndef NDEBUG
@@ -32,78 +27,13 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugReportCallback(VkDebugReportFlagsEXT
 
 bool initVulkan()
 {
-    HMODULE hVulkanDll = LoadLibrary(TEXT("vulkan-1.dll"));
+    hVulkanDll = LoadLibrary(TEXT("vulkan-1.dll"));
     if (!hVulkanDll) {
         MessageBox(hWnd, TEXT("Unable to load Vulkan DLL."), TEXT("Error"), MB_ICONERROR | MB_OK);
         return false;
     }
 
-    if (!getVulkanAPI(hVulkanDll, "vkCreateInstance", vkCreateInstance) ||
-        !getVulkanAPI(hVulkanDll, "vkGetInstanceProcAddr", vkGetInstanceProcAddr) ||
-        !getVulkanAPI(hVulkanDll, "vkEnumerateInstanceExtensionProperties", vkEnumerateInstanceExtensionProperties) ||
-        !getVulkanAPI(hVulkanDll, "vkEnumerateInstanceLayerProperties", vkEnumerateInstanceLayerProperties) ||
-        !getVulkanAPI(hVulkanDll, "vkEnumeratePhysicalDevices", vkEnumeratePhysicalDevices) ||
-        !getVulkanAPI(hVulkanDll, "vkGetPhysicalDeviceProperties", vkGetPhysicalDeviceProperties) ||
-        !getVulkanAPI(hVulkanDll, "vkGetPhysicalDeviceQueueFamilyProperties", vkGetPhysicalDeviceQueueFamilyProperties) ||
-        !getVulkanAPI(hVulkanDll, "vkCreateDevice", vkCreateDevice) ||
-        !getVulkanAPI(hVulkanDll, "vkDestroyDevice", vkDestroyDevice) ||
-        !getVulkanAPI(hVulkanDll, "vkGetDeviceQueue", vkGetDeviceQueue) ||
-        !getVulkanAPI(hVulkanDll, "vkCreateCommandPool", vkCreateCommandPool) ||
-        !getVulkanAPI(hVulkanDll, "vkDestroyCommandPool", vkDestroyCommandPool) ||
-        !getVulkanAPI(hVulkanDll, "vkAllocateCommandBuffers", vkAllocateCommandBuffers) ||
-        !getVulkanAPI(hVulkanDll, "vkFreeCommandBuffers", vkFreeCommandBuffers) ||
-        !getVulkanAPI(hVulkanDll, "vkCreateFence", vkCreateFence) ||
-        !getVulkanAPI(hVulkanDll, "vkDestroyFence", vkDestroyFence) ||
-        !getVulkanAPI(hVulkanDll, "vkCreateSemaphore", vkCreateSemaphore) ||
-        !getVulkanAPI(hVulkanDll, "vkBeginCommandBuffer", vkBeginCommandBuffer) ||
-        !getVulkanAPI(hVulkanDll, "vkEndCommandBuffer", vkEndCommandBuffer) ||
-        !getVulkanAPI(hVulkanDll, "vkCmdPipelineBarrier", vkCmdPipelineBarrier) ||
-        !getVulkanAPI(hVulkanDll, "vkQueueSubmit", vkQueueSubmit) ||
-        !getVulkanAPI(hVulkanDll, "vkWaitForFences", vkWaitForFences) ||
-        !getVulkanAPI(hVulkanDll, "vkResetFences", vkResetFences) ||
-        !getVulkanAPI(hVulkanDll, "vkDestroySemaphore", vkDestroySemaphore) ||
-        !getVulkanAPI(hVulkanDll, "vkResetCommandBuffer", vkResetCommandBuffer) ||
-        !getVulkanAPI(hVulkanDll, "vkCreateImageView", vkCreateImageView) ||
-        !getVulkanAPI(hVulkanDll, "vkDestroyImageView", vkDestroyImageView) ||
-        !getVulkanAPI(hVulkanDll, "vkGetPhysicalDeviceMemoryProperties", vkGetPhysicalDeviceMemoryProperties) ||
-        !getVulkanAPI(hVulkanDll, "vkCreateImage", vkCreateImage) ||
-        !getVulkanAPI(hVulkanDll, "vkDestroyImage", vkDestroyImage) ||
-        !getVulkanAPI(hVulkanDll, "vkGetImageMemoryRequirements", vkGetImageMemoryRequirements) ||
-        !getVulkanAPI(hVulkanDll, "vkAllocateMemory", vkAllocateMemory) ||
-        !getVulkanAPI(hVulkanDll, "vkFreeMemory", vkFreeMemory) ||
-        !getVulkanAPI(hVulkanDll, "vkBindImageMemory", vkBindImageMemory) ||
-        !getVulkanAPI(hVulkanDll, "vkCreateRenderPass", vkCreateRenderPass) ||
-        !getVulkanAPI(hVulkanDll, "vkDestroyRenderPass", vkDestroyRenderPass) ||
-        !getVulkanAPI(hVulkanDll, "vkCreateFramebuffer", vkCreateFramebuffer) ||
-        !getVulkanAPI(hVulkanDll, "vkCreateBuffer", vkCreateBuffer) ||
-        !getVulkanAPI(hVulkanDll, "vkDestroyBuffer", vkDestroyBuffer) ||
-        !getVulkanAPI(hVulkanDll, "vkGetBufferMemoryRequirements", vkGetBufferMemoryRequirements) ||
-        !getVulkanAPI(hVulkanDll, "vkMapMemory", vkMapMemory) ||
-        !getVulkanAPI(hVulkanDll, "vkUnmapMemory", vkUnmapMemory) ||
-        !getVulkanAPI(hVulkanDll, "vkBindBufferMemory", vkBindBufferMemory) ||
-        !getVulkanAPI(hVulkanDll, "vkCreateShaderModule", vkCreateShaderModule) ||
-        !getVulkanAPI(hVulkanDll, "vkDestroyShaderModule", vkDestroyShaderModule) ||
-        !getVulkanAPI(hVulkanDll, "vkCreateGraphicsPipelines", vkCreateGraphicsPipelines) ||
-        !getVulkanAPI(hVulkanDll, "vkDestroyPipeline", vkDestroyPipeline) ||
-        !getVulkanAPI(hVulkanDll, "vkCreatePipelineLayout", vkCreatePipelineLayout) ||
-        !getVulkanAPI(hVulkanDll, "vkDestroyPipelineLayout", vkDestroyPipelineLayout) ||
-        !getVulkanAPI(hVulkanDll, "vkCmdBeginRenderPass", vkCmdBeginRenderPass) ||
-        !getVulkanAPI(hVulkanDll, "vkCmdEndRenderPass", vkCmdEndRenderPass) ||
-        !getVulkanAPI(hVulkanDll, "vkCmdBindPipeline", vkCmdBindPipeline) ||
-        !getVulkanAPI(hVulkanDll, "vkCmdBindVertexBuffers", vkCmdBindVertexBuffers) ||
-        !getVulkanAPI(hVulkanDll, "vkCmdBindIndexBuffer", vkCmdBindIndexBuffer) ||
-        !getVulkanAPI(hVulkanDll, "vkCmdDraw", vkCmdDraw) ||
-        !getVulkanAPI(hVulkanDll, "vkCmdDrawIndexed", vkCmdDrawIndexed) ||
-        !getVulkanAPI(hVulkanDll, "vkCreateDescriptorSetLayout", vkCreateDescriptorSetLayout) ||
-        !getVulkanAPI(hVulkanDll, "vkDestroyDescriptorSetLayout", vkDestroyDescriptorSetLayout) ||
-        !getVulkanAPI(hVulkanDll, "vkCreateDescriptorPool", vkCreateDescriptorPool) ||
-        !getVulkanAPI(hVulkanDll, "vkDestroyDescriptorPool", vkDestroyDescriptorPool) ||
-        !getVulkanAPI(hVulkanDll, "vkAllocateDescriptorSets", vkAllocateDescriptorSets) ||
-        !getVulkanAPI(hVulkanDll, "vkUpdateDescriptorSets", vkUpdateDescriptorSets) ||
-        !getVulkanAPI(hVulkanDll, "vkCmdBindDescriptorSets", vkCmdBindDescriptorSets) ||
-        !getVulkanAPI(hVulkanDll, "vkCmdCopyBufferToImage", vkCmdCopyBufferToImage) ||
-        !getVulkanAPI(hVulkanDll, "vkCreateSampler", vkCreateSampler) ||
-        !getVulkanAPI(hVulkanDll, "vkDestroySampler", vkDestroySampler))
+    if (!vulkanLoadExports(getVulkanDllExport))
         return false;
 
     // Enumerate avaiable layers